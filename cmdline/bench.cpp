@@ -0,0 +1,1340 @@
+// This file is part of Golly.
+// See docs/License.html for the copyright notice.
+
+/*
+ *   Benchmarks and checks of the algorithms that are too slow or too
+ *   narrow for bgolly:  each test times one part of gollybase (and
+ *   checks its results where it can) and exits.
+ */
+#include "qlifealgo.h"
+#include "hlifealgo.h"
+#include "generationsalgo.h"
+#include "ltlalgo.h"
+#include "jvnalgo.h"
+#include "superalgo.h"
+#include "ruleloaderalgo.h"
+#include "ruletreealgo.h"
+#include "readpattern.h"
+#include "writepattern.h"
+#include "periodfinder.h"
+#include "util.h"
+#include <stdlib.h>
+#include <iostream>
+#include <cstdio>
+#include <string.h>
+#include <string>
+#include <fstream>
+#include <vector>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+using namespace std ;
+
+#define STRINGIFY(ARG) STR2(ARG)
+#define STR2(ARG) #ARG
+
+/*
+ *   The timer every test uses:  secs is the time since it was started
+ *   (or restarted), and lap gives that and restarts it.
+ */
+class stopwatch {
+public:
+   stopwatch() { restart() ; }
+   void restart() { t0 = gollySecondCount() ; }
+   double secs() const { return gollySecondCount() - t0 ; }
+   double lap() {
+      double now = gollySecondCount(), r = now - t0 ;
+      t0 = now ;
+      return r ;
+   }
+private:
+   double t0 ;
+} ;
+
+char* user_rules = (char *)"" ;             // can be changed by -s or --search
+char* supplied_rules = (char *)"Rules/" ;
+
+class stderrors : public lifeerrors {
+public:
+   stderrors() {}
+   virtual void fatal(const char *s) { cout << "Fatal error: " << s << endl ; exit(10) ; }
+   virtual void warning(const char *s) { cout << "Warning: " << s << endl ; }
+   virtual void status(const char *s) { cout << s << endl ; }
+   virtual void beginprogress(const char *) {}
+   virtual bool abortprogress(double, const char *) { return 0 ; }
+   virtual void endprogress() {}
+   virtual const char* getuserrules() { return user_rules ; }
+   virtual const char* getrulesdir() { return supplied_rules ; }
+} ;
+stderrors stderrors_instance ;
+
+struct options {
+  const char *shortopt ;
+  const char *longopt ;
+  const char *desc ;
+  char opttype ;
+  void *data ;
+} ;
+lifealgo *imp = 0 ;
+bigint maxgen = -1, inc = 0 ;
+int maxmem = 256 ;
+int numthreads = 1 ;
+int timelinebudget ;
+char *algoName = 0 ;
+char *liferule = 0 ;
+char *outfilename = 0 ;
+int outputgzip ;
+pattern_format outputformat = RLE_format ;
+options options[] = {
+  { "-m", "--generation", "How far to run (the tests give defaults)", 'I',
+                                                                 &maxgen },
+  { "-i", "--stepsize", "Step size", 'I', &inc },
+  { "-M", "--maxmemory", "Max memory to use in megabytes", 'i', &maxmem },
+  { "",   "--threads", "Number of threads to use", 'i', &numthreads },
+  { "",   "--timelinebudget", "Timeline memory in megabytes (default -M/2)",
+                                                     'i', &timelinebudget },
+  { "-r", "--rule", "Life rule to use", 's', &liferule },
+  { "-s", "--search", "Search directory for .rule files", 's', &user_rules },
+  { "-a", "--algorithm", "Select algorithm by name (default QuickLife)", 's',
+                                                               &algoName },
+  { "-o", "--output", "Output file (*.rle, *.mc, *.mcb, optionally .gz)", 's',
+                                                             &outfilename },
+  { 0, 0, 0, 0, 0 }
+} ;
+
+int endswith(const char *s, const char *suff) {
+   int off = (int)(strlen(s) - strlen(suff)) ;
+   if (off <= 0)
+      return 0 ;
+   s += off ;
+   while (*s)
+      if (tolower(*s++) != tolower(*suff++))
+         return 0 ;
+   return 1 ;
+}
+
+lifealgo *createUniverse() {
+   staticAlgoInfo *ai = staticAlgoInfo::byName(algoName) ;
+   if (ai == 0)
+      lifefatal("No such algorithm") ;
+   lifealgo *imp = (ai->creator)() ;
+   if (imp == 0)
+      lifefatal("Could not create universe") ;
+   imp->setMaxMemory(maxmem) ;
+   imp->setNumThreads(numthreads) ;
+   return imp ;
+}
+
+// the pattern file, with -r applied
+void loadpattern(lifealgo &e, const char *patfile) {
+   const char *err = readpattern(patfile, e) ;
+   if (err == 0 && liferule)
+      err = e.setrule(liferule) ;
+   if (err)
+      lifefatal(err) ;
+}
+
+/*
+ *   Hash the live cells with nextcell, so that runs of different kernels
+ *   or thread counts can be compared.
+ */
+unsigned int nextcellsum(lifealgo &e) {
+   unsigned int sum = 0 ;
+   if (e.isEmpty())
+      return sum ;
+   bigint top, left, bottom, right ;
+   e.findedges(&top, &left, &bottom, &right) ;
+   for (int y=top.toint(); y<=bottom.toint(); y++)
+      for (int x=left.toint(), v; x<=right.toint(); x++) {
+         int skip = e.nextcell(x, y, v) ;
+         if (skip < 0 || x + skip > right.toint())
+            break ;
+         x += skip ;
+         sum = sum * 31 + x * 7 + y ;
+      }
+   return sum ;
+}
+
+/*
+ *   Time each way of evaluating a RuleTree rule on a block of random
+ *   states (half of them zero, as in most patterns), check that they
+ *   all agree, and report cells per second.
+ */
+void runtreebench(const char *) {
+   if (strcmp(algoName, "RuleLoader") != 0)
+      lifefatal("tree needs the RuleLoader algorithm") ;
+   if (liferule) {
+      const char *err = imp->setrule(liferule) ;
+      if (err) lifefatal(err) ;
+   }
+   ruletreealgo *rt = ((ruleloaderalgo *)imp)->GetRuleTree() ;
+   if (rt == 0) {
+      cout << imp->getrule() << " is not a RuleTree rule" << endl ;
+      return ;
+   }
+   const int sz = 66 ;
+   static state in[sz*sz], out[sz*sz] ;
+   int ns = rt->NumCellStates() ;
+   srand(1) ;
+   for (int i=0; i<sz*sz; i++)
+      in[i] = (rand() & 1) ? 0 : (state)(rand() % ns) ;
+   int was = rt->getkernel() ;
+   unsigned int check = 0 ;
+   for (int k=ruletreealgo::TREEWALK; k<=ruletreealgo::TREEDIRECT; k++) {
+      cout << imp->getrule() << " states " << ns << " "
+           << ruletreealgo::kernelname(k) << (k == was ? "*" : "") << " " ;
+      if (!rt->setkernel(k)) {
+         cout << "too large" << endl ;
+         continue ;
+      }
+      stopwatch sw ;
+      double cells = 0 ;
+      do {
+         for (int r=0; r<100; r++)
+            rt->slowcalcblock(out, in, sz, sz-2, sz-2) ;
+         cells += 100.0 * (sz-2) * (sz-2) ;
+      } while (sw.secs() < 0.5) ;
+      double t = sw.secs() ;
+      unsigned int sum = 0 ;
+      for (int y=0; y<sz-2; y++)
+         for (int x=0; x<sz-2; x++)
+            sum = sum * 31 + out[y*sz+x] ;
+      if (k == ruletreealgo::TREEWALK)
+         check = sum ;
+      else if (sum != check)
+         lifefatal("RuleTree kernels disagree") ;
+      cout << (cells / t / 1e6) << " Mcells/s" << endl ;
+   }
+   rt->setkernel(was) ;
+}
+
+/*
+ *   Run QuickLife with each kernel that can handle the rule, starting
+ *   from the given pattern or else from a random 512x512 soup, check
+ *   that they all end up with the same cells, and report generations
+ *   per second.
+ */
+void runqlifebench(const char *patfile) {
+   if (strcmp(algoName, "QuickLife") != 0)
+      lifefatal("qlife needs the QuickLife algorithm") ;
+   bigint gens = maxgen >= 0 ? maxgen : bigint(1000) ;
+   unsigned int check = 0 ;
+   for (int k=qlifealgo::QLIFETABLE; k<=qlifealgo::QLIFEAVX2; k++) {
+      delete imp ;
+      imp = createUniverse() ;
+      if (patfile) {
+         loadpattern(*imp, patfile) ;
+      } else {
+         const char *err = imp->setrule(liferule ? liferule : "B3/S23") ;
+         if (err) lifefatal(err) ;
+         srand(1) ;
+         for (int y=0; y<512; y++)
+            for (int x=0; x<512; x++)
+               if (rand() & 1)
+                  imp->setcell(x, y, 1) ;
+         imp->endofpattern() ;
+      }
+      qlifealgo *q = (qlifealgo *)imp ;
+      int was = q->getkernel() ;
+      cout << imp->getrule() << " " << qlifealgo::kernelname(k)
+           << (k == was ? "*" : "") << " " ;
+      if (!q->setkernel(k)) {
+         cout << "can't be used" << endl ;
+         continue ;
+      }
+      stopwatch sw ;
+      imp->setIncrement(gens) ;
+      imp->step() ;
+      double t = sw.secs() ;
+      unsigned int sum = nextcellsum(*imp) ;
+      if (k == qlifealgo::QLIFETABLE)
+         check = sum ;
+      else if (sum != check)
+         lifefatal("QuickLife kernels disagree") ;
+      cout << imp->getPopulation().tostring() << " cells, "
+           << (gens.todouble() / t) << " gens/s" << endl ;
+   }
+}
+
+/*
+ *   Run Larger than Life on a random 512x512 soup on a torus for each of
+ *   the Moore, von Neumann, circular and weighted neighborhoods at a few
+ *   ranges, with one thread and then with --threads threads, check that
+ *   the results agree, and report generations per second.  The weighted
+ *   neighborhood doesn't fit in a rule string at range 50.
+ */
+void runltlbench(const char *) {
+   if (strcmp(algoName, "Larger than Life") != 0)
+      lifefatal("ltl needs the Larger than Life algorithm") ;
+   bigint gens = maxgen >= 0 ? maxgen : bigint(100) ;
+   const int ranges[] = { 1, 5, 20, 50 } ;
+   const char *ntypes = "MNCW" ;
+   for (const char *nt=ntypes; *nt; nt++) {
+      for (int ri=0; ri<4; ri++) {
+         int r = ranges[ri] ;
+         // count the neighborhood (weighted cells near the middle count 2)
+         string weights ;
+         int n = 0 ;
+         for (int y=-r; y<=r; y++)
+            for (int x=-r; x<=r; x++) {
+               int w = 0 ;
+               if (x == 0 && y == 0)
+                  w = 0 ;
+               else if (*nt == 'M')
+                  w = 1 ;
+               else if (*nt == 'N')
+                  w = (abs(x) + abs(y) <= r) ;
+               else if (*nt == 'C')
+                  w = (x * x + y * y <= r * r + r) ;
+               else
+                  w = (2 * abs(x) <= r && 2 * abs(y) <= r) ? 2 : 1 ;
+               weights += (char)('0' + w) ;
+               n += w ;
+            }
+         char rule[MAXRULESIZE] ;
+         if (*nt == 'W' && 60 + weights.size() >= sizeof(rule)) {
+            cout << "R" << r << " N" << *nt << " too large" << endl ;
+            continue ;
+         }
+         // a majority vote rule, so the soup settles into large blobs
+         // rather than dying out or filling the grid
+         int slo = n / 2, shi = n ;
+         int blo = n / 2 + 1, bhi = n ;
+         sprintf(rule, "R%d,C0,M0,S%d..%d,B%d..%d,N%c%s:T512,512", r,
+                 slo, shi, blo, bhi, *nt, *nt == 'W' ? weights.c_str() : "") ;
+         unsigned int check = 0 ;
+         double rate1 = 0 ;
+         for (int pass=0; pass<2; pass++) {
+            int nthreads = pass ? numthreads : 1 ;
+            if (pass && nthreads <= 1)
+               break ;
+            delete imp ;
+            imp = createUniverse() ;
+            imp->setNumThreads(nthreads) ;
+            const char *err = imp->setrule(rule) ;
+            if (err) lifefatal(err) ;
+            srand(1) ;
+            for (int y=-256; y<256; y++)
+               for (int x=-256; x<256; x++)
+                  if (rand() % 2 == 0)
+                     imp->setcell(x, y, 1) ;
+            imp->endofpattern() ;
+            stopwatch sw ;
+            imp->setIncrement(gens) ;
+            imp->step() ;
+            double rate = gens.todouble() / sw.secs() ;
+            unsigned int sum = nextcellsum(*imp) ;
+            if (pass == 0) {
+               check = sum ;
+               rate1 = rate ;
+               cout << "R" << r << " N" << *nt << " "
+                    << imp->getPopulation().tostring() << " cells, "
+                    << rate << " gens/s" ;
+            } else {
+               if (sum != check)
+                  lifefatal("Larger than Life thread counts disagree") ;
+               cout << ", " << nthreads << " threads " << rate
+                    << " gens/s (x" << (rate / rate1) << ")" ;
+            }
+         }
+         cout << endl ;
+      }
+   }
+}
+
+/*
+ *   Hash the runs the algorithm hands over, so the two ways of finding
+ *   them can be compared.
+ */
+class hashrunsink : public liferunsink {
+public:
+   hashrunsink() : runs(0), cells(0), sum(0) {}
+   virtual int run(G_INT64 x, G_INT64 y, G_INT64 len, int state) {
+      runs++ ;
+      cells += len ;
+      sum = sum * 31 + (unsigned int)(x * 7 + y * 5 + len * 3 + state) ;
+      return 0 ;
+   }
+   G_INT64 runs, cells ;
+   unsigned int sum ;
+} ;
+/*
+ *   Fill a 10000x10000 square (10^8 cells) with a random soup in each of
+ *   HashLife, QuickLife and Generations, and time finding the runs of
+ *   live cells with nextcell (as RLE output used to) and with getruns,
+ *   check that they agree, and time writing the soup as RLE to the
+ *   output file (or nowhere).  An output file is read back to check it.
+ */
+void runrlebench(const char *) {
+   const int sz = 10000 ;
+   const char *algos[] = { "HashLife", "QuickLife", "Generations" } ;
+   const char *rules[] = { "B3/S23", "B3/S23", "345/2/4" } ;
+   for (int a=0; a<3; a++) {
+      algoName = (char *)algos[a] ;
+      delete imp ;
+      imp = createUniverse() ;
+      const char *err = imp->setrule(rules[a]) ;
+      if (err) lifefatal(err) ;
+      int ns = imp->NumCellStates() ;
+      srand(1) ;
+      for (int y=0; y<sz; y++)
+         for (int x=0; x<sz; x++)
+            if (rand() & 1)
+               imp->setcell(x, y, 1 + rand() % (ns - 1)) ;
+      imp->endofpattern() ;
+      bigint top, left, bottom, right ;
+      imp->findedges(&top, &left, &bottom, &right) ;
+      cout << algos[a] << " " << imp->getPopulation().tostring() << " cells" ;
+      // the old way:  look for each cell from the root
+      hashrunsink oldsink ;
+      stopwatch sw ;
+      {
+         runjoiner runs(oldsink, sz) ;
+         int v = 0 ;
+         for (int y=top.toint(); y<=bottom.toint(); y++)
+            for (int x=left.toint(); x<=right.toint(); x++) {
+               int skip = imp->nextcell(x, y, v) ;
+               if (skip < 0 || x + skip > right.toint())
+                  break ;
+               x += skip ;
+               runs.add(x - left.toint(), y - top.toint(), 1, v) ;
+            }
+         runs.finish() ;
+      }
+      double told = sw.lap() ;
+      hashrunsink newsink ;
+      imp->getruns(top, left, bottom, right, newsink) ;
+      double tnew = sw.lap() ;
+      if (newsink.sum != oldsink.sum || newsink.cells != oldsink.cells ||
+          newsink.runs != oldsink.runs)
+         lifefatal("getruns and nextcell disagree") ;
+      cout << ", " << newsink.runs << " runs; nextcell " << told
+           << " s, getruns " << tnew << " s (x" << (told / tnew) << ")" ;
+#ifdef _WIN32
+      const char *dest = outfilename ? outfilename : "NUL" ;
+#else
+      const char *dest = outfilename ? outfilename : "/dev/null" ;
+#endif
+      err = writepattern(dest, *imp, RLE_format,
+                         outputgzip ? gzip_compression : no_compression,
+                         top, left, bottom, right) ;
+      if (err) lifefatal(err) ;
+      cout << ", write " << sw.lap() << " s" << endl ;
+      if (outfilename) {
+         lifealgo *back = createUniverse() ;
+         err = readpattern(outfilename, *back) ;
+         if (err) lifefatal(err) ;
+         if (back->getPopulation() != imp->getPopulation())
+            lifefatal("RLE output read back with the wrong population") ;
+         delete back ;
+      }
+   }
+}
+
+double filemegabytes(const char *name) {
+   ifstream f(name, ios::in | ios::binary | ios::ate) ;
+   if (!f)
+      lifefatal("Can't open output file") ;
+   return (double)f.tellg() / 1048576.0 ;
+}
+
+/*
+ *   Write the pattern to the gzipped output file with one compression
+ *   thread and then with --threads threads, and read each file back with
+ *   and without decompressing ahead; speeds are in MB/s of uncompressed
+ *   data, which is measured by first writing the file uncompressed.
+ */
+void rungzbench(const char *patfile) {
+   if (outfilename == 0 || !outputgzip)
+      lifefatal("gz needs a gzipped output file") ;
+   loadpattern(*imp, patfile) ;
+   bigint t, l, b, r ;
+   imp->findedges(&t, &l, &b, &r) ;
+   string plainname(outfilename, strlen(outfilename) - 3) ;
+   stopwatch sw ;
+   const char *err = writepattern(plainname.c_str(), *imp, outputformat,
+                                  no_compression, t, l, b, r) ;
+   if (err) lifefatal(err) ;
+   double secs = sw.secs() ;
+   double mb = filemegabytes(plainname.c_str()) ;
+   remove(plainname.c_str()) ;
+   cout << mb << " MB uncompressed, write " << (mb / secs) << " MB/s" << endl ;
+   for (int pass=0; pass<2; pass++) {
+      int nthreads = pass ? numthreads : 1 ;
+      if (pass && nthreads <= 1)
+         break ;
+      setgzipthreads(nthreads) ;
+      sw.restart() ;
+      err = writepattern(outfilename, *imp, outputformat, gzip_compression,
+                         t, l, b, r) ;
+      if (err) lifefatal(err) ;
+      secs = sw.secs() ;
+      cout << nthreads << " thread" << (nthreads > 1 ? "s" : "")
+           << ": " << filemegabytes(outfilename) << " MB gzipped, write "
+           << (mb / secs) << " MB/s" ;
+      for (int ahead=0; ahead<2; ahead++) {
+         lifealgo *back = createUniverse() ;
+         patternreader reader ;
+         reader.readahead = ahead != 0 ;
+         sw.restart() ;
+         if (!reader.openfile(outfilename))
+            lifefatal("Can't open output file") ;
+         err = readpattern(reader, *back) ;
+         if (err) lifefatal(err) ;
+         secs = sw.secs() ;
+         if (back->getPopulation() != imp->getPopulation())
+            lifefatal("Gzipped output read back with the wrong population") ;
+         delete back ;
+         cout << (ahead ? ", read ahead " : ", read ") << (mb / secs) << " MB/s" ;
+      }
+      cout << endl ;
+   }
+}
+
+/*
+ *   Time the bigint operations that generation counts, populations,
+ *   coordinates and the status line use, on a value held directly, on
+ *   one just over 2^31, and on one of 100 bits:  adding in place, adding
+ *   to a copy (as value arithmetic does), mul_smallint on a copy and
+ *   tostring, each in ns per operation.  Given a pattern, also step it
+ *   100 times by the step size (or 1) and time getPopulation after each
+ *   step.
+ */
+void runbigintbench(const char *patfile) {
+   const char *names[] = { "2^20", "2^31+1", "2^100" } ;
+   const int n = 2000000 ;
+   for (int k=0; k<3; k++) {
+      bigint a(names[k]) ;
+      if (k == 1)
+         a += 1 ;
+      bigint d = a ;
+      d.div2() ;
+      cout << names[k] ;
+      stopwatch sw ;
+      bigint sum = a ;
+      for (int i=0; i<n; i++) {
+         sum += d ;
+         sum -= d ;
+      }
+      cout << ": add " << (sw.lap() * 1e9 / (2.0 * n)) << " ns" ;
+      unsigned int sink = 0 ;
+      for (int i=0; i<n; i++) {
+         bigint c = a ;
+         c += d ;
+         sink += c.low31() ;
+      }
+      cout << ", copy+add " << (sw.lap() * 1e9 / n) << " ns" ;
+      for (int i=0; i<n; i++) {
+         bigint c = a ;
+         c.mul_smallint(10) ;
+         sink += c.low31() ;
+      }
+      cout << ", mul_smallint " << (sw.lap() * 1e9 / n) << " ns" ;
+      for (int i=0; i<n/10; i++)
+         sink += a.tostring()[0] ;
+      cout << ", tostring " << (sw.lap() * 1e9 / (n / 10)) << " ns" ;
+      if (sum != a || sink == 0)
+         lifefatal("bigint arithmetic went wrong") ;
+      cout << endl ;
+   }
+   if (patfile == 0)
+      return ;
+   loadpattern(*imp, patfile) ;
+   imp->setIncrement(inc > 0 ? inc : bigint::one) ;
+   double t = 0 ;
+   for (int i=0; i<100; i++) {
+      imp->step() ;
+      stopwatch sw ;
+      imp->getPopulation() ;
+      t += sw.secs() ;
+   }
+   cout << "getPopulation " << (t * 1e3 / 100) << " ms per step, population "
+        << imp->getPopulation().tostring() << " at generation "
+        << imp->getGeneration().tostring() << endl ;
+}
+
+/*
+ *   How g.hash used to hash a rectangle, a cell at a time.
+ */
+int oldhash(lifealgo &e, int x, int y, int wd, int ht) {
+   int hash = 31415962 ;
+   int right = x + wd - 1 ;
+   int bottom = y + ht - 1 ;
+   int v = 0 ;
+   bool multistate = e.NumCellStates() > 2 ;
+   for (int cy=y; cy<=bottom; cy++) {
+      int yshift = cy - y ;
+      for (int cx=x; cx<=right; cx++) {
+         int skip = e.nextcell(cx, cy, v) ;
+         if (skip >= 0) {
+            cx += skip ;
+            if (cx <= right) {
+               hash = (hash * 1000003) ^ yshift ;
+               hash = (hash * 1000003) ^ (cx - x) ;
+               if (multistate) hash = (hash * 1000003) ^ v ;
+            }
+         } else {
+            cx = right ;
+         }
+      }
+   }
+   return hash ;
+}
+/*
+ *   Time hashing the bounding box after each of 100 steps the old way,
+ *   with gethash, and with the getruns one every algorithm falls back
+ *   on, which gethash must agree with.
+ */
+void runhashbench(const char *patfile) {
+   loadpattern(*imp, patfile) ;
+   imp->setIncrement(inc > 0 ? inc : bigint::one) ;
+   double told = 0, tnew = 0, truns = 0 ;
+   int steps = 100 ;
+   for (int i=0; i<steps; i++) {
+      imp->step() ;
+      bigint t, l, b, r ;
+      imp->findedges(&t, &l, &b, &r) ;
+      if (imp->isEmpty())
+         continue ;
+      if (t < bigint::min_coord || l < bigint::min_coord ||
+          b > bigint::max_coord || r > bigint::max_coord)
+         lifefatal("Pattern is too big for the old hash") ;
+      int x = l.toint(), y = t.toint() ;
+      int wd = r.toint() - x + 1, ht = b.toint() - y + 1 ;
+      stopwatch sw ;
+      oldhash(*imp, x, y, wd, ht) ;
+      told += sw.lap() ;
+      cellhash::value h = imp->gethash(t, l, b, r) ;
+      tnew += sw.lap() ;
+      cellhash::value hr = imp->lifealgo::gethash(t, l, b, r) ;
+      truns += sw.lap() ;
+      if (h != hr)
+         lifefatal("gethash doesn't match the getruns hash") ;
+   }
+   cout << "old hash " << (told * 1e3 / steps) << " ms, gethash "
+        << (tnew * 1e3 / steps) << " ms, getruns hash "
+        << (truns * 1e3 / steps) << " ms per step; population "
+        << imp->getPopulation().tostring() << " at generation "
+        << imp->getGeneration().tostring() << endl ;
+}
+
+/*
+ *   Time copying the pattern out to a cell list and into a new universe,
+ *   first a cell at a time with nextcell and setcell as the scripts'
+ *   getcells and putcells do with a cell list, then in bulk with getcells
+ *   and setcells as they do with a cell buffer.
+ */
+void runcellbench(const char *patfile) {
+   loadpattern(*imp, patfile) ;
+   bigint t, l, b, r ;
+   imp->findedges(&t, &l, &b, &r) ;
+   if (imp->isEmpty())
+      lifefatal("cell needs a pattern") ;
+   if (t < bigint::min_coord || l < bigint::min_coord ||
+       b > bigint::max_coord || r > bigint::max_coord)
+      lifefatal("Pattern is too big for a cell list") ;
+   int x = l.toint(), y = t.toint() ;
+   int wd = r.toint() - x + 1, ht = b.toint() - y + 1 ;
+   int multistate = imp->NumCellStates() > 2 ;
+   stopwatch sw ;
+   vector<int> cells ;
+   int v = 0 ;
+   for (int cy=y; cy<y+ht; cy++) {
+      for (int cx=x; cx<x+wd; cx++) {
+         int skip = imp->nextcell(cx, cy, v) ;
+         if (skip < 0)
+            break ;
+         cx += skip ;
+         if (cx >= x + wd)
+            break ;
+         cells.push_back(cx) ;
+         cells.push_back(cy) ;
+         if (multistate)
+            cells.push_back(v) ;
+      }
+   }
+   if (multistate && cells.size() && (cells.size() & 1) == 0)
+      cells.push_back(0) ;
+   double tnext = sw.lap() ;
+   lifealgo *e = createUniverse() ;
+   e->setrule(imp->getrule()) ;
+   int step = multistate ? 3 : 2 ;
+   for (size_t i=0; i+step<=cells.size(); i+=step)
+      e->setcell(cells[i], cells[i+1], multistate ? cells[i+2] : 1) ;
+   e->endofpattern() ;
+   double tset = sw.lap() ;
+   cellbuffer buf ;
+   imp->getcells(buf, x, y, wd, ht) ;
+   double tgetbuf = sw.lap() ;
+   lifealgo *e2 = createUniverse() ;
+   e2->setrule(imp->getrule()) ;
+   if (e2->setcells(buf.data(), buf.size(), buf.multistate, 0, 0) < 0)
+      lifefatal("setcells found a bad state") ;
+   e2->endofpattern() ;
+   double tsetbuf = sw.lap() ;
+   if (buf.cells != cells)
+      lifefatal("getcells doesn't match nextcell") ;
+   if (e->getPopulation() != imp->getPopulation() ||
+       e2->getPopulation() != imp->getPopulation() ||
+       e->gethash(t, l, b, r) != imp->gethash(t, l, b, r) ||
+       e2->gethash(t, l, b, r) != imp->gethash(t, l, b, r))
+      lifefatal("The copied pattern doesn't match") ;
+   cout << buf.count() << " cells: nextcell " << tnext << " s, getcells "
+        << tgetbuf << " s; setcell " << tset << " s, setcells "
+        << tsetbuf << " s" << endl ;
+   delete e ;
+   delete e2 ;
+}
+
+/*
+ *   What the GUI's undo history costs for each step:  saving the pattern
+ *   to a macrocell file before and after (the old way) against pinning
+ *   the root in the node store, and restoring it by reading the file
+ *   back into a new universe against setcurrentstate.  Also shows how
+ *   small a "clear the pattern" batch of cell changes becomes.
+ */
+void runundobench(const char *patfile) {
+   loadpattern(*imp, patfile) ;
+   if (!imp->hyperCapable())
+      lifefatal("undo needs a hashing algorithm") ;
+   if (inc != 0)
+      imp->setIncrement(inc) ;
+   const int steps = 8 ;
+   const char *tmpname = outfilename ? outfilename : "undobench.mc" ;
+   vector<void *> states ;
+   vector<bigint> gens, pops ;
+   double pinsecs = 0, writesecs = 0, stepsecs = 0 ;
+   for (int i=0; i<=steps; i++) {
+      stopwatch sw ;
+      if (i > 0) {
+         imp->step() ;
+         stepsecs += sw.lap() ;
+      }
+      void *state = imp->pinstate() ;
+      pinsecs += sw.lap() ;
+      if (state == 0)
+         lifefatal("This algorithm can't pin its states") ;
+      states.push_back(state) ;
+      gens.push_back(imp->getGeneration()) ;
+      pops.push_back(imp->getPopulation()) ;
+      sw.restart() ;
+      const char *err = writepattern(tmpname, *imp, MC_format, no_compression,
+                                     0, 0, 0, 0) ;
+      if (err) lifefatal(err) ;
+      writesecs += sw.secs() ;
+      if (i < steps)
+         remove(tmpname) ;
+   }
+   // undo back to the first state both ways (the file holds the last one)
+   stopwatch sw ;
+   lifealgo *back = createUniverse() ;
+   const char *err = readpattern(tmpname, *back) ;
+   if (err) lifefatal(err) ;
+   double readsecs = sw.secs() ;
+   remove(tmpname) ;
+   if (back->getPopulation() != pops[steps])
+      lifefatal("The saved state read back with the wrong population") ;
+   delete back ;
+   sw.restart() ;
+   imp->endofpattern() ;
+   imp->setcurrentstate(states[0]) ;
+   imp->setGeneration(gens[0]) ;
+   double restoresecs = sw.secs() ;
+   if (imp->getPopulation() != pops[0])
+      lifefatal("The pinned state was restored with the wrong population") ;
+   cout << steps << " steps to gen " << gens[steps].tostring()
+        << ", population " << pops[steps].tostring() << endl ;
+   cout << "per step: step " << (stepsecs / steps) << " s, save *.mc "
+        << (writesecs / (steps + 1)) << " s, pin "
+        << (pinsecs / (steps + 1)) << " s" << endl ;
+   cout << "undo: read *.mc " << readsecs << " s, setcurrentstate "
+        << restoresecs << " s" << endl ;
+   cout << "last gc kept " << (100.0 * imp->getkeptfraction())
+        << "% of the node store" << endl ;
+   for (int i=0; i<=steps; i++)
+      imp->unpinstate(states[i]) ;
+   // a batch of cell changes clearing (at most) the first 10^6 cells
+   bigint t, l, b, r ;
+   imp->findedges(&t, &l, &b, &r) ;
+   if (t < bigint::min_coord || l < bigint::min_coord ||
+       b > bigint::max_coord || r > bigint::max_coord)
+      return ;
+   cellchanges batch ;
+   int x = l.toint(), y = t.toint(), right = r.toint(), bottom = b.toint() ;
+   int v = 0 ;
+   for (int cy=y; cy<=bottom && batch.count() < 1000000; cy++) {
+      for (int cx=x; cx<=right && batch.count() < 1000000; cx++) {
+         int skip = imp->nextcell(cx, cy, v) ;
+         if (skip < 0)
+            break ;
+         cx += skip ;
+         batch.add(cx, cy, v, 0) ;
+      }
+   }
+   batch.trim() ;
+   cout << "clearing " << batch.count() << " cells: " << batch.bytes()
+        << " bytes of changes, was " << (16.0 * batch.count()) << endl ;
+}
+
+/*
+ *   Record a timeline of the pattern, stepping by -i (a power of two,
+ *   1 by default) to generation -m, then time showing frames picked at
+ *   random, as scrubbing does; evicted frames are recomputed.
+ */
+void runscrubbench(const char *patfile) {
+   loadpattern(*imp, patfile) ;
+   if (maxgen < 0)
+      lifefatal("scrub needs -m") ;
+   if (inc == 0)
+      inc = 1 ;
+   int lowbit = inc.lowbitset() ;
+   bigint t = 1 ;
+   for (int i=0; i<lowbit; i++)
+      t.mul_smallint(2) ;
+   if (t != inc)
+      lifefatal("Bad increment for timeline") ;
+   imp->setIncrement(inc) ;
+   imp->settimelinebudget(timelinebudget) ;
+   stopwatch sw ;
+   if (imp->startrecording(2, lowbit) == 0)
+      lifefatal("This pattern can't be recorded") ;
+   while (imp->getGeneration() < maxgen) {
+      imp->step() ;
+      imp->extendtimeline() ;
+   }
+   imp->stoprecording() ;
+   int n = imp->getframecount(), kept = 0 ;
+   for (int i=0; i<n; i++)
+      if (imp->nearestkeptframe(i) == i)
+         kept++ ;
+   cout << "recorded " << n << " frames in " << sw.lap() << " s, kept "
+        << kept << endl ;
+   const int visits = 1000 ;
+   unsigned int r = 12345 ;
+   double worst = 0 ;
+   for (int v=0; v<visits; v++) {
+      r = r * 1103515245 + 12345 ;
+      stopwatch one ;
+      imp->gotoframe((int)((r >> 8) % (unsigned int)n)) ;
+      imp->getPopulation() ;
+      if (one.secs() > worst)
+         worst = one.secs() ;
+   }
+   cout << "gotoframe average " << (sw.secs() / visits * 1000)
+        << "ms worst " << (worst * 1000) << "ms" << endl ;
+}
+
+/*
+ *   The way Scripts/Python/oscar.py looks for a period:  step one
+ *   generation at a time, hash the bounding box with nextcell (as the
+ *   script's g.hash did) and keep only the record-breaking minimal hashes
+ *   (Gabriel Nivasch's "keep minima" algorithm).  Only the script
+ *   interpreter's overhead is left out.
+ */
+struct oscarentry {
+   int hash ;
+   bigint gen, pop ;
+   int x, y, wd, ht ;
+} ;
+int oscarfind(lifealgo &e, const bigint &maxgens, bigint &period) {
+   vector<oscarentry> list ;
+   bigint gens = 0 ;
+   e.setIncrement(1) ;
+   for (;;) {
+      oscarentry now ;
+      now.gen = e.getGeneration() ;
+      now.pop = e.getPopulation() ;
+      if (e.isEmpty()) {
+         period = 1 ;
+         return 1 ;
+      }
+      bigint t, l, b, r ;
+      e.findedges(&t, &l, &b, &r) ;
+      now.x = l.toint() ;
+      now.y = t.toint() ;
+      now.wd = r.toint() - now.x + 1 ;
+      now.ht = b.toint() - now.y + 1 ;
+      int h = oldhash(e, now.x, now.y, now.wd, now.ht) ;
+      now.hash = h ;
+      size_t pos = 0 ;
+      while (pos < list.size()) {
+         if (h > list[pos].hash) {
+            pos++ ;
+         } else if (h < list[pos].hash) {
+            list.resize(pos) ;
+            break ;
+         } else {
+            oscarentry &o = list[pos] ;
+            period = now.gen ;
+            period -= o.gen ;
+            if (now.pop == o.pop && now.wd == o.wd && now.ht == o.ht &&
+                !(e.alternatingRules() && period.odd()))
+               return 1 ;
+            pos++ ;
+         }
+      }
+      list.insert(list.begin() + pos, now) ;
+      if (gens >= maxgens)
+         return 0 ;
+      e.step() ;
+      gens += 1 ;
+   }
+}
+/*
+ *   Find the pattern's period within -m generations with the period
+ *   finder and then the way oscar.py does it.
+ */
+void runperiodbench(const char *patfile) {
+   if (maxgen < 0)
+      lifefatal("period needs -m") ;
+   loadpattern(*imp, patfile) ;
+   periodfinder finder(*imp) ;
+   stopwatch sw ;
+   finder.find(maxgen) ;
+   double secs = sw.lap() ;
+   if (finder.found)
+      cout << "period finder: period " << finder.period.tostring() ;
+   else
+      cout << "period finder: no period" ;
+   cout << " at generation " << imp->getGeneration().tostring()
+        << " in " << secs << " s" << endl ;
+   lifealgo *e = createUniverse() ;
+   loadpattern(*e, patfile) ;
+   bigint period ;
+   sw.restart() ;
+   int found = oscarfind(*e, maxgen, period) ;
+   secs = sw.secs() ;
+   if (found)
+      cout << "oscar.py's way: period " << period.tostring() ;
+   else
+      cout << "oscar.py's way: no period" ;
+   cout << " at generation " << e->getGeneration().tostring()
+        << " in " << secs << " s" << endl ;
+   if (found != finder.found || (found && period != finder.period))
+      lifefatal("The period finder and oscar.py's way disagree") ;
+   delete e ;
+}
+
+/*
+ *   Load every pattern file given with readpatterns, first on one thread
+ *   and then on --threads threads, and report the time taken.  Like Golly,
+ *   files the chosen algorithm can't read are tried with each of the others.
+ */
+double batchload(vector<string> &files, int nthreads, vector<string> &pops) {
+   pops.assign(files.size(), "") ;
+   vector<lifealgo *> algos(files.size(), (lifealgo *)0) ;
+   vector<staticAlgoInfo *> order ;
+   order.push_back(staticAlgoInfo::byName(algoName)) ;
+   for (staticAlgoInfo *ai=staticAlgoInfo::head; ai; ai=ai->next)
+      if (ai != order[0])
+         order.push_back(ai) ;
+   double secs = 0 ;
+   for (size_t a=0; a<order.size(); a++) {
+      vector<patternjob> jobs ;
+      vector<size_t> which ;
+      for (size_t i=0; i<files.size(); i++) {
+         if (algos[i])
+            continue ;
+         patternjob job ;
+         job.filename = files[i] ;
+         job.imp = (order[a]->creator)() ;
+         job.imp->setMaxMemory(maxmem) ;
+         jobs.push_back(job) ;
+         which.push_back(i) ;
+      }
+      stopwatch sw ;
+      readpatterns(jobs, nthreads) ;
+      secs += sw.secs() ;
+      for (size_t j=0; j<jobs.size(); j++) {
+         if (jobs[j].errmsg.empty()) {
+            algos[which[j]] = jobs[j].imp ;
+            pops[which[j]] = string(order[a]->algoName) + " " +
+                             jobs[j].imp->getPopulation().tostring() ;
+         } else
+            delete jobs[j].imp ;
+      }
+   }
+   for (size_t i=0; i<files.size(); i++)
+      delete algos[i] ;
+   return secs ;
+}
+/*
+ *   Time loading one pattern (- reads standard input) and show the peak
+ *   memory, or time loading several with batchload.
+ */
+void runloadbench(int nfiles, char **names) {
+   if (nfiles > 1) {
+      vector<string> files(names, names + nfiles) ;
+      vector<string> pops1, pops ;
+      double t1 = batchload(files, 1, pops1) ;
+      int nread = 0 ;
+      for (size_t i=0; i<files.size(); i++)
+         if (pops1[i].empty())
+            cout << "could not read " << files[i] << endl ;
+         else
+            nread++ ;
+      cout << "read " << nread << " of " << files.size() << " files in "
+           << t1 << " s" ;
+      if (numthreads > 1) {
+         double t = batchload(files, numthreads, pops) ;
+         if (pops != pops1)
+            lifefatal("Patterns read on several threads disagree") ;
+         cout << ", " << numthreads << " threads " << t << " s (x" << (t1 / t)
+              << ")" ;
+      }
+      cout << endl ;
+      return ;
+   }
+   stopwatch sw ;
+   const char *err ;
+   if (strcmp(names[0], "-") == 0) {
+      patternreader reader ;
+      if (!reader.openstream(stdin))
+         lifefatal("Can't read pattern from standard input") ;
+      err = readpattern(reader, *imp) ;
+   } else
+      err = readpattern(names[0], *imp) ;
+   if (err) lifefatal(err) ;
+   double secs = sw.secs() ;
+   double pop = imp->getPopulation().todouble() ;
+   cout << "loaded in " << secs << " s" ;
+   cout << ", population " << imp->getPopulation().tostring() ;
+   if (secs > 0)
+      cout << ", " << (pop / secs) << " cells/s" ;
+#ifndef _WIN32
+   struct rusage ru ;
+   getrusage(RUSAGE_SELF, &ru) ;
+   cout << ", peak memory " << (ru.ru_maxrss >> 10) << "MB" ;
+#endif
+   cout << endl ;
+}
+
+/*
+ *   The hash of the whole pattern, so frames can be compared.
+ */
+cellhash::value patternhash(lifealgo &e) {
+   if (e.isEmpty())
+      return 0 ;
+   bigint t, l, b, r ;
+   e.findedges(&t, &l, &b, &r) ;
+   return e.gethash(t, l, b, r) ;
+}
+/*
+ *   Record a soup with a budget small enough that most frames are
+ *   evicted, then check that every frame visited shows the same cells
+ *   and generation as when it was recorded.  For the hashing algorithms
+ *   the timeline is also saved as .mc and .mcb, read back into a new
+ *   universe, and checked the same way, since the files hold only the
+ *   kept frames and the reader has to leave the rest to be recomputed.
+ */
+int checktimeline(const char *algo, const char *rule, int frames) {
+   algoName = (char *)algo ;
+   lifealgo *a = createUniverse() ;
+   const char *err = a->setrule(rule) ;
+   if (err) lifefatal(err) ;
+   int ns = a->NumCellStates() ;
+   srand(11) ;
+   for (int y=0; y<200; y++)
+      for (int x=0; x<200; x++)
+         if (rand() % 3 == 0)
+            a->setcell(x, y, 1 + rand() % (ns - 1)) ;
+   a->endofpattern() ;
+   a->setIncrement(1) ;
+   a->settimelinebudget(1) ;
+   vector<cellhash::value> hashes ;
+   vector<bigint> gens ;
+   if (a->startrecording(2, 0) == 0)
+      lifefatal("Can't record a timeline") ;
+   hashes.push_back(patternhash(*a)) ;
+   gens.push_back(a->getGeneration()) ;
+   for (int i=1; i<frames; i++) {
+      a->step() ;
+      a->extendtimeline() ;
+      hashes.push_back(patternhash(*a)) ;
+      gens.push_back(a->getGeneration()) ;
+   }
+   a->stoprecording() ;
+   int kept = 0 ;
+   for (int i=0; i<frames; i++)
+      if (a->nearestkeptframe(i) == i)
+         kept++ ;
+   cout << algo << ": " << a->getframecount() << " frames, " << kept
+        << " kept" ;
+   if (a->getframecount() != frames || kept == frames)
+      lifefatal("The timeline wasn't recorded with evicted frames") ;
+   int bad = 0 ;
+   vector<lifealgo *> checks ;
+   checks.push_back(a) ;
+   if (a->hyperCapable()) {
+      const char *names[] = { "timelinetest.mc", "timelinetest.mcb" } ;
+      pattern_format formats[] = { MC_format, MCB_format } ;
+      for (int f=0; f<2; f++) {
+         err = writepattern(names[f], *a, formats[f], no_compression,
+                            0, 0, 0, 0) ;
+         if (err) lifefatal(err) ;
+         lifealgo *back = createUniverse() ;
+         err = readpattern(names[f], *back) ;
+         remove(names[f]) ;
+         if (err) lifefatal(err) ;
+         if (back->getframecount() != frames) {
+            cout << ", " << names[f] << " read " << back->getframecount()
+                 << " frames" ;
+            bad++ ;
+            delete back ;
+            continue ;
+         }
+         checks.push_back(back) ;
+      }
+   }
+   for (size_t c=0; c<checks.size(); c++) {
+      lifealgo *e = checks[c] ;
+      srand(5) ;
+      for (int k=0; k<200; k++) {
+         // the last frames, then frames at random
+         int i = k < 20 ? frames - 1 - k : rand() % frames ;
+         e->gotoframe(i) ;
+         if (patternhash(*e) != hashes[i] || e->getGeneration() != gens[i])
+            bad++ ;
+      }
+      if (c > 0)
+         delete e ;
+   }
+   cout << (bad ? ", FAILED" : ", ok") << endl ;
+   delete a ;
+   return bad ;
+}
+void runtimelinetest(const char *) {
+   int bad = checktimeline("HashLife", "B3/S23", 2000) ;
+   bad += checktimeline("Generations", "B3/S23/3", 2000) ;
+   bad += checktimeline("QuickLife", "B3/S23", 1000) ;
+   if (bad)
+      exit(1) ;
+}
+
+/*
+ *   Paste soups over part of another the way the GUI does when undo is
+ *   on, keeping the changes in a cellchanges batch, then undo and redo
+ *   it twice, checking the cells each time.  For the hashing algorithms
+ *   a step is also undone and redone through pinned states, with the
+ *   paste undone and redone on top of it.
+ */
+int checkpaste(const char *algo, const char *rule) {
+   algoName = (char *)algo ;
+   lifealgo *a = createUniverse() ;
+   const char *err = a->setrule(rule) ;
+   if (err) lifefatal(err) ;
+   int ns = a->NumCellStates() ;
+   const int sz = 800 ;
+   srand(7) ;
+   for (int y=0; y<sz; y++)
+      for (int x=0; x<sz; x++)
+         if (rand() % 3 == 0)
+            a->setcell(x, y, 1 + rand() % (ns - 1)) ;
+   a->endofpattern() ;
+   void *first = a->hyperCapable() ? a->pinstate() : 0 ;
+   if (first) {
+      a->setIncrement(64) ;
+      a->step() ;
+   }
+   void *stepped = first ? a->pinstate() : 0 ;
+   cellhash::value before = patternhash(*a) ;
+   stopwatch sw ;
+   cellchanges paste ;
+   // the second, overlapping paste changes some cells twice, as a
+   // script can, so undo has to go back in order
+   for (int p=1; p<=2; p++)
+      for (int y=p*sz/4; y<p*sz/4+sz; y++)
+         for (int x=p*sz/4; x<p*sz/4+sz; x++) {
+            int oldstate = a->getcell(x, y) ;
+            int newstate = rand() % 2 ? 1 + rand() % (ns - 1) : 0 ;
+            if (oldstate != newstate) {
+               a->setcell(x, y, newstate) ;
+               paste.add(x, y, oldstate, newstate) ;
+            }
+         }
+   a->endofpattern() ;
+   paste.trim() ;
+   double pastesecs = sw.lap() ;
+   cellhash::value after = patternhash(*a) ;
+   int bad = 0 ;
+   for (int i=0; i<2; i++) {
+      paste.apply(*a, 1) ;
+      a->endofpattern() ;
+      if (patternhash(*a) != before)
+         bad++ ;
+      paste.apply(*a, 0) ;
+      a->endofpattern() ;
+      if (patternhash(*a) != after)
+         bad++ ;
+   }
+   double undosecs = sw.lap() / 4 ;
+   cout << algo << ": pasted " << paste.count() << " cells in " << pastesecs
+        << " s, " << paste.bytes() << " bytes of changes, undo or redo "
+        << undosecs << " s" ;
+   if (first) {
+      // undo the paste and the step, then redo both
+      paste.apply(*a, 1) ;
+      a->endofpattern() ;
+      a->setcurrentstate(first) ;
+      cellhash::value start = patternhash(*a) ;
+      a->setcurrentstate(stepped) ;
+      if (patternhash(*a) != before || start == before)
+         bad++ ;
+      paste.apply(*a, 0) ;
+      a->endofpattern() ;
+      if (patternhash(*a) != after)
+         bad++ ;
+      a->unpinstate(first) ;
+      a->unpinstate(stepped) ;
+   }
+   cout << (bad ? ", FAILED" : ", ok") << endl ;
+   delete a ;
+   return bad ;
+}
+void runpastetest(const char *) {
+   int bad = checkpaste("HashLife", "B3/S23") ;
+   bad += checkpaste("Generations", "B3/S23/3") ;
+   bad += checkpaste("QuickLife", "B3/S23") ;
+   if (bad)
+      exit(1) ;
+}
+
+struct benchtest {
+   const char *name ;
+   const char *desc ;
+   int needs ;          // 0 no pattern, 1 optional, 2 one, 3 one or more
+   void (*run)(const char *) ;
+} ;
+benchtest tests[] = {
+  { "tree", "Time each RuleTree kernel on the rule (-a RuleLoader -r)", 0,
+                                                            runtreebench },
+  { "qlife", "Time each QuickLife kernel on the pattern (or a soup)", 1,
+                                                           runqlifebench },
+  { "ltl", "Time Larger than Life on each neighborhood", 0, runltlbench },
+  { "rle", "Time writing 10^8-cell soups as RLE", 0, runrlebench },
+  { "gz", "Time writing and reading the pattern as *.gz output (-o)", 2,
+                                                              rungzbench },
+  { "bigint", "Time bigint arithmetic (and getPopulation)", 1,
+                                                          runbigintbench },
+  { "hash", "Time g.hash's old cell-by-cell hash against gethash", 2,
+                                                            runhashbench },
+  { "cell", "Time copying the pattern out to a cell list and back", 2,
+                                                            runcellbench },
+  { "undo", "Time keeping undo states in memory against *.mc files", 2,
+                                                            runundobench },
+  { "scrub", "Record a timeline to -m and time showing random frames", 2,
+                                                           runscrubbench },
+  { "period", "Time the period finder against oscar.py's way (to -m)", 2,
+                                                          runperiodbench },
+  { "load", "Time loading the pattern(s) and show peak memory", 3, 0 },
+  { "timeline", "Check that timelines with evicted frames save and reload",
+                                                     0, runtimelinetest },
+  { "paste", "Check that undoing and redoing a large paste restores it", 0,
+                                                            runpastetest },
+  { 0, 0, 0, 0 }
+} ;
+
+void usage(const char *s) {
+  fprintf(stderr, "Usage:  bench [options] test [patternfile]\n") ;
+  fprintf(stderr, "Tests:\n") ;
+  for (int i=0; tests[i].name; i++)
+    fprintf(stderr, "    %-15s %s\n", tests[i].name, tests[i].desc) ;
+  fprintf(stderr, "Options:\n") ;
+  for (int i=0; options[i].shortopt; i++)
+    fprintf(stderr, "%3s %-15s %s\n", options[i].shortopt, options[i].longopt,
+            options[i].desc) ;
+  if (s)
+    lifefatal(s) ;
+  exit(0) ;
+}
+
+int main(int argc, char *argv[]) {
+   cout << "This is bench " STRINGIFY(VERSION) " Copyright 2005-2020 The Golly Gang."
+        << endl ;
+   cout << "-" ;
+   for (int i=0; i<argc; i++)
+      cout << " " << argv[i] ;
+   cout << endl << flush ;
+   lifeerrors::seterrorhandler(&stderrors_instance) ;
+   qlifealgo::doInitializeAlgoInfo(staticAlgoInfo::tick()) ;
+   hlifealgo::doInitializeAlgoInfo(staticAlgoInfo::tick()) ;
+   generationsalgo::doInitializeAlgoInfo(staticAlgoInfo::tick()) ;
+   ltlalgo::doInitializeAlgoInfo(staticAlgoInfo::tick()) ;
+   jvnalgo::doInitializeAlgoInfo(staticAlgoInfo::tick()) ;
+   superalgo::doInitializeAlgoInfo(staticAlgoInfo::tick()) ;
+   ruleloaderalgo::doInitializeAlgoInfo(staticAlgoInfo::tick()) ;
+   while (argc > 1 && argv[1][0] == '-' && argv[1][1] != 0) {
+      argc-- ;
+      argv++ ;
+      char *opt = argv[0] ;
+      int hit = 0 ;
+      for (int i=0; options[i].shortopt; i++) {
+        if (strcmp(opt, options[i].shortopt) == 0 ||
+            strcmp(opt, options[i].longopt) == 0) {
+          if (argc < 2)
+             lifefatal("Bad option argument") ;
+          switch (options[i].opttype) {
+case 'i':
+             *(int *)options[i].data = atol(argv[1]) ;
+             break ;
+case 'I':
+             *(bigint *)options[i].data = bigint(argv[1]) ;
+             break ;
+case 's':
+             *(char **)options[i].data = argv[1] ;
+             break ;
+          }
+          argc-- ;
+          argv++ ;
+          hit++ ;
+          break ;
+        }
+      }
+      if (!hit)
+         usage("Bad option given") ;
+   }
+   if (argc < 2)
+      usage("No test given") ;
+   benchtest *test = 0 ;
+   for (int i=0; tests[i].name; i++)
+      if (strcmp(argv[1], tests[i].name) == 0)
+         test = &tests[i] ;
+   if (test == 0)
+      usage("No such test") ;
+   int npats = argc - 2 ;
+   if (npats == 0 && test->needs >= 2)
+      usage("No pattern argument given") ;
+   if ((npats > 0 && test->needs == 0) || (npats > 1 && test->needs < 3))
+      usage("Extra stuff after pattern argument") ;
+   if (outfilename) {
+      if (endswith(outfilename, ".rle")) {
+      } else if (endswith(outfilename, ".mc")) {
+         outputformat = MC_format ;
+      } else if (endswith(outfilename, ".mcb")) {
+         outputformat = MCB_format ;
+#ifdef ZLIB
+      } else if (endswith(outfilename, ".rle.gz")) {
+         outputgzip = 1 ;
+      } else if (endswith(outfilename, ".mc.gz")) {
+         outputformat = MC_format ;
+         outputgzip = 1 ;
+      } else if (endswith(outfilename, ".mcb.gz")) {
+         outputformat = MCB_format ;
+         outputgzip = 1 ;
+#endif
+      } else {
+         lifefatal("Output filename must end with .rle, .mc or .mcb.") ;
+      }
+   }
+   if (algoName == 0)
+      algoName = (char *)"QuickLife" ;
+   imp = createUniverse() ;
+   setgzipthreads(numthreads) ;
+   if (test->run)
+      test->run(npats > 0 ? argv[2] : 0) ;
+   else
+      runloadbench(npats, argv + 2) ;
+   delete imp ;
+   return 0 ;
+}
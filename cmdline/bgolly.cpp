@@ -13,23 +13,41 @@
 #include "viewport.h"
 #include "liferender.h"
 #include "writepattern.h"
+#include "periodfinder.h"
+#include "soupcensus.h"
 #include <stdlib.h>
 #include <iostream>
 #include <cstdio>
 #include <string.h>
+#include <string>
 #include <cstdlib>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 using namespace std ;
 
 double start ;
 int maxtime = 0 ;
+void finishcheckpoint() ;
 double timestamp() {
    double now = gollySecondCount() ;
    double r = now - start ;
    if (start == 0)
       start = now ;
-   else if (maxtime && r > maxtime)
-      exit(0) ;   
+   else if (maxtime && r > maxtime) {
+      finishcheckpoint() ;
+      exit(0) ;
+   }
    return r ;
 }
 
@@ -59,20 +77,21 @@ char* user_rules = (char *)"";              // can be changed by -s or --search
 char* supplied_rules = (char *)"Rules/";
 
 int benchmark ; // show timing?
+ostream *msgout = &cout ; // banner and messages; stderr for --batch
 /*
  *   This lifeerrors is used to check rendering during a progress dialog.
  */
 class progerrors : public lifeerrors {
 public:
    progerrors() {}
-   virtual void fatal(const char *s) { cout << "Fatal error: " << s << endl ; exit(10) ; }
-   virtual void warning(const char *s) { cout << "Warning: " << s << endl ; }
+   virtual void fatal(const char *s) { *msgout << "Fatal error: " << s << endl ; exit(10) ; }
+   virtual void warning(const char *s) { *msgout << "Warning: " << s << endl ; }
    virtual void status(const char *s) { 
       if (benchmark)
-         cout << timestamp() << " " << s << endl ;
+         *msgout << timestamp() << " " << s << endl ;
       else {
          timestamp() ;
-         cout << s << endl ;
+         *msgout << s << endl ;
       }
    }
    virtual void beginprogress(const char *s) { abortprogress(0, s) ; }
@@ -94,14 +113,14 @@ bool progerrors::abortprogress(double, const char *) {
 class stderrors : public lifeerrors {
 public:
    stderrors() {}
-   virtual void fatal(const char *s) { cout << "Fatal error: " << s << endl ; exit(10) ; }
-   virtual void warning(const char *s) { cout << "Warning: " << s << endl ; }
+   virtual void fatal(const char *s) { *msgout << "Fatal error: " << s << endl ; exit(10) ; }
+   virtual void warning(const char *s) { *msgout << "Warning: " << s << endl ; }
    virtual void status(const char *s) {
       if (benchmark)
-         cout << timestamp() << " " << s << endl ;
+         *msgout << timestamp() << " " << s << endl ;
       else {
          timestamp() ;
-         cout << s << endl ;
+         *msgout << s << endl ;
       }
    }
    virtual void beginprogress(const char *) {}
@@ -122,23 +141,85 @@ struct options {
 } ;
 bigint maxgen = -1, inc = 0 ;
 int maxmem = 256 ;
+int numthreads = 1 ;
+int threaddepth = 0 ;
+int compactnodes ;
+int incgc, gcage ;
+int leafblock ;
+int showhash ;
+char *batchfile = 0 ;
+int stabilize ;
+bigint periodgens = -1, testperiod = -1 ;
+char *censusfile = 0 ;
+int soups = 1000 ;
+char *soupseed = (char *)"bgolly" ;
+int convert, mcbpops ;
+char *rcache = 0 ;
+int rcachesize = 1024 ;
+int rcachedepth = 10 ;
+char *checkpointfile = 0 ;
+int checkpointsecs = 600 ;
+bigint checkpointgens = 0 ;
+int resume ;
 int hyperxxx ;   // renamed hyper to avoid conflict with windows.h
 int render, autofit, quiet, popcount, progress ;
 int hashlife ;
 char *algoName = 0 ;
 int verbose ;
 int timeline ;
+int timelinebudget ;
 int stepthresh, stepfactor ;
 char *liferule = 0 ;
 char *outfilename = 0 ;
 char *renderscale = (char *)"1" ;
 char *testscript = 0 ;
-int outputgzip, outputismc ;
+int outputgzip ;
+pattern_format outputformat = RLE_format ;
 int numberoffset ; // where to insert file name numbers
 options options[] = {
   { "-m", "--generation", "How far to run", 'I', &maxgen },
   { "-i", "--stepsize", "Step size", 'I', &inc },
   { "-M", "--maxmemory", "Max memory to use in megabytes", 'i', &maxmem },
+  { "",   "--threads", "Number of threads to use (HashLife, QuickLife, LtL)",
+                                                       'i', &numthreads },
+  { "",   "--threaddepth", "Min node depth to compute in parallel", 'i',
+                                                             &threaddepth },
+  { "",   "--compactnodes", "Use the compact 32-bit node store (HashLife)", 'b',
+                                                            &compactnodes },
+  { "",   "--incgc", "Sweep garbage incrementally (hashing algos)", 'b', &incgc },
+  { "",   "--gcage", "Let gc drop results not reused since the last gc", 'b',
+                                                                   &gcage },
+  { "",   "--leafblock", "Block size stepped directly (4, 8 or 16; multi-state)",
+                                                             'i', &leafblock },
+  { "",   "--hash", "Show the hash of the pattern (as g.hash) with its population",
+                                                           'b', &showhash },
+  { "",   "--batch", "Run each pattern in a manifest (- is stdin) to -m gens",
+                                                            's', &batchfile },
+  { "",   "--stabilize", "In batch mode, stop a pattern once it repeats", 'b',
+                                                              &stabilize },
+  { "",   "--period", "Find the pattern's period within this many gens", 'I',
+                                                              &periodgens },
+  { "",   "--testperiod", "Check whether the pattern repeats after this many gens",
+                                                         'I', &testperiod },
+  { "",   "--census", "Write a census of random soups to this file", 's',
+                                                              &censusfile },
+  { "",   "--soups", "Number of soups for --census (default 1000)", 'i',
+                                                                  &soups },
+  { "",   "--seed", "Seed the --census soups are made from", 's', &soupseed },
+  { "",   "--rcache", "Result cache file shared across runs (HashLife)", 's',
+                                                                  &rcache },
+  { "",   "--rcachesize", "Size of a new result cache file in megabytes", 'i',
+                                                              &rcachesize },
+  { "",   "--rcachedepth", "Min node depth to look up in the result cache",
+                                                         'i', &rcachedepth },
+  { "",   "--checkpoint", "Save the run to this file now and then", 's',
+                                                          &checkpointfile },
+  { "",   "--checkpointsecs", "Seconds between checkpoints (default 600)",
+                                                     'i', &checkpointsecs },
+  { "",   "--checkpointgens", "Generations between checkpoints", 'I',
+                                                          &checkpointgens },
+  { "",   "--resume", "Carry on from the checkpoint file if there is one",
+                                                               'b', &resume },
   { "-T", "--maxtime", "Max duration", 'i', &maxtime },
   { "-b", "--benchmark", "Show timestamps", 'b', &benchmark },
   { "-2", "--exponential", "Use exponentially increasing steps", 'b', &hyperxxx },
@@ -147,10 +228,15 @@ options options[] = {
   { "-s", "--search", "Search directory for .rule files", 's', &user_rules },
   { "-h", "--hashlife", "Use Hashlife algorithm", 'b', &hashlife },
   { "-a", "--algorithm", "Select algorithm by name", 's', &algoName },
-  { "-o", "--output", "Output file (*.rle, *.mc, *.rle.gz, *.mc.gz)", 's',
+  { "-o", "--output", "Output file (*.rle, *.mc, *.mcb, optionally .gz)", 's',
                                                                &outfilename },
+  { "",   "--mcbpops", "Store node populations in *.mcb output", 'b', &mcbpops },
+  { "",   "--convert", "Write the pattern to the output file and exit", 'b',
+                                                                 &convert },
   { "-v", "--verbose", "Verbose", 'b', &verbose },
   { "-t", "--timeline", "Use timeline", 'b', &timeline },
+  { "",   "--timelinebudget", "Timeline memory in megabytes (default -M/2)",
+                                                     'i', &timelinebudget },
   { "",   "--render", "Render (benchmarking)", 'b', &render },
   { "",   "--progress", "Render during progress dialog (debugging)", 'b', &progress },
   { "",   "--popcount", "Popcount (benchmarking)", 'b', &popcount },
@@ -177,7 +263,7 @@ int endswith(const char *s, const char *suff) {
 }
 
 void usage(const char *s) {
-  fprintf(stderr, "Usage:  bgolly [options] patternfile\n") ;
+  fprintf(stderr, "Usage:  bgolly [options] patternfile (- reads standard input)\n") ;
   for (int i=0; options[i].shortopt; i++)
     fprintf(stderr, "%3s %-15s %s\n", options[i].shortopt, options[i].longopt,
             options[i].desc) ;
@@ -188,8 +274,8 @@ void usage(const char *s) {
 
 #define STRINGIFY(ARG) STR2(ARG)
 #define STR2(ARG) #ARG
-#define MAXRLE 1000000000
 void writepat(int fc) {
+   finishcheckpoint() ;   // writing macrocells marks the nodes
    char *thisfilename = outfilename ;
    char tmpfilename[256] ;
    if (fc >= 0) {
@@ -204,17 +290,121 @@ void writepat(int fc) {
    cerr << "(->" << thisfilename << flush ;
    bigint t, l, b, r ;
    imp->findedges(&t, &l, &b, &r) ;
-   if (!outputismc && (t < -MAXRLE || l < -MAXRLE || b > MAXRLE || r > MAXRLE))
-      lifefatal("Pattern too large to write in RLE format") ;
    const char *err = writepattern(thisfilename, *imp,
-                                  outputismc ? MC_format : RLE_format,
+                                  outputformat,
                                   outputgzip ? gzip_compression : no_compression,
-                                  t.toint(), l.toint(), b.toint(), r.toint()) ;
+                                  t, l, b, r) ;
    if (err != 0)
       lifewarning(err) ;
    cerr << ")" << flush ;
 }
 
+/*
+ *   Checkpoints.  Now and then the run is saved to checkpointfile, as a
+ *   macrocell file if the algorithm can write one and as extended RLE
+ *   otherwise, with a comment line giving the step settings for
+ *   --resume.  It's written to a .tmp file that is then renamed over
+ *   the last one, so a crash always leaves a whole checkpoint behind.
+ *   HashLife writes from a snapshot on another thread while this one
+ *   goes on stepping.
+ */
+thread *checkpointer = 0 ;
+hsnapshot *checkpointsnap = 0 ;
+const char *checkpointerr = 0 ;
+atomic<bool> checkpointdone(true) ;
+double lastcheckpoint ;
+bigint lastcheckpointgen ;
+int resumefc ;
+const char *commitcheckpoint(const string &tmpname) {
+#ifdef _WIN32
+   remove(checkpointfile) ;   // rename won't replace an existing file
+#else
+   int fd = open(tmpname.c_str(), O_RDONLY) ;
+   if (fd < 0)
+      return "Can't open checkpoint file to sync it" ;
+   int synced = fsync(fd) ;
+   close(fd) ;
+   if (synced != 0)
+      return "Can't sync checkpoint file" ;
+#endif
+   if (rename(tmpname.c_str(), checkpointfile) != 0)
+      return "Can't rename checkpoint file" ;
+   return 0 ;
+}
+void finishcheckpoint() {
+   if (checkpointer == 0)
+      return ;
+   checkpointer->join() ;
+   delete checkpointer ;
+   checkpointer = 0 ;
+   ((hlifealgo *)imp)->releasesnapshot(checkpointsnap) ;
+   checkpointsnap = 0 ;
+   if (checkpointerr)
+      lifewarning(checkpointerr) ;
+}
+void writecheckpoint(int fc) {
+   finishcheckpoint() ;
+   string comments = "#C bgolly checkpoint step " ;
+   comments += inc.tostring('\0') ;
+   comments += hyperxxx ? " exponential 1" : " exponential 0" ;
+   comments += " outputs " + to_string(fc) + "\n" ;
+   string tmpname = string(checkpointfile) + ".tmp" ;
+   if (strcmp(algoName, "HashLife") == 0) {
+      hlifealgo *hl = (hlifealgo *)imp ;
+      checkpointsnap = hl->snapshot() ;
+      checkpointerr = 0 ;
+      checkpointdone = false ;
+      checkpointer = new thread([hl, comments, tmpname]() {
+         ofstream os(tmpname.c_str()) ;
+         const char *err = "Can't create checkpoint file" ;
+         if (os)
+            err = hl->writesnapshot(checkpointsnap, os, comments.c_str()) ;
+         os.close() ;
+         if (err == 0)
+            err = commitcheckpoint(tmpname) ;
+         checkpointerr = err ;
+         checkpointdone = true ;
+      }) ;
+   } else {
+      bigint t, l, b, r ;
+      imp->findedges(&t, &l, &b, &r) ;
+      const char *err = writepattern(tmpname.c_str(), *imp,
+                            imp->hyperCapable() ? MC_format : XRLE_format,
+                            no_compression, t, l, b, r, comments.c_str()) ;
+      if (err == 0)
+         err = commitcheckpoint(tmpname) ;
+      if (err)
+         lifewarning(err) ;
+   }
+   lastcheckpoint = gollySecondCount() ;
+   lastcheckpointgen = imp->getGeneration() ;
+}
+/*
+ *   Take back the step settings from a checkpoint's comments; -i and
+ *   -2 given now win.
+ */
+void readcheckpointsettings() {
+   char *comments = 0 ;
+   const char *err = readcomments(checkpointfile, &comments) ;
+   if (err == 0 && comments) {
+      const char *key = "#C bgolly checkpoint step " ;
+      char *p = strstr(comments, key) ;
+      if (p) {
+         char step[256] ;
+         int exponential = 0 ;
+         if (sscanf(p + strlen(key), "%255s exponential %d outputs %d", step,
+                    &exponential, &resumefc) == 3) {
+            if (inc == 0)
+               inc = bigint(step) ;
+            if (exponential)
+               hyperxxx = 1 ;
+         }
+      }
+   }
+   if (comments)
+      free(comments) ;
+}
+
 const int MAXCMDLENGTH = 2048 ;
 struct cmdbase {
    cmdbase(const char *cmdarg, const char *argsarg) {
@@ -442,13 +632,29 @@ lifealgo *createUniverse() {
    }
    staticAlgoInfo *ai = staticAlgoInfo::byName(algoName) ;
    if (ai == 0) {
-      cout << algoName << endl ; //!!!
+      *msgout << algoName << endl ; //!!!
       lifefatal("No such algorithm") ;
    }
-   lifealgo *imp = (ai->creator)() ;
+   lifealgo *imp ;
+   if (compactnodes && strcmp(algoName, "HashLife") == 0)
+      imp = new hlifealgo(1) ;
+   else
+      imp = (ai->creator)() ;
    if (imp == 0)
       lifefatal("Could not create universe") ;
    imp->setMaxMemory(maxmem) ;
+   imp->setNumThreads(numthreads) ;
+   imp->setGCMode(incgc, gcage) ;
+   if (leafblock)
+      imp->setLeafBlock(leafblock) ;
+   if (threaddepth > 0 && strcmp(algoName, "HashLife") == 0)
+      ((hlifealgo *)imp)->setThreadDepth(threaddepth) ;
+   if (rcache && strcmp(algoName, "HashLife") == 0) {
+      const char *err = ((hlifealgo *)imp)->setResultCache(rcache, rcachesize,
+                                                           rcachedepth) ;
+      if (err)
+         lifefatal(err) ;
+   }
    return imp ;
 }
 
@@ -489,6 +695,334 @@ struct edgescmd : public cmdbase {
       cout << " " << b.tostring() << endl ;
    }
 } edges_inst ;
+/*
+ *   The hash of the pattern's bounding box, folded to an int as g.hash
+ *   gives it.
+ */
+int patternhash() {
+   bigint t, l, b, r ;
+   imp->findedges(&t, &l, &b, &r) ;
+   cellhash::value h = imp->gethash(t, l, b, r) ;
+   return (int)(h ^ (h >> 32)) ;
+}
+/*
+ *   --period and --testperiod.
+ */
+void runperiod() {
+   periodfinder finder(*imp) ;
+   double t0 = gollySecondCount() ;
+   if (testperiod >= 0)
+      finder.test(testperiod) ;
+   else
+      finder.find(periodgens) ;
+   double secs = gollySecondCount() - t0 ;
+   if (finder.found) {
+      cout << "period " << finder.period.tostring() ;
+      if (finder.dx != 0 || finder.dy != 0)
+         cout << ", moving " << finder.dx.tostring() << ","
+              << finder.dy.tostring() ;
+      cout << " (generation " << finder.start.tostring() << " repeats at "
+           << imp->getGeneration().tostring() << ")" ;
+   } else if (testperiod >= 0) {
+      cout << "no repeat after " << testperiod.tostring() << " generations" ;
+   } else {
+      cout << "no period found by generation " << imp->getGeneration().tostring() ;
+   }
+   cout << " in " << secs << " s" << endl ;
+}
+
+string jsonstring(const string &s) {
+   string r = "\"" ;
+   for (size_t i=0; i<s.size(); i++) {
+      unsigned char c = s[i] ;
+      if (c == '"' || c == '\\') {
+         r += '\\' ;
+         r += c ;
+      } else if (c < ' ') {
+         char buf[8] ;
+         sprintf(buf, "\\u%04x", c) ;
+         r += buf ;
+      } else
+         r += c ;
+   }
+   return r + "\"" ;
+}
+
+/*
+ *   The patterns for --batch.  Each line of the manifest names a pattern
+ *   file, except that RLE text can be given inline from an "x = ..." line
+ *   to the line with the "!", so a stream of soups can be piped in.
+ *   Blank lines and lines starting with # are skipped.
+ */
+struct batchitem {
+   size_t seq ;
+   string name ;                       // file name, or manifest:line
+   string rle ;                        // inline RLE text, if any
+} ;
+
+class batchmanifest {
+public:
+   batchmanifest(FILE *farg, const char *namearg)
+      : f(farg), name(namearg), lineno(0), count(0) {}
+   bool getline(string &line) {
+      line.clear() ;
+      int c ;
+      while ((c = getc(f)) != EOF && c != '\n')
+         if (c != '\r')
+            line += (char)c ;
+      if (c == EOF && line.empty())
+         return false ;
+      lineno++ ;
+      return true ;
+   }
+   bool next(batchitem &item) {
+      string line ;
+      while (getline(line)) {
+         size_t i = line.find_first_not_of(" \t") ;
+         if (i == string::npos || line[i] == '#')
+            continue ;
+         item.seq = count++ ;
+         item.rle.clear() ;
+         if (line[i] == 'x' && line.find('=', i) != string::npos &&
+             line.find_first_not_of(" \t", i + 1) == line.find('=', i)) {
+            char where[32] ;
+            sprintf(where, ":%d", lineno) ;
+            item.name = name + where ;
+            item.rle = line + "\n" ;
+            while (line.find('!') == string::npos && getline(line))
+               item.rle += line + "\n" ;
+         } else {
+            item.name = line.substr(i, line.find_last_not_of(" \t") + 1 - i) ;
+         }
+         return true ;
+      }
+      return false ;
+   }
+private:
+   FILE *f ;
+   string name ;
+   int lineno ;
+   size_t count ;
+} ;
+
+/*
+ *   Read one batch pattern into the engine, run it, and describe the
+ *   result as a line of JSON.
+ */
+string runbatchitem(lifealgo &e, const batchitem &item) {
+   string json = "{\"pattern\":" + jsonstring(item.name) ;
+   e.clearall() ;
+   patternreader reader ;
+   const char *err = 0 ;
+   if (!item.rle.empty())
+      reader.openmemory(item.rle.data(), item.rle.size()) ;
+   else if (!reader.openfile(item.name.c_str()))
+      err = "Can't open pattern file" ;
+   if (err == 0)
+      err = readpattern(reader, e) ;
+   if (err == 0 && liferule)
+      err = e.setrule(liferule) ;
+   if (err)
+      return json + ",\"error\":" + jsonstring(err) + "}" ;
+   bool bounded = e.unbounded && (e.gridwd > 0 || e.gridht > 0) ;
+   periodfinder finder(e) ;
+   if (stabilize) {
+      // stop at the first repeat, whatever the algorithm
+      finder.jumpahead = 0 ;
+      bigint gens = maxgen ;
+      gens -= e.getGeneration() ;
+      finder.find(gens) ;
+   } else {
+      while (e.getGeneration() < maxgen) {
+         bigint diff = maxgen ;
+         diff -= e.getGeneration() ;
+         if (bounded)
+            diff = 1 ;
+         else if (inc > 0 && inc < diff)
+            diff = inc ;
+         else if (inc == 0) {
+            int bs = diff.lowbitset() ;
+            diff = 1 ;
+            diff <<= bs ;
+         }
+         e.setIncrement(diff) ;
+         if (bounded && !e.CreateBorderCells())
+            break ;
+         e.step() ;
+         if (bounded && !e.DeleteBorderCells())
+            break ;
+      }
+   }
+   patternsig sig ;
+   finder.sign(sig) ;
+   json += ",\"rule\":" + jsonstring(e.getrule()) ;
+   json += ",\"generation\":" + string(e.getGeneration().tostring('\0')) ;
+   json += ",\"population\":" + string(sig.pop.tostring('\0')) ;
+   if (sig.wd != 0) {
+      json += ",\"bbox\":[" + string(sig.left.tostring('\0')) ;
+      json += "," + string(sig.top.tostring('\0')) ;
+      json += "," + string(sig.wd.tostring('\0')) ;
+      json += "," + string(sig.ht.tostring('\0')) + "]" ;
+   } else
+      json += ",\"bbox\":null" ;
+   char buf[40] ;
+   sprintf(buf, ",\"hash\":\"%016llx\"", (unsigned long long)sig.hash) ;
+   json += buf ;
+   if (finder.found) {
+      json += ",\"period\":" + string(finder.period.tostring('\0')) ;
+      json += ",\"dx\":" + string(finder.dx.tostring('\0')) ;
+      json += ",\"dy\":" + string(finder.dy.tostring('\0')) ;
+   }
+   return json + "}" ;
+}
+
+/*
+ *   Batch mode:  run every pattern in the manifest on --threads threads,
+ *   each with an engine of its own that is cleared and reused from one
+ *   pattern to the next, and write the results as JSON lines in manifest
+ *   order.
+ */
+void runbatch() {
+   if (maxgen < 0)
+      lifefatal("--batch needs -m (the generation to stop at)") ;
+   FILE *f = strcmp(batchfile, "-") == 0 ? stdin : fopen(batchfile, "r") ;
+   if (f == 0)
+      lifefatal("Can't open the batch manifest") ;
+   batchmanifest manifest(f, strcmp(batchfile, "-") == 0 ? "stdin" : batchfile) ;
+   int nthreads = numthreads > 1 ? numthreads : 1 ;
+   vector<lifealgo *> engines ;
+   vector<lifepoll> pollers(nthreads) ;
+   char *rcachefile = rcache ;
+   for (int t=0; t<nthreads; t++) {
+      // only one engine can own the result cache
+      rcache = t ? 0 : rcachefile ;
+      engines.push_back(createUniverse()) ;
+      engines[t]->setNumThreads(1) ;
+      engines[t]->setpoll(&pollers[t]) ;
+   }
+   rcache = rcachefile ;
+   mutex inlock, outlock ;
+   map<size_t, string> done ;
+   size_t nextout = 0 ;
+   auto worker = [&](int t) {
+      batchitem item ;
+      for (;;) {
+         {
+            lock_guard<mutex> lock(inlock) ;
+            if (!manifest.next(item))
+               break ;
+         }
+         string json = runbatchitem(*engines[t], item) ;
+         lock_guard<mutex> lock(outlock) ;
+         done[item.seq] = json ;
+         while (!done.empty() && done.begin()->first == nextout) {
+            cout << done.begin()->second << '\n' ;
+            done.erase(done.begin()) ;
+            nextout++ ;
+         }
+      }
+   } ;
+   vector<thread> threads ;
+   for (int t=1; t<nthreads; t++)
+      threads.push_back(thread(worker, t)) ;
+   worker(0) ;
+   for (size_t t=0; t<threads.size(); t++)
+      threads[t].join() ;
+   cout << flush ;
+   if (f != stdin)
+      fclose(f) ;
+   for (int t=0; t<nthreads; t++)
+      delete engines[t] ;
+}
+
+/*
+ *   Census mode:  run --soups soups made from --seed on --threads
+ *   threads, each with a soup universe and a scratch universe of its own,
+ *   and write the objects they settle into to the census file, most
+ *   common first, with the first soup each was seen in.  -m overrides
+ *   how long a soup is given to settle.
+ */
+void runcensus() {
+   if (soups <= 0)
+      lifefatal("--census needs a positive number of --soups") ;
+   int nthreads = numthreads > 1 ? numthreads : 1 ;
+   vector<lifealgo *> soupalgos, scratchalgos ;
+   vector<lifepoll> pollers(2 * nthreads) ;
+   char *rcachefile = rcache ;
+   for (int t=0; t<2*nthreads; t++) {
+      // only one engine can own the result cache
+      rcache = t ? 0 : rcachefile ;
+      lifealgo *e = createUniverse() ;
+      const char *err = e->setrule(liferule ? liferule : e->DefaultRule()) ;
+      if (err)
+         lifefatal(err) ;
+      if ((t & 1) && strcmp(algoName, "QuickLife") != 0) {
+         // lone objects are stepped one generation at a time, which
+         // QuickLife does best, if it can run the rule
+         lifealgo *q = staticAlgoInfo::byName("QuickLife")->creator() ;
+         if (q->setrule(e->getrule()) == 0) {
+            delete e ;
+            e = q ;
+         } else
+            delete q ;
+      }
+      e->setNumThreads(1) ;
+      e->setpoll(&pollers[t]) ;
+      if (e->NumCellStates() != 2)
+         lifefatal("--census needs a two-state rule") ;
+      if (e->gridwd > 0 || e->gridht > 0)
+         lifefatal("--census needs an unbounded universe") ;
+      (t & 1 ? scratchalgos : soupalgos).push_back(e) ;
+   }
+   rcache = rcachefile ;
+   vector<censustally> tallies(nthreads) ;
+   atomic<int> nextsoup(0) ;
+   auto worker = [&](int t) {
+      soupcensus census(*soupalgos[t], *scratchalgos[t]) ;
+      if (maxgen >= 0)
+         census.maxgens = maxgen ;
+      for (;;) {
+         int n = nextsoup++ ;
+         if (n >= soups)
+            break ;
+         census.runsoup(soupseed, n, tallies[t]) ;
+      }
+   } ;
+   double t0 = gollySecondCount() ;
+   vector<thread> threads ;
+   for (int t=1; t<nthreads; t++)
+      threads.push_back(thread(worker, t)) ;
+   worker(0) ;
+   for (size_t t=0; t<threads.size(); t++)
+      threads[t].join() ;
+   double secs = gollySecondCount() - t0 ;
+   censustally tally ;
+   for (int t=0; t<nthreads; t++)
+      soupcensus::merge(tally, tallies[t]) ;
+   vector<pair<string, censusentry> > rows(tally.begin(), tally.end()) ;
+   stable_sort(rows.begin(), rows.end(),
+               [](const pair<string, censusentry> &a,
+                  const pair<string, censusentry> &b) {
+                  return a.second.count > b.second.count ;
+               }) ;
+   FILE *f = fopen(censusfile, "w") ;
+   if (f == 0)
+      lifefatal("Can't create the census file") ;
+   fprintf(f, "# census of %d C1 soups, seed %s, rule %s\n", soups, soupseed,
+           soupalgos[0]->getrule()) ;
+   for (size_t i=0; i<rows.size(); i++)
+      fprintf(f, "%s %lld %s%lld\n", rows[i].first.c_str(),
+              (long long)rows[i].second.count, soupseed,
+              (long long)rows[i].second.firstsoup) ;
+   if (fclose(f) != 0)
+      lifefatal("Can't write the census file") ;
+   cout << soups << " soups in " << secs << " s (" << (soups / secs)
+        << " soups/s), " << rows.size() << " kinds of object" << endl ;
+   for (int t=0; t<nthreads; t++) {
+      delete soupalgos[t] ;
+      delete scratchalgos[t] ;
+   }
+}
 
 void runtestscript(const char *testscript) {
    FILE *cmdfile = 0 ;
@@ -513,12 +1047,16 @@ void runtestscript(const char *testscript) {
 }
 
 int main(int argc, char *argv[]) {
-   cout << "This is bgolly " STRINGIFY(VERSION) " Copyright 2005-2020 The Golly Gang."
-        << endl ;
-   cout << "-" ;
+   // in batch mode stdout carries nothing but the JSON lines
+   for (int i=1; i<argc; i++)
+      if (strcmp(argv[i], "--batch") == 0)
+         msgout = &cerr ;
+   *msgout << "This is bgolly " STRINGIFY(VERSION) " Copyright 2005-2020 The Golly Gang."
+           << endl ;
+   *msgout << "-" ;
    for (int i=0; i<argc; i++)
-      cout << " " << argv[i] ;
-   cout << endl << flush ;
+      *msgout << " " << argv[i] ;
+   *msgout << endl << flush ;
    qlifealgo::doInitializeAlgoInfo(staticAlgoInfo::tick()) ;
    hlifealgo::doInitializeAlgoInfo(staticAlgoInfo::tick()) ;
    generationsalgo::doInitializeAlgoInfo(staticAlgoInfo::tick()) ;
@@ -526,7 +1064,7 @@ int main(int argc, char *argv[]) {
    jvnalgo::doInitializeAlgoInfo(staticAlgoInfo::tick()) ;
    superalgo::doInitializeAlgoInfo(staticAlgoInfo::tick()) ;
    ruleloaderalgo::doInitializeAlgoInfo(staticAlgoInfo::tick()) ;
-   while (argc > 1 && argv[1][0] == '-') {
+   while (argc > 1 && argv[1][0] == '-' && argv[1][1] != 0) {
       argc-- ;
       argv++ ;
       char *opt = argv[0] ;
@@ -567,24 +1105,31 @@ case 's':
       if (!hit)
          usage("Bad option given") ;
    }
-   if (argc < 2 && !testscript)
+   if (argc < 2 && !testscript && !batchfile && !censusfile)
       usage("No pattern argument given") ;
    if (argc > 2)
       usage("Extra stuff after pattern argument") ;
    if (outfilename) {
       if (endswith(outfilename, ".rle")) {
       } else if (endswith(outfilename, ".mc")) {
-         outputismc = 1 ;
+         outputformat = MC_format ;
+      } else if (endswith(outfilename, ".mcb")) {
+         outputformat = MCB_format ;
 #ifdef ZLIB
       } else if (endswith(outfilename, ".rle.gz")) {
          outputgzip = 1 ;
       } else if (endswith(outfilename, ".mc.gz")) {
-         outputismc = 1 ;
+         outputformat = MC_format ;
+         outputgzip = 1 ;
+      } else if (endswith(outfilename, ".mcb.gz")) {
+         outputformat = MCB_format ;
          outputgzip = 1 ;
 #endif
       } else {
-         lifefatal("Output filename must end with .rle or .mc.") ;
+         lifefatal("Output filename must end with .rle, .mc or .mcb.") ;
       }
+      if (mcbpops && outputformat == MCB_format)
+         outputformat = MCBP_format ;
       if (strlen(outfilename) > 200)
          lifefatal("Output filename too long") ;
    }
@@ -599,7 +1144,16 @@ case 's':
       hlifealgo::setVerbose(1) ;
    }
    imp->setMaxMemory(maxmem) ;
+   setgzipthreads(numthreads) ;
    timestamp() ;
+   if (batchfile) {
+      runbatch() ;
+      exit(0) ;
+   }
+   if (censusfile) {
+      runcensus() ;
+      exit(0) ;
+   }
    if (testscript) {
       if (argc > 1) {
          filename = argv[1] ;
@@ -609,12 +1163,45 @@ case 's':
       runtestscript(testscript) ;
    }
    filename = argv[1] ;
-   const char *err = readpattern(argv[1], *imp) ;
+   if (resume) {
+      if (checkpointfile == 0)
+         lifefatal("--resume needs a --checkpoint file") ;
+      FILE *f = fopen(checkpointfile, "r") ;
+      if (f) {
+         fclose(f) ;
+         filename = checkpointfile ;
+         readcheckpointsettings() ;
+         cout << "resuming from " << checkpointfile << endl ;
+      } else
+         resume = 0 ;
+   }
+   const char *err ;
+   if (resume) {
+      err = readpattern(checkpointfile, *imp) ;
+   } else if (strcmp(argv[1], "-") == 0) {
+      // read the pattern from a pipe
+      patternreader reader ;
+      if (!reader.openstream(stdin))
+         lifefatal("Can't read pattern from standard input") ;
+      err = readpattern(reader, *imp) ;
+   } else
+      err = readpattern(argv[1], *imp) ;
    if (err) lifefatal(err) ;
    if (liferule) {
       err = imp->setrule(liferule) ;
       if (err) lifefatal(err) ;
    }
+   if (periodgens >= 0 || testperiod >= 0) {
+      runperiod() ;
+      exit(0) ;
+   }
+   if (convert) {
+      if (outfilename == 0)
+         lifefatal("--convert needs an output file") ;
+      writepat(-1) ;
+      cerr << endl ;
+      exit(0) ;
+   }
    bool boundedgrid = imp->unbounded && (imp->gridwd > 0 || imp->gridht > 0) ;
    if (boundedgrid) {
       if (hyperxxx || inc > 1)
@@ -624,6 +1211,8 @@ case 's':
    }
    if (inc != 0)
       imp->setIncrement(inc) ;
+   else if (hyperxxx && imp->getGeneration() > 0)
+      imp->setIncrement(imp->getGeneration()) ;   // a resumed -2 run
    if (timeline) {
       int lowbit = inc.lowbitset() ;
       bigint t = 1 ;
@@ -631,9 +1220,12 @@ case 's':
          t.mul_smallint(2) ;
       if (t != inc)
          lifefatal("Bad increment for timeline") ;
+      imp->settimelinebudget(timelinebudget) ;
       imp->startrecording(2, lowbit) ;
    }
-   int fc = 0 ;
+   int fc = resumefc ;
+   lastcheckpoint = gollySecondCount() ;
+   lastcheckpointgen = imp->getGeneration() ;
    for (;;) {
       if (benchmark)
          cout << timestamp() << " " ;
@@ -647,7 +1239,10 @@ case 's':
                cout << endl ;
                cout << timestamp() << " pop " << s << endl ;
             } else {
-               cout << ": " << s << endl ;
+               cout << ": " << s ;
+               if (showhash)
+                  cout << " hash " << patternhash() ;
+               cout << endl ;
             }
          } else
             cout << endl ;
@@ -674,12 +1269,34 @@ case 's':
       if (timeline) imp->extendtimeline() ;
       if (maxgen < 0 && outfilename != 0)
          writepat(fc++) ;
-      if (timeline && imp->getframecount() + 2 > MAX_FRAME_COUNT)
-         imp->pruneframes() ;
+      if (checkpointfile && checkpointdone) {
+         bigint gens = imp->getGeneration() ;
+         gens -= lastcheckpointgen ;
+         if ((checkpointsecs > 0 &&
+              gollySecondCount() - lastcheckpoint >= checkpointsecs) ||
+             (checkpointgens > 0 && gens >= checkpointgens))
+            writecheckpoint(fc) ;
+      }
       if (hyperxxx)
          imp->setIncrement(imp->getGeneration()) ;
    }
+   finishcheckpoint() ;
    if (maxgen >= 0 && outfilename != 0)
       writepat(-1) ;
+   if (benchmark && strcmp(algoName, "HashLife") == 0) {
+      g_uintptr_t nodes, slots, bytes ;
+      ((hlifealgo *)imp)->getNodeStats(nodes, slots, bytes) ;
+      cout << timestamp() << " nodes " << nodes << " slots " << slots
+           << " memory " << (bytes >> 20) << "MB nodes/GB "
+           << (g_uintptr_t)(slots * 1073741824.0 / (bytes ? bytes : 1))
+           << endl ;
+   }
+   if (rcache && strcmp(algoName, "HashLife") == 0) {
+      double hits, misses, stores ;
+      ((hlifealgo *)imp)->getResultCacheStats(hits, misses, stores) ;
+      cout << "result cache hits " << hits << " misses " << misses
+           << " hit ratio " << (hits + misses > 0 ? hits / (hits + misses) : 0)
+           << " stored " << stores << endl ;
+   }
    exit(0) ;
 }
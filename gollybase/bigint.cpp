@@ -15,12 +15,79 @@ using namespace std ;
  */
 static const int MAX_SIMPLE = 0x3fffffff ;
 static const int MIN_SIMPLE = -0x40000000 ;
-char *bigint::printbuf ;
-int *bigint::work ;
-int bigint::printbuflen ;
-int bigint::workarrlen ;
+thread_local char *bigint::printbuf ;
+thread_local int *bigint::work ;
+thread_local int bigint::printbuflen ;
+thread_local int bigint::workarrlen ;
 char bigint::sepchar = ',' ;
 int bigint::sepcount = 3 ;
+/**
+ *   Word arrays of up to 64 ints come from per-thread free lists, one
+ *   for each power-of-two size, rather than from the heap each time.
+ *   An array freed by another thread than the one that made it just
+ *   joins the freeing thread's list.  Since shrinking a bigint doesn't
+ *   reallocate, an array can be bigger than its used size says; it is
+ *   filed under the size it would have been given, which is never more
+ *   than it really has.
+ */
+static const int POOLSIZES = 5 ;        // 4, 8, 16, 32 and 64 ints
+static const int POOLDEPTH = 256 ;      // arrays kept per size per thread
+static thread_local int *poolfree[POOLSIZES] ;
+static thread_local int poolcount[POOLSIZES] ;
+static thread_local bool poolinuse, poolgone ;
+struct bigintpool {
+   bool armed ;
+   ~bigintpool() {
+      for (int i=0; i<POOLSIZES; i++)
+         while (poolfree[i]) {
+            int *p = poolfree[i] ;
+            memcpy(&poolfree[i], p, sizeof(int *)) ;
+            delete [] p ;
+         }
+      poolgone = true ;
+   }
+} ;
+static thread_local bigintpool poolreaper ;
+// the array size for a used size; always a power of two, at least 4
+static int arrsize(int used) {
+   int sz = used ;
+   while (sz & (sz - 1))
+      sz &= sz - 1 ;
+   sz *= 2 ;
+   return sz < 4 ? 4 : sz ;
+}
+static int poolsize(int sz) {
+   int i = 0 ;
+   while ((4 << i) < sz)
+      i++ ;
+   return i ;
+}
+static int *newarr(int sz) {
+   int i = poolsize(sz) ;
+   if (i < POOLSIZES && poolfree[i]) {
+      int *p = poolfree[i] ;
+      memcpy(&poolfree[i], p, sizeof(int *)) ;
+      poolcount[i]-- ;
+      return p ;
+   }
+   return new int[sz] ;
+}
+static void freearr(int *p) {
+   int i = poolsize(arrsize(p[0])) ;
+   if (i < POOLSIZES && poolcount[i] < POOLDEPTH && !poolgone) {
+      if (!poolinuse) {
+         // touching the reaper makes sure the lists are freed when the
+         // thread exits
+         poolreaper.armed = true ;
+         poolinuse = true ;
+      }
+      memcpy(p, &poolfree[i], sizeof(int *)) ;
+      poolfree[i] = p ;
+      poolcount[i]++ ;
+   } else {
+      delete [] p ;
+   }
+}
 /**
  *   Routines.
  */
@@ -52,7 +119,7 @@ bigint::bigint(const char *s) {
          while (asz & (asz - 1))
             asz &= asz - 1 ;
          asz *= 2 ;
-         v.p = new int[asz] ;
+         v.p = newarr(asz) ;
          v.p[0] = sz ;
          for (int i=1; i<=sz; i++)
             v.p[i] = 0 ;
@@ -79,11 +146,8 @@ bigint::bigint(const char *s) {
    }
 }
 static int *copyarr(int *p) {
-   int sz = *p ;
-   while (sz & (sz - 1))
-      sz &= sz - 1 ;
-   sz *= 2 ;
-   int *r = new int[sz] ;
+   int sz = arrsize(*p) ;
+   int *r = newarr(sz) ;
    memcpy(r, p, sizeof(int) * (p[0] + 1)) ;
 #ifdef SLOWCHECK
    for (int i=p[0]+1; i<sz; i++)
@@ -105,7 +169,7 @@ bigint &bigint::operator=(const bigint &b) {
    if (&b != this) {
       if (0 == (v.i & 1))
          if (v.p)
-            delete [] v.p ;
+            freearr(v.p) ;
       if (b.v.i & 1)
          v.i = b.v.i ;
       else
@@ -115,7 +179,7 @@ bigint &bigint::operator=(const bigint &b) {
 }
 bigint::~bigint() {
    if (0 == (v.i & 1))
-      delete [] v.p ;
+      freearr(v.p) ;
 }
 bigint::bigint(const bigint &a, const bigint &b, const bigint &c, const bigint &d) {
    const int checkmask = 0xf0000001 ;
@@ -202,14 +266,14 @@ void bigint::grow(int osz, int nsz) {
    if (bdiffs > osz) {
       while (bdiffs & (bdiffs - 1))
          bdiffs &= bdiffs - 1 ;
-      int *nv = new int[2*bdiffs] ;
+      int *nv = newarr(2*bdiffs) ;
       for (int i=0; i<=osz; i++)
          nv[i] = v.p[i] ;
 #ifdef SLOWCHECK
       for (int i=osz+1; i<2*bdiffs; i++)
          nv[i] = 0xdeadbeef ;
 #endif
-      delete [] v.p ;
+      freearr(v.p) ;
       v.p = nv ;
    }
    int av = v.p[osz] ;
@@ -268,11 +332,11 @@ void bigint::shrink(int pos) {
    }
    if (pos == 1) {
       int c = v.p[1] ;
-      delete [] v.p ;
+      freearr(v.p) ;
       v.i = 1 | (c << 1) ;
    } else if (pos == 2 && ((v.p[2] ^ v.p[1]) & 0x40000000) == 0) {
       int c = v.p[1] + (v.p[2] << 31) ;
-      delete [] v.p ;
+      freearr(v.p) ;
       v.i = 1 | (c << 1) ;
    }
 }
@@ -332,7 +396,7 @@ void bigint::ripplesub(const bigint &a, int carry) {
 }
 // make sure it's in vector form; may leave it not canonical!
 void bigint::vectorize(int i) {
-   v.p = new int[4] ;
+   v.p = newarr(4) ;
    v.p[0] = 2 ;
    v.p[1] = i & 0x7fffffff ;
    if (i < 0)
@@ -691,6 +755,17 @@ int bigint::toint() const {
       return (v.i >> 1) ;
    return (v.p[v.p[0]] << 31) | v.p[1] ;
 }
+/**
+ *   Return a 64-bit int.
+ */
+G_INT64 bigint::toint64() const {
+   if (v.i & 1)
+      return (v.i >> 1) ;
+   G_INT64 r = v.p[v.p[0]] ;
+   for (int i=v.p[0]-1; i>0; i--)
+      r = (G_INT64)((unsigned G_INT64)r << 31) | v.p[i] ;
+   return r ;
+}
 /**
  *   How many bits required to represent this, approximately?
  *   Should overestimate but not by too much.
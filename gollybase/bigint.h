@@ -18,9 +18,11 @@
  *   lot of allocation/deallocation during copy and assignment, or
  *   (preferably, for efficiency) you can use it as a mutating
  *   class, with +=, -=, and the like operators that will not
- *   allocate/free unnecessarily.
+ *   allocate/free unnecessarily.  Moving a bigint never allocates.
  *
- *   We'll add mempool support soon.
+ *   The int arrays of all but huge bigints are recycled through small
+ *   per-thread pools, so even the allocations that do happen seldom
+ *   reach the heap.
  *
  *   If we are using an int array, each holds 31 bits of the number.
  *   All elements except the last are in the range 0..2^31-1; the
@@ -95,10 +97,17 @@ public:
    bigint(G_INT64 i) ;
    bigint(const char *s) ;
    bigint(const bigint &a) ;
+   bigint(bigint &&a) noexcept { v = a.v ; a.v.i = 1 ; }
    // create a new bigint by adding four other bigints; fastpath for popcount
    bigint(const bigint &a, const bigint &b, const bigint &c, const bigint &d) ;
    ~bigint() ;
    bigint& operator=(const bigint &a) ;
+   bigint& operator=(bigint &&a) noexcept {
+      int *t = v.p ;
+      v.p = a.v.p ;
+      a.v.p = t ;
+      return *this ;
+   }
    bigint& operator+=(const bigint &a) ;
    bigint& operator-=(const bigint &a) ;
    bigint& operator>>=(int i) ;
@@ -130,6 +139,8 @@ public:
    double todouble() const ;
    double toscinot() const ;
    int toint() const ;
+   // the value must fit in 64 bits
+   G_INT64 toint64() const ;
    // static values predefined
    static const bigint zero, one, two, three, minint, maxint ;
    // editing limits
@@ -157,10 +168,11 @@ private:
       int i ;
       int *p ;
    } v ;
-   static char *printbuf ;
-   static int *work ;
-   static int printbuflen ;
-   static int workarrlen ;
+   // tostring's buffers; one set per thread
+   static thread_local char *printbuf ;
+   static thread_local int *work ;
+   static thread_local int printbuflen ;
+   static thread_local int workarrlen ;
    static char sepchar ;
    static int sepcount ;
 } ;
@@ -51,6 +51,11 @@ state generationsalgo::slowcalc(state nw, state n, state ne, state w, state c,
    return result ;
 }
 
+void generationsalgo::slowcalcblock(state *out, const state *in, int stride,
+                                    int wd, int ht) {
+   ghslowcalcblock(this, out, in, stride, wd, ht) ;
+}
+
 static lifealgo *creator() { return new generationsalgo() ; }
 
 void generationsalgo::doInitializeAlgoInfo(staticAlgoInfo &ai) {
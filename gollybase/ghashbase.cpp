@@ -17,6 +17,7 @@
 #include "util.h"
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
 using namespace std ;
 /*
  *   Power of two hash sizes work fine.
@@ -56,6 +57,24 @@ g_uintptr_t ghnode_hash(void *a, void *b, void *c, void *d) {
 }
 #endif
 #define ghleaf_hash(a,b,c,d) (65537*(d)+257*(c)+17*(b)+5*(a))
+/*
+ *   Small nodes are not worth recursing on:  below blockdepth we copy
+ *   the node into a flat array of states, let the algorithm step the
+ *   whole array with one slowcalcblock call per generation, and hash
+ *   the center back into a node.  At 1 only the 4x4 nodes are done
+ *   this way; larger blocks (8x8 at 2, the size of the hlifealgo
+ *   leaves, or 16x16 at 3) skip the nine plus four tiny intermediate
+ *   nodes per level that dorecurs would build, but also lose their
+ *   cached results, so they only pay off for cheap rules.
+ */
+#define MAXBLOCKDEPTH 3
+#define MAXBLOCKSIZE (2 << MAXBLOCKDEPTH)
+/*
+ *   Bit 2 of res says the result has been reused since the last gc
+ *   (see setGCMode); resof strips it.
+ */
+#define resof(n) ((ghnode *)(~(g_uintptr_t)4 & (g_uintptr_t)(n)->res))
+#define setreused(n) ((n)->res = (ghnode *)(4 | (g_uintptr_t)(n)->res))
 /*
  *   Resize the hash.  The max load factor defined here does not actually
  *   yield the maximum load factor the hash will see, because when we
@@ -187,7 +206,7 @@ ghleaf *ghashbase::find_ghleaf(state nw, state ne, state sw, state se) {
    p->ne = ne ;
    p->sw = sw ;
    p->se = se ;
-   p->leafpop = bigint((short)((nw != 0) + (ne != 0) + (sw != 0) + (se != 0))) ;
+   p->leafpop = (nw != 0) + (ne != 0) + (sw != 0) + (se != 0) ;
    p->isghnode = 0 ;
    p->next = hashtab[h] ;
    hashtab[h] = (ghnode *)p ;
@@ -206,8 +225,13 @@ ghleaf *ghashbase::find_ghleaf(state nw, state ne, state sw, state se) {
  *   stack pointer and garbage collection stuff.
  */
 ghnode *ghashbase::getres(ghnode *n, int depth) {
-   if (n->res)
-     return n->res ;
+   if (n->res) {
+     if (gcage) {
+       setreused(n) ;
+       save(resof(n)) ;
+     }
+     return resof(n) ;
+   }
    ghnode *res = 0 ;
    /**
     *   This routine be the only place we assign to res.  We use
@@ -225,19 +249,12 @@ ghnode *ghashbase::getres(ghnode *n, int depth) {
    if (running_hperf.fastinc(depth, ngens < depth))
       running_hperf.report(inc_hperf, verbose) ;
    depth-- ;
-   if (ngens >= depth) {
-     if (is_ghnode(n->nw)) {
-       res = dorecurs(n->nw, n->ne, n->sw, n->se, depth) ;
-     } else {
-       res = (ghnode *)dorecurs_ghleaf((ghleaf *)n->nw, (ghleaf *)n->ne,
-                                       (ghleaf *)n->sw, (ghleaf *)n->se) ;
-     }
+   if (depth < blockdepth) {
+     res = dorecurs_block(n, depth + 1) ;
+   } else if (ngens >= depth) {
+     res = dorecurs(n->nw, n->ne, n->sw, n->se, depth) ;
    } else {
-     if (is_ghnode(n->nw)) {
-       res = dorecurs_half(n->nw, n->ne, n->sw, n->se, depth) ;
-     } else {
-       lifefatal("! can't happen") ;
-     }
+     res = dorecurs_half(n->nw, n->ne, n->sw, n->se, depth) ;
    }
    pop(sp) ;
    if (softinterrupt || poller->isInterrupted()) // don't assign this to the cache field!
@@ -246,6 +263,10 @@ ghnode *ghashbase::getres(ghnode *n, int depth) {
      if (ngens < depth && halvesdone < 1000)
        halvesdone++ ;
      n->res = res ;
+     if (gcage) {
+       setreused(n) ;
+       save(res) ;
+     }
    }
    return res ;
 }
@@ -406,26 +427,84 @@ ghnode *ghashbase::dorecurs_half(ghnode *n, ghnode *ne, ghnode *t,
    return save(n) ;
 }
 /*
- *   If the ghnode is a 16-ghnode, then the constituents are leaves, so we
- *   need a very similar but still somewhat different subroutine.  Since
- *   we do not (yet) garbage collect leaves, we don't need all that
- *   save/pop mumbo-jumbo.
- */
-ghleaf *ghashbase::dorecurs_ghleaf(ghleaf *nw, ghleaf *ne, ghleaf *sw,
-                                   ghleaf *se) {
-   return find_ghleaf(
-             slowcalc(nw->nw, nw->ne, ne->nw,
-                      nw->sw, nw->se, ne->sw,
-                      sw->nw, sw->ne, se->nw),
-             slowcalc(nw->ne, ne->nw, ne->ne,
-                      nw->se, ne->sw, ne->se,
-                      sw->ne, se->nw, se->ne),
-             slowcalc(nw->sw, nw->se, ne->sw,
-                      sw->nw, sw->ne, se->nw,
-                      sw->sw, sw->se, se->sw),
-             slowcalc(nw->se, ne->sw, ne->se,
-                      sw->ne, se->nw, se->ne,
-                      sw->se, se->sw, se->se)) ;
+ *   Copy a node into, or build one from, a square of states.
+ */
+void ghashbase::fillblock(ghnode *n, int depth, state *p, int stride) {
+   if (depth == 0) {
+      ghleaf *l = (ghleaf *)n ;
+      p[0] = l->nw ;
+      p[1] = l->ne ;
+      p[stride] = l->sw ;
+      p[stride+1] = l->se ;
+   } else {
+      int h = 1 << depth ;
+      depth-- ;
+      fillblock(n->nw, depth, p, stride) ;
+      fillblock(n->ne, depth, p + h, stride) ;
+      fillblock(n->sw, depth, p + h * stride, stride) ;
+      fillblock(n->se, depth, p + h * stride + h, stride) ;
+   }
+}
+ghnode *ghashbase::buildblock(const state *p, int depth, int stride) {
+   if (depth == 0)
+      return (ghnode *)find_ghleaf(p[0], p[1], p[stride], p[stride+1]) ;
+   int h = 1 << depth ;
+   depth-- ;
+   ghnode *nw = buildblock(p, depth, stride) ;
+   ghnode *ne = buildblock(p + h, depth, stride) ;
+   ghnode *sw = buildblock(p + h * stride, depth, stride) ;
+   ghnode *se = buildblock(p + h * stride + h, depth, stride) ;
+   return find_ghnode(nw, ne, sw, se) ;
+}
+/*
+ *   The node n is 2^(depth+1) cells on a side; we return its center
+ *   half, stepped 2^(depth-1) generations (or 2^ngens if that is less).
+ *   Each generation the valid part of the array shrinks by one cell on
+ *   every side, and slowcalcblock shifts it back to the origin.
+ */
+ghnode *ghashbase::dorecurs_block(ghnode *n, int depth) {
+   state a[MAXBLOCKSIZE*MAXBLOCKSIZE], b[MAXBLOCKSIZE*MAXBLOCKSIZE] ;
+   int sz = 2 << depth ;
+   int gens = 1 << (ngens < depth - 1 ? ngens : depth - 1) ;
+   state *in = a, *out = b ;
+   if (depth == 1) {
+      ghleaf *nw = (ghleaf *)n->nw, *ne = (ghleaf *)n->ne,
+             *sw = (ghleaf *)n->sw, *se = (ghleaf *)n->se ;
+      a[0] = nw->nw ; a[1] = nw->ne ; a[2] = ne->nw ; a[3] = ne->ne ;
+      a[4] = nw->sw ; a[5] = nw->se ; a[6] = ne->sw ; a[7] = ne->se ;
+      a[8] = sw->nw ; a[9] = sw->ne ; a[10] = se->nw ; a[11] = se->ne ;
+      a[12] = sw->sw ; a[13] = sw->se ; a[14] = se->sw ; a[15] = se->se ;
+      slowcalcblock(b, a, 4, 2, 2) ;
+      return (ghnode *)find_ghleaf(b[0], b[1], b[4], b[5]) ;
+   }
+   fillblock(n, depth, a, sz) ;
+   for (int g=1; g<=gens; g++) {
+      slowcalcblock(out, in, sz, sz - 2 * g, sz - 2 * g) ;
+      state *t = in ;
+      in = out ;
+      out = t ;
+   }
+   int off = sz / 4 - gens ;
+   int sp = gsp ;
+   n = buildblock(in + off * sz + off, depth - 1, sz) ;
+   pop(sp) ;
+   return save(n) ;
+}
+/*
+ *   The default block step just calls slowcalc on every cell; deriving
+ *   classes override this (see ghslowcalcblock) to make the calls
+ *   non-virtual.
+ */
+void ghashbase::slowcalcblock(state *out, const state *in, int stride,
+                              int wd, int ht) {
+   for (int y=0; y<ht; y++) {
+      const state *p = in + y * stride ;
+      state *q = out + y * stride ;
+      for (int x=0; x<wd; x++, p++)
+         q[x] = slowcalc(p[0], p[1], p[2],
+                         p[stride], p[stride+1], p[stride+2],
+                         p[2*stride], p[2*stride+1], p[2*stride+2]) ;
+   }
 }
 /*
  *   We keep free ghnodes in a linked list for allocation, and we allocate
@@ -433,23 +512,31 @@ ghleaf *ghashbase::dorecurs_ghleaf(ghleaf *nw, ghleaf *ne, ghleaf *sw,
  */
 ghnode *ghashbase::newghnode() {
    ghnode *r ;
-   if (freeghnodes == 0) {
-      int i ;
-      freeghnodes = (ghnode *)calloc(1001, sizeof(ghnode)) ;
-      if (freeghnodes == 0)
-         lifefatal("Out of memory; try reducing the hash memory limit.") ;
-      alloced += 1001 * sizeof(ghnode) ;
-      freeghnodes->next = ghnodeblocks ;
-      ghnodeblocks = freeghnodes++ ;
-      for (i=0; i<999; i++) {
-         freeghnodes[1].next = freeghnodes ;
-         freeghnodes++ ;
+   int gcdone = 0 ;
+   for (;;) {
+      if (sweeping && (freeghnodes == 0 || freeghnodes->next == 0))
+         sweepslice() ;
+      if (freeghnodes == 0) {
+         int i ;
+         freeghnodes = (ghnode *)calloc(1001, sizeof(ghnode)) ;
+         if (freeghnodes == 0)
+            lifefatal("Out of memory; try reducing the hash memory limit.") ;
+         alloced += 1001 * sizeof(ghnode) ;
+         freeghnodes->next = ghnodeblocks ;
+         ghnodeblocks = freeghnodes++ ;
+         for (i=0; i<999; i++) {
+            freeghnodes[1].next = freeghnodes ;
+            freeghnodes++ ;
+         }
+         totalthings += 1000 ;
       }
-      totalthings += 1000 ;
-   }
-   if (freeghnodes->next == 0 && alloced + 1000 * sizeof(ghnode) > maxmem &&
-       okaytogc) {
-      do_gc(0) ;
+      if (freeghnodes->next == 0 && alloced + 1000 * sizeof(ghnode) > maxmem &&
+          okaytogc && !sweeping && !gcdone) {
+         do_gc(0) ;
+         gcdone = 1 ;
+         continue ;
+      }
+      break ;
    }
    r = freeghnodes ;
    freeghnodes = freeghnodes->next ;
@@ -459,9 +546,7 @@ ghnode *ghashbase::newghnode() {
  *   Leaves are the same.
  */
 ghleaf *ghashbase::newghleaf() {
-   ghleaf *r = (ghleaf *)newghnode() ;
-   new(&(r->leafpop))bigint ;
-   return r ;
+   return (ghleaf *)newghnode() ;
 }
 /*
  *   Sometimes we want the new ghnode or ghleaf to be automatically cleared
@@ -471,9 +556,7 @@ ghnode *ghashbase::newclearedghnode() {
    return (ghnode *)memset(newghnode(), 0, sizeof(ghnode)) ;
 }
 ghleaf *ghashbase::newclearedghleaf() {
-   ghleaf *r = (ghleaf *)newclearedghnode() ;
-   new(&(r->leafpop))bigint ;
-   return r ;
+   return (ghleaf *)newclearedghnode() ;
 }
 ghashbase::ghashbase() {
    hashprime = nexthashsize(1000) ;
@@ -496,8 +579,11 @@ ghashbase::ghashbase() {
    freeghnodes = 0 ;
    okaytogc = 0 ;
    totalthings = 0 ;
+   keptfraction = 0 ;
    ghnodeblocks = 0 ;
    zeroghnodea = 0 ;
+   sweeping = 0 ;             // newclearedghnode looks at these
+   sweepblock = 0 ;
 /*
  *   We initialize our universe to be a 16-square.  We are in drawing
  *   mode at this point.
@@ -517,6 +603,10 @@ ghashbase::ghashbase() {
    inGC = 0 ;
    cacheinvalid = 0 ;
    gccount = 0 ;
+   incgc = 0 ;
+   gcage = 0 ;
+   blockdepth = 1 ;
+   agenow = 0 ;
    gcstep = 0 ;
    running_hperf.clear() ;
    inc_hperf = running_hperf ;
@@ -608,6 +698,18 @@ void ghashbase::setcurrentstate(void *n) {
       popValid = 0 ;
    }
 }
+void *ghashbase::pinstate() {
+   ensure_hashed() ;
+   pinned.push_back(root) ;
+   return root ;
+}
+void ghashbase::unpinstate(void *n) {
+   for (size_t i=pinned.size(); i>0; i--)
+      if (pinned[i-1] == (ghnode *)n) {
+         pinned.erase(pinned.begin() + (i-1)) ;
+         break ;
+      }
+}
 /*
  *   Set the max memory
  */
@@ -627,10 +729,24 @@ void ghashbase::setMaxMemory(int newmemlimit) {
    hashlimit = (g_uintptr_t)(maxloadfactor * hashprime) ;
 }
 /**
- *   Clear everything.
+ *   Clear everything.  As in hlifealgo, the old pattern's ghnodes stay
+ *   in the hash with their results until the next gc.
  */
 void ghashbase::clearall() {
-   lifefatal("clearall not implemented yet") ;
+   poller->bailIfCalculating() ;
+   destroytimeline() ;
+   clearstack() ;
+   okaytogc = 0 ;
+   root = (ghnode *)newclearedghnode() ;
+   population = 0 ;
+   generation = 0 ;
+   increment = 1 ;
+   depth = 1 ;
+   hashed = 0 ;
+   popValid = 0 ;
+   needPop = 0 ;
+   inGC = 0 ;
+   softinterrupt = 0 ;
 }
 /*
  *   This routine expands our universe by a factor of two, maintaining
@@ -965,6 +1081,146 @@ int ghashbase::setcell(int x, int y, int newstate) {
    }
    return 0 ;
 }
+/*
+ *   setcells and setruns sort the cells they are given into changes to
+ *   the leaves they fall in, keyed by the leaf's place in the quadtree;
+ *   the states are nw, ne, sw, se and bit i of mask says whether st[i]
+ *   is set.
+ */
+struct ghleafedit {
+   unsigned G_INT64 key ;
+   state st[4] ;
+   int mask ;
+   bool operator<(const ghleafedit &b) const { return key < b.key ; }
+   // apply a later change to the same leaf
+   void add(const ghleafedit &b) {
+      for (int i=0; i<4; i++)
+         if (b.mask & (1 << i))
+            st[i] = b.st[i] ;
+      mask |= b.mask ;
+   }
+} ;
+int ghashbase::setcells(const int *cells, size_t n, int multistate,
+                        int dx, int dy) {
+   return setbatch(cells, n, multistate ? 3 : 2, dx, dy) ;
+}
+int ghashbase::setruns(const int *runs, size_t n, int dx, int dy) {
+   return setbatch(runs, n, 4, dx, dy) ;
+}
+/*
+ *   Set a batch of cells (stride 2 or 3) or runs (stride 4).  Rather
+ *   than going down from the root for each cell, we sort the changes
+ *   into quadtree order and build each changed node once, bottom up,
+ *   hashing as we go.
+ */
+int ghashbase::setbatch(const int *p, size_t n, int stride, int dx, int dy) {
+   G_INT64 minx = 0, maxx = -1, miny = 0, maxy = 0 ;
+   for (size_t i=0; i+stride<=n; i+=stride) {
+      int len = stride == 4 ? p[i+2] : 1 ;
+      int st = stride == 2 ? 1 : p[i+stride-1] ;
+      if (st < 0 || st >= maxCellStates)
+         return -1 ;
+      if (len <= 0)
+         continue ;
+      G_INT64 x = (G_INT64)p[i] + dx, y = (G_INT64)p[i+1] + dy ;
+      if (maxx < minx) {
+         minx = maxx = x ;
+         miny = maxy = y ;
+      }
+      if (x < minx) minx = x ;
+      if (x + len - 1 > maxx) maxx = x + len - 1 ;
+      if (y < miny) miny = y ;
+      if (y > maxy) maxy = y ;
+   }
+   if (maxx < minx)
+      return 0 ;
+   if (!hashed) {
+      root = hashpattern(root, depth) ;
+      zeroghnode(depth) ;
+      hashed = 1 ;
+   }
+   clearstack() ;
+   save(root) ;
+   okaytogc = 1 ;
+   inGC = 1 ;
+   // the root covers -2^depth..2^depth-1 (with y going up)
+   while (depth < 62 && (minx < -((G_INT64)1 << depth) ||
+                         maxx >= ((G_INT64)1 << depth) ||
+                         maxy > ((G_INT64)1 << depth) ||
+                         miny <= -((G_INT64)1 << depth))) {
+      root = save(pushroot(root)) ;
+      depth++ ;
+   }
+   if (depth > 32) {
+      // too big for our keys, so set the cells one at a time
+      okaytogc = 0 ;
+      for (size_t i=0; i+stride<=n; i+=stride) {
+         int len = stride == 4 ? p[i+2] : 1 ;
+         for (int k=0; k<len; k++)
+            setcell(p[i] + dx + k, p[i+1] + dy, stride == 2 ? 1 : p[i+stride-1]) ;
+      }
+      return 0 ;
+   }
+   G_INT64 half = (G_INT64)1 << depth ;
+   vector<ghleafedit> edits ;
+   edits.reserve(n / stride) ;
+   for (size_t i=0; i+stride<=n; i+=stride) {
+      int len = stride == 4 ? p[i+2] : 1 ;
+      int st = stride == 2 ? 1 : p[i+stride-1] ;
+      // measured from the top left of the root
+      G_INT64 u = (G_INT64)p[i] + dx + half ;
+      G_INT64 r = half - 1 + ((G_INT64)p[i+1] + dy) ;
+      for (G_INT64 end=u+len; u<end; u++) {
+         unsigned G_INT64 key = quadkey((unsigned int)(u >> 1),
+                                        (unsigned int)(r >> 1)) ;
+         int c = (int)(((r & 1) << 1) | (u & 1)) ;
+         if (edits.empty() || edits.back().key != key) {
+            ghleafedit e = { key, { 0, 0, 0, 0 }, 0 } ;
+            edits.push_back(e) ;
+         }
+         edits.back().st[c] = (state)st ;
+         edits.back().mask |= 1 << c ;
+      }
+   }
+   // later changes to a leaf must stay later
+   std::stable_sort(edits.begin(), edits.end()) ;
+   size_t m = 0 ;
+   for (size_t i=1; i<edits.size(); i++) {
+      if (edits[i].key == edits[m].key)
+         edits[m].add(edits[i]) ;
+      else
+         edits[++m] = edits[i] ;
+   }
+   edits.resize(m + 1) ;
+   root = setleaves(root, depth, &edits[0], &edits[0] + edits.size()) ;
+   okaytogc = 0 ;
+   return 0 ;
+}
+/*
+ *   Apply the (sorted) leaf changes that fall in this node.
+ */
+ghnode *ghashbase::setleaves(ghnode *n, int depth, const ghleafedit *b,
+                             const ghleafedit *e) {
+   if (depth == 0) {
+      ghleaf *l = (ghleaf *)n ;
+      state st[4] = { l->nw, l->ne, l->sw, l->se } ;
+      for (int i=0; i<4; i++)
+         if (b->mask & (1 << i))
+            st[i] = b->st[i] ;
+      return (ghnode *)find_ghleaf(st[0], st[1], st[2], st[3]) ;
+   }
+   int sh = 2 * (depth - 1) ;
+   ghnode *kid[4] = { n->nw, n->ne, n->sw, n->se } ;
+   while (b < e) {
+      int q = (int)((b->key >> sh) & 3) ;
+      const ghleafedit *qe = b ;
+      while (qe < e && (int)((qe->key >> sh) & 3) == q)
+         qe++ ;
+      kid[q] = setleaves(kid[q], depth-1, b, qe) ;
+      b = qe ;
+   }
+   return find_ghnode(kid[0], kid[1], kid[2], kid[3]) ;
+}
 /*
  *   Our nonrecurse top-level bit getting routine.
  */
@@ -1024,6 +1280,269 @@ int ghashbase::nextcell(int x, int y, int &v) {
    }
    return nextbit(root, x, y, depth, v) ;
 }
+/*
+ *   As in hlifealgo, getruns walks the universe a band at a time:  a
+ *   band is the nonempty ghnodes of one depth that cover the same rows,
+ *   left to right, each with the offset of its left edge from the
+ *   rectangle.
+ */
+struct ghrunwalk {
+   ghrunwalk(liferunsink &sink, G_INT64 wdarg, G_INT64 htarg) :
+      runs(sink, wdarg), wd(wdarg), ht(htarg) {}
+   runjoiner runs ;
+   G_INT64 wd, ht ;
+   vector<ghnode *> zeros ;
+   vector<vector<pair<ghnode *, G_INT64> > > bands ;
+} ;
+int ghashbase::bandruns(ghrunwalk &w, int d, G_INT64 y) {
+   vector<pair<ghnode *, G_INT64> > &band = w.bands[d] ;
+   if (d == 0) {
+      for (int r=0; r<2; r++) {
+         if (y + r < 0)
+            continue ;
+         if (y + r >= w.ht)
+            break ;
+         for (size_t i=0; i<band.size(); i++) {
+            ghleaf *l = (ghleaf *)band[i].first ;
+            G_INT64 x = band[i].second ;
+            state a = r ? l->sw : l->nw ;
+            state b = r ? l->se : l->ne ;
+            if (a && w.runs.add(x, y + r, 1, a))
+               return 1 ;
+            if (b && w.runs.add(x + 1, y + r, 1, b))
+               return 1 ;
+         }
+      }
+      return 0 ;
+   }
+   G_INT64 half = (G_INT64)1 << d ;
+   ghnode *z = w.zeros[d-1] ;
+   vector<pair<ghnode *, G_INT64> > &sub = w.bands[d-1] ;
+   for (int south=0; south<2; south++) {
+      G_INT64 sy = y + (south ? half : 0) ;
+      if (sy + half <= 0 || sy >= w.ht)
+         continue ;
+      sub.clear() ;
+      for (size_t i=0; i<band.size(); i++) {
+         ghnode *n = band[i].first ;
+         G_INT64 x = band[i].second ;
+         ghnode *a = south ? n->sw : n->nw ;
+         ghnode *b = south ? n->se : n->ne ;
+         if (a != z && x + half > 0 && x < w.wd)
+            sub.push_back(make_pair(a, x)) ;
+         if (b != z && x + 2 * half > 0 && x + half < w.wd)
+            sub.push_back(make_pair(b, x + half)) ;
+      }
+      if (!sub.empty() && bandruns(w, d-1, sy))
+         return 1 ;
+   }
+   return 0 ;
+}
+/*
+ *   Split the root with bigints until the ghnodes are small enough for
+ *   their offsets from the rectangle to fit in 64 bits; there are at
+ *   most nine of them that meet the rectangle.  Each goes in start with
+ *   its offset (y first) and their depth is returned.
+ */
+int ghashbase::splitroot(const bigint &top, const bigint &left,
+                         const bigint &bottom, const bigint &right,
+                         vector<pair<pair<G_INT64, G_INT64>, ghnode *> > &start) {
+   int d = depth ;
+   bigint size = 1 ;
+   size <<= d ;
+   bigint x0 = 0, y0 = 1 ;
+   x0 -= size ;
+   y0 -= size ;
+   size += size ;
+   vector<ghnode *> nodes ;
+   vector<bigint> xs, ys ;
+   nodes.push_back(root) ;
+   xs.push_back(x0) ;
+   ys.push_back(y0) ;
+   for (;;) {
+      // drop the ghnodes that are empty or miss the rectangle
+      vector<ghnode *> keep ;
+      vector<bigint> keepx, keepy ;
+      ghnode *z = zeroghnode(d) ;
+      for (size_t i=0; i<nodes.size(); i++) {
+         bigint r = xs[i], b = ys[i] ;
+         r += size ;
+         b += size ;
+         if (nodes[i] != z && xs[i] <= right && r > left &&
+             ys[i] <= bottom && b > top) {
+            keep.push_back(nodes[i]) ;
+            keepx.push_back(xs[i]) ;
+            keepy.push_back(ys[i]) ;
+         }
+      }
+      nodes.swap(keep) ;
+      xs.swap(keepx) ;
+      ys.swap(keepy) ;
+      if (d <= 61)
+         break ;
+      bigint half = size ;
+      half.div2() ;
+      keep.clear() ;
+      keepx.clear() ;
+      keepy.clear() ;
+      for (size_t i=0; i<nodes.size(); i++) {
+         ghnode *n = nodes[i] ;
+         ghnode *kids[4] = { n->nw, n->ne, n->sw, n->se } ;
+         for (int q=0; q<4; q++) {
+            keep.push_back(kids[q]) ;
+            bigint x = xs[i], y = ys[i] ;
+            if (q & 1)
+               x += half ;
+            if (q & 2)
+               y += half ;
+            keepx.push_back(x) ;
+            keepy.push_back(y) ;
+         }
+      }
+      nodes.swap(keep) ;
+      xs.swap(keepx) ;
+      ys.swap(keepy) ;
+      size = half ;
+      d-- ;
+   }
+   for (size_t i=0; i<nodes.size(); i++) {
+      xs[i] -= left ;
+      ys[i] -= top ;
+      start.push_back(make_pair(make_pair(ys[i].toint64(), xs[i].toint64()),
+                                nodes[i])) ;
+   }
+   return d ;
+}
+int ghashbase::getruns(const bigint &top, const bigint &left,
+                       const bigint &bottom, const bigint &right,
+                       liferunsink &sink) {
+   ensure_hashed() ;
+   if (top > bottom || left > right)
+      return 0 ;
+   bigint wd = right, ht = bottom ;
+   wd -= left ;
+   wd += 1 ;
+   ht -= top ;
+   ht += 1 ;
+   ghrunwalk w(sink, wd.toint64(), ht.toint64()) ;
+   vector<pair<pair<G_INT64, G_INT64>, ghnode *> > start ;
+   int d = splitroot(top, left, bottom, right, start) ;
+   for (int i=0; i<=d; i++)
+      w.zeros.push_back(zeroghnode(i)) ;
+   // sort them by row and then column, and walk each row as a band
+   sort(start.begin(), start.end()) ;
+   w.bands.resize(d+1) ;
+   for (size_t i=0; i<start.size(); ) {
+      G_INT64 y = start[i].first.first ;
+      vector<pair<ghnode *, G_INT64> > &band = w.bands[d] ;
+      band.clear() ;
+      for (; i<start.size() && start[i].first.first == y; i++)
+         band.push_back(make_pair(start[i].second, start[i].first.second)) ;
+      if (bandruns(w, d, y))
+         return 1 ;
+   }
+   return w.runs.finish() ;
+}
+/*
+ *   The hash of a ghnode with (0,0) at its top left (see cellhash); gc
+ *   forgets those of the ghnodes it frees.
+ */
+cellhash::value ghashbase::nodehash(ghnode *n, int depth) {
+   if (depth == 0) {
+      ghleaf *l = (ghleaf *)n ;
+      return cellhash::add(
+         cellhash::add(cellhash::weight(l->nw),
+                       cellhash::mul(cellhash::weight(l->ne), cellhash::X)),
+         cellhash::mul(cellhash::add(cellhash::weight(l->sw),
+                       cellhash::mul(cellhash::weight(l->se), cellhash::X)),
+                       cellhash::Y)) ;
+   }
+   std::unordered_map<ghnode *, cellhash::value>::iterator it =
+                                                      nodehashes.find(n) ;
+   if (it != nodehashes.end())
+      return it->second ;
+   ghnode *z = zeroghnode(depth - 1) ;
+   ghnode *kids[4] = { n->nw, n->ne, n->sw, n->se } ;
+   cellhash::value h = 0 ;
+   for (int q=0; q<4; q++) {
+      if (kids[q] == z)
+         continue ;
+      cellhash::value k = nodehash(kids[q], depth - 1) ;
+      if (q & 1)
+         k = cellhash::mul(k, cellhash::xpow2(depth)) ;
+      if (q & 2)
+         k = cellhash::mul(k, cellhash::ypow2(depth)) ;
+      h = cellhash::add(h, k) ;
+   }
+   nodehashes[n] = h ;
+   return h ;
+}
+/*
+ *   The hash of the part of a ghnode inside a wd by ht rectangle, where
+ *   the ghnode is at (x,y) from the rectangle's corner and fx, fy are
+ *   X^x, Y^y.
+ */
+cellhash::value ghashbase::recthash(ghnode *n, int depth, G_INT64 x,
+                                    G_INT64 y, cellhash::value fx,
+                                    cellhash::value fy, G_INT64 wd,
+                                    G_INT64 ht) {
+   G_INT64 size = (G_INT64)2 << depth ;
+   if (x >= wd || y >= ht || x + size <= 0 || y + size <= 0 ||
+       n == zeroghnode(depth))
+      return 0 ;
+   if (x >= 0 && y >= 0 && x + size <= wd && y + size <= ht)
+      return cellhash::mul(nodehash(n, depth), cellhash::mul(fx, fy)) ;
+   if (depth == 0) {
+      // a ghleaf on the edge; add up the cells inside
+      ghleaf *l = (ghleaf *)n ;
+      state cells[4] = { l->nw, l->ne, l->sw, l->se } ;
+      cellhash::value h = 0 ;
+      for (int i=0; i<4; i++) {
+         G_INT64 cx = x + (i & 1), cy = y + (i >> 1) ;
+         if (cells[i] && cx >= 0 && cx < wd && cy >= 0 && cy < ht) {
+            cellhash::value c = cellhash::mul(cellhash::weight(cells[i]),
+                                              cellhash::mul(fx, fy)) ;
+            if (i & 1)
+               c = cellhash::mul(c, cellhash::X) ;
+            if (i & 2)
+               c = cellhash::mul(c, cellhash::Y) ;
+            h = cellhash::add(h, c) ;
+         }
+      }
+      return h ;
+   }
+   G_INT64 half = (G_INT64)1 << depth ;
+   cellhash::value hx = cellhash::mul(fx, cellhash::xpow2(depth)) ;
+   cellhash::value hy = cellhash::mul(fy, cellhash::ypow2(depth)) ;
+   depth-- ;
+   return cellhash::add(
+      cellhash::add(recthash(n->nw, depth, x, y, fx, fy, wd, ht),
+                    recthash(n->ne, depth, x + half, y, hx, fy, wd, ht)),
+      cellhash::add(recthash(n->sw, depth, x, y + half, fx, hy, wd, ht),
+                    recthash(n->se, depth, x + half, y + half, hx, hy,
+                             wd, ht))) ;
+}
+cellhash::value ghashbase::gethash(const bigint &top, const bigint &left,
+                                   const bigint &bottom, const bigint &right) {
+   ensure_hashed() ;
+   if (top > bottom || left > right)
+      return 0 ;
+   bigint wd = right, ht = bottom ;
+   wd -= left ;
+   wd += 1 ;
+   ht -= top ;
+   ht += 1 ;
+   vector<pair<pair<G_INT64, G_INT64>, ghnode *> > start ;
+   int d = splitroot(top, left, bottom, right, start) ;
+   cellhash::value h = 0 ;
+   for (size_t i=0; i<start.size(); i++) {
+      G_INT64 x = start[i].first.second, y = start[i].first.first ;
+      h = cellhash::add(h, recthash(start[i].second, d, x, y,
+                                    cellhash::xpow(x), cellhash::ypow(y),
+                                    wd.toint64(), ht.toint64())) ;
+   }
+   return h ;
+}
 /*
  *   Canonicalize a universe by filling in the null pointers and then
  *   invoking find_ghnode on each ghnode.  Drops the original universe on
@@ -1141,6 +1660,10 @@ void ghashbase::rehash_ghnode(ghnode *n) {
    n->next = hashtab[h] ;
    hashtab[h] = n ;
 }
+/*
+ *   The populations a leaf can have.
+ */
+static const bigint leafpops[5] = { 0, 1, 2, 3, 4 } ;
 /*
  *   This recursive routine calculates the population by hanging the
  *   population on marked ghnodes.
@@ -1149,7 +1672,7 @@ const bigint &ghashbase::calcpop(ghnode *root, int depth) {
    if (root == zeroghnode(depth))
       return bigint::zero ;
    if (depth == 0)
-      return ((ghleaf *)root)->leafpop ;
+      return leafpops[((ghleaf *)root)->leafpop] ;
    if (marked2(root))
       return *(bigint*)&(root->next) ;
    depth-- ;
@@ -1274,13 +1797,73 @@ void ghashbase::gc_mark(ghnode *root, int invalidate) {
          gc_mark(root->sw, invalidate) ;
          gc_mark(root->se, invalidate) ;
          if (root->res) {
-            if (invalidate)
+            if (invalidate || (agenow && !takereused(root)))
               root->res = 0 ;
             else
-              gc_mark(root->res, invalidate) ;
+              gc_mark(resof(root), invalidate) ;
+         }
+      }
+   }
+}
+/*
+ *   The incremental gc marks a ghnode by putting it back into the hash,
+ *   which do_gc has emptied; a ghnode that's already there is marked.
+ *   Ghnodes that aren't in the hash are swept onto the free list a slice
+ *   at a time afterwards by newghnode.  Ghnodes allocated since the gc
+ *   only point at ghnodes in the hash, so the sweep never looks at them.
+ */
+g_uintptr_t ghashbase::hashof(ghnode *p) {
+   if (is_ghnode(p))
+      return HASHMOD(ghnode_hash(p->nw, p->ne, p->sw, p->se)) ;
+   ghleaf *lp = (ghleaf *)p ;
+   return HASHMOD(ghleaf_hash(lp->nw, lp->ne, lp->sw, lp->se)) ;
+}
+int ghashbase::inhash(ghnode *p, g_uintptr_t h) {
+   for (ghnode *q=hashtab[h]; q; q=q->next)
+      if (q == p)
+         return 1 ;
+   return 0 ;
+}
+void ghashbase::gc_rehash(ghnode *root, int invalidate) {
+   g_uintptr_t h = hashof(root) ;
+   if (inhash(root, h))
+      return ;
+   root->next = hashtab[h] ;
+   hashtab[h] = root ;
+   hashpop++ ;
+   if (is_ghnode(root)) {
+      gc_rehash(root->nw, invalidate) ;
+      gc_rehash(root->ne, invalidate) ;
+      gc_rehash(root->sw, invalidate) ;
+      gc_rehash(root->se, invalidate) ;
+      if (root->res) {
+         if (invalidate || (agenow && !takereused(root)))
+           root->res = 0 ;
+         else
+           gc_rehash(resof(root), invalidate) ;
+      }
+   }
+}
+void ghashbase::sweepslice() {
+   g_uintptr_t found = 0 ;
+   while (sweepblock && found < 1000) {
+      ghnode *pp = sweepblock + 1 ;
+      sweepblock = sweepblock->next ;
+      for (int i=1; i<1001; i++, pp++) {
+         if (!inhash(pp, hashof(pp))) {
+            pp->next = freeghnodes ;
+            freeghnodes = pp ;
+            found++ ;
          }
       }
    }
+   if (sweepblock == 0)
+      sweeping = 0 ;
+}
+int ghashbase::takereused(ghnode *n) {
+   int r = (int)(4 & (g_uintptr_t)n->res) ;
+   n->res = resof(n) ;
+   return r ;
 }
 /**
  *   If the invalidate flag is set, we want to kill *all* cache entries
@@ -1290,6 +1873,9 @@ void ghashbase::do_gc(int invalidate) {
    int i ;
    g_uintptr_t freed_ghnodes=0 ;
    ghnode *p, *pp ;
+   void (ghashbase::*keep)(ghnode *, int) =
+                        incgc ? &ghashbase::gc_rehash : &ghashbase::gc_mark ;
+   double t0 = gollySecondCount() ;
    inGC = 1 ;
    gccount++ ;
    gcstep++ ;
@@ -1300,23 +1886,38 @@ void ghashbase::do_gc(int invalidate) {
        sprintf(statusline, "GC #%d", gccount) ;
      lifestatus(statusline) ;
    }
+   if (incgc) {
+      hashpop = 0 ;
+      memset(hashtab, 0, sizeof(ghnode *) * hashprime) ;
+   }
    for (i=nzeros-1; i>=0; i--)
       if (zeroghnodea[i] != 0)
          break ;
    if (i >= 0)
-      gc_mark(zeroghnodea[i], 0) ; // never invalidate zeroghnode
+      (this->*keep)(zeroghnodea[i], 0) ; // never invalidate zeroghnode
    if (root != 0)
-      gc_mark(root, invalidate) ; // pick up the root
+      (this->*keep)(root, invalidate) ; // pick up the root
    for (i=0; i<gsp; i++) {
       poller->poll() ;
-      gc_mark((ghnode *)stack[i], invalidate) ;
+      (this->*keep)((ghnode *)stack[i], invalidate) ;
    }
-   for (i=0; i<timeline.framecount; i++)
-      gc_mark((ghnode *)timeline.frames[i], invalidate) ;
-   hashpop = 0 ;
-   memset(hashtab, 0, sizeof(ghnode *) * hashprime) ;
+   for (i=0; i<(int)timeline.frames.size(); i++)
+      if (timeline.frames[i])             // 0 if evicted
+         (this->*keep)((ghnode *)timeline.frames[i], invalidate) ;
+   for (size_t j=0; j<pinned.size(); j++)
+      (this->*keep)(pinned[j], invalidate) ;
    freeghnodes = 0 ;
-   for (p=ghnodeblocks; p; p=p->next) {
+   if (incgc) {
+      // everything not back in the hash is swept later by newghnode
+      sweeping = 1 ;
+      sweepblock = ghnodeblocks ;
+      freed_ghnodes = totalthings - hashpop ;
+   } else {
+      hashpop = 0 ;
+      memset(hashtab, 0, sizeof(ghnode *) * hashprime) ;
+      sweeping = 0 ;
+   }
+   for (p=(incgc ? 0 : ghnodeblocks); p; p=p->next) {
       poller->poll() ;
       for (pp=p+1, i=1; i<1001; i++, pp++) {
          if (marked(pp)) {
@@ -1337,11 +1938,24 @@ void ghashbase::do_gc(int invalidate) {
          }
       }
    }
+   // forget the hashes of the ghnodes no longer in the hash
+   for (auto it=nodehashes.begin(); it!=nodehashes.end(); )
+      if (inhash(it->first, hashof(it->first)))
+         ++it ;
+      else
+         it = nodehashes.erase(it) ;
    inGC = 0 ;
+   keptfraction = totalthings ?
+                  1.0 - (double)freed_ghnodes / (double)totalthings : 0 ;
+   // only age the cache when it's crowding out everything else
+   agenow = gcage && freed_ghnodes * 2 < totalthings ;
+   double pause = gollySecondCount() - t0 ;
+   running_hperf.gcpause(pause) ;
    if (verbose) {
      double perc = (double)freed_ghnodes / (double)totalthings * 100.0 ;
-     sprintf(statusline+strlen(statusline), " freed %g percent (%" PRIuPTR ").",
-                                                  perc, freed_ghnodes) ;
+     sprintf(statusline+strlen(statusline),
+             " freed %g percent (%" PRIuPTR ") in %gs.", perc, freed_ghnodes,
+             pause) ;
      lifestatus(statusline) ;
    }
    if (needPop) {
@@ -1366,7 +1980,7 @@ void ghashbase::clearcache(ghnode *n, int depth, int clearto) {
          clearcache(n->sw, depth, clearto) ;
          clearcache(n->se, depth, clearto) ;
          if (n->res)
-            clearcache(n->res, depth, clearto) ;
+            clearcache(resof(n), depth, clearto) ;
       }
       if (depth >= clearto)
          n->res = 0 ;
@@ -1387,7 +2001,7 @@ void ghashbase::clearcache_p1(ghnode *n, int depth, int clearto) {
       clearcache_p1(n->sw, depth, clearto) ;
       clearcache_p1(n->se, depth, clearto) ;
       if (n->res)
-         clearcache_p1(n->res, depth, clearto) ;
+         clearcache_p1(resof(n), depth, clearto) ;
    }
 }
 /*
@@ -1405,7 +2019,7 @@ void ghashbase::clearcache_p2(ghnode *n, int depth, int clearto) {
       clearcache_p2(n->sw, depth, clearto) ;
       clearcache_p2(n->se, depth, clearto) ;
       if (n->res)
-         clearcache_p2(n->res, depth, clearto) ;
+         clearcache_p2(resof(n), depth, clearto) ;
    }
    if (n->res)
       n->res = 0 ;
@@ -1540,13 +2154,14 @@ ghnode *ghashbase::runpattern() {
    generation += pow2step ;
    return n ;
 }
-const char *ghashbase::readmacrocell(char *line) {
+const char *ghashbase::readmacrocell(patternreader &reader, char *line) {
    int n=0 ;
    g_uintptr_t i=1, nw=0, ne=0, sw=0, se=0, indlen=0 ;
    int r, d ;
+   long nframes = 0 ; // as given by #FRAMES
    ghnode **ind = 0 ;
    root = 0 ;
-   while (getline(line, 10000)) {
+   while (reader.getline(line, 10000)) {
       if (i >= indlen) {
          g_uintptr_t nlen = i + indlen + 10 ;
          ind = (ghnode **)realloc(ind, sizeof(ghnode*) * nlen) ;
@@ -1589,6 +2204,7 @@ const char *ghashbase::readmacrocell(char *line) {
 	       long cnt = atol(p) ;
 	       if (cnt < 0 || cnt > MAX_FRAME_COUNT)
 		  return "Bad FRAMES line" ;
+	       nframes = cnt ;
 	       destroytimeline() ;
 	       while ('0' <= *p && *p <= '9')
 		 p++ ;
@@ -1637,12 +2253,18 @@ const char *ghashbase::readmacrocell(char *line) {
 	       g_uintptr_t nodeind = 0 ;
 	       n = sscanf(line+7, "%d %" PRIuPTR, &frameind, &nodeind) ;
 	       if (n != 2 || frameind > MAX_FRAME_COUNT || frameind < 0 ||
-		   nodeind > i || timeline.framecount != frameind)
+		   nodeind > i || frameind >= nframes ||
+		   timeline.framecount > frameind ||
+		   (timeline.framecount == 0 && frameind != 0))
 		  return "Bad FRAME line" ;
-	       timeline.frames.push_back(ind[nodeind]) ;
-	       timeline.framecount++ ;
-	       timeline.end = timeline.next ;
-	       timeline.next += timeline.inc ;
+	       // frames that weren't saved are recomputed when needed
+	       while (timeline.framecount <= frameind) {
+		  timeline.frames.push_back(0) ;
+		  timeline.framecount++ ;
+		  timeline.end = timeline.next ;
+		  timeline.next += timeline.inc ;
+	       }
+	       timeline.frames.back() = ind[nodeind] ;
 	    }
 	    break ;
          }
@@ -1821,6 +2443,7 @@ g_uintptr_t ghashbase::writecell_2p2(std::ostream &os, ghnode *root, int depth)
 #define STRINGIFY(arg) STR2(arg)
 #define STR2(arg) #arg
 const char *ghashbase::writeNativeFormat(std::ostream &os, char *comments) {
+   int framestosave = timeline.savetimeline ? timeline.framecount : 0 ;
    int depth = ghnode_depth(root) ;
    os << "[M2] (golly " STRINGIFY(VERSION) ")\n" ;
    
@@ -1861,18 +2484,18 @@ const char *ghashbase::writeNativeFormat(std::ostream &os, char *comments) {
    */
    /* this is the new two-pass way */
    cellcounter = 0 ;
+   // evicted frames are left out; the reader recomputes them as needed
    vector<int> depths(timeline.framecount) ;
-   int framestosave = timeline.framecount ;
-   if (timeline.savetimeline == 0)
-     framestosave = 0 ;
    if (framestosave) {
      for (int i=0; i<timeline.framecount; i++) {
        ghnode *frame = (ghnode*)timeline.frames[i] ;
-       depths[i] = ghnode_depth(frame) ;
+       if (frame)
+         depths[i] = ghnode_depth(frame) ;
      }
      for (int i=0; i<timeline.framecount; i++) {
        ghnode *frame = (ghnode*)timeline.frames[i] ;
-       writecell_2p1(frame, depths[i]) ;
+       if (frame)
+         writecell_2p1(frame, depths[i]) ;
      }
    }
    writecell_2p1(root, depth) ;
@@ -1885,6 +2508,8 @@ const char *ghashbase::writeNativeFormat(std::ostream &os, char *comments) {
          << ' ' << timeline.base << '^' << timeline.expo << '\n' ;
       for (int i=0; i<timeline.framecount; i++) {
          ghnode *frame = (ghnode*)timeline.frames[i] ;
+         if (frame == 0)
+            continue ;
          writecell_2p2(os, frame, depths[i]) ;
          os << "#FRAME " << i << ' ' << (g_uintptr_t)frame->next << '\n' ;
       }
@@ -1894,13 +2519,216 @@ const char *ghashbase::writeNativeFormat(std::ostream &os, char *comments) {
    if (framestosave) {
      for (int i=0; i<timeline.framecount; i++) {
        ghnode *frame = (ghnode*)timeline.frames[i] ;
-       afterwritemc(frame, depths[i]) ;
+       if (frame)
+         afterwritemc(frame, depths[i]) ;
      }
    }
    afterwritemc(root, depth) ;
    inGC = 0 ;
    return 0 ;
 }
+/*
+ *   Load a binary macrocell file a level at a time; since children are
+ *   always in the level below we only need the ghnodes of two levels at
+ *   once.  We grow the hash up front so it isn't rebuilt as we go.
+ */
+const char *ghashbase::readbinarymacrocell(const char *data, size_t len) {
+   mcbimage f ;
+   const char *err = f.parse(data, len) ;
+   if (err)
+      return err ;
+   if (f.hdr->leafbytes != 4)
+      return "This binary macrocell file has two-state 8x8 leaves." ;
+   err = setupfrommcb(f) ;
+   if (err)
+      return err ;
+   root = 0 ;
+   double total = (double)f.totalnodes(), done = 0 ;
+   while (hashlimit != G_MAX && hashpop + total > hashlimit)
+      resize() ;
+   vector<ghnode *> frames(f.hdr->framecount) ;
+   vector<ghnode *> below, here ;
+   for (unsigned int l=0; l<f.hdr->nlevels; l++) {
+      g_uintptr_t n = (g_uintptr_t)f.count(l), nbelow = below.size() ;
+      const char *rec = f.records(l) ;
+      size_t recbytes = f.recordbytes(l) ;
+      here.resize(n + 1) ;
+      if (l > 0)
+         below[0] = zeroghnode(l - 1) ;
+      for (g_uintptr_t i=1; i<=n; i++, rec += recbytes) {
+         if ((i & 65535) == 0) {
+            lifeabortprogress((done + i) / total, "") ;
+            if (isaborted())
+               return "File contains truncated pattern." ;
+         }
+         clearstack() ;
+         if (l == 0) {
+            const state *q = (const state *)rec ;
+            if (q[0] >= maxCellStates || q[1] >= maxCellStates ||
+                q[2] >= maxCellStates || q[3] >= maxCellStates)
+               return "Cell state values too high for this algorithm." ;
+            here[i] = (ghnode *)find_ghleaf(q[0], q[1], q[2], q[3]) ;
+         } else {
+            g_uintptr_t nw = (g_uintptr_t)f.child(rec, 0),
+                        ne = (g_uintptr_t)f.child(rec, 1),
+                        sw = (g_uintptr_t)f.child(rec, 2),
+                        se = (g_uintptr_t)f.child(rec, 3) ;
+            if (nw >= nbelow || ne >= nbelow || sw >= nbelow || se >= nbelow)
+               return "Node out of range in binary macrocell file." ;
+            here[i] = find_ghnode(below[nw], below[ne], below[sw], below[se]) ;
+         }
+      }
+      done += n ;
+      if (f.hdr->rootindex && f.hdr->rootlevel == l)
+         root = here[(g_uintptr_t)f.hdr->rootindex] ;
+      // frames that weren't saved (MCBNOFRAME) stay 0
+      for (unsigned int i=0; i<f.hdr->framecount; i++)
+         if (f.frames[2*i] == l)
+            frames[i] = here[(g_uintptr_t)f.frames[2*i+1]] ;
+      below.swap(here) ;
+   }
+   clearstack() ;
+   for (unsigned int i=0; i<f.hdr->framecount; i++) {
+      timeline.frames.push_back(frames[i]) ;
+      timeline.framecount++ ;
+      timeline.end = timeline.next ;
+      timeline.next += timeline.inc ;
+   }
+   if (root == 0)
+      return 0 ; // empty; endofpattern() will be called soon
+   depth = f.hdr->rootlevel ;
+   hashed = 1 ;
+   return 0 ;
+}
+/*
+ *   Number the ghnodes of each depth in the order their parents need
+ *   them, using the same fields and marks as writecell_2p1, and
+ *   collect them by depth.
+ */
+void ghashbase::mcbnumber(ghnode *root, int depth,
+                          vector<vector<ghnode *> > &levels) {
+   if (root == zeroghnode(depth))
+      return ;
+   vector<ghnode *> &level = levels[depth] ;
+   if (depth == 0) {
+      if (root->nw != 0)
+         return ;
+      level.push_back(root) ;
+      root->nw = (ghnode *)(g_uintptr_t)level.size() ;
+   } else {
+      if (marked2(root))
+         return ;
+      unhash_ghnode2(root) ;
+      mark2(root) ;
+      mcbnumber(root->nw, depth-1, levels) ;
+      mcbnumber(root->ne, depth-1, levels) ;
+      mcbnumber(root->sw, depth-1, levels) ;
+      mcbnumber(root->se, depth-1, levels) ;
+      level.push_back(root) ;
+      root->next = (ghnode *)(g_uintptr_t)level.size() ;
+   }
+   // note:  we *must* not abort this prescan
+   if ((++cellcounter & 4095) == 0)
+      lifeabortprogress(0, "Scanning tree") ;
+}
+g_uintptr_t ghashbase::mcbindex(ghnode *n, int depth) {
+   if (n == zeroghnode(depth))
+      return 0 ;
+   return (g_uintptr_t)(depth == 0 ? n->nw : n->next) ;
+}
+const char *ghashbase::writeBinaryFormat(std::ostream &os, char *comments,
+                                         int withpops) {
+   int framestosave = timeline.savetimeline ? timeline.framecount : 0 ;
+   mcbheader h ;
+   std::string gen, start ;
+   initmcbheader(h, withpops, framestosave, gen, start) ;
+   h.leafbytes = 4 ;
+   int rootdepth = ghnode_depth(root) ;
+   int maxdepth = rootdepth ;
+   // evicted frames are left out; the reader recomputes them as needed
+   vector<int> depths(framestosave) ;
+   for (int i=0; i<framestosave; i++) {
+      if (timeline.frames[i] == 0)
+         continue ;
+      depths[i] = ghnode_depth((ghnode *)timeline.frames[i]) ;
+      if (depths[i] > maxdepth)
+         maxdepth = depths[i] ;
+   }
+   inGC = 1 ;
+   cellcounter = 0 ;
+   vector<vector<ghnode *> > levels(maxdepth + 1) ;
+   for (int i=0; i<framestosave; i++)
+      if (timeline.frames[i])
+         mcbnumber((ghnode *)timeline.frames[i], depths[i], levels) ;
+   mcbnumber(root, rootdepth, levels) ;
+   vector<unsigned G_INT64> counts(levels.size()), frames ;
+   h.idxbytes = 4 ;
+   for (size_t l=0; l<levels.size(); l++) {
+      counts[l] = levels[l].size() ;
+      if (counts[l] > 0xffffffffU)
+         h.idxbytes = 8 ;
+   }
+   h.rootlevel = rootdepth ;
+   h.rootindex = mcbindex(root, rootdepth) ;
+   for (int i=0; i<framestosave; i++) {
+      if (timeline.frames[i] == 0) {
+         frames.push_back(MCBNOFRAME) ;
+         frames.push_back(0) ;
+         continue ;
+      }
+      frames.push_back(depths[i]) ;
+      frames.push_back(mcbindex((ghnode *)timeline.frames[i], depths[i])) ;
+   }
+   mcbwriter w(os) ;
+   w.writeheader(h, counts, frames, getrule(), gen.c_str(), start.c_str(),
+                 comments) ;
+   writecells = cellcounter ;
+   cellcounter = 0 ;
+   vector<unsigned G_INT64> pops, belowpops(1) ;
+   for (size_t l=0; l<levels.size() && !isaborted(); l++) {
+      int d = (int)l ;
+      pops.assign(levels[l].size() + 1, 0) ;
+      for (size_t i=0; i<levels[l].size(); i++) {
+         ghnode *n = levels[l][i] ;
+         if (d == 0) {
+            ghleaf *lf = (ghleaf *)n ;
+            state q[4] = { lf->nw, lf->ne, lf->sw, lf->se } ;
+            w.put(q, sizeof(q)) ;
+            pops[i+1] = (q[0] != 0) + (q[1] != 0) + (q[2] != 0) + (q[3] != 0) ;
+         } else {
+            ghnode *k[4] = { n->nw, n->ne, n->sw, n->se } ;
+            unsigned G_INT64 p = 0 ;
+            for (int j=0; j<4; j++) {
+               g_uintptr_t c = mcbindex(k[j], d-1) ;
+               w.putindex(c, h.idxbytes) ;
+               p += belowpops[c] ;
+               if (p < belowpops[c])
+                  p = ~(unsigned G_INT64)0 ; // saturate
+            }
+            pops[i+1] = p ;
+         }
+         if ((++cellcounter & 4095) == 0) {
+            sprintf(progressmsg, "File size: %.2f MB", w.size() / 1048576.0) ;
+            lifeabortprogress(cellcounter/(double)writecells, progressmsg) ;
+            if (isaborted())
+               break ;
+         }
+      }
+      w.pad() ;
+      if (withpops) {
+         w.put(pops.data() + 1, (pops.size() - 1) * 8) ;
+         w.pad() ;
+      }
+      belowpops.swap(pops) ;
+   }
+   w.flush() ;
+   for (int i=0; i<framestosave; i++)
+      if (timeline.frames[i])
+         afterwritemc((ghnode *)timeline.frames[i], depths[i]) ;
+   afterwritemc(root, rootdepth) ;
+   inGC = 0 ;
+   return 0 ;
+}
 char ghashbase::statusline[120] ;
 void ghashbase::doInitializeAlgoInfo(staticAlgoInfo &ai) {
    ai.setDefaultBaseStep(8) ;
@@ -6,6 +6,7 @@
 #include "lifealgo.h"
 #include "liferules.h"
 #include "util.h"
+#include <unordered_map>
 /*
  *   This class forms the basis of all hashlife-type algorithms except
  *   the highly-optimized hlifealgo (which is most appropriate for
@@ -31,7 +32,7 @@ struct ghleaf {
    ghnode *next ;              /* hash link */
    ghnode *isghnode ;          /* must always be zero for leaves */
    state nw, ne, sw, se ;      /* constant */
-   bigint leafpop ;            /* how many set bits */
+   unsigned int leafpop ;      /* how many set bits */
 } ;
 /*
  *   If it is a struct ghnode, this returns a non-zero value, otherwise it
@@ -50,6 +51,15 @@ struct ghsetup_t {
 } ;
 #endif
 
+/*
+ *   The state of a getruns walk; only defined in ghashbase.cpp.
+ */
+struct ghrunwalk ;
+/*
+ *   A change to one leaf made by setcells or setruns; only defined in
+ *   ghashbase.cpp.
+ */
+struct ghleafedit ;
 /**
  *   Our ghashbase class.  Note that this is an abstract class; you need
  *   to expand specific methods to specialize it for a particular multi-state
@@ -63,6 +73,12 @@ public:
    //  This should be overridden by a deriving class.
    virtual state slowcalc(state nw, state n, state ne, state w, state c,
                           state e, state sw, state s, state se) = 0 ;
+   //  Step a block of cells one generation:  out[y*stride+x] is the
+   //  new state of in[(y+1)*stride+x+1] for x<wd and y<ht.  The default
+   //  calls slowcalc per cell; deriving classes should override it with
+   //  ghslowcalcblock (below) or their own table-driven loop.
+   virtual void slowcalcblock(state *out, const state *in, int stride,
+                              int wd, int ht) ;
    // note that for ghashbase, clearall() releases no memory; it retains
    // the full cache information but just sets the current pattern to
    // the empty pattern.
@@ -70,6 +86,14 @@ public:
    virtual int setcell(int x, int y, int newstate) ;
    virtual int getcell(int x, int y) ;
    virtual int nextcell(int x, int y, int &v) ;
+   virtual int setcells(const int *cells, size_t n, int multistate,
+                        int dx, int dy) ;
+   virtual int setruns(const int *runs, size_t n, int dx, int dy) ;
+   virtual int getruns(const bigint &top, const bigint &left,
+                       const bigint &bottom, const bigint &right,
+                       liferunsink &sink) ;
+   virtual cellhash::value gethash(const bigint &top, const bigint &left,
+                                   const bigint &bottom, const bigint &right) ;
    virtual void endofpattern() ;
    virtual void setIncrement(bigint inc) ;
    virtual void setIncrement(int inc) { setIncrement(bigint(inc)) ; }
@@ -84,6 +108,9 @@ public:
    virtual void step() ;
    virtual void* getcurrentstate() { return root ; }
    virtual void setcurrentstate(void *n) ;
+   virtual void *pinstate() ;
+   virtual void unpinstate(void *n) ;
+   virtual double getkeptfraction() { return keptfraction ; }
    /*
     *   The contract of draw() is that it render every pixel in the
     *   viewport precisely once.  This allows us to eliminate all
@@ -93,8 +120,20 @@ public:
    virtual void fit(viewport &view, int force) ;
    virtual void lowerRightPixel(bigint &x, bigint &y, int mag) ;
    virtual void findedges(bigint *t, bigint *l, bigint *b, bigint *r) ;
-   virtual const char *readmacrocell(char *line) ;
+   virtual const char *readmacrocell(patternreader &reader, char *line) ;
    virtual const char *writeNativeFormat(std::ostream &os, char *comments) ;
+   virtual const char *readbinarymacrocell(const char *data, size_t len) ;
+   virtual const char *writeBinaryFormat(std::ostream &os, char *comments,
+                                         int withpops) ;
+   virtual void setGCMode(int incremental, int age) {
+      incgc = incremental ;
+      gcage = age ;
+      if (!age)
+         agenow = 0 ;
+   }
+   virtual void setLeafBlock(int cells) {
+      blockdepth = cells >= 16 ? 3 : cells >= 8 ? 2 : 1 ;
+   }
    static void doInitializeAlgoInfo(staticAlgoInfo &) ;
    
 private:
@@ -121,12 +160,15 @@ private:
  */
    ghnode **stack ;
    int stacksize ;
+   std::vector<ghnode *> pinned ;   // the roots pinstate keeps
+   double keptfraction ;            // of the ghnodes, by the last gc
    g_uintptr_t hashpop, hashlimit, hashprime ;
 #ifndef PRIMEMOD
    g_uintptr_t hashmask ;
 #endif
    static double maxloadfactor ;
    ghnode **hashtab ;
+   std::unordered_map<ghnode *, cellhash::value> nodehashes ;
    int halvesdone ;
    int gsp ;
    g_uintptr_t alloced, maxmem ;
@@ -154,7 +196,12 @@ private:
    g_uintptr_t cellcounter ; // used when writing
    g_uintptr_t writecells ; // how many to write
    int gccount ; // how many gcs total this pattern
+   int incgc, gcage ; // gc modes; see setGCMode in lifealgo.h
+   int agenow ; // the last gc freed too little, so this one ages the cache
+   int sweeping ; // an incremental gc's sweep is unfinished
+   ghnode *sweepblock ; // the next block it will sweep
    int gcstep ; // how many gcs this step
+   int blockdepth ; // nodes below this depth are stepped by slowcalcblock
    hperf running_hperf, step_hperf, inc_hperf ;
    int softinterrupt ;
    static char statusline[] ;
@@ -172,7 +219,9 @@ private:
    ghnode *getres(ghnode *n, int depth) ;
    ghnode *dorecurs(ghnode *n, ghnode *ne, ghnode *t, ghnode *e, int depth) ;
    ghnode *dorecurs_half(ghnode *n, ghnode *ne, ghnode *t, ghnode *e, int depth) ;
-   ghleaf *dorecurs_ghleaf(ghleaf *n, ghleaf *ne, ghleaf *t, ghleaf *e) ;
+   ghnode *dorecurs_block(ghnode *n, int depth) ;
+   void fillblock(ghnode *n, int depth, state *p, int stride) ;
+   ghnode *buildblock(const state *p, int depth, int stride) ;
    ghnode *newghnode() ;
    ghleaf *newghleaf() ;
    ghnode *newclearedghnode() ;
@@ -182,19 +231,38 @@ private:
    ghnode *zeroghnode(int depth) ;
    ghnode *pushroot(ghnode *n) ;
    ghnode *gsetbit(ghnode *n, int x, int y, int newstate, int depth) ;
+   int setbatch(const int *p, size_t n, int stride, int dx, int dy) ;
+   ghnode *setleaves(ghnode *n, int depth, const ghleafedit *b,
+                     const ghleafedit *e) ;
    int getbit(ghnode *n, int x, int y, int depth) ;
    int nextbit(ghnode *n, int x, int y, int depth, int &v) ;
+   int bandruns(ghrunwalk &w, int depth, G_INT64 y) ;
+   int splitroot(const bigint &top, const bigint &left,
+                 const bigint &bottom, const bigint &right,
+                 vector<std::pair<std::pair<G_INT64, G_INT64>, ghnode *> >
+                                                                 &start) ;
+   cellhash::value nodehash(ghnode *n, int depth) ;
+   cellhash::value recthash(ghnode *n, int depth, G_INT64 x, G_INT64 y,
+                            cellhash::value fx, cellhash::value fy,
+                            G_INT64 wd, G_INT64 ht) ;
    ghnode *hashpattern(ghnode *root, int depth) ;
    ghnode *popzeros(ghnode *n) ;
    const bigint &calcpop(ghnode *root, int depth) ;
    void aftercalcpop2(ghnode *root, int depth) ;
    void afterwritemc(ghnode *root, int depth) ;
+   void mcbnumber(ghnode *root, int depth, vector<vector<ghnode *> > &levels) ;
+   g_uintptr_t mcbindex(ghnode *n, int depth) ;
    void calcPopulation() ;
    ghnode *save(ghnode *n) ;
    void pop(int n) ;
    void clearstack() ;
    void clearcache() ;
    void gc_mark(ghnode *root, int invalidate) ;
+   void gc_rehash(ghnode *root, int invalidate) ;
+   g_uintptr_t hashof(ghnode *p) ;
+   int inhash(ghnode *p, g_uintptr_t h) ;
+   void sweepslice() ;
+   int takereused(ghnode *n) ;
    void do_gc(int invalidate) ;
    void clearcache(ghnode *n, int depth, int clearto) ;
    void clearcache_p1(ghnode *n, int depth, int clearto) ;
@@ -215,4 +283,20 @@ private:
    // AKT: set all pixels to background color
    void killpixels();
 } ;
+/*
+ *   A slowcalcblock body for deriving classes; calling T::slowcalc
+ *   directly lets the compiler inline the rule into the loop.
+ */
+template <class T>
+inline void ghslowcalcblock(T *algo, state *out, const state *in, int stride,
+                            int wd, int ht) {
+   for (int y=0; y<ht; y++) {
+      const state *p = in + y * stride ;
+      state *q = out + y * stride ;
+      for (int x=0; x<wd; x++, p++)
+         q[x] = algo->T::slowcalc(p[0], p[1], p[2],
+                                  p[stride], p[stride+1], p[stride+2],
+                                  p[2*stride], p[2*stride+1], p[2*stride+2]) ;
+   }
+}
 #endif
@@ -18,7 +18,170 @@
 #include <stdlib.h>
 #include <string.h>
 #include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <unordered_map>
+#include <algorithm>
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 using namespace std ;
+/*
+ *   Multi-threaded mode.  The expensive part of a step is the tree
+ *   of getres() calls, and in dorecurs the nine subresults (and then
+ *   the four results built from them) are independent of each other.
+ *   Above a depth threshold we turn each missing subresult into a task,
+ *   push the tasks on our own work queue, and let idle threads steal
+ *   them; a thread waiting for its tasks runs queued work itself.  Since
+ *   nodes are canonical, it doesn't matter which thread computes a
+ *   result or in what order, so the results are identical to those of
+ *   the serial code (at worst, two threads compute the same result).
+ *
+ *   Each thread keeps its own gc stack and free node list.  The hash
+ *   table is protected by an array of striped spin locks.  Garbage
+ *   collection and resizing still need the whole universe to themselves,
+ *   so they are done by the stepping thread while all the other threads
+ *   are parked at a safepoint (in getres, in the allocator, or while
+ *   waiting for tasks); a thread that wants one raises a flag and parks.
+ *
+ *   Subresults that have been computed but not yet combined are kept in
+ *   an hframe on the C stack; each thread's frames are chained so the
+ *   gc can find them.
+ */
+struct htask {
+   node *n ;
+   int depth ;
+   hframe *f ;
+   int slot ;
+} ;
+struct hframe {
+   node *slot[13] ;
+   hframe *prev ;
+   std::atomic<int> pending ;
+} ;
+struct hthreadctx {
+   node **stack ;
+   int stacksize, gsp ;
+   node *freenodes ;
+   int askedgc ;
+   hframe *frames ;
+   int halves ;
+   int ismain ;
+   std::mutex qlock ;
+   std::deque<htask *> q ;
+} ;
+const int NBUCKETLOCKS = 4096 ;
+struct hlifethreads {
+   int n ;                          // number of threads, including ours
+   hthreadctx *ctx ;                // ctx[0] belongs to the stepping thread
+   std::thread **workers ;
+   std::mutex lock ;                // guards the next group of fields
+   std::condition_variable cv, workcv ;
+   int running, parked, shutdown, stepping ;
+   int wantgc, wantresize ;
+   std::atomic<int> stop ;          // a thread wants the world stopped
+   std::atomic<int> abort ;         // the step was interrupted
+   std::atomic<int> idle ;          // threads waiting for work
+   std::atomic<g_uintptr_t> newnodes ; // hashed since last exclusive op
+   std::mutex alloclock ;           // guards the shared free list
+   std::atomic<int> bucketlocks[NBUCKETLOCKS] ;
+} ;
+/*
+ *   The thread context of the current thread while it is working on
+ *   a multi-threaded step.
+ */
+static thread_local hthreadctx *curctx ;
+/*
+ *   The hash buckets are guarded by a table of spin locks.
+ */
+static inline void lockbucket(hlifethreads *mt, g_uintptr_t h) {
+   std::atomic<int> &l = mt->bucketlocks[h & (NBUCKETLOCKS - 1)] ;
+   while (l.exchange(1, std::memory_order_acquire))
+      std::this_thread::yield() ;
+}
+static inline void unlockbucket(hlifethreads *mt, g_uintptr_t h) {
+   mt->bucketlocks[h & (NBUCKETLOCKS - 1)].store(0, std::memory_order_release) ;
+}
+/*
+ *   The persistent result cache is a file we map into memory.  It
+ *   starts with a header, then an open-addressed index of slots, then
+ *   the data:  a content-addressed store of nodes, each a 16-byte cell
+ *   holding the cell numbers of its children (or DCLEAF and its bits,
+ *   for a leaf).  The index maps the content hash of a node to its
+ *   cell, and the key of a result (see diskkey) to the cell of the
+ *   result; both hashes are 128 bits, so a hit is never a collision in
+ *   practice.  The header records the rule the file was filled with,
+ *   and the file is ignored when running any other rule.  Only one
+ *   process at a time writes (it holds an exclusive lock on the file);
+ *   others just read.  A writer fills in a cell and the slot's key
+ *   before it sets the slot's offset, so readers never see a partial
+ *   entry.
+ */
+static const char DCMAGIC[9] = "GolRC002" ;
+const unsigned int DCLEAF = 0xffffffff ;
+const unsigned G_INT64 DCNODETAG = 0x6a09e667f3bcc909ULL ;
+const int DCPROBES = 32 ;
+struct hdiskhdr {
+   char magic[8] ;
+   G_INT64 size, nslots, data, used, entries ;
+   unsigned G_INT64 rulekey ;
+   char rule[456] ;          // empty until the first result is stored
+} ;
+struct hdiskslot {
+   unsigned G_INT64 key, check ;
+   G_INT64 off ;             // zero means empty
+} ;
+static G_INT64 diskdata(G_INT64 nslots) {
+   return (G_INT64)(sizeof(hdiskhdr) + nslots * sizeof(hdiskslot) + 15) & ~(G_INT64)15 ;
+}
+enum { DCOTHERRULE, DCTHISRULE, DCNORULE } ;
+struct hdiskcache {
+   int fd, writable, mindepth ;
+   int rulestate ;           // does the file hold results for our rule?
+   char *base ;
+   hdiskhdr *hdr ;
+   hdiskslot *slots ;
+   unsigned G_INT64 rulekey ;
+   double hits, misses, stores ;
+   // these remember node pointers, so they're cleared by every gc
+   std::unordered_map<node *, hdiskkey> memo ; // content hashes
+   std::unordered_map<node *, unsigned int> stored ;   // cells in the file
+   std::unordered_map<unsigned int, node *> built ;    // used by diskget
+} ;
+static unsigned G_INT64 hmix(unsigned G_INT64 x) {
+   x ^= x >> 30 ;
+   x *= 0xbf58476d1ce4e5b9ULL ;
+   x ^= x >> 27 ;
+   x *= 0x94d049bb133111ebULL ;
+   x ^= x >> 31 ;
+   return x ;
+}
+/*
+ *   Find the slot holding key, or (if insert is set) the empty slot
+ *   where it should go.  Returns 0 if there isn't one.
+ */
+static hdiskslot *diskslot(hdiskcache *dc, const hdiskkey &k, int insert) {
+   G_INT64 n = dc->hdr->nslots ;
+   for (int i=0; i<DCPROBES; i++) {
+      hdiskslot *s = dc->slots + (G_INT64)((k.key + i) % n) ;
+      G_INT64 off = s->off ;
+      std::atomic_thread_fence(std::memory_order_acquire) ;
+      if (off == 0)
+         return insert ? s : 0 ;
+      if (s->key == k.key && s->check == k.check)
+         return insert ? 0 : s ;
+   }
+   return 0 ;
+}
 /*
  *   Power of two hash sizes work fine.
  */
@@ -48,6 +211,39 @@ static g_uintptr_t nexthashsize(g_uintptr_t i) {
  *   unsigned shorts; this is so we can directly index into these arrays.
  */
 static unsigned char shortpop[65536] ;
+/*
+ *   The population and bounding box of every node a query has reached,
+ *   so that after a step a query only visits the nodes the step made.
+ *   It's an open-addressed table keyed by node (n is 0 in an empty
+ *   slot); gc drops the entries of the nodes it frees.  The few nodes
+ *   too big for 64 bits keep their bigint population or box on the side.
+ */
+struct hsumtable {
+   std::vector<nodesum> slots ;
+   g_uintptr_t used ;
+   std::unordered_map<node *, bigint> bigpops ;
+   std::unordered_map<node *, std::vector<bigint> > bigboxes ;
+   hsumtable() : used(0) {}
+   g_uintptr_t slotof(node *n) const {
+      return (g_uintptr_t)(((unsigned long long)(g_uintptr_t)n *
+                            0x9e3779b97f4a7c15ULL) >> 20) & (slots.size() - 1) ;
+   }
+   nodesum *find(node *n) {
+      if (slots.empty())
+         return 0 ;
+      for (g_uintptr_t i=slotof(n); slots[i].n; i=(i+1) & (slots.size()-1))
+         if (slots[i].n == n)
+            return &slots[i] ;
+      return 0 ;
+   }
+   void insert(const nodesum &s) {
+      g_uintptr_t i = slotof(s.n) ;
+      while (slots[i].n)
+         i = (i + 1) & (slots.size() - 1) ;
+      slots[i] = s ;
+      used++ ;
+   }
+} ;
 /*
  *   The cached result of an 8-square is a new 4-square representing
  *   two generations into the future.  This subroutine calculates that
@@ -81,7 +277,8 @@ static unsigned char shortpop[65536] ;
        ((t00) << 15) | ((t01) << 13) | (((t02) << 11) & 0x1000) | \
        (((t10) << 7) & 0x880) | ((t11) << 5) | (((t12) << 3) & 0x110) | \
        (((t20) >> 1) & 0x8) | ((t21) >> 3) | ((t22) >> 5)
-void hlifealgo::leafres(leaf *n) {
+void hlifealgo::leafres(leaf *l) {
+   leafbits *n = bits(l) ;
    unsigned short
    t00 = ruletable[n->nw],
    t01 = ruletable[((n->nw << 2) & 0xcccc) | ((n->ne >> 2) & 0x3333)],
@@ -99,8 +296,8 @@ void hlifealgo::leafres(leaf *n) {
    (ruletable[(t01 << 10) | (t02 << 8) | (t11 << 2) | t12] << 8) |
    (ruletable[(t10 << 10) | (t11 << 8) | (t20 << 2) | t21] << 2) |
     ruletable[(t11 << 10) | (t12 << 8) | (t21 << 2) | t22] ;
-   n->leafpop = bigint((short)(shortpop[n->nw] + shortpop[n->ne] +
-                               shortpop[n->sw] + shortpop[n->se])) ;
+   n->leafpop = shortpop[n->nw] + shortpop[n->ne] + shortpop[n->sw] +
+                shortpop[n->se] ;
 }
 /*
  *   We do now support garbage collection, but there are some routines we
@@ -141,9 +338,10 @@ void hlifealgo::resize() {
 #endif
    g_uintptr_t i, nhashprime = nexthashsize(2 * hashprime) ;
    node *p, **nhashtab ;
+   size_t bucketsize = compact ? sizeof(unsigned int) : sizeof(node *) ;
    if (hashprime > (totalthings >> 2)) {
       if (alloced > maxmem ||
-          nhashprime * sizeof(node *) > (maxmem - alloced)) {
+          nhashprime * bucketsize > (maxmem - alloced)) {
          hashlimit = G_MAX ;
          return ;
       }
@@ -152,37 +350,39 @@ void hlifealgo::resize() {
      sprintf(statusline, "Resizing hash to %" PRIuPTR "...", nhashprime) ;
      lifestatus(statusline) ;
    }
-   nhashtab = (node **)calloc(nhashprime, sizeof(node *)) ;
+   nhashtab = (node **)calloc(nhashprime, bucketsize) ;
    if (nhashtab == 0) {
      lifewarning("Out of memory; running in a somewhat slower mode; "
                  "try reducing the hash memory limit after restarting.") ;
      hashlimit = G_MAX ;
      return ;
    }
-   alloced += sizeof(node *) * (nhashprime - hashprime) ;
+   alloced += bucketsize * (nhashprime - hashprime) ;
    g_uintptr_t ohashprime = hashprime ;
    hashprime = nhashprime ;
 #ifndef PRIMEMOD
    hashmask = hashprime - 1 ;
 #endif
+   node **ohashtab = hashtab ;
+   hashtab = nhashtab ;
    for (i=0; i<ohashprime; i++) {
-      for (p=hashtab[i]; p;) {
-         node *np = p->next ;
+      p = compact ? ch(((unsigned int *)ohashtab)[i]) : ohashtab[i] ;
+      while (p) {
+         node *np = nextof(p) ;
          g_uintptr_t h ;
-         if (is_node(p)) {
-            h = node_hash(p->nw, p->ne, p->sw, p->se) ;
+         if (notleaf(p)) {
+            h = node_hash(nwof(p), neof(p), swof(p), seof(p)) ;
          } else {
-            leaf *l = (leaf *)p ;
+            leafbits *l = bits(p) ;
             h = leaf_hash(l->nw, l->ne, l->sw, l->se) ;
          }
          h = HASHMOD(h) ;
-         p->next = nhashtab[h] ;
-         nhashtab[h] = p ;
+         setnext(p, bucket(h)) ;
+         setbucket(h, p) ;
          p = np ;
       }
    }
-   free(hashtab) ;
-   hashtab = nhashtab ;
+   free(ohashtab) ;
    hashlimit = (g_uintptr_t)(maxloadfactor * hashprime) ;
    if (verbose) {
      strcpy(statusline+strlen(statusline), " done.") ;
@@ -196,6 +396,15 @@ void hlifealgo::resize() {
  *   new node and store it in the hash table, and return that.
  */
 node *hlifealgo::find_node(node *nw, node *ne, node *sw, node *se) {
+   return compact ? find_node<1>(nw, ne, sw, se)
+                  : find_node<0>(nw, ne, sw, se) ;
+}
+template <int C>
+node *hlifealgo::find_node(node *nw, node *ne, node *sw, node *se) {
+   if (parallel)
+      return mt_find_node(nw, ne, sw, se) ;
+   if (C)
+      return cfind_node(nw, ne, sw, se) ;
    node *p ;
    g_uintptr_t h = node_hash(nw,ne,sw,se) ;
    node *pred = 0 ;
@@ -227,6 +436,16 @@ node *hlifealgo::find_node(node *nw, node *ne, node *sw, node *se) {
 }
 leaf *hlifealgo::find_leaf(unsigned short nw, unsigned short ne,
                                   unsigned short sw, unsigned short se) {
+   return compact ? find_leaf<1>(nw, ne, sw, se)
+                  : find_leaf<0>(nw, ne, sw, se) ;
+}
+template <int C>
+leaf *hlifealgo::find_leaf(unsigned short nw, unsigned short ne,
+                                  unsigned short sw, unsigned short se) {
+   if (parallel)
+      return mt_find_leaf(nw, ne, sw, se) ;
+   if (C)
+      return cfind_leaf(nw, ne, sw, se) ;
    leaf *p ;
    leaf *pred = 0 ;
    g_uintptr_t h = leaf_hash(nw, ne, sw, se) ;
@@ -258,6 +477,79 @@ leaf *hlifealgo::find_leaf(unsigned short nw, unsigned short ne,
       resize() ;
    return p ;
 }
+/*
+ *   The same two lookups for the compact node store.
+ */
+node *hlifealgo::cfind_node(node *nw, node *ne, node *sw, node *se) {
+   unsigned int *tab = (unsigned int *)hashtab ;
+   unsigned int inw = ci(nw), ine = ci(ne), isw = ci(sw), ise = ci(se) ;
+   g_uintptr_t h = HASHMOD(node_hash(nw,ne,sw,se)) ;
+   cnode *pred = 0 ;
+   for (unsigned int i=tab[h]; i; ) {
+      cnode *p = cn(ch(i)) ;
+      if (inw == p->nw && ine == p->ne && isw == p->sw && ise == p->se) {
+         if (pred) { /* move this one to the front */
+            pred->next = p->next ;
+            p->next = tab[h] ;
+            tab[h] = i ;
+         }
+         return save(ch(i)) ;
+      }
+      pred = p ;
+      i = p->next ;
+   }
+   node *r = newnode() ;
+   tab = (unsigned int *)hashtab ;
+   cnode *p = cn(r) ;
+   p->nw = inw ;
+   p->ne = ine ;
+   p->sw = isw ;
+   p->se = ise ;
+   p->res = 0 ;
+   p->next = tab[h] ;
+   tab[h] = ci(r) ;
+   hashpop++ ;
+   save(r) ;
+   if (hashpop > hashlimit)
+      resize() ;
+   return r ;
+}
+leaf *hlifealgo::cfind_leaf(unsigned short nw, unsigned short ne,
+                            unsigned short sw, unsigned short se) {
+   unsigned int *tab = (unsigned int *)hashtab ;
+   g_uintptr_t h = HASHMOD(leaf_hash(nw, ne, sw, se)) ;
+   cleaf *pred = 0 ;
+   for (unsigned int i=tab[h]; i; ) {
+      cleaf *p = (cleaf *)cn(ch(i)) ;
+      if (nw == p->nw && ne == p->ne && sw == p->sw && se == p->se &&
+          !p->isnode) {
+         if (pred) {
+            pred->next = p->next ;
+            p->next = tab[h] ;
+            tab[h] = i ;
+         }
+         return (leaf *)save(ch(i)) ;
+      }
+      pred = p ;
+      i = p->next ;
+   }
+   node *r = newnode() ;
+   tab = (unsigned int *)hashtab ;
+   cleaf *p = (cleaf *)cn(r) ;
+   p->nw = nw ;
+   p->ne = ne ;
+   p->sw = sw ;
+   p->se = se ;
+   p->isnode = 0 ;
+   leafres((leaf *)r) ;
+   p->next = tab[h] ;
+   tab[h] = ci(r) ;
+   hashpop++ ;
+   save(r) ;
+   if (hashpop > hashlimit)
+      resize() ;
+   return (leaf *)r ;
+}
 /*
  *   The following routine does the same, but first it checks to see if
  *   the cached result is any good.  If it is, it directly returns that.
@@ -267,9 +559,20 @@ leaf *hlifealgo::find_leaf(unsigned short nw, unsigned short ne,
  *   stack pointer and garbage collection stuff.
  */
 node *hlifealgo::getres(node *n, int depth) {
-   if (n->res)
-     return n->res ;
-   node *res = 0 ;
+   return compact ? getres<1>(n, depth) : getres<0>(n, depth) ;
+}
+template <int C>
+node *hlifealgo::getres(node *n, int depth) {
+   if (parallel)
+     return mt_getres<C>(n, depth) ;
+   node *res = resof<C>(n) ;
+   if (res) {
+     if (gcage) {
+       setreused<C>(n) ;
+       save(res) ;
+     }
+     return res ;
+   }
    /**
     *   This routine be the only place we assign to res.  We use
     *   the fact that the poll routine is *sticky* to allow us to
@@ -286,23 +589,32 @@ node *hlifealgo::getres(node *n, int depth) {
    int sp = gsp ;
    if (running_hperf.fastinc(depth, ngens < depth))
       running_hperf.report(inc_hperf, verbose) ;
+   int fromdisk = 0 ;
+   if (dc && depth >= dc->mindepth) {
+     res = diskget(n, depth) ;
+     fromdisk = (res != 0) ;
+   }
    depth-- ;
-   if (ngens >= depth) {
-     if (is_node(n->nw)) {
-       res = dorecurs(n->nw, n->ne, n->sw, n->se, depth) ;
+   node *nw = nwof<C>(n), *ne = neof<C>(n), *sw = swof<C>(n),
+        *se = seof<C>(n) ;
+   if (fromdisk) {
+     // nothing to compute
+   } else if (ngens >= depth) {
+     if (notleaf<C>(nw)) {
+       res = dorecurs<C>(nw, ne, sw, se, depth) ;
      } else {
-       res = (node *)dorecurs_leaf((leaf *)n->nw, (leaf *)n->ne,
-                                   (leaf *)n->sw, (leaf *)n->se) ;
+       res = (node *)dorecurs_leaf<C>((leaf *)nw, (leaf *)ne,
+                                      (leaf *)sw, (leaf *)se) ;
      }
    } else {
-     if (is_node(n->nw)) {
-       res = dorecurs_half(n->nw, n->ne, n->sw, n->se, depth) ;
+     if (notleaf<C>(nw)) {
+       res = dorecurs_half<C>(nw, ne, sw, se, depth) ;
      } else if (ngens == 0) {
-       res = (node *)dorecurs_leaf_quarter((leaf *)n->nw, (leaf *)n->ne,
-                                           (leaf *)n->sw, (leaf *)n->se) ;
+       res = (node *)dorecurs_leaf_quarter<C>((leaf *)nw, (leaf *)ne,
+                                              (leaf *)sw, (leaf *)se) ;
      } else {
-       res = (node *)dorecurs_leaf_half((leaf *)n->nw, (leaf *)n->ne,
-                                        (leaf *)n->sw, (leaf *)n->se) ;
+       res = (node *)dorecurs_leaf_half<C>((leaf *)nw, (leaf *)ne,
+                                           (leaf *)sw, (leaf *)se) ;
      }
    }
    pop(sp) ;
@@ -312,20 +624,35 @@ node *hlifealgo::getres(node *n, int depth) {
    else {
      if (ngens < depth && halvesdone < 1000)
        halvesdone++ ;
-     n->res = res ;
+     setres<C>(n, res) ;
+     if (gcage) {
+       setreused<C>(n) ;
+       save(res) ;
+     }
+     if (dc && !fromdisk && depth + 1 >= dc->mindepth)
+       diskput(n, depth + 1, res) ;
    }
    return res ;
 }
 #ifdef USEPREFETCH
+template <int C>
 void hlifealgo::setupprefetch(setup_t &su, node *nw, node *ne, node *sw, node *se) {
    su.h = node_hash(nw,ne,sw,se) ;
    su.nw = nw ;
    su.ne = ne ;
    su.sw = sw ;
    su.se = se ;
-   su.prefetch(hashtab + HASHMOD(su.h)) ;
+   if (C)
+      su.prefetch((node **)((unsigned int *)hashtab + HASHMOD(su.h))) ;
+   else
+      su.prefetch(hashtab + HASHMOD(su.h)) ;
 }
+template <int C>
 node *hlifealgo::find_node(setup_t &su) {
+   if (parallel)
+      return mt_find_node(su.nw, su.ne, su.sw, su.se) ;
+   if (C)
+      return cfind_node(su.nw, su.ne, su.sw, su.se) ;
    node *p ;
    node *pred = 0 ;
    g_uintptr_t h = HASHMOD(su.h) ;
@@ -354,34 +681,38 @@ node *hlifealgo::find_node(setup_t &su) {
       resize() ;
    return p ;
 }
+template <int C>
 node *hlifealgo::dorecurs(node *n, node *ne, node *t, node *e, int depth) {
-   int sp = gsp ;
+   int sp = stackpos() ;
    setup_t su[5] ;
-   setupprefetch(su[2], n->se, ne->sw, t->ne, e->nw) ;
-   setupprefetch(su[0], n->ne, ne->nw, n->se, ne->sw) ;
-   setupprefetch(su[1], ne->sw, ne->se, e->nw, e->ne) ;
-   setupprefetch(su[3], n->sw, n->se, t->nw, t->ne) ;
-   setupprefetch(su[4], t->ne, e->nw, t->se, e->sw) ;
+   setupprefetch<C>(su[2], seof<C>(n), swof<C>(ne), neof<C>(t),
+                    nwof<C>(e)) ;
+   setupprefetch<C>(su[0], neof<C>(n), nwof<C>(ne), seof<C>(n),
+                    swof<C>(ne)) ;
+   setupprefetch<C>(su[1], swof<C>(ne), seof<C>(ne), nwof<C>(e),
+                    neof<C>(e)) ;
+   setupprefetch<C>(su[3], swof<C>(n), seof<C>(n), nwof<C>(t), neof<C>(t)) ;
+   setupprefetch<C>(su[4], neof<C>(t), nwof<C>(e), seof<C>(t), swof<C>(e)) ;
    node
-   *t00 = getres(n, depth),
-   *t01 = getres(find_node(su[0]), depth),
-   *t02 = getres(ne, depth),
-   *t12 = getres(find_node(su[1]), depth),
-   *t11 = getres(find_node(su[2]), depth),
-   *t10 = getres(find_node(su[3]), depth),
-   *t20 = getres(t, depth),
-   *t21 = getres(find_node(su[4]), depth),
-   *t22 = getres(e, depth) ;
-   setupprefetch(su[0], t11, t12, t21, t22) ;
-   setupprefetch(su[1], t10, t11, t20, t21) ;
-   setupprefetch(su[2], t00, t01, t10, t11) ;
-   setupprefetch(su[3], t01, t02, t11, t12) ;
+   *t00 = getres<C>(n, depth),
+   *t01 = getres<C>(find_node<C>(su[0]), depth),
+   *t02 = getres<C>(ne, depth),
+   *t12 = getres<C>(find_node<C>(su[1]), depth),
+   *t11 = getres<C>(find_node<C>(su[2]), depth),
+   *t10 = getres<C>(find_node<C>(su[3]), depth),
+   *t20 = getres<C>(t, depth),
+   *t21 = getres<C>(find_node<C>(su[4]), depth),
+   *t22 = getres<C>(e, depth) ;
+   setupprefetch<C>(su[0], t11, t12, t21, t22) ;
+   setupprefetch<C>(su[1], t10, t11, t20, t21) ;
+   setupprefetch<C>(su[2], t00, t01, t10, t11) ;
+   setupprefetch<C>(su[3], t01, t02, t11, t12) ;
    node
-   *t44 = getres(find_node(su[0]), depth),
-   *t43 = getres(find_node(su[1]), depth),
-   *t33 = getres(find_node(su[2]), depth),
-   *t34 = getres(find_node(su[3]), depth) ;
-   n = find_node(t33, t34, t43, t44) ;
+   *t44 = getres<C>(find_node<C>(su[0]), depth),
+   *t43 = getres<C>(find_node<C>(su[1]), depth),
+   *t33 = getres<C>(find_node<C>(su[2]), depth),
+   *t34 = getres<C>(find_node<C>(su[3]), depth) ;
+   n = find_node<C>(t33, t34, t43, t44) ;
    pop(sp) ;
    return save(n) ;
 }
@@ -398,23 +729,29 @@ node *hlifealgo::dorecurs(node *n, node *ne, node *t, node *e, int depth) {
  *   9 n/4-squares, use those to calculate 4 more n/4-squares, and
  *   then put these together into a new n/2-square.  Simple, eh?
  */
+template <int C>
 node *hlifealgo::dorecurs(node *n, node *ne, node *t, node *e, int depth) {
-   int sp = gsp ;
+   int sp = stackpos() ;
    node
-   *t11 = getres(find_node(n->se, ne->sw, t->ne, e->nw), depth),
-   *t00 = getres(n, depth),
-   *t01 = getres(find_node(n->ne, ne->nw, n->se, ne->sw), depth),
-   *t02 = getres(ne, depth),
-   *t12 = getres(find_node(ne->sw, ne->se, e->nw, e->ne), depth),
-   *t10 = getres(find_node(n->sw, n->se, t->nw, t->ne), depth),
-   *t20 = getres(t, depth),
-   *t21 = getres(find_node(t->ne, e->nw, t->se, e->sw), depth),
-   *t22 = getres(e, depth),
-   *t44 = getres(find_node(t11, t12, t21, t22), depth),
-   *t43 = getres(find_node(t10, t11, t20, t21), depth),
-   *t33 = getres(find_node(t00, t01, t10, t11), depth),
-   *t34 = getres(find_node(t01, t02, t11, t12), depth) ;
-   n = find_node(t33, t34, t43, t44) ;
+   *t11 = getres<C>(find_node<C>(seof<C>(n), swof<C>(ne), neof<C>(t),
+                                 nwof<C>(e)), depth),
+   *t00 = getres<C>(n, depth),
+   *t01 = getres<C>(find_node<C>(neof<C>(n), nwof<C>(ne), seof<C>(n),
+                                 swof<C>(ne)), depth),
+   *t02 = getres<C>(ne, depth),
+   *t12 = getres<C>(find_node<C>(swof<C>(ne), seof<C>(ne), nwof<C>(e),
+                                 neof<C>(e)), depth),
+   *t10 = getres<C>(find_node<C>(swof<C>(n), seof<C>(n), nwof<C>(t),
+                                 neof<C>(t)), depth),
+   *t20 = getres<C>(t, depth),
+   *t21 = getres<C>(find_node<C>(neof<C>(t), nwof<C>(e), seof<C>(t),
+                                 swof<C>(e)), depth),
+   *t22 = getres<C>(e, depth),
+   *t44 = getres<C>(find_node<C>(t11, t12, t21, t22), depth),
+   *t43 = getres<C>(find_node<C>(t10, t11, t20, t21), depth),
+   *t33 = getres<C>(find_node<C>(t00, t01, t10, t11), depth),
+   *t34 = getres<C>(find_node<C>(t01, t02, t11, t12), depth) ;
+   n = find_node<C>(t33, t34, t43, t44) ;
    pop(sp) ;
    return save(n) ;
 }
@@ -422,41 +759,48 @@ node *hlifealgo::dorecurs(node *n, node *ne, node *t, node *e, int depth) {
 /*
  *   Same as above, but we only do one step instead of 2.
  */
+template <int C>
 node *hlifealgo::dorecurs_half(node *n, node *ne, node *t,
                                node *e, int depth) {
-   int sp = gsp ;
+   int sp = stackpos() ;
    node
-   *t00 = getres(n, depth),
-   *t01 = getres(find_node(n->ne, ne->nw, n->se, ne->sw), depth),
-   *t10 = getres(find_node(n->sw, n->se, t->nw, t->ne), depth),
-   *t11 = getres(find_node(n->se, ne->sw, t->ne, e->nw), depth),
-   *t02 = getres(ne, depth),
-   *t12 = getres(find_node(ne->sw, ne->se, e->nw, e->ne), depth),
-   *t20 = getres(t, depth),
-   *t21 = getres(find_node(t->ne, e->nw, t->se, e->sw), depth),
-   *t22 = getres(e, depth) ;
+   *t00 = getres<C>(n, depth),
+   *t01 = getres<C>(find_node<C>(neof<C>(n), nwof<C>(ne), seof<C>(n),
+                                 swof<C>(ne)), depth),
+   *t10 = getres<C>(find_node<C>(swof<C>(n), seof<C>(n), nwof<C>(t),
+                                 neof<C>(t)), depth),
+   *t11 = getres<C>(find_node<C>(seof<C>(n), swof<C>(ne), neof<C>(t),
+                                 nwof<C>(e)), depth),
+   *t02 = getres<C>(ne, depth),
+   *t12 = getres<C>(find_node<C>(swof<C>(ne), seof<C>(ne), nwof<C>(e),
+                                 neof<C>(e)), depth),
+   *t20 = getres<C>(t, depth),
+   *t21 = getres<C>(find_node<C>(neof<C>(t), nwof<C>(e), seof<C>(t),
+                                 swof<C>(e)), depth),
+   *t22 = getres<C>(e, depth) ;
    if (depth > 3) {
-      n = find_node(find_node(t00->se, t01->sw, t10->ne, t11->nw),
-                    find_node(t01->se, t02->sw, t11->ne, t12->nw),
-                    find_node(t10->se, t11->sw, t20->ne, t21->nw),
-                    find_node(t11->se, t12->sw, t21->ne, t22->nw)) ;
+      n = find_node<C>(
+          find_node<C>(seof<C>(t00), swof<C>(t01), neof<C>(t10), nwof<C>(t11)),
+          find_node<C>(seof<C>(t01), swof<C>(t02), neof<C>(t11), nwof<C>(t12)),
+          find_node<C>(seof<C>(t10), swof<C>(t11), neof<C>(t20), nwof<C>(t21)),
+          find_node<C>(seof<C>(t11), swof<C>(t12), neof<C>(t21), nwof<C>(t22))) ;
    } else {
-      n = find_node((node *)find_leaf(((leaf *)t00)->se,
-                                             ((leaf *)t01)->sw,
-                                             ((leaf *)t10)->ne,
-                                             ((leaf *)t11)->nw),
-                    (node *)find_leaf(((leaf *)t01)->se,
-                                             ((leaf *)t02)->sw,
-                                             ((leaf *)t11)->ne,
-                                             ((leaf *)t12)->nw),
-                    (node *)find_leaf(((leaf *)t10)->se,
-                                             ((leaf *)t11)->sw,
-                                             ((leaf *)t20)->ne,
-                                             ((leaf *)t21)->nw),
-                    (node *)find_leaf(((leaf *)t11)->se,
-                                             ((leaf *)t12)->sw,
-                                             ((leaf *)t21)->ne,
-                                             ((leaf *)t22)->nw)) ;
+      n = find_node<C>((node *)find_leaf<C>(bits<C>(t00)->se,
+                                            bits<C>(t01)->sw,
+                                            bits<C>(t10)->ne,
+                                            bits<C>(t11)->nw),
+                       (node *)find_leaf<C>(bits<C>(t01)->se,
+                                            bits<C>(t02)->sw,
+                                            bits<C>(t11)->ne,
+                                            bits<C>(t12)->nw),
+                       (node *)find_leaf<C>(bits<C>(t10)->se,
+                                            bits<C>(t11)->sw,
+                                            bits<C>(t20)->ne,
+                                            bits<C>(t21)->nw),
+                       (node *)find_leaf<C>(bits<C>(t11)->se,
+                                            bits<C>(t12)->sw,
+                                            bits<C>(t21)->ne,
+                                            bits<C>(t22)->nw)) ;
    }
    pop(sp) ;
    return save(n) ;
@@ -467,112 +811,157 @@ node *hlifealgo::dorecurs_half(node *n, node *ne, node *t,
  *   we do not (yet) garbage collect leaves, we don't need all that
  *   save/pop mumbo-jumbo.
  */
-leaf *hlifealgo::dorecurs_leaf(leaf *n, leaf *ne, leaf *t, leaf *e) {
+template <int C>
+leaf *hlifealgo::dorecurs_leaf(leaf *nl, leaf *nel, leaf *tl, leaf *el) {
+   leafbits *n = bits<C>(nl), *ne = bits<C>(nel),
+            *t = bits<C>(tl), *e = bits<C>(el) ;
    unsigned short
    t00 = n->res2,
-   t01 = find_leaf(n->ne, ne->nw, n->se, ne->sw)->res2,
+   t01 = bits<C>(find_leaf<C>(n->ne, ne->nw, n->se, ne->sw))->res2,
    t02 = ne->res2,
-   t10 = find_leaf(n->sw, n->se, t->nw, t->ne)->res2,
-   t11 = find_leaf(n->se, ne->sw, t->ne, e->nw)->res2,
-   t12 = find_leaf(ne->sw, ne->se, e->nw, e->ne)->res2,
+   t10 = bits<C>(find_leaf<C>(n->sw, n->se, t->nw, t->ne))->res2,
+   t11 = bits<C>(find_leaf<C>(n->se, ne->sw, t->ne, e->nw))->res2,
+   t12 = bits<C>(find_leaf<C>(ne->sw, ne->se, e->nw, e->ne))->res2,
    t20 = t->res2,
-   t21 = find_leaf(t->ne, e->nw, t->se, e->sw)->res2,
+   t21 = bits<C>(find_leaf<C>(t->ne, e->nw, t->se, e->sw))->res2,
    t22 = e->res2 ;
-   return find_leaf(find_leaf(t00, t01, t10, t11)->res2,
-                    find_leaf(t01, t02, t11, t12)->res2,
-                    find_leaf(t10, t11, t20, t21)->res2,
-                    find_leaf(t11, t12, t21, t22)->res2) ;
+   return find_leaf<C>(bits<C>(find_leaf<C>(t00, t01, t10, t11))->res2,
+                       bits<C>(find_leaf<C>(t01, t02, t11, t12))->res2,
+                       bits<C>(find_leaf<C>(t10, t11, t20, t21))->res2,
+                       bits<C>(find_leaf<C>(t11, t12, t21, t22))->res2) ;
 }
 /*
  *   Same as above but we only do two generations.
  */
 #define combine4(t00,t01,t10,t11) (unsigned short)\
 ((((t00)<<10)&0xcc00)|(((t01)<<6)&0x3300)|(((t10)>>6)&0xcc)|(((t11)>>10)&0x33))
-leaf *hlifealgo::dorecurs_leaf_half(leaf *n, leaf *ne, leaf *t, leaf *e) {
+template <int C>
+leaf *hlifealgo::dorecurs_leaf_half(leaf *nl, leaf *nel, leaf *tl, leaf *el) {
+   leafbits *n = bits<C>(nl), *ne = bits<C>(nel),
+            *t = bits<C>(tl), *e = bits<C>(el) ;
    unsigned short
    t00 = n->res2,
-   t01 = find_leaf(n->ne, ne->nw, n->se, ne->sw)->res2,
+   t01 = bits<C>(find_leaf<C>(n->ne, ne->nw, n->se, ne->sw))->res2,
    t02 = ne->res2,
-   t10 = find_leaf(n->sw, n->se, t->nw, t->ne)->res2,
-   t11 = find_leaf(n->se, ne->sw, t->ne, e->nw)->res2,
-   t12 = find_leaf(ne->sw, ne->se, e->nw, e->ne)->res2,
+   t10 = bits<C>(find_leaf<C>(n->sw, n->se, t->nw, t->ne))->res2,
+   t11 = bits<C>(find_leaf<C>(n->se, ne->sw, t->ne, e->nw))->res2,
+   t12 = bits<C>(find_leaf<C>(ne->sw, ne->se, e->nw, e->ne))->res2,
    t20 = t->res2,
-   t21 = find_leaf(t->ne, e->nw, t->se, e->sw)->res2,
+   t21 = bits<C>(find_leaf<C>(t->ne, e->nw, t->se, e->sw))->res2,
    t22 = e->res2 ;
-   return find_leaf(combine4(t00, t01, t10, t11),
-                    combine4(t01, t02, t11, t12),
-                    combine4(t10, t11, t20, t21),
-                    combine4(t11, t12, t21, t22)) ;
+   return find_leaf<C>(combine4(t00, t01, t10, t11),
+                       combine4(t01, t02, t11, t12),
+                       combine4(t10, t11, t20, t21),
+                       combine4(t11, t12, t21, t22)) ;
 }
 /*
  *   Same as above but we only do one generation.
  */
-leaf *hlifealgo::dorecurs_leaf_quarter(leaf *n, leaf *ne,
-                                   leaf *t, leaf *e) {
+template <int C>
+leaf *hlifealgo::dorecurs_leaf_quarter(leaf *nl, leaf *nel,
+                                   leaf *tl, leaf *el) {
+   leafbits *n = bits<C>(nl), *ne = bits<C>(nel),
+            *t = bits<C>(tl), *e = bits<C>(el) ;
    unsigned short
    t00 = n->res1,
-   t01 = find_leaf(n->ne, ne->nw, n->se, ne->sw)->res1,
+   t01 = bits<C>(find_leaf<C>(n->ne, ne->nw, n->se, ne->sw))->res1,
    t02 = ne->res1,
-   t10 = find_leaf(n->sw, n->se, t->nw, t->ne)->res1,
-   t11 = find_leaf(n->se, ne->sw, t->ne, e->nw)->res1,
-   t12 = find_leaf(ne->sw, ne->se, e->nw, e->ne)->res1,
+   t10 = bits<C>(find_leaf<C>(n->sw, n->se, t->nw, t->ne))->res1,
+   t11 = bits<C>(find_leaf<C>(n->se, ne->sw, t->ne, e->nw))->res1,
+   t12 = bits<C>(find_leaf<C>(ne->sw, ne->se, e->nw, e->ne))->res1,
    t20 = t->res1,
-   t21 = find_leaf(t->ne, e->nw, t->se, e->sw)->res1,
+   t21 = bits<C>(find_leaf<C>(t->ne, e->nw, t->se, e->sw))->res1,
    t22 = e->res1 ;
-   return find_leaf(combine4(t00, t01, t10, t11),
-                    combine4(t01, t02, t11, t12),
-                    combine4(t10, t11, t20, t21),
-                    combine4(t11, t12, t21, t22)) ;
+   return find_leaf<C>(combine4(t00, t01, t10, t11),
+                       combine4(t01, t02, t11, t12),
+                       combine4(t10, t11, t20, t21),
+                       combine4(t11, t12, t21, t22)) ;
 }
 /*
  *   We keep free nodes in a linked list for allocation, and we allocate
- *   them 1000 at a time.
+ *   them 1000 at a time.  If an incremental gc left a sweep unfinished
+ *   we sweep some more before allocating, and we don't start another
+ *   gc until the sweep is done.
  */
 node *hlifealgo::newnode() {
    node *r ;
-   if (freenodes == 0) {
-      int i ;
-      freenodes = (node *)calloc(1001, sizeof(node)) ;
-      if (freenodes == 0)
-         lifefatal("Out of memory; try reducing the hash memory limit.") ;
-      alloced += 1001 * sizeof(node) ;
-      freenodes->next = nodeblocks ;
-      nodeblocks = freenodes++ ;
-      for (i=0; i<999; i++) {
-         freenodes[1].next = freenodes ;
-         freenodes++ ;
-      }
-      totalthings += 1000 ;
-   }
-   if (freenodes->next == 0 && alloced + 1000 * sizeof(node) > maxmem &&
-       okaytogc) {
-      do_gc(0) ;
+   int gcdone = 0 ;
+   for (;;) {
+      if (sweeping && (freenodes == 0 || nextof(freenodes) == 0))
+         sweepslice() ;
+      if (freenodes == 0) {
+         if (compact) {
+            newchunk(freenodes) ;
+         } else {
+            int i ;
+            freenodes = (node *)calloc(1001, sizeof(node)) ;
+            if (freenodes == 0)
+               lifefatal("Out of memory; try reducing the hash memory limit.") ;
+            alloced += 1001 * sizeof(node) ;
+            freenodes->next = nodeblocks ;
+            nodeblocks = freenodes++ ;
+            for (i=0; i<999; i++) {
+               freenodes[1].next = freenodes ;
+               freenodes++ ;
+            }
+            totalthings += 1000 ;
+         }
+      }
+      if (nextof(freenodes) == 0 && okaytogc && !sweeping && !gcdone &&
+          alloced + (compact ? CCHUNKBYTES : 1000 * sizeof(node)) > maxmem) {
+         do_gc(0) ;
+         gcdone = 1 ;
+         continue ;
+      }
+      break ;
    }
    r = freenodes ;
-   freenodes = freenodes->next ;
+   freenodes = nextof(freenodes) ;
    return r ;
 }
+/*
+ *   The compact store grows a chunk at a time; we thread the new
+ *   slots onto the given free list.
+ */
+void hlifealgo::newchunk(node *&list) {
+   if (ncchunks >= CMAXCHUNKS)
+      lifefatal("Out of node indices; try the default node store.") ;
+   cnode *b = (cnode *)calloc(1, CCHUNKBYTES) ;
+   if (b == 0)
+      lifefatal("Out of memory; try reducing the hash memory limit.") ;
+   alloced += CCHUNKBYTES ;
+   unsigned int base = (unsigned int)ncchunks << CCHUNKBITS ;
+   cchunks[ncchunks++] = b ;
+   for (int i=CCHUNKSIZE-1; i>=0; i--) {
+      if (base + i == 0) // index zero is null
+         continue ;
+      b[i].next = ci(list) ;
+      list = ch(base + i) ;
+      totalthings++ ;
+   }
+}
 /*
  *   Leaves are the same.
  */
 leaf *hlifealgo::newleaf() {
-   leaf *r = (leaf *)newnode() ;
-   new(&(r->leafpop))bigint ;
-   return r ;
+   return (leaf *)newnode() ;
 }
 /*
  *   Sometimes we want the new node or leaf to be automatically cleared
  *   for us.
  */
 node *hlifealgo::newclearednode() {
-   return (node *)memset(newnode(), 0, sizeof(node)) ;
+   node *r = newnode() ;
+   if (compact)
+      memset(cn(r), 0, sizeof(cnode)) ;
+   else
+      memset(r, 0, sizeof(node)) ;
+   return r ;
 }
 leaf *hlifealgo::newclearedleaf() {
-   leaf *r = (leaf *)newclearednode() ;
-   new(&(r->leafpop))bigint ;
-   return r ;
+   return (leaf *)newclearednode() ;
 }
-hlifealgo::hlifealgo() {
+hlifealgo::hlifealgo(int compactstore) {
    int i ;
 /*
  *   The population of one-bits in an integer is one more than the
@@ -580,19 +969,32 @@ hlifealgo::hlifealgo() {
  *   and we can turn off a bit by anding an integer with the next
  *   lower integer.
  */
-   if (shortpop[1] == 0)
+   if (shortpop[1] == 0) {
       for (i=1; i<65536; i++)
          shortpop[i] = shortpop[i & (i - 1)] + 1 ;
+   }
    hashprime = nexthashsize(1000) ;
 #ifndef PRIMEMOD
    hashmask = hashprime - 1 ;
 #endif
    hashlimit = (g_uintptr_t)(maxloadfactor * hashprime) ;
    hashpop = 0 ;
-   hashtab = (node **)calloc(hashprime, sizeof(node *)) ;
-   if (hashtab == 0)
-     lifefatal("Out of memory (1).") ;
-   alloced = hashprime * sizeof(node *) ;
+   compact = compactstore ;
+   cchunks = 0 ;
+   ncchunks = 0 ;
+   if (compact) {
+      hashtab = (node **)calloc(hashprime, sizeof(unsigned int)) ;
+      cchunks = (cnode **)calloc(CMAXCHUNKS, sizeof(cnode *)) ;
+      if (hashtab == 0 || cchunks == 0)
+        lifefatal("Out of memory (1).") ;
+      alloced = hashprime * sizeof(unsigned int) +
+                CMAXCHUNKS * sizeof(cnode *) ;
+   } else {
+      hashtab = (node **)calloc(hashprime, sizeof(node *)) ;
+      if (hashtab == 0)
+        lifefatal("Out of memory (1).") ;
+      alloced = hashprime * sizeof(node *) ;
+   }
    ngens = 0 ;
    stacksize = 0 ;
    halvesdone = 0 ;
@@ -603,8 +1005,12 @@ hlifealgo::hlifealgo() {
    freenodes = 0 ;
    okaytogc = 0 ;
    totalthings = 0 ;
+   keptfraction = 0 ;
    nodeblocks = 0 ;
    zeronodea = 0 ;
+   sweeping = 0 ;             // newclearednode looks at these
+   sweepblock = 0 ;
+   sweepidx = sweepend = 0 ;
    ruletable = hliferules.rule0 ;
 /*
  *   We initialize our universe to be a 16-square.  We are in drawing
@@ -630,17 +1036,33 @@ hlifealgo::hlifealgo() {
    inc_hperf = running_hperf ;
    step_hperf = running_hperf ;
    softinterrupt = 0 ;
+   incgc = 0 ;
+   gcage = 0 ;
+   agenow = 0 ;
+   numthreads = 1 ;
+   threaddepth = 10 ;
+   parallel = 0 ;
+   mt = 0 ;
+   dc = 0 ;
+   sums = 0 ;
 }
 /**
  *   Destructor frees memory.
  */
 hlifealgo::~hlifealgo() {
+   mt_stopthreads() ;
+   closeResultCache() ;
    free(hashtab) ;
    while (nodeblocks) {
       node *r = nodeblocks ;
       nodeblocks = nodeblocks->next ;
       free(r) ;
    }
+   if (cchunks) {
+      for (int i=0; i<ncchunks; i++)
+         free(cchunks[i]) ;
+      free(cchunks) ;
+   }
    if (zeronodea)
       free(zeronodea) ;
    if (stack)
@@ -649,6 +1071,7 @@ hlifealgo::~hlifealgo() {
       delete [] llxb ;
       delete [] llyb ;
    }
+   delete sums ;
 }
 /**
  *   Set increment.
@@ -735,10 +1158,25 @@ void hlifealgo::setMaxMemory(int newmemlimit) {
    hashlimit = (g_uintptr_t)(maxloadfactor * hashprime) ;
 }
 /**
- *   Clear everything.
+ *   Clear everything.  The old pattern's nodes stay in the hash with
+ *   their results, so a similar pattern can reuse them; the next gc
+ *   frees the ones that aren't wanted.  We go back to drawing mode.
  */
 void hlifealgo::clearall() {
-   lifefatal("clearall not implemented yet") ;
+   poller->bailIfCalculating() ;
+   destroytimeline() ;
+   clearstack() ;
+   okaytogc = 0 ;
+   root = (node *)newclearednode() ;
+   population = 0 ;
+   generation = 0 ;
+   increment = 1 ;
+   depth = 3 ;
+   hashed = 0 ;
+   popValid = 0 ;
+   needPop = 0 ;
+   inGC = 0 ;
+   softinterrupt = 0 ;
 }
 /*
  *   This routine expands our universe by a factor of two, maintaining
@@ -748,17 +1186,17 @@ void hlifealgo::clearall() {
 void hlifealgo::pushroot_1() {
    node *t ;
    t = newclearednode() ;
-   t->se = root->nw ;
-   root->nw = t ;
+   setse(t, nwof(root)) ;
+   setnw(root, t) ;
    t = newclearednode() ;
-   t->sw = root->ne ;
-   root->ne = t ;
+   setsw(t, neof(root)) ;
+   setne(root, t) ;
    t = newclearednode() ;
-   t->ne = root->sw ;
-   root->sw = t ;
+   setne(t, swof(root)) ;
+   setsw(root, t) ;
    t = newclearednode() ;
-   t->nw = root->se ;
-   root->se = t ;
+   setnw(t, seof(root)) ;
+   setse(root, t) ;
    depth++ ;
 }
 /*
@@ -766,9 +1204,9 @@ void hlifealgo::pushroot_1() {
  */
 int hlifealgo::node_depth(node *n) {
    int depth = 2 ;
-   while (is_node(n)) {
+   while (notleaf(n)) {
       depth++ ;
-      n = n->nw ;
+      n = nwof(n) ;
    }
    return depth ;
 }
@@ -804,15 +1242,15 @@ node *hlifealgo::pushroot(node *n) {
    int depth = node_depth(n) ;
    zeronode(depth+1) ; // ensure enough zero nodes for rendering
    node *z = zeronode(depth-1) ;
-   return find_node(find_node(z, z, z, n->nw),
-                    find_node(z, z, n->ne, z),
-                    find_node(z, n->sw, z, z),
-                    find_node(n->se, z, z, z)) ;
+   return find_node(find_node(z, z, z, nwof(n)),
+                    find_node(z, z, neof(n), z),
+                    find_node(z, swof(n), z, z),
+                    find_node(seof(n), z, z, z)) ;
 }
 /* Returns an internal (i.e. non-leaf) node containing the given node. */
 node *hlifealgo::make_internal_node(node *n) {
-   if (is_node(n)) return n ;
-   leaf *l=(leaf *)n ;
+   if (notleaf(n)) return n ;
+   leafbits *l=bits(n) ;
    return find_node((node *)find_leaf(0, 0, 0, l->nw),
                     (node *)find_leaf(0, 0, l->ne, 0),
                     (node *)find_leaf(0, l->sw, 0, 0),
@@ -830,7 +1268,7 @@ node *hlifealgo::make_internal_node(node *n) {
  */
 node *hlifealgo::gsetbit(node *n, int x, int y, int newstate, int depth) {
    if (depth == 2) {
-      leaf *l = (leaf *)n ;
+      leafbits *l = bits(n) ;
       if (hashed) {
          unsigned short nw = l->nw ;
          unsigned short sw = l->sw ;
@@ -884,7 +1322,7 @@ node *hlifealgo::gsetbit(node *n, int x, int y, int newstate, int depth) {
             else
                l->ne &= ~(1 << (3 - (x & 3) + 4 * (y & 3))) ;
       }
-      return (node *)l ;
+      return n ;
    } else {
       unsigned int w = 0, wh = 0 ;
       if (depth >= 32) {
@@ -895,49 +1333,47 @@ node *hlifealgo::gsetbit(node *n, int x, int y, int newstate, int depth) {
          wh = 1 << (depth - 1) ;
       }
       depth-- ;
-      node **nptr ;
+      int q ;     /* quadrant:  0=nw, 1=ne, 2=sw, 3=se */
       if (depth+1 == this->depth || depth < 31) {
          if (x < 0) {
             if (y < 0)
-               nptr = &(n->sw) ;
+               q = 2 ;
             else
-               nptr = &(n->nw) ;
+               q = 0 ;
          } else {
             if (y < 0)
-               nptr = &(n->se) ;
+               q = 3 ;
             else
-               nptr = &(n->ne) ;
+               q = 1 ;
          }
       } else {
          if (x >= 0) {
             if (y >= 0)
-               nptr = &(n->sw) ;
+               q = 2 ;
             else
-               nptr = &(n->nw) ;
+               q = 0 ;
          } else {
             if (y >= 0)
-               nptr = &(n->se) ;
+               q = 3 ;
             else
-               nptr = &(n->ne) ;
+               q = 1 ;
          }
       }
-      if (*nptr == 0) {
+      node *kid[4] = { nwof(n), neof(n), swof(n), seof(n) } ;
+      if (kid[q] == 0) {
          if (depth == 2)
-            *nptr = (node *)newclearedleaf() ;
+            kid[q] = (node *)newclearedleaf() ;
          else
-            *nptr = newclearednode() ;
+            kid[q] = newclearednode() ;
+         setkid(n, q, kid[q]) ;
       }
-      node *s = gsetbit(*nptr, (x & (w - 1)) - wh,
+      node *s = gsetbit(kid[q], (x & (w - 1)) - wh,
                                (y & (w - 1)) - wh, newstate, depth) ;
-      if (hashed) {
-         node *nw = (nptr == &(n->nw) ? s : n->nw) ;
-         node *sw = (nptr == &(n->sw) ? s : n->sw) ;
-         node *ne = (nptr == &(n->ne) ? s : n->ne) ;
-         node *se = (nptr == &(n->se) ? s : n->se) ;
-         n = save(find_node(nw, ne, sw, se)) ;
-      } else {
-         *nptr = s ;
-      }
+      kid[q] = s ;
+      if (hashed)
+         n = save(find_node(kid[0], kid[1], kid[2], kid[3])) ;
+      else
+         setkid(n, q, s) ;
       return n ;
    }
 }
@@ -947,17 +1383,8 @@ node *hlifealgo::gsetbit(node *n, int x, int y, int newstate, int depth) {
  *   but really not all that complicated.
  */
 int hlifealgo::getbit(node *n, int x, int y, int depth) {
-   struct node tnode ;
-   while (depth >= 32) {
-      tnode.nw = n->nw->se ;
-      tnode.ne = n->ne->sw ;
-      tnode.sw = n->sw->ne ;
-      tnode.se = n->se->nw ;
-      n = &tnode ;
-      depth-- ;
-   }
    if (depth == 2) {
-      leaf *l = (leaf *)n ;
+      leafbits *l = bits(n) ;
       int test = 0 ;
       if (x < 0)
          if (y < 0)
@@ -973,6 +1400,18 @@ int hlifealgo::getbit(node *n, int x, int y, int depth) {
          return 1 ;
       return 0 ;
    } else {
+      /*
+       *   Above depth 31 we walk down the centers; the quadrants of the
+       *   center are grandchildren of n.
+       */
+      node *nw = nwof(n), *ne = neof(n), *sw = swof(n), *se = seof(n) ;
+      while (depth >= 32) {
+         nw = seof(nw) ;
+         ne = swof(ne) ;
+         sw = neof(sw) ;
+         se = nwof(se) ;
+         depth-- ;
+      }
       unsigned int w = 0, wh = 0 ;
       if (depth >= 32) {
          if (depth == 32)
@@ -985,14 +1424,14 @@ int hlifealgo::getbit(node *n, int x, int y, int depth) {
       node *nptr ;
       if (x < 0) {
          if (y < 0)
-            nptr = n->sw ;
+            nptr = sw ;
          else
-            nptr = n->nw ;
+            nptr = nw ;
       } else {
          if (y < 0)
-            nptr = n->se ;
+            nptr = se ;
          else
-            nptr = n->ne ;
+            nptr = ne ;
       }
       if (nptr == 0 || nptr == zeronode(depth))
          return 0 ;
@@ -1008,7 +1447,7 @@ int hlifealgo::nextbit(node *n, int x, int y, int depth) {
    if (n == 0 || n == zeronode(depth))
       return -1 ;
    if (depth == 2) {
-      leaf *l = (leaf *)n ;
+      leafbits *l = bits(n) ;
       int test = 0 ;
       if (y < 0)
         test = (((l->sw >> (4 * (y & 3))) & 15) << 4) |
@@ -1034,11 +1473,11 @@ int hlifealgo::nextbit(node *n, int x, int y, int depth) {
       node *lft, *rght ;
       depth-- ;
       if (y < 0) {
-        lft = n->sw ;
-        rght = n->se ;
+        lft = swof(n) ;
+        rght = seof(n) ;
       } else {
-        lft = n->nw ;
-        rght = n->ne ;
+        lft = nwof(n) ;
+        rght = neof(n) ;
       }
       int r = 0 ;
       if (x < 0) {
@@ -1098,6 +1537,158 @@ int hlifealgo::setcell(int x, int y, int newstate) {
    }
    return 0 ;
 }
+/*
+ *   setcells and setruns sort the cells they are given into changes to
+ *   the leaves they fall in, keyed by the leaf's place in the quadtree.
+ *   Each leaf's bits are held as its four quadrants, nw in the low 16
+ *   bits up to se in the high ones; the leaf keeps the bits not in clr
+ *   and gains those in set.
+ */
+struct hleafedit {
+   unsigned G_INT64 key, clr, set ;
+   bool operator<(const hleafedit &b) const { return key < b.key ; }
+   // apply a later change to the same leaf
+   void add(unsigned G_INT64 c, unsigned G_INT64 s) {
+      clr |= c ;
+      set = (set & ~c) | s ;
+   }
+} ;
+// the bits of a leaf for the cells in the given row (0 at the top) whose
+// bits are set in m (the left cell in bit 7)
+static inline unsigned G_INT64 leafrowbits(int row, unsigned int m) {
+   int sh = 4 * (3 - (row & 3)) ;
+   unsigned G_INT64 b = ((unsigned G_INT64)((m >> 4) & 15) << sh) |
+                        ((unsigned G_INT64)(m & 15) << (sh + 16)) ;
+   return row < 4 ? b : b << 32 ;
+}
+int hlifealgo::setcells(const int *cells, size_t n, int multistate,
+                        int dx, int dy) {
+   return setbatch(cells, n, multistate ? 3 : 2, dx, dy) ;
+}
+int hlifealgo::setruns(const int *runs, size_t n, int dx, int dy) {
+   return setbatch(runs, n, 4, dx, dy) ;
+}
+/*
+ *   Set a batch of cells (stride 2 or 3) or runs (stride 4).  Rather
+ *   than going down from the root for each cell, we sort the changes
+ *   into quadtree order and build each changed node once, bottom up,
+ *   hashing as we go.
+ */
+int hlifealgo::setbatch(const int *p, size_t n, int stride, int dx, int dy) {
+   G_INT64 minx = 0, maxx = -1, miny = 0, maxy = 0 ;
+   for (size_t i=0; i+stride<=n; i+=stride) {
+      int len = stride == 4 ? p[i+2] : 1 ;
+      int st = stride == 2 ? 1 : p[i+stride-1] ;
+      if (st & ~1)
+         return -1 ;
+      if (len <= 0)
+         continue ;
+      G_INT64 x = (G_INT64)p[i] + dx, y = (G_INT64)p[i+1] + dy ;
+      if (maxx < minx) {
+         minx = maxx = x ;
+         miny = maxy = y ;
+      }
+      if (x < minx) minx = x ;
+      if (x + len - 1 > maxx) maxx = x + len - 1 ;
+      if (y < miny) miny = y ;
+      if (y > maxy) maxy = y ;
+   }
+   if (maxx < minx)
+      return 0 ;
+   if (!hashed) {
+      root = hashpattern(root, depth) ;
+      zeronode(depth) ;
+      hashed = 1 ;
+   }
+   clearstack() ;
+   save(root) ;
+   okaytogc = 1 ;
+   inGC = 1 ;
+   // the root covers -2^depth..2^depth-1 (with y going up)
+   while (depth < 62 && (minx < -((G_INT64)1 << depth) ||
+                         maxx >= ((G_INT64)1 << depth) ||
+                         maxy > ((G_INT64)1 << depth) ||
+                         miny <= -((G_INT64)1 << depth))) {
+      root = save(pushroot(root)) ;
+      depth++ ;
+   }
+   if (depth > 32) {
+      // too big for our keys, so set the cells one at a time
+      okaytogc = 0 ;
+      for (size_t i=0; i+stride<=n; i+=stride) {
+         int len = stride == 4 ? p[i+2] : 1 ;
+         for (int k=0; k<len; k++)
+            setcell(p[i] + dx + k, p[i+1] + dy, stride == 2 ? 1 : p[i+stride-1]) ;
+      }
+      return 0 ;
+   }
+   G_INT64 half = (G_INT64)1 << depth ;
+   vector<hleafedit> edits ;
+   edits.reserve(n / stride) ;
+   for (size_t i=0; i+stride<=n; i+=stride) {
+      int len = stride == 4 ? p[i+2] : 1 ;
+      int st = stride == 2 ? 1 : p[i+stride-1] ;
+      // measured from the top left of the root
+      G_INT64 u = (G_INT64)p[i] + dx + half ;
+      G_INT64 r = half - 1 + ((G_INT64)p[i+1] + dy) ;
+      G_INT64 end = u + len ;
+      while (u < end) {
+         int c = (int)(u & 7) ;
+         int w = end - u < 8 - c ? (int)(end - u) : 8 - c ;
+         unsigned G_INT64 b = leafrowbits((int)(r & 7),
+                                          (0xff >> c) & ~(0xff >> (c + w))) ;
+         unsigned G_INT64 key = quadkey((unsigned int)(u >> 3),
+                                        (unsigned int)(r >> 3)) ;
+         if (!edits.empty() && edits.back().key == key) {
+            edits.back().add(b, st ? b : 0) ;
+         } else {
+            hleafedit e = { key, b, st ? b : 0 } ;
+            edits.push_back(e) ;
+         }
+         u += w ;
+      }
+   }
+   // later changes to a leaf must stay later
+   std::stable_sort(edits.begin(), edits.end()) ;
+   size_t m = 0 ;
+   for (size_t i=1; i<edits.size(); i++) {
+      if (edits[i].key == edits[m].key)
+         edits[m].add(edits[i].clr, edits[i].set) ;
+      else
+         edits[++m] = edits[i] ;
+   }
+   edits.resize(m + 1) ;
+   root = setleaves(root, depth, &edits[0], &edits[0] + edits.size()) ;
+   okaytogc = 0 ;
+   return 0 ;
+}
+/*
+ *   Apply the (sorted) leaf changes that fall in this node.
+ */
+node *hlifealgo::setleaves(node *n, int depth, const hleafedit *b,
+                           const hleafedit *e) {
+   if (depth == 2) {
+      leafbits *l = bits(n) ;
+      unsigned G_INT64 v = l->nw | ((unsigned G_INT64)l->ne << 16) |
+                           ((unsigned G_INT64)l->sw << 32) |
+                           ((unsigned G_INT64)l->se << 48) ;
+      v = (v & ~b->clr) | b->set ;
+      return (node *)find_leaf((unsigned short)v, (unsigned short)(v >> 16),
+                               (unsigned short)(v >> 32),
+                               (unsigned short)(v >> 48)) ;
+   }
+   int sh = 2 * (depth - 3) ;
+   node *kid[4] = { nwof(n), neof(n), swof(n), seof(n) } ;
+   while (b < e) {
+      int q = (int)((b->key >> sh) & 3) ;
+      const hleafedit *qe = b ;
+      while (qe < e && (int)((qe->key >> sh) & 3) == q)
+         qe++ ;
+      kid[q] = setleaves(kid[q], depth-1, b, qe) ;
+      b = qe ;
+   }
+   return find_node(kid[0], kid[1], kid[2], kid[3]) ;
+}
 /*
  *   Our nonrecurse top-level bit getting routine.
  */
@@ -1145,19 +1736,310 @@ int hlifealgo::nextcell(int x, int y, int &v) {
       sy >>= 1 ;
    }
    if (depth > 30) {
-      struct node tnode = *root ;
+      /*
+       *   Build the center node in a scratch node; it is not hashed,
+       *   and goes straight back on the free list.
+       */
+      node *tnode = newnode() ;
+      node *nw = nwof(root), *ne = neof(root), *sw = swof(root),
+           *se = seof(root) ;
       int mdepth = depth ;
       while (mdepth > 30) {
-         tnode.nw = tnode.nw->se ;
-         tnode.ne = tnode.ne->sw ;
-         tnode.sw = tnode.sw->ne ;
-         tnode.se = tnode.se->nw ;
+         nw = seof(nw) ;
+         ne = swof(ne) ;
+         sw = neof(sw) ;
+         se = nwof(se) ;
          mdepth-- ;
       }
-      return nextbit(&tnode, x, y, mdepth) ;
+      setnw(tnode, nw) ;
+      setne(tnode, ne) ;
+      setsw(tnode, sw) ;
+      setse(tnode, se) ;
+      int r = nextbit(tnode, x, y, mdepth) ;
+      setnext(tnode, freenodes) ;
+      freenodes = tnode ;
+      return r ;
    }
    return nextbit(root, x, y, depth) ;
 }
+/*
+ *   Rather than look for each run from the root, getruns walks the
+ *   universe a band at a time:  a band is the nonempty nodes of one
+ *   depth that cover the same rows, left to right, each with the
+ *   offset of its left edge from the rectangle.  The band splits into
+ *   the band of the north children and then that of the south ones,
+ *   until the leaves give up their rows directly.
+ */
+struct hrunwalk {
+   hrunwalk(liferunsink &sink, G_INT64 wdarg, G_INT64 htarg) :
+      runs(sink, wdarg), wd(wdarg), ht(htarg) {}
+   runjoiner runs ;
+   G_INT64 wd, ht ;
+   vector<node *> zeros ;
+   vector<vector<pair<node *, G_INT64> > > bands ;
+} ;
+int hlifealgo::bandruns(hrunwalk &w, int d, G_INT64 y) {
+   vector<pair<node *, G_INT64> > &band = w.bands[d] ;
+   if (d == 2) {
+      for (int r=0; r<8; r++) {
+         if (y + r < 0)
+            continue ;
+         if (y + r >= w.ht)
+            break ;
+         int sh = 4 * (3 - (r & 3)) ;
+         for (size_t i=0; i<band.size(); i++) {
+            leafbits *l = bits(band[i].first) ;
+            unsigned int b ;
+            if (r < 4)
+               b = (((l->nw >> sh) & 15) << 4) | ((l->ne >> sh) & 15) ;
+            else
+               b = (((l->sw >> sh) & 15) << 4) | ((l->se >> sh) & 15) ;
+            if (b && w.runs.addbits(band[i].second, y + r, b, 8))
+               return 1 ;
+         }
+      }
+      return 0 ;
+   }
+   G_INT64 half = (G_INT64)1 << d ;
+   node *z = w.zeros[d-1] ;
+   vector<pair<node *, G_INT64> > &sub = w.bands[d-1] ;
+   for (int south=0; south<2; south++) {
+      G_INT64 sy = y + (south ? half : 0) ;
+      if (sy + half <= 0 || sy >= w.ht)
+         continue ;
+      sub.clear() ;
+      for (size_t i=0; i<band.size(); i++) {
+         node *n = band[i].first ;
+         G_INT64 x = band[i].second ;
+         node *a = south ? swof(n) : nwof(n) ;
+         node *b = south ? seof(n) : neof(n) ;
+         if (a != z && x + half > 0 && x < w.wd)
+            sub.push_back(make_pair(a, x)) ;
+         if (b != z && x + 2 * half > 0 && x + half < w.wd)
+            sub.push_back(make_pair(b, x + half)) ;
+      }
+      if (!sub.empty() && bandruns(w, d-1, sy))
+         return 1 ;
+   }
+   return 0 ;
+}
+/*
+ *   Split the root with bigints until the nodes are small enough for
+ *   their offsets from the rectangle to fit in 64 bits; there are at
+ *   most nine of them that meet the rectangle.  Each goes in start with
+ *   its offset (y first) and their depth is returned.
+ */
+int hlifealgo::splitroot(const bigint &top, const bigint &left,
+                         const bigint &bottom, const bigint &right,
+                         vector<pair<pair<G_INT64, G_INT64>, node *> > &start) {
+   int d = depth ;
+   bigint size = 1 ;
+   size <<= d ;
+   bigint x0 = 0, y0 = 1 ;
+   x0 -= size ;
+   y0 -= size ;
+   size += size ;
+   vector<node *> nodes ;
+   vector<bigint> xs, ys ;
+   nodes.push_back(root) ;
+   xs.push_back(x0) ;
+   ys.push_back(y0) ;
+   for (;;) {
+      // drop the nodes that are empty or miss the rectangle
+      vector<node *> keep ;
+      vector<bigint> keepx, keepy ;
+      node *z = zeronode(d) ;
+      for (size_t i=0; i<nodes.size(); i++) {
+         bigint r = xs[i], b = ys[i] ;
+         r += size ;
+         b += size ;
+         if (nodes[i] != z && xs[i] <= right && r > left &&
+             ys[i] <= bottom && b > top) {
+            keep.push_back(nodes[i]) ;
+            keepx.push_back(xs[i]) ;
+            keepy.push_back(ys[i]) ;
+         }
+      }
+      nodes.swap(keep) ;
+      xs.swap(keepx) ;
+      ys.swap(keepy) ;
+      if (d <= 61)
+         break ;
+      bigint half = size ;
+      half.div2() ;
+      keep.clear() ;
+      keepx.clear() ;
+      keepy.clear() ;
+      for (size_t i=0; i<nodes.size(); i++) {
+         for (int q=0; q<4; q++) {
+            node *n = nodes[i] ;
+            keep.push_back(q == 0 ? nwof(n) : q == 1 ? neof(n) :
+                           q == 2 ? swof(n) : seof(n)) ;
+            bigint x = xs[i], y = ys[i] ;
+            if (q & 1)
+               x += half ;
+            if (q & 2)
+               y += half ;
+            keepx.push_back(x) ;
+            keepy.push_back(y) ;
+         }
+      }
+      nodes.swap(keep) ;
+      xs.swap(keepx) ;
+      ys.swap(keepy) ;
+      size = half ;
+      d-- ;
+   }
+   for (size_t i=0; i<nodes.size(); i++) {
+      xs[i] -= left ;
+      ys[i] -= top ;
+      start.push_back(make_pair(make_pair(ys[i].toint64(), xs[i].toint64()),
+                                nodes[i])) ;
+   }
+   return d ;
+}
+int hlifealgo::getruns(const bigint &top, const bigint &left,
+                       const bigint &bottom, const bigint &right,
+                       liferunsink &sink) {
+   ensure_hashed() ;
+   if (top > bottom || left > right)
+      return 0 ;
+   bigint wd = right, ht = bottom ;
+   wd -= left ;
+   wd += 1 ;
+   ht -= top ;
+   ht += 1 ;
+   hrunwalk w(sink, wd.toint64(), ht.toint64()) ;
+   vector<pair<pair<G_INT64, G_INT64>, node *> > start ;
+   int d = splitroot(top, left, bottom, right, start) ;
+   for (int i=0; i<=d; i++)
+      w.zeros.push_back(i < 2 ? 0 : zeronode(i)) ;
+   // sort them by row and then column, and walk each row as a band
+   sort(start.begin(), start.end()) ;
+   w.bands.resize(d+1) ;
+   for (size_t i=0; i<start.size(); ) {
+      G_INT64 y = start[i].first.first ;
+      vector<pair<node *, G_INT64> > &band = w.bands[d] ;
+      band.clear() ;
+      for (; i<start.size() && start[i].first.first == y; i++)
+         band.push_back(make_pair(start[i].second, start[i].first.second)) ;
+      if (bandruns(w, d, y))
+         return 1 ;
+   }
+   return w.runs.finish() ;
+}
+/*
+ *   The hash of a node with (0,0) at its top left (see cellhash); it's
+ *   kept with the node's summary.
+ */
+static const cellhash::value NOHASH = ~(cellhash::value)0 ;
+cellhash::value hlifealgo::nodehash(node *n, int depth) {
+   if (depth == 2) {
+      leafbits *l = bits(n) ;
+      cellhash::value h = 0, yp = 1 ;
+      for (int r=0; r<8; r++, yp=cellhash::mul(yp, cellhash::Y)) {
+         int sh = 12 - 4 * (r & 3) ;
+         unsigned short w = r < 4 ? l->nw : l->sw ;
+         unsigned short e = r < 4 ? l->ne : l->se ;
+         int row = (((w >> sh) & 15) << 4) | ((e >> sh) & 15) ;
+         if (row)
+            h = cellhash::add(h, cellhash::mul(cellhash::row8(row), yp)) ;
+      }
+      return h ;
+   }
+   summarize(n, depth) ;
+   nodesum *s = sums->find(n) ;
+   if (s->hash != NOHASH)
+      return s->hash ;
+   node *z = zeronode(depth - 1) ;
+   node *kids[4] = { nwof(n), neof(n), swof(n), seof(n) } ;
+   cellhash::value h = 0 ;
+   for (int q=0; q<4; q++) {
+      if (kids[q] == z)
+         continue ;
+      cellhash::value k = nodehash(kids[q], depth - 1) ;
+      if (q & 1)
+         k = cellhash::mul(k, cellhash::xpow2(depth)) ;
+      if (q & 2)
+         k = cellhash::mul(k, cellhash::ypow2(depth)) ;
+      h = cellhash::add(h, k) ;
+   }
+   // the table may have been rebuilt meanwhile
+   s = sums->find(n) ;
+   if (s == 0) {
+      summarize(n, depth) ;
+      s = sums->find(n) ;
+   }
+   s->hash = h ;
+   return h ;
+}
+/*
+ *   The hash of the part of a node inside a wd by ht rectangle, where the
+ *   node is at (x,y) from the rectangle's corner and fx, fy are X^x, Y^y.
+ */
+cellhash::value hlifealgo::recthash(node *n, int depth, G_INT64 x,
+                                    G_INT64 y, cellhash::value fx,
+                                    cellhash::value fy, G_INT64 wd,
+                                    G_INT64 ht) {
+   G_INT64 size = (G_INT64)2 << depth ;
+   if (x >= wd || y >= ht || x + size <= 0 || y + size <= 0 ||
+       n == zeronode(depth))
+      return 0 ;
+   if (x >= 0 && y >= 0 && x + size <= wd && y + size <= ht)
+      return cellhash::mul(nodehash(n, depth), cellhash::mul(fx, fy)) ;
+   if (depth == 2) {
+      // a leaf on the edge; drop the columns outside
+      unsigned int mask = 0xff ;
+      if (x < 0)
+         mask &= 0xff >> -x ;
+      if (x + 8 > wd)
+         mask &= (0xff << (8 - (wd - x))) & 0xff ;
+      leafbits *l = bits(n) ;
+      cellhash::value h = 0, yp = fy ;
+      for (int r=0; r<8; r++, yp=cellhash::mul(yp, cellhash::Y)) {
+         if (y + r < 0 || y + r >= ht)
+            continue ;
+         int sh = 12 - 4 * (r & 3) ;
+         unsigned short w = r < 4 ? l->nw : l->sw ;
+         unsigned short e = r < 4 ? l->ne : l->se ;
+         int row = ((((w >> sh) & 15) << 4) | ((e >> sh) & 15)) & mask ;
+         if (row)
+            h = cellhash::add(h, cellhash::mul(cellhash::row8(row), yp)) ;
+      }
+      return cellhash::mul(h, fx) ;
+   }
+   G_INT64 half = (G_INT64)1 << depth ;
+   cellhash::value hx = cellhash::mul(fx, cellhash::xpow2(depth)) ;
+   cellhash::value hy = cellhash::mul(fy, cellhash::ypow2(depth)) ;
+   depth-- ;
+   return cellhash::add(
+      cellhash::add(recthash(nwof(n), depth, x, y, fx, fy, wd, ht),
+                    recthash(neof(n), depth, x + half, y, hx, fy, wd, ht)),
+      cellhash::add(recthash(swof(n), depth, x, y + half, fx, hy, wd, ht),
+                    recthash(seof(n), depth, x + half, y + half, hx, hy,
+                             wd, ht))) ;
+}
+cellhash::value hlifealgo::gethash(const bigint &top, const bigint &left,
+                                   const bigint &bottom, const bigint &right) {
+   ensure_hashed() ;
+   if (top > bottom || left > right)
+      return 0 ;
+   bigint wd = right, ht = bottom ;
+   wd -= left ;
+   wd += 1 ;
+   ht -= top ;
+   ht += 1 ;
+   vector<pair<pair<G_INT64, G_INT64>, node *> > start ;
+   int d = splitroot(top, left, bottom, right, start) ;
+   cellhash::value h = 0 ;
+   for (size_t i=0; i<start.size(); i++) {
+      G_INT64 x = start[i].first.second, y = start[i].first.first ;
+      h = cellhash::add(h, recthash(start[i].second, d, x, y,
+                                    cellhash::xpow(x), cellhash::ypow(y),
+                                    wd.toint64(), ht.toint64())) ;
+   }
+   return h ;
+}
 /*
  *   Canonicalize a universe by filling in the null pointers and then
  *   invoking find_node on each node.  Drops the original universe on
@@ -1168,17 +2050,17 @@ node *hlifealgo::hashpattern(node *root, int depth) {
    if (root == 0) {
       r = zeronode(depth) ;
    } else if (depth == 2) {
-      leaf *n = (leaf *)root ;
+      leafbits *n = bits(root) ;
       r = (node *)find_leaf(n->nw, n->ne, n->sw, n->se) ;
-      n->next = freenodes ;
+      setnext(root, freenodes) ;
       freenodes = root ;
    } else {
       depth-- ;
-      r = find_node(hashpattern(root->nw, depth),
-                    hashpattern(root->ne, depth),
-                    hashpattern(root->sw, depth),
-                    hashpattern(root->se, depth)) ;
-      root->next = freenodes ;
+      r = find_node(hashpattern(nwof(root), depth),
+                    hashpattern(neof(root), depth),
+                    hashpattern(swof(root), depth),
+                    hashpattern(seof(root), depth)) ;
+      setnext(root, freenodes) ;
       freenodes = root ;
    }
    return r ;
@@ -1205,12 +2087,13 @@ node *hlifealgo::popzeros(node *n) {
    int depth = node_depth(n) ;
    while (depth > 3) {
       node *z = zeronode(depth-2) ;
-      if (n->nw->nw == z && n->nw->ne == z && n->nw->sw == z &&
-          n->ne->nw == z && n->ne->ne == z && n->ne->se == z &&
-          n->sw->nw == z && n->sw->sw == z && n->sw->se == z &&
-          n->se->ne == z && n->se->sw == z && n->se->se == z) {
+      node *nw = nwof(n), *ne = neof(n), *sw = swof(n), *se = seof(n) ;
+      if (nwof(nw) == z && neof(nw) == z && swof(nw) == z &&
+          nwof(ne) == z && neof(ne) == z && seof(ne) == z &&
+          nwof(sw) == z && swof(sw) == z && seof(sw) == z &&
+          neof(se) == z && swof(se) == z && seof(se) == z) {
          depth-- ;
-         n = find_node(n->nw->se, n->ne->sw, n->sw->ne, n->se->nw) ;
+         n = find_node(seof(nw), swof(ne), neof(sw), nwof(se)) ;
       } else {
          break ;
       }
@@ -1223,29 +2106,35 @@ node *hlifealgo::popzeros(node *n) {
  *   (or abusing) the cache (res) field, and the least significant bit of
  *   the hash next field (as a visited bit).
  */
-#define marked(n) (1 & (g_uintptr_t)(n)->next)
-#define mark(n) ((n)->next = (node *)(1 | (g_uintptr_t)(n)->next))
-#define clearmark(n) ((n)->next = (node *)(~1 & (g_uintptr_t)(n)->next))
+#define marked(n) (compact ? (1 & cmark(n)) : (1 & (g_uintptr_t)(n)->next))
+#define mark(n) (compact ? (void)(cmark(n) |= 1) : \
+             (void)((n)->next = (node *)(1 | (g_uintptr_t)(n)->next)))
+#define clearmark(n) (compact ? (void)(cmark(n) &= ~1) : \
+             (void)((n)->next = (node *)(~1 & (g_uintptr_t)(n)->next)))
 #define clearmarkbit(p) ((node *)(~1 & (g_uintptr_t)(p)))
 /*
  *   Sometimes we want to use *res* instead of next to mark.  You cannot
- *   do this to leaves, though.
+ *   do this to leaves, though.  (In the compact store both kinds of
+ *   mark live in the chunk's mark bytes.)
  */
-#define marked2(n) (3 & (g_uintptr_t)(n)->res)
-#define mark2(n) ((n)->res = (node *)(1 | (g_uintptr_t)(n)->res))
-#define mark2v(n,v) ((n)->res = (node *)(v | (g_uintptr_t)(n)->res))
-#define clearmark2(n) ((n)->res = (node *)(~3 & (g_uintptr_t)(n)->res))
+#define marked2(n) (compact ? (3 & (cmark(n) >> 1)) : \
+             (3 & (g_uintptr_t)(n)->res))
+#define mark2v(n,v) (compact ? (void)(cmark(n) |= (v) << 1) : \
+             (void)((n)->res = (node *)(v | (g_uintptr_t)(n)->res)))
+#define mark2(n) mark2v(n,1)
+#define clearmark2(n) (compact ? (void)(cmark(n) &= ~6) : \
+             (void)((n)->res = (node *)(~3 & (g_uintptr_t)(n)->res)))
 void hlifealgo::unhash_node(node *n) {
    node *p ;
-   g_uintptr_t h = node_hash(n->nw,n->ne,n->sw,n->se) ;
+   g_uintptr_t h = node_hash(nwof(n),neof(n),swof(n),seof(n)) ;
    node *pred = 0 ;
    h = HASHMOD(h) ;
-   for (p=hashtab[h]; (!is_node(p) || !marked2(p)) && p; p = p->next) {
+   for (p=bucket(h); p && (!notleaf(p) || !marked2(p)); p = nextof(p)) {
       if (p == n) {
          if (pred)
-            pred->next = p->next ;
+            setnext(pred, nextof(p)) ;
          else
-            hashtab[h] = p->next ;
+            setbucket(h, nextof(p)) ;
          return ;
       }
       pred = p ;
@@ -1254,15 +2143,15 @@ void hlifealgo::unhash_node(node *n) {
 }
 void hlifealgo::unhash_node2(node *n) {
    node *p ;
-   g_uintptr_t h = node_hash(n->nw,n->ne,n->sw,n->se) ;
+   g_uintptr_t h = node_hash(nwof(n),neof(n),swof(n),seof(n)) ;
    node *pred = 0 ;
    h = HASHMOD(h) ;
-   for (p=hashtab[h]; p; p = p->next) {
+   for (p=bucket(h); p; p = nextof(p)) {
       if (p == n) {
          if (pred)
-            pred->next = p->next ;
+            setnext(pred, nextof(p)) ;
          else
-            hashtab[h] = p->next ;
+            setbucket(h, nextof(p)) ;
          return ;
       }
       pred = p ;
@@ -1270,61 +2159,10 @@ void hlifealgo::unhash_node2(node *n) {
    lifefatal("Didn't find node to unhash 2") ;
 }
 void hlifealgo::rehash_node(node *n) {
-   g_uintptr_t h = node_hash(n->nw,n->ne,n->sw,n->se) ;
+   g_uintptr_t h = node_hash(nwof(n),neof(n),swof(n),seof(n)) ;
    h = HASHMOD(h) ;
-   n->next = hashtab[h] ;
-   hashtab[h] = n ;
-}
-/*
- *   This recursive routine calculates the population by hanging the
- *   population on marked nodes.
- */
-const bigint &hlifealgo::calcpop(node *root, int depth) {
-   if (root == zeronode(depth))
-      return bigint::zero ;
-   if (depth == 2)
-      return ((leaf *)root)->leafpop ;
-   if (marked2(root))
-      return *(bigint*)&(root->next) ;
-   depth-- ;
-   if (root->next == 0)
-      mark2v(root, 3) ;
-   else {
-      unhash_node(root) ;
-      mark2(root) ;
-   }
-/**
- *   We use allocate-in-place bigint constructor here to initialize the
- *   node.  This should compile to a single instruction.
- */
-   new(&(root->next))bigint(
-        calcpop(root->nw, depth), calcpop(root->ne, depth),
-        calcpop(root->sw, depth), calcpop(root->se, depth)) ;
-   return *(bigint *)&(root->next) ;
-}
-/*
- *   Call this after doing something that unhashes nodes in order to
- *   use the next field as a temp pointer.
- */
-void hlifealgo::aftercalcpop2(node *root, int depth) {
-   if (depth == 2 || root == zeronode(depth))
-      return ;
-   int v = marked2(root) ;
-   if (v) {
-      clearmark2(root) ;
-      depth-- ;
-      if (depth > 2) {
-         aftercalcpop2(root->nw, depth) ;
-         aftercalcpop2(root->ne, depth) ;
-         aftercalcpop2(root->sw, depth) ;
-         aftercalcpop2(root->se, depth) ;
-      }
-      ((bigint *)&(root->next))->~bigint() ;
-      if (v == 3)
-         root->next = 0 ;
-      else
-         rehash_node(root) ;
-   }
+   setnext(n, bucket(h)) ;
+   setbucket(h, n) ;
 }
 /*
  *   Call this after writing macrocell.
@@ -1333,47 +2171,257 @@ void hlifealgo::afterwritemc(node *root, int depth) {
    if (root == zeronode(depth))
       return ;
    if (depth == 2) {
-      root->nw = 0 ;
+      setnw(root, 0) ;
       return ;
    }
    if (marked2(root)) {
       clearmark2(root) ;
       depth-- ;
-      afterwritemc(root->nw, depth) ;
-      afterwritemc(root->ne, depth) ;
-      afterwritemc(root->sw, depth) ;
-      afterwritemc(root->se, depth) ;
+      afterwritemc(nwof(root), depth) ;
+      afterwritemc(neof(root), depth) ;
+      afterwritemc(swof(root), depth) ;
+      afterwritemc(seof(root), depth) ;
       rehash_node(root) ;
    }
 }
 /*
- *   This top level routine calculates the population of a universe.
+ *   Populations of 2^62 or more, and boxes of nodes more than this deep,
+ *   are worked out with bigints from the children instead.
  */
-void hlifealgo::calcPopulation() {
-   int depth ;
-   ensure_hashed() ;
-   depth = node_depth(root) ;
-   population = calcpop(root, depth) ;
-   aftercalcpop2(root, depth) ;
+static const G_INT64 MAXSUMPOP = G_MAKEINT64(0x3fffffffffffffff) ;
+static const int MAXSUMDEPTH = 60 ;
+void hlifealgo::addsum(const nodesum &s) {
+   if (sums == 0)
+      sums = new hsumtable ;
+   if (2 * (sums->used + 1) > sums->slots.size()) {
+      g_uintptr_t bytes = sums->slots.size() * sizeof(nodesum) ;
+      std::vector<nodesum> old ;
+      old.swap(sums->slots) ;
+      sums->used = 0 ;
+      alloced -= bytes ;
+      // grow, unless the table would take more than a quarter of the
+      // memory; then start again
+      g_uintptr_t n = old.empty() ? 1024 : 2 * old.size() ;
+      if (n * sizeof(nodesum) > maxmem / 4) {
+         n = old.size() ;
+         old.clear() ;
+      }
+      nodesum empty = { 0, 0, 0, 0, 0, 0, 0 } ;
+      sums->slots.assign(n, empty) ;
+      alloced += n * sizeof(nodesum) ;
+      for (size_t i=0; i<old.size(); i++)
+         if (old[i].n)
+            sums->insert(old[i]) ;
+   }
+   sums->insert(s) ;
 }
 /*
- *   Is the universe empty?
+ *   After a gc, forget the nodes that are no longer in the hash.
  */
-int hlifealgo::isEmpty() {
-   ensure_hashed() ;
-   return root == zeronode(depth) ;
+void hlifealgo::purgesums() {
+   if (sums == 0)
+      return ;
+   for (auto it=sums->bigpops.begin(); it!=sums->bigpops.end(); )
+      if (inhash(it->first, hashof(it->first)))
+         ++it ;
+      else
+         it = sums->bigpops.erase(it) ;
+   for (auto it=sums->bigboxes.begin(); it!=sums->bigboxes.end(); )
+      if (inhash(it->first, hashof(it->first)))
+         ++it ;
+      else
+         it = sums->bigboxes.erase(it) ;
+   if (sums->used == 0)
+      return ;
+   std::vector<nodesum> live ;
+   for (size_t i=0; i<sums->slots.size(); i++) {
+      node *n = sums->slots[i].n ;
+      if (n && inhash(n, hashof(n)))
+         live.push_back(sums->slots[i]) ;
+   }
+   nodesum empty = { 0, 0, 0, 0, 0, 0, 0 } ;
+   sums->slots.assign(sums->slots.size(), empty) ;
+   sums->used = 0 ;
+   for (size_t i=0; i<live.size(); i++)
+      sums->insert(live[i]) ;
 }
 /*
- *   This routine marks a node as needed to be saved.
+ *   The population of a node and the box around its live cells, with
+ *   (0,0) at its top left and y increasing downward.  The box is only
+ *   filled in (top >= 0) if the node is at most MAXSUMDEPTH deep and
+ *   not empty; pop is -1 if it is MAXSUMPOP or more.
  */
-node *hlifealgo::save(node *n) {
-   if (gsp >= stacksize) {
-      int nstacksize = stacksize * 2 + 100 ;
-      alloced += sizeof(node *)*(nstacksize-stacksize) ;
-      stack = (node **)realloc(stack, nstacksize * sizeof(node *)) ;
-      if (stack == 0)
-        lifefatal("Out of memory (3).") ;
-      stacksize = nstacksize ;
+nodesum hlifealgo::summarize(node *n, int depth) {
+   nodesum s = { n, 0, -1, -1, -1, -1, NOHASH } ;
+   if (depth == 2) {
+      leafbits *l = bits(n) ;
+      s.pop = l->leafpop ;
+      if (s.pop == 0)
+         return s ;
+      // one byte per row, most significant bit at the left
+      int cols = 0 ;
+      for (int r=0; r<8; r++) {
+         int sh = 12 - 4 * (r & 3) ;
+         unsigned short w = r < 4 ? l->nw : l->sw ;
+         unsigned short e = r < 4 ? l->ne : l->se ;
+         int row = (((w >> sh) & 15) << 4) | ((e >> sh) & 15) ;
+         if (row) {
+            if (s.top < 0)
+               s.top = r ;
+            s.bottom = r ;
+            cols |= row ;
+         }
+      }
+      for (s.left=0; (cols & (0x80 >> s.left)) == 0; s.left++) ;
+      for (s.right=7; (cols & (0x80 >> s.right)) == 0; s.right--) ;
+      return s ;
+   }
+   if (sums) {
+      const nodesum *known = sums->find(n) ;
+      if (known)
+         return *known ;
+   }
+   node *z = zeronode(depth - 1) ;
+   node *kids[4] = { nwof(n), neof(n), swof(n), seof(n) } ;
+   G_INT64 half = depth <= MAXSUMDEPTH ? (G_INT64)1 << depth : 0 ;
+   for (int q=0; q<4; q++) {
+      if (kids[q] == z)
+         continue ;
+      nodesum k = summarize(kids[q], depth - 1) ;
+      if (k.pop == 0)
+         continue ;
+      if (s.pop < 0 || k.pop < 0 || k.pop > MAXSUMPOP - s.pop)
+         s.pop = -1 ;
+      else
+         s.pop += k.pop ;
+      if (half) {
+         G_INT64 ox = (q & 1) ? half : 0 ;
+         G_INT64 oy = (q & 2) ? half : 0 ;
+         if (s.top < 0 || k.top + oy < s.top)
+            s.top = k.top + oy ;
+         if (s.left < 0 || k.left + ox < s.left)
+            s.left = k.left + ox ;
+         if (k.bottom + oy > s.bottom)
+            s.bottom = k.bottom + oy ;
+         if (k.right + ox > s.right)
+            s.right = k.right + ox ;
+      }
+   }
+   addsum(s) ;
+   return s ;
+}
+/*
+ *   The population of a node whose summary overflowed.
+ */
+bigint hlifealgo::bigpop(node *n, int depth) {
+   if (n == zeronode(depth))
+      return bigint::zero ;
+   nodesum s = summarize(n, depth) ;
+   if (s.pop >= 0)
+      return bigint(s.pop) ;
+   std::unordered_map<node *, bigint>::iterator it = sums->bigpops.find(n) ;
+   if (it != sums->bigpops.end())
+      return it->second ;
+   depth-- ;
+   bigint pop(bigpop(nwof(n), depth), bigpop(neof(n), depth),
+              bigpop(swof(n), depth), bigpop(seof(n), depth)) ;
+   sums->bigpops[n] = pop ;
+   return pop ;
+}
+/*
+ *   The box of a nonempty node of any depth, as for summarize.
+ */
+void hlifealgo::bigbox(node *n, int depth, bigint box[4]) {
+   if (depth <= MAXSUMDEPTH) {
+      nodesum s = summarize(n, depth) ;
+      box[0] = bigint(s.top) ;
+      box[1] = bigint(s.left) ;
+      box[2] = bigint(s.bottom) ;
+      box[3] = bigint(s.right) ;
+      return ;
+   }
+   std::unordered_map<node *, std::vector<bigint> >::iterator it =
+                                                     sums->bigboxes.find(n) ;
+   if (it != sums->bigboxes.end()) {
+      for (int i=0; i<4; i++)
+         box[i] = it->second[i] ;
+      return ;
+   }
+   node *z = zeronode(depth - 1) ;
+   node *kids[4] = { nwof(n), neof(n), swof(n), seof(n) } ;
+   bigint half = 1 ;
+   half <<= depth ;
+   int any = 0 ;
+   for (int q=0; q<4; q++) {
+      if (kids[q] == z)
+         continue ;
+      bigint k[4] ;
+      bigbox(kids[q], depth - 1, k) ;
+      if (q & 2) {
+         k[0] += half ;
+         k[2] += half ;
+      }
+      if (q & 1) {
+         k[1] += half ;
+         k[3] += half ;
+      }
+      if (!any || k[0] < box[0])
+         box[0] = k[0] ;
+      if (!any || k[1] < box[1])
+         box[1] = k[1] ;
+      if (!any || k[2] > box[2])
+         box[2] = k[2] ;
+      if (!any || k[3] > box[3])
+         box[3] = k[3] ;
+      any = 1 ;
+   }
+   sums->bigboxes[n] = std::vector<bigint>(box, box + 4) ;
+}
+/*
+ *   This top level routine calculates the population of a universe.
+ */
+void hlifealgo::calcPopulation() {
+   ensure_hashed() ;
+   int d = node_depth(root) ;
+   nodesum s = summarize(root, d) ;
+   if (s.pop >= 0) {
+      population = bigint(s.pop) ;
+   } else {
+      population = bigpop(root, d) ;
+   }
+}
+/*
+ *   Is the universe empty?
+ */
+int hlifealgo::isEmpty() {
+   ensure_hashed() ;
+   return root == zeronode(depth) ;
+}
+/*
+ *   This routine marks a node as needed to be saved.
+ */
+node *hlifealgo::save(node *n) {
+   if (parallel) {
+      hthreadctx *c = curctx ;
+      if (c->gsp >= c->stacksize) {
+         int nstacksize = c->stacksize * 2 + 100 ;
+         std::lock_guard<std::mutex> g(mt->alloclock) ;
+         alloced += sizeof(node *)*(nstacksize-c->stacksize) ;
+         c->stack = (node **)realloc(c->stack, nstacksize * sizeof(node *)) ;
+         if (c->stack == 0)
+           lifefatal("Out of memory (3).") ;
+         c->stacksize = nstacksize ;
+      }
+      c->stack[c->gsp++] = n ;
+      return n ;
+   }
+   if (gsp >= stacksize) {
+      int nstacksize = stacksize * 2 + 100 ;
+      alloced += sizeof(node *)*(nstacksize-stacksize) ;
+      stack = (node **)realloc(stack, nstacksize * sizeof(node *)) ;
+      if (stack == 0)
+        lifefatal("Out of memory (3).") ;
+      stacksize = nstacksize ;
    }
    stack[gsp++] = n ;
    return n ;
@@ -1382,7 +2430,16 @@ node *hlifealgo::save(node *n) {
  *   This routine pops the stack back to a previous depth.
  */
 void hlifealgo::pop(int n) {
-   gsp = n ;
+   if (parallel)
+      curctx->gsp = n ;
+   else
+      gsp = n ;
+}
+/*
+ *   Where the stack is now, to pass to pop() later.
+ */
+int hlifealgo::stackpos() {
+   return parallel ? curctx->gsp : gsp ;
 }
 /*
  *   This routine clears the stack altogether.
@@ -1400,16 +2457,97 @@ void hlifealgo::clearstack() {
 void hlifealgo::gc_mark(node *root, int invalidate) {
    if (!marked(root)) {
       mark(root) ;
-      if (is_node(root)) {
-         gc_mark(root->nw, invalidate) ;
-         gc_mark(root->ne, invalidate) ;
-         gc_mark(root->sw, invalidate) ;
-         gc_mark(root->se, invalidate) ;
-         if (root->res) {
-            if (invalidate)
-              root->res = 0 ;
+      if (notleaf(root)) {
+         gc_mark(nwof(root), invalidate) ;
+         gc_mark(neof(root), invalidate) ;
+         gc_mark(swof(root), invalidate) ;
+         gc_mark(seof(root), invalidate) ;
+         if (resof(root)) {
+            if (invalidate || (agenow && !takereused(root)))
+              setres(root, 0) ;
             else
-              gc_mark(root->res, invalidate) ;
+              gc_mark(resof(root), invalidate) ;
+         }
+      }
+   }
+}
+/*
+ *   The incremental gc marks a node by putting it back into the hash,
+ *   which do_gc has emptied; a node that's already there is marked.
+ *   Nodes that aren't in the hash are swept onto the free list a slice
+ *   at a time afterwards.  Nodes allocated since the gc only point at
+ *   nodes in the hash, so the sweep never needs to look at them.
+ */
+g_uintptr_t hlifealgo::hashof(node *p) {
+   if (notleaf(p))
+      return HASHMOD(node_hash(nwof(p), neof(p), swof(p), seof(p))) ;
+   leafbits *l = bits(p) ;
+   return HASHMOD(leaf_hash(l->nw, l->ne, l->sw, l->se)) ;
+}
+int hlifealgo::inhash(node *p, g_uintptr_t h) {
+   for (node *q=bucket(h); q; q=nextof(q))
+      if (q == p)
+         return 1 ;
+   return 0 ;
+}
+void hlifealgo::gc_rehash(node *root, int invalidate) {
+   g_uintptr_t h = hashof(root) ;
+   if (inhash(root, h))
+      return ;
+   setnext(root, bucket(h)) ;
+   setbucket(h, root) ;
+   hashpop++ ;
+   if (notleaf(root)) {
+      gc_rehash(nwof(root), invalidate) ;
+      gc_rehash(neof(root), invalidate) ;
+      gc_rehash(swof(root), invalidate) ;
+      gc_rehash(seof(root), invalidate) ;
+      if (resof(root)) {
+         if (invalidate || (agenow && !takereused(root)))
+           setres(root, 0) ;
+         else
+           gc_rehash(resof(root), invalidate) ;
+      }
+   } else if (invalidate) {
+      leafres((leaf *)root) ;
+   }
+}
+void hlifealgo::sweepslice() {
+   g_uintptr_t found = 0 ;
+   while (sweeping && found < 1000) {
+      node *p = 0 ;
+      int n = 1 ;
+      if (compact) {
+         if (sweepidx >= sweepend)
+            sweeping = 0 ;
+         else
+            p = ch((unsigned int)sweepidx++) ;
+      } else {
+         if (sweepblock == 0) {
+            sweeping = 0 ;
+         } else {
+            p = sweepblock + 1 ;
+            n = 1000 ;
+            sweepblock = sweepblock->next ;
+         }
+      }
+      for (int i=0; p && i<n; i++) {
+         node *q = (compact ? p : p + i) ;
+         g_uintptr_t h = hashof(q) ;
+         int live ;
+         if (parallel) {
+            lockbucket(mt, h) ;
+            live = inhash(q, h) ;
+            unlockbucket(mt, h) ;
+         } else {
+            live = inhash(q, h) ;
+         }
+         if (!live) {
+            if (compact)
+               cmark(q) = 0 ;
+            setnext(q, freenodes) ;
+            freenodes = q ;
+            found++ ;
          }
       }
    }
@@ -1422,7 +2560,14 @@ void hlifealgo::do_gc(int invalidate) {
    int i ;
    g_uintptr_t freed_nodes=0 ;
    node *p, *pp ;
+   void (hlifealgo::*keep)(node *, int) =
+                           incgc ? &hlifealgo::gc_rehash : &hlifealgo::gc_mark ;
+   double t0 = gollySecondCount() ;
    inGC = 1 ;
+   if (dc) { // the nodes may be reused
+      dc->memo.clear() ;
+      dc->stored.clear() ;
+   }
    gccount++ ;
    gcstep++ ;
    if (verbose) {
@@ -1432,23 +2577,86 @@ void hlifealgo::do_gc(int invalidate) {
        sprintf(statusline, "GC #%d", gccount) ;
      lifestatus(statusline) ;
    }
+   if (incgc) {
+      hashpop = 0 ;
+      memset(hashtab, 0, (compact ? sizeof(unsigned int) : sizeof(node *))
+                                                             * hashprime) ;
+   }
    for (i=nzeros-1; i>=0; i--)
       if (zeronodea[i] != 0)
          break ;
    if (i >= 0)
-      gc_mark(zeronodea[i], 0) ; // never invalidate zeronode
+      (this->*keep)(zeronodea[i], 0) ; // never invalidate zeronode
    if (root != 0)
-      gc_mark(root, invalidate) ; // pick up the root
+      (this->*keep)(root, invalidate) ; // pick up the root
    for (i=0; i<gsp; i++) {
       poller->poll() ;
-      gc_mark(stack[i], invalidate) ;
+      (this->*keep)(stack[i], invalidate) ;
+   }
+   for (i=0; i<(int)timeline.frames.size(); i++)
+      if (timeline.frames[i])             // 0 if evicted
+         (this->*keep)((node *)timeline.frames[i], invalidate) ;
+   for (size_t j=0; j<pinned.size(); j++)
+      (this->*keep)(pinned[j], invalidate) ;
+   if (parallel) {
+      for (int t=0; t<mt->n; t++) {
+         hthreadctx *c = mt->ctx + t ;
+         for (i=0; i<c->gsp; i++)
+            (this->*keep)(c->stack[i], invalidate) ;
+         for (hframe *f=c->frames; f; f=f->prev)
+            for (int j=0; j<13; j++)
+               if (f->slot[j])
+                  (this->*keep)(f->slot[j], invalidate) ;
+         c->freenodes = 0 ; // the sweep below puts these back
+      }
    }
-   for (i=0; i<timeline.framecount; i++)
-      gc_mark((node *)timeline.frames[i], invalidate) ;
-   hashpop = 0 ;
-   memset(hashtab, 0, sizeof(node *) * hashprime) ;
    freenodes = 0 ;
-   for (p=nodeblocks; p; p=p->next) {
+   if (incgc) {
+      // everything not back in the hash is swept later by newnode
+      sweeping = 1 ;
+      sweepblock = (compact ? 0 : nodeblocks) ;
+      sweepidx = 1 ;
+      sweepend = (g_uintptr_t)ncchunks << CCHUNKBITS ;
+      freed_nodes = totalthings - hashpop ;
+   } else {
+      hashpop = 0 ;
+      memset(hashtab, 0, (compact ? sizeof(unsigned int) : sizeof(node *))
+                                                             * hashprime) ;
+      sweeping = 0 ;
+   }
+   if (compact && !incgc) {
+      unsigned int *tab = (unsigned int *)hashtab ;
+      for (int c=0; c<ncchunks; c++) {
+         poller->poll() ;
+         cnode *cp = cchunks[c] ;
+         unsigned char *marks = (unsigned char *)(cp + CCHUNKSIZE) ;
+         for (i=(c == 0 ? 1 : 0); i<CCHUNKSIZE; i++) {
+            unsigned int idx = ((unsigned int)c << CCHUNKBITS) + i ;
+            if (marks[i] & 1) {
+               g_uintptr_t h = 0 ;
+               marks[i] = 0 ;
+               if (cp[i].nw) {
+                  h = HASHMOD(node_hash(ch(cp[i].nw), ch(cp[i].ne),
+                                       ch(cp[i].sw), ch(cp[i].se))) ;
+               } else {
+                  cleaf *lp = (cleaf *)(cp + i) ;
+                  if (invalidate)
+                     leafres((leaf *)ch(idx)) ;
+                  h = HASHMOD(leaf_hash(lp->nw, lp->ne, lp->sw, lp->se)) ;
+               }
+               cp[i].next = tab[h] ;
+               tab[h] = idx ;
+               hashpop++ ;
+            } else {
+               marks[i] = 0 ;
+               cp[i].next = ci(freenodes) ;
+               freenodes = ch(idx) ;
+               freed_nodes++ ;
+            }
+         }
+      }
+   }
+   for (p=(compact || incgc ? 0 : nodeblocks); p; p=p->next) {
       poller->poll() ;
       for (pp=p+1, i=1; i<1001; i++, pp++) {
          if (marked(pp)) {
@@ -1471,11 +2679,19 @@ void hlifealgo::do_gc(int invalidate) {
          }
       }
    }
+   purgesums() ;
    inGC = 0 ;
+   keptfraction = totalthings ? 1.0 - (double)freed_nodes / (double)totalthings
+                              : 0 ;
+   // only age the cache when it's crowding out everything else
+   agenow = gcage && freed_nodes * 2 < totalthings ;
+   double pause = gollySecondCount() - t0 ;
+   running_hperf.gcpause(pause) ;
    if (verbose) {
      double perc = (double)freed_nodes / (double)totalthings * 100.0 ;
-     sprintf(statusline+strlen(statusline), " freed %g percent (%" PRIuPTR ").",
-                                                   perc, freed_nodes) ;
+     sprintf(statusline+strlen(statusline),
+             " freed %g percent (%" PRIuPTR ") in %gs.", perc, freed_nodes,
+             pause) ;
      lifestatus(statusline) ;
    }
    if (needPop) {
@@ -1495,15 +2711,15 @@ void hlifealgo::clearcache(node *n, int depth, int clearto) {
       if (depth > 3) {
          depth-- ;
          poller->poll() ;
-         clearcache(n->nw, depth, clearto) ;
-         clearcache(n->ne, depth, clearto) ;
-         clearcache(n->sw, depth, clearto) ;
-         clearcache(n->se, depth, clearto) ;
-         if (n->res)
-            clearcache(n->res, depth, clearto) ;
+         clearcache(nwof(n), depth, clearto) ;
+         clearcache(neof(n), depth, clearto) ;
+         clearcache(swof(n), depth, clearto) ;
+         clearcache(seof(n), depth, clearto) ;
+         if (resof(n))
+            clearcache(resof(n), depth, clearto) ;
       }
       if (depth >= clearto)
-         n->res = 0 ;
+         setres(n, 0) ;
    }
 }
 /*
@@ -1541,10 +2757,12 @@ void hlifealgo::new_ngens(int newval) {
    ngens = newval ;
    inGC = 1 ;
    for (i=0; i<hashprime; i++)
-      for (p=hashtab[i]; p; p=clearmarkbit(p->next))
-         if (is_node(p) && !marked(p))
+      for (p=bucket(i); p; p=(compact ? nextof(p) : clearmarkbit(p->next)))
+         if (notleaf(p) && !marked(p))
             clearcache(p, node_depth(p), clearto) ;
-   for (p=nodeblocks; p; p=p->next) {
+   for (int c=0; c<ncchunks; c++)
+      memset(cchunks[c] + CCHUNKSIZE, 0, CCHUNKSIZE) ;
+   for (p=(compact ? 0 : nodeblocks); p; p=p->next) {
       poller->poll() ;
       for (pp=p+1, i=1; i<1001; i++, pp++)
          clearmark(pp) ;
@@ -1623,11 +2841,17 @@ node *hlifealgo::runpattern() {
    }
    save(zeronode(nzeros-1)) ;
    save(n) ;
-   n2 = getres(n, depth) ;
+   if (numthreads > 1) {
+      mt_beginstep() ;
+      n2 = getres(n, depth) ;
+      mt_endstep() ;
+   } else {
+      n2 = getres(n, depth) ;
+   }
    okaytogc = 0 ;
    clearstack() ;
-   if (halvesdone == 1 && n->res != 0) {
-      n->res = 0 ;
+   if (halvesdone == 1 && resof(n) != 0) {
+      setres(n, 0) ;
       halvesdone = 0 ;
    }
    if (poller->isInterrupted() || softinterrupt)
@@ -1637,16 +2861,17 @@ node *hlifealgo::runpattern() {
    return n ;
 }
 /* Returns the center 4-square of an 8x8 leaf node. */
-static unsigned short unpack4x4center(leaf *leaf) {
+static unsigned short unpack4x4center(leafbits *leaf) {
    return combine4(leaf->nw, leaf->ne, leaf->sw, leaf->se);
 }
-const char *hlifealgo::readmacrocell(char *line) {
+const char *hlifealgo::readmacrocell(patternreader &reader, char *line) {
    int n=0 ;
    g_uintptr_t i=1, nw=0, ne=0, sw=0, se=0, indlen=0 ;
    int r, d ;
+   long nframes = 0 ; // as given by #FRAMES
    node **ind = 0 ;
    root = 0 ;
-   while (getline(line, 10000)) {
+   while (reader.getline(line, 10000)) {
       if (i >= indlen) {
          g_uintptr_t nlen = i + indlen + 10 ;
          ind = (node **)realloc(ind, sizeof(node*) * nlen) ;
@@ -1724,6 +2949,7 @@ default:       return "Illegal character in readmacrocell." ;
 	       long cnt = atol(p) ;
 	       if (cnt < 0 || cnt > MAX_FRAME_COUNT)
 		  return "Bad FRAMES line" ;
+	       nframes = cnt ;
 	       destroytimeline() ;
 	       while ('0' <= *p && *p <= '9')
 		 p++ ;
@@ -1772,12 +2998,18 @@ default:       return "Illegal character in readmacrocell." ;
 	       g_uintptr_t nodeind = 0 ;
 	       n = sscanf(line+7, "%d %" PRIuPTR, &frameind, &nodeind) ;
 	       if (n != 2 || frameind > MAX_FRAME_COUNT || frameind < 0 ||
-		   nodeind > i || timeline.framecount != frameind)
+		   nodeind > i || frameind >= nframes ||
+		   timeline.framecount > frameind ||
+		   (timeline.framecount == 0 && frameind != 0))
 		  return "Bad FRAME line" ;
-	       timeline.frames.push_back(make_internal_node(ind[nodeind])) ;
-	       timeline.framecount++ ;
-	       timeline.end = timeline.next ;
-	       timeline.next += timeline.inc ;
+	       // frames that weren't saved are recomputed when needed
+	       while (timeline.framecount <= frameind) {
+		  timeline.frames.push_back(0) ;
+		  timeline.framecount++ ;
+		  timeline.end = timeline.next ;
+		  timeline.next += timeline.inc ;
+	       }
+	       timeline.frames.back() = make_internal_node(ind[nodeind]) ;
 	    }
 	    break ;
          }
@@ -1822,13 +3054,13 @@ default:       return "Illegal character in readmacrocell." ;
                lse = se ? 1 << 15 : 0 ;
             } else { // d == 2 || d == 3
                node *pnw=ind[nw], *pne=ind[ne], *psw=ind[sw], *pse=ind[se] ;
-               if (is_node(pnw) || is_node(pne) || is_node(psw) || is_node(pse)) {
+               if (notleaf(pnw) || notleaf(pne) || notleaf(psw) || notleaf(pse)) {
                   return "Invalid leaf node reference in readmacrocell." ;
                }
-               lnw = unpack4x4center((leaf *)pnw) ;
-               lne = unpack4x4center((leaf *)pne) ;
-               lsw = unpack4x4center((leaf *)psw) ;
-               lse = unpack4x4center((leaf *)pse) ;
+               lnw = unpack4x4center(bits(pnw)) ;
+               lne = unpack4x4center(bits(pne)) ;
+               lsw = unpack4x4center(bits(psw)) ;
+               lse = unpack4x4center(bits(pse)) ;
                if (d == 2) {
                   lnw >>= 5 ;
                   lne >>= 3 ;
@@ -1888,6 +3120,7 @@ const char *hlifealgo::setrule(const char *s) {
    }
 
    clearcache() ;
+   setrulekey() ;
    
    if (hliferules.alternate_rules)
       return "B0-not-Smax rules are not allowed in HashLife.";
@@ -1903,7 +3136,7 @@ const char *hlifealgo::setrule(const char *s) {
 }
 void hlifealgo::unpack8x8(unsigned short nw, unsigned short ne,
                           unsigned short sw, unsigned short se,
-                          unsigned int *top, unsigned int *bot) {
+                          unsigned int *top, unsigned int *bot) const {
    *top = ((nw & 0xf000) << 16) | (((ne & 0xf000) | (nw & 0xf00)) << 12) |
           (((ne & 0xf00) | (nw & 0xf0)) << 8) |
           (((ne & 0xf0) | (nw & 0xf)) << 4) | (ne & 0xf) ;
@@ -1920,20 +3153,20 @@ g_uintptr_t hlifealgo::writecell(std::ostream &os, node *root, int depth) {
    if (root == zeronode(depth))
       return 0 ;
    if (depth == 2) {
-      if (root->nw != 0)
-         return (g_uintptr_t)(root->nw) ;
+      if (nwof(root) != 0)
+         return (g_uintptr_t)nwof(root) ;
    } else {
       if (marked2(root))
-         return (g_uintptr_t)(root->next) ;
+         return (g_uintptr_t)nextof(root) ;
       unhash_node2(root) ;
       mark2(root) ;
    }
    if (depth == 2) {
       int i, j ;
       unsigned int top, bot ;
-      leaf *n = (leaf *)root ;
+      leafbits *n = bits(root) ;
       thiscell = ++cellcounter ;
-      root->nw = (node *)thiscell ;
+      setnw(root, (node *)thiscell) ;
       unpack8x8(n->nw, n->ne, n->sw, n->se, &top, &bot) ;
       for (j=7; (top | bot) && j>=0; j--) {
          int bits = (top >> 24) ;
@@ -1948,12 +3181,12 @@ g_uintptr_t hlifealgo::writecell(std::ostream &os, node *root, int depth) {
       }
       os << '\n' ;
    } else {
-      g_uintptr_t nw = writecell(os, root->nw, depth-1) ;
-      g_uintptr_t ne = writecell(os, root->ne, depth-1) ;
-      g_uintptr_t sw = writecell(os, root->sw, depth-1) ;
-      g_uintptr_t se = writecell(os, root->se, depth-1) ;
+      g_uintptr_t nw = writecell(os, nwof(root), depth-1) ;
+      g_uintptr_t ne = writecell(os, neof(root), depth-1) ;
+      g_uintptr_t sw = writecell(os, swof(root), depth-1) ;
+      g_uintptr_t se = writecell(os, seof(root), depth-1) ;
       thiscell = ++cellcounter ;
-      root->next = (node *)thiscell ;
+      setnext(root, (node *)thiscell) ;
       os << depth+1 << ' ' << nw << ' ' << ne << ' ' << sw << ' ' << se << '\n';
    }
    return thiscell ;
@@ -1968,11 +3201,11 @@ g_uintptr_t hlifealgo::writecell_2p1(node *root, int depth) {
    if (root == zeronode(depth))
       return 0 ;
    if (depth == 2) {
-      if (root->nw != 0)
-         return (g_uintptr_t)(root->nw) ;
+      if (nwof(root) != 0)
+         return (g_uintptr_t)nwof(root) ;
    } else {
       if (marked2(root))
-         return (g_uintptr_t)(root->next) ;
+         return (g_uintptr_t)nextof(root) ;
       unhash_node2(root) ;
       mark2(root) ;
    }
@@ -1981,17 +3214,17 @@ g_uintptr_t hlifealgo::writecell_2p1(node *root, int depth) {
       // note:  we *must* not abort this prescan
       if ((cellcounter & 4095) == 0)
          lifeabortprogress(0, "Scanning tree") ;
-      root->nw = (node *)thiscell ;
+      setnw(root, (node *)thiscell) ;
    } else {
-      writecell_2p1(root->nw, depth-1) ;
-      writecell_2p1(root->ne, depth-1) ;
-      writecell_2p1(root->sw, depth-1) ;
-      writecell_2p1(root->se, depth-1) ;
+      writecell_2p1(nwof(root), depth-1) ;
+      writecell_2p1(neof(root), depth-1) ;
+      writecell_2p1(swof(root), depth-1) ;
+      writecell_2p1(seof(root), depth-1) ;
       thiscell = ++cellcounter ;
       // note:  we *must* not abort this prescan
       if ((cellcounter & 4095) == 0)
          lifeabortprogress(0, "Scanning tree") ;
-      root->next = (node *)thiscell ;
+      setnext(root, (node *)thiscell) ;
    }
    return thiscell ;
 }
@@ -2005,8 +3238,8 @@ g_uintptr_t hlifealgo::writecell_2p2(std::ostream &os, node *root, int depth) {
    if (root == zeronode(depth))
       return 0 ;
    if (depth == 2) {
-      if (cellcounter + 1 != (g_uintptr_t)(root->nw))
-         return (g_uintptr_t)(root->nw) ;
+      if (cellcounter + 1 != (g_uintptr_t)nwof(root))
+         return (g_uintptr_t)nwof(root) ;
       thiscell = ++cellcounter ;
       if ((cellcounter & 4095) == 0) {
          std::streampos siz = os.tellp();
@@ -2015,8 +3248,8 @@ g_uintptr_t hlifealgo::writecell_2p2(std::ostream &os, node *root, int depth) {
       }
       int i, j ;
       unsigned int top, bot ;
-      leaf *n = (leaf *)root ;
-      root->nw = (node *)thiscell ;
+      leafbits *n = bits(root) ;
+      setnw(root, (node *)thiscell) ;
       unpack8x8(n->nw, n->ne, n->sw, n->se, &top, &bot) ;
       for (j=7; (top | bot) && j>=0; j--) {
          int bits = (top >> 24) ;
@@ -2031,16 +3264,16 @@ g_uintptr_t hlifealgo::writecell_2p2(std::ostream &os, node *root, int depth) {
       }
       os << '\n' ;
    } else {
-      if (cellcounter + 1 > (g_uintptr_t)(root->next) || isaborted())
-         return (g_uintptr_t)(root->next) ;
-      g_uintptr_t nw = writecell_2p2(os, root->nw, depth-1) ;
-      g_uintptr_t ne = writecell_2p2(os, root->ne, depth-1) ;
-      g_uintptr_t sw = writecell_2p2(os, root->sw, depth-1) ;
-      g_uintptr_t se = writecell_2p2(os, root->se, depth-1) ;
+      if (cellcounter + 1 > (g_uintptr_t)nextof(root) || isaborted())
+         return (g_uintptr_t)nextof(root) ;
+      g_uintptr_t nw = writecell_2p2(os, nwof(root), depth-1) ;
+      g_uintptr_t ne = writecell_2p2(os, neof(root), depth-1) ;
+      g_uintptr_t sw = writecell_2p2(os, swof(root), depth-1) ;
+      g_uintptr_t se = writecell_2p2(os, seof(root), depth-1) ;
       if (!isaborted() &&
-          cellcounter + 1 != (g_uintptr_t)(root->next)) { // this should never happen
+          cellcounter + 1 != (g_uintptr_t)nextof(root)) { // this should never happen
          lifefatal("Internal in writecell_2p2") ;
-         return (g_uintptr_t)(root->next) ;
+         return (g_uintptr_t)nextof(root) ;
       }
       thiscell = ++cellcounter ;
       if ((cellcounter & 4095) == 0) {
@@ -2048,7 +3281,7 @@ g_uintptr_t hlifealgo::writecell_2p2(std::ostream &os, node *root, int depth) {
          sprintf(progressmsg, "File size: %.2f MB", double(siz) / 1048576.0) ;
          lifeabortprogress(thiscell/(double)writecells, progressmsg) ;
       }
-      root->next = (node *)thiscell ;
+      setnext(root, (node *)thiscell) ;
       os << depth+1 << ' ' << nw << ' ' << ne << ' ' << sw << ' ' << se << '\n';
    }
    return thiscell ;
@@ -2056,6 +3289,7 @@ g_uintptr_t hlifealgo::writecell_2p2(std::ostream &os, node *root, int depth) {
 #define STRINGIFY(arg) STR2(arg)
 #define STR2(arg) #arg
 const char *hlifealgo::writeNativeFormat(std::ostream &os, char *comments) {
+   int framestosave = timeline.savetimeline ? timeline.framecount : 0 ;
    int depth = node_depth(root) ;
    os << "[M2] (golly " STRINGIFY(VERSION) ")\n" ;
 
@@ -2096,18 +3330,18 @@ const char *hlifealgo::writeNativeFormat(std::ostream &os, char *comments) {
    */
    /* this is the new two-pass way */
    cellcounter = 0 ;
+   // evicted frames are left out; the reader recomputes them as needed
    vector<int> depths(timeline.framecount) ;
-   int framestosave = timeline.framecount ;
-   if (timeline.savetimeline == 0)
-     framestosave = 0 ;
    if (framestosave) {
      for (int i=0; i<timeline.framecount; i++) {
        node *frame = (node*)timeline.frames[i] ;
-       depths[i] = node_depth(frame) ;
+       if (frame)
+         depths[i] = node_depth(frame) ;
      }
      for (int i=0; i<timeline.framecount; i++) {
        node *frame = (node*)timeline.frames[i] ;
-       writecell_2p1(frame, depths[i]) ;
+       if (frame)
+         writecell_2p1(frame, depths[i]) ;
      }
    }
    writecell_2p1(root, depth) ;
@@ -2120,8 +3354,10 @@ const char *hlifealgo::writeNativeFormat(std::ostream &os, char *comments) {
          << ' ' << timeline.base << '^' << timeline.expo << '\n' ;
      for (int i=0; i<timeline.framecount; i++) {
        node *frame = (node*)timeline.frames[i] ;
+       if (frame == 0)
+         continue ;
        writecell_2p2(os, frame, depths[i]) ;
-       os << "#FRAME " << i << ' ' << (g_uintptr_t)frame->next << '\n' ;
+       os << "#FRAME " << i << ' ' << (g_uintptr_t)nextof(frame) << '\n' ;
      }
    }
    writecell_2p2(os, root, depth) ;
@@ -2129,13 +3365,1203 @@ const char *hlifealgo::writeNativeFormat(std::ostream &os, char *comments) {
    if (framestosave) {
      for (int i=0; i<timeline.framecount; i++) {
        node *frame = (node*)timeline.frames[i] ;
-       afterwritemc(frame, depths[i]) ;
+       if (frame)
+         afterwritemc(frame, depths[i]) ;
      }
    }
    afterwritemc(root, depth) ;
    inGC = 0 ;
    return 0 ;
 }
+/*
+ *   What snapshot pins:  the root, the empty nodes below it (so the
+ *   writer needn't call zeronode, which can make nodes), and the rule
+ *   and generation at the time.  The writer numbers the nodes in ids.
+ */
+struct hsnapshot {
+   node *root ;
+   int depth ;
+   std::vector<node *> zeros ;
+   std::string rule ;
+   bigint generation ;
+   std::unordered_map<node *, g_uintptr_t> ids ;
+   g_uintptr_t counter ;
+} ;
+hsnapshot *hlifealgo::snapshot() {
+   ensure_hashed() ;
+   hsnapshot *snap = new hsnapshot ;
+   snap->root = root ;
+   snap->depth = node_depth(root) ;
+   snap->zeros.assign(snap->depth + 1, (node *)0) ;
+   for (int d=2; d<=snap->depth; d++)
+      snap->zeros[d] = zeronode(d) ;
+   snap->rule = hliferules.getrule() ;
+   snap->generation = generation ;
+   snap->counter = 0 ;
+   pinned.push_back(root) ;
+   return snap ;
+}
+void *hlifealgo::pinstate() {
+   ensure_hashed() ;
+   pinned.push_back(root) ;
+   return root ;
+}
+void hlifealgo::unpinstate(void *n) {
+   for (size_t i=pinned.size(); i>0; i--)
+      if (pinned[i-1] == (node *)n) {
+         pinned.erase(pinned.begin() + (i-1)) ;
+         break ;
+      }
+}
+void hlifealgo::releasesnapshot(hsnapshot *snap) {
+   for (size_t i=0; i<pinned.size(); i++)
+      if (pinned[i] == snap->root) {
+         pinned.erase(pinned.begin() + i) ;
+         break ;
+      }
+   delete snap ;
+}
+/*
+ *   Like writecell, but with the numbers kept in the snapshot rather
+ *   than in the nodes.
+ */
+g_uintptr_t hlifealgo::writesnapcell(std::ostream &os, node *n, int depth,
+                                     hsnapshot &snap) const {
+   if (n == snap.zeros[depth])
+      return 0 ;
+   std::unordered_map<node *, g_uintptr_t>::iterator it = snap.ids.find(n) ;
+   if (it != snap.ids.end())
+      return it->second ;
+   g_uintptr_t thiscell ;
+   if (depth == 2) {
+      int i, j ;
+      unsigned int top, bot ;
+      leafbits *l = bits(n) ;
+      thiscell = ++snap.counter ;
+      unpack8x8(l->nw, l->ne, l->sw, l->se, &top, &bot) ;
+      for (j=7; (top | bot) && j>=0; j--) {
+         int bits = (top >> 24) ;
+         top = (top << 8) | (bot >> 24) ;
+         bot = (bot << 8) ;
+         for (i=0; bits && i<8; i++, bits = (bits << 1) & 255)
+            if (bits & 128)
+               os << '*' ;
+            else
+               os << '.' ;
+         os << '$' ;
+      }
+      os << '\n' ;
+   } else {
+      g_uintptr_t nw = writesnapcell(os, nwof(n), depth-1, snap) ;
+      g_uintptr_t ne = writesnapcell(os, neof(n), depth-1, snap) ;
+      g_uintptr_t sw = writesnapcell(os, swof(n), depth-1, snap) ;
+      g_uintptr_t se = writesnapcell(os, seof(n), depth-1, snap) ;
+      thiscell = ++snap.counter ;
+      os << depth+1 << ' ' << nw << ' ' << ne << ' ' << sw << ' ' << se << '\n';
+   }
+   snap.ids[n] = thiscell ;
+   return thiscell ;
+}
+const char *hlifealgo::writesnapshot(hsnapshot *snap, std::ostream &os,
+                                     const char *comments) const {
+   os << "[M2] (golly " STRINGIFY(VERSION) ")\n" ;
+   os << "#R " << snap->rule << '\n' ;
+   if (snap->generation > bigint::zero)
+      os << "#G " << snap->generation.tostring('\0') << '\n' ;
+   if (comments)
+      os << comments ;
+   snap->ids.clear() ;
+   snap->counter = 0 ;
+   writesnapcell(os, snap->root, snap->depth, *snap) ;
+   snap->ids.clear() ;
+   if (!os.flush())
+      return "Error occurred writing file; maybe disk is full?" ;
+   return 0 ;
+}
+/*
+ *   Load a binary macrocell file a level at a time; since children are
+ *   always in the level below we only need the nodes of two levels at
+ *   once.  We grow the hash up front so it isn't rebuilt as we go.
+ */
+const char *hlifealgo::readbinarymacrocell(const char *data, size_t len) {
+   mcbimage f ;
+   const char *err = f.parse(data, len) ;
+   if (err)
+      return err ;
+   if (f.hdr->leafbytes != 8)
+      return "This binary macrocell file has multi-state leaves." ;
+   err = setupfrommcb(f) ;
+   if (err)
+      return err ;
+   root = 0 ;
+   double total = (double)f.totalnodes(), done = 0 ;
+   while (hashlimit != G_MAX && hashpop + total > hashlimit)
+      resize() ;
+   vector<node *> frames(f.hdr->framecount) ;
+   vector<node *> below, here ;
+   for (unsigned int l=0; l<f.hdr->nlevels; l++) {
+      g_uintptr_t n = (g_uintptr_t)f.count(l), nbelow = below.size() ;
+      const char *rec = f.records(l) ;
+      size_t recbytes = f.recordbytes(l) ;
+      here.resize(n + 1) ;
+      if (l > 0)
+         below[0] = zeronode(l + 1) ;
+      for (g_uintptr_t i=1; i<=n; i++, rec += recbytes) {
+         if ((i & 65535) == 0) {
+            lifeabortprogress((done + i) / total, "") ;
+            if (isaborted())
+               return "File contains truncated pattern." ;
+         }
+         clearstack() ;
+         if (l == 0) {
+            const unsigned short *q = (const unsigned short *)rec ;
+            here[i] = (node *)find_leaf(q[0], q[1], q[2], q[3]) ;
+         } else {
+            g_uintptr_t nw = (g_uintptr_t)f.child(rec, 0),
+                        ne = (g_uintptr_t)f.child(rec, 1),
+                        sw = (g_uintptr_t)f.child(rec, 2),
+                        se = (g_uintptr_t)f.child(rec, 3) ;
+            if (nw >= nbelow || ne >= nbelow || sw >= nbelow || se >= nbelow)
+               return "Node out of range in binary macrocell file." ;
+            here[i] = find_node(below[nw], below[ne], below[sw], below[se]) ;
+         }
+      }
+      done += n ;
+      if (f.hdr->rootindex && f.hdr->rootlevel == l)
+         root = here[(g_uintptr_t)f.hdr->rootindex] ;
+      // frames that weren't saved (MCBNOFRAME) stay 0
+      for (unsigned int i=0; i<f.hdr->framecount; i++)
+         if (f.frames[2*i] == l)
+            frames[i] = make_internal_node(here[(g_uintptr_t)f.frames[2*i+1]]) ;
+      below.swap(here) ;
+   }
+   clearstack() ;
+   for (unsigned int i=0; i<f.hdr->framecount; i++) {
+      timeline.frames.push_back(frames[i]) ;
+      timeline.framecount++ ;
+      timeline.end = timeline.next ;
+      timeline.next += timeline.inc ;
+   }
+   if (root == 0)
+      return 0 ; // empty; endofpattern() will be called soon
+   depth = f.hdr->rootlevel + 2 ;
+   if (depth < 3) {
+      root = make_internal_node(root) ;
+      depth = 3 ;
+   }
+   hashed = 1 ;
+   return 0 ;
+}
+/*
+ *   Number the nodes of each depth in the order their parents need
+ *   them, using the same fields and marks as writecell_2p1, and
+ *   collect them by depth.
+ */
+void hlifealgo::mcbnumber(node *root, int depth,
+                          vector<vector<node *> > &levels) {
+   if (root == zeronode(depth))
+      return ;
+   vector<node *> &level = levels[depth-2] ;
+   if (depth == 2) {
+      if (nwof(root) != 0)
+         return ;
+      level.push_back(root) ;
+      setnw(root, (node *)(g_uintptr_t)level.size()) ;
+   } else {
+      if (marked2(root))
+         return ;
+      unhash_node2(root) ;
+      mark2(root) ;
+      mcbnumber(nwof(root), depth-1, levels) ;
+      mcbnumber(neof(root), depth-1, levels) ;
+      mcbnumber(swof(root), depth-1, levels) ;
+      mcbnumber(seof(root), depth-1, levels) ;
+      level.push_back(root) ;
+      setnext(root, (node *)(g_uintptr_t)level.size()) ;
+   }
+   // note:  we *must* not abort this prescan
+   if ((++cellcounter & 4095) == 0)
+      lifeabortprogress(0, "Scanning tree") ;
+}
+g_uintptr_t hlifealgo::mcbindex(node *n, int depth) {
+   if (n == zeronode(depth))
+      return 0 ;
+   return (g_uintptr_t)(depth == 2 ? nwof(n) : nextof(n)) ;
+}
+const char *hlifealgo::writeBinaryFormat(std::ostream &os, char *comments,
+                                         int withpops) {
+   int framestosave = timeline.savetimeline ? timeline.framecount : 0 ;
+   mcbheader h ;
+   std::string gen, start ;
+   initmcbheader(h, withpops, framestosave, gen, start) ;
+   h.leafbytes = 8 ;
+   int rootdepth = node_depth(root) ;
+   int maxdepth = rootdepth ;
+   // evicted frames are left out; the reader recomputes them as needed
+   vector<int> depths(framestosave) ;
+   for (int i=0; i<framestosave; i++) {
+      if (timeline.frames[i] == 0)
+         continue ;
+      depths[i] = node_depth((node *)timeline.frames[i]) ;
+      if (depths[i] > maxdepth)
+         maxdepth = depths[i] ;
+   }
+   inGC = 1 ;
+   cellcounter = 0 ;
+   vector<vector<node *> > levels(maxdepth - 1) ;
+   for (int i=0; i<framestosave; i++)
+      if (timeline.frames[i])
+         mcbnumber((node *)timeline.frames[i], depths[i], levels) ;
+   mcbnumber(root, rootdepth, levels) ;
+   vector<unsigned G_INT64> counts(levels.size()), frames ;
+   h.idxbytes = 4 ;
+   for (size_t l=0; l<levels.size(); l++) {
+      counts[l] = levels[l].size() ;
+      if (counts[l] > 0xffffffffU)
+         h.idxbytes = 8 ;
+   }
+   h.rootlevel = rootdepth - 2 ;
+   h.rootindex = mcbindex(root, rootdepth) ;
+   for (int i=0; i<framestosave; i++) {
+      if (timeline.frames[i] == 0) {
+         frames.push_back(MCBNOFRAME) ;
+         frames.push_back(0) ;
+         continue ;
+      }
+      frames.push_back(depths[i] - 2) ;
+      frames.push_back(mcbindex((node *)timeline.frames[i], depths[i])) ;
+   }
+   mcbwriter w(os) ;
+   w.writeheader(h, counts, frames, hliferules.getrule(), gen.c_str(),
+                 start.c_str(), comments) ;
+   writecells = cellcounter ;
+   cellcounter = 0 ;
+   vector<unsigned G_INT64> pops, belowpops(1) ;
+   for (size_t l=0; l<levels.size() && !isaborted(); l++) {
+      int d = (int)l + 2 ;
+      pops.assign(levels[l].size() + 1, 0) ;
+      for (size_t i=0; i<levels[l].size(); i++) {
+         node *n = levels[l][i] ;
+         if (d == 2) {
+            leafbits *b = bits(n) ;
+            unsigned short q[4] = { b->nw, b->ne, b->sw, b->se } ;
+            w.put(q, sizeof(q)) ;
+            pops[i+1] = shortpop[q[0]] + shortpop[q[1]] + shortpop[q[2]] +
+                        shortpop[q[3]] ;
+         } else {
+            node *k[4] = { nwof(n), neof(n), swof(n), seof(n) } ;
+            unsigned G_INT64 p = 0 ;
+            for (int j=0; j<4; j++) {
+               g_uintptr_t c = mcbindex(k[j], d-1) ;
+               w.putindex(c, h.idxbytes) ;
+               p += belowpops[c] ;
+               if (p < belowpops[c])
+                  p = ~(unsigned G_INT64)0 ; // saturate
+            }
+            pops[i+1] = p ;
+         }
+         if ((++cellcounter & 4095) == 0) {
+            sprintf(progressmsg, "File size: %.2f MB", w.size() / 1048576.0) ;
+            lifeabortprogress(cellcounter/(double)writecells, progressmsg) ;
+            if (isaborted())
+               break ;
+         }
+      }
+      w.pad() ;
+      if (withpops) {
+         w.put(pops.data() + 1, (pops.size() - 1) * 8) ;
+         w.pad() ;
+      }
+      belowpops.swap(pops) ;
+   }
+   w.flush() ;
+   for (int i=0; i<framestosave; i++)
+      if (timeline.frames[i])
+         afterwritemc((node *)timeline.frames[i], depths[i]) ;
+   afterwritemc(root, rootdepth) ;
+   inGC = 0 ;
+   return 0 ;
+}
+/*
+ *   Switching modes is safe at any time; a sweep that's under way just
+ *   finishes.
+ */
+void hlifealgo::setGCMode(int incremental, int age) {
+   incgc = incremental ;
+   gcage = age ;
+   if (!age)
+      agenow = 0 ;
+}
+/*
+ *   Set the number of threads to use when stepping.  The pool itself
+ *   is started lazily by the first step that needs it.
+ */
+void hlifealgo::setNumThreads(int n) {
+   poller->bailIfCalculating() ;
+   if (n < 1)
+      n = 1 ;
+   if (n > 1024)
+      n = 1024 ;
+   if (n != numthreads)
+      mt_stopthreads() ;
+   numthreads = n ;
+}
+void hlifealgo::mt_startthreads() {
+   mt = new hlifethreads() ;
+   mt->n = numthreads ;
+   mt->ctx = new hthreadctx[numthreads] ;
+   for (int i=0; i<numthreads; i++) {
+      hthreadctx *c = mt->ctx + i ;
+      c->stack = 0 ;
+      c->stacksize = c->gsp = 0 ;
+      c->freenodes = 0 ;
+      c->askedgc = 0 ;
+      c->frames = 0 ;
+      c->halves = 0 ;
+      c->ismain = (i == 0) ;
+   }
+   mt->running = mt->parked = mt->shutdown = mt->stepping = 0 ;
+   mt->wantgc = mt->wantresize = 0 ;
+   mt->stop = 0 ;
+   mt->abort = 0 ;
+   mt->idle = 0 ;
+   mt->newnodes = 0 ;
+   for (int i=0; i<NBUCKETLOCKS; i++)
+      mt->bucketlocks[i] = 0 ;
+   mt->workers = new std::thread *[numthreads] ;
+   mt->workers[0] = 0 ;
+   for (int i=1; i<numthreads; i++)
+      mt->workers[i] = new std::thread(&hlifealgo::mt_worker, this, i) ;
+}
+void hlifealgo::mt_stopthreads() {
+   if (mt == 0)
+      return ;
+   {
+      std::lock_guard<std::mutex> g(mt->lock) ;
+      mt->shutdown = 1 ;
+   }
+   mt->workcv.notify_all() ;
+   for (int i=1; i<mt->n; i++) {
+      mt->workers[i]->join() ;
+      delete mt->workers[i] ;
+   }
+   for (int i=0; i<mt->n; i++) {
+      hthreadctx *c = mt->ctx + i ;
+      if (c->stack) {
+         alloced -= sizeof(node *) * c->stacksize ;
+         free(c->stack) ;
+      }
+   }
+   delete [] mt->workers ;
+   delete [] mt->ctx ;
+   delete mt ;
+   mt = 0 ;
+}
+/*
+ *   Find some work:  our own most recent task first, else steal the
+ *   oldest task of some other thread.
+ */
+static htask *findwork(hlifethreads *mt, hthreadctx *c) {
+   htask *t = 0 ;
+   {
+      std::lock_guard<std::mutex> g(c->qlock) ;
+      if (!c->q.empty()) {
+         t = c->q.back() ;
+         c->q.pop_back() ;
+         return t ;
+      }
+   }
+   int me = (int)(c - mt->ctx) ;
+   for (int i=1; i<mt->n; i++) {
+      hthreadctx *v = mt->ctx + (me + i) % mt->n ;
+      std::lock_guard<std::mutex> g(v->qlock) ;
+      if (!v->q.empty()) {
+         t = v->q.front() ;
+         v->q.pop_front() ;
+         return t ;
+      }
+   }
+   return 0 ;
+}
+void hlifealgo::mt_worker(int i) {
+   hthreadctx *c = mt->ctx + i ;
+   curctx = c ;
+   for (;;) {
+      htask *t = findwork(mt, c) ;
+      if (t == 0) {
+         std::unique_lock<std::mutex> lk(mt->lock) ;
+         if (mt->shutdown)
+            return ;
+         // between steps sleep until needed; during a step, look for
+         // new work at least every millisecond
+         mt->idle++ ;
+         if (mt->stepping)
+            mt->workcv.wait_for(lk, std::chrono::milliseconds(1)) ;
+         else
+            mt->workcv.wait(lk) ;
+         mt->idle-- ;
+         continue ;
+      }
+      {
+         std::unique_lock<std::mutex> lk(mt->lock) ;
+         while (mt->stop)
+            mt->cv.wait(lk) ;
+         mt->running++ ;
+      }
+      t->f->slot[t->slot] = getres(t->n, t->depth) ;
+      c->gsp = 0 ;
+      t->f->pending.fetch_sub(1, std::memory_order_release) ;
+      {
+         std::lock_guard<std::mutex> g(mt->lock) ;
+         mt->running-- ;
+      }
+      mt->cv.notify_all() ;
+   }
+}
+void hlifealgo::mt_beginstep() {
+   if (mt == 0)
+      mt_startthreads() ;
+   for (int i=0; i<mt->n; i++) {
+      hthreadctx *c = mt->ctx + i ;
+      c->gsp = 0 ;
+      c->frames = 0 ;
+      c->halves = 0 ;
+      c->askedgc = 0 ;
+   }
+   mt->abort = 0 ;
+   mt->newnodes = 0 ;
+   {
+      std::lock_guard<std::mutex> g(mt->lock) ;
+      mt->running = 1 ;
+      mt->stepping = 1 ;
+   }
+   curctx = mt->ctx ;
+   parallel = 1 ;
+}
+void hlifealgo::mt_endstep() {
+   parallel = 0 ;
+   curctx = 0 ;
+   std::lock_guard<std::mutex> g(mt->lock) ;
+   mt->running = 0 ;
+   mt->stepping = 0 ;
+   hashpop += mt->newnodes ;
+   mt->newnodes = 0 ;
+   // give the per-thread free lists back to the serial allocator
+   for (int i=0; i<mt->n; i++) {
+      hthreadctx *c = mt->ctx + i ;
+      while (c->freenodes) {
+         node *p = c->freenodes ;
+         c->freenodes = nextof(p) ;
+         setnext(p, freenodes) ;
+         freenodes = p ;
+      }
+      c->gsp = 0 ;
+      halvesdone += c->halves ;
+   }
+   if (halvesdone > 1000)
+      halvesdone = 1000 ;
+}
+/*
+ *   A thread reached a point where it holds no node pointers the gc
+ *   cannot see; if somebody wants the world stopped, stop.
+ */
+void hlifealgo::mt_safepoint() {
+   if (mt->stop.load(std::memory_order_acquire)) {
+      if (curctx->ismain)
+         mt_exclusive() ;
+      else
+         mt_park() ;
+   }
+}
+void hlifealgo::mt_park() {
+   std::unique_lock<std::mutex> lk(mt->lock) ;
+   mt->parked++ ;
+   mt->cv.notify_all() ;
+   while (mt->stop)
+      mt->cv.wait(lk) ;
+   mt->parked-- ;
+}
+/*
+ *   Ask for a gc or a hash resize; it is done by the stepping thread
+ *   (which owns the poller) once everybody else is parked.
+ */
+const int MT_GC = 1, MT_RESIZE = 2 ;
+void hlifealgo::mt_request(int what) {
+   {
+      std::lock_guard<std::mutex> g(mt->lock) ;
+      if (what & MT_GC)
+         mt->wantgc = 1 ;
+      if (what & MT_RESIZE)
+         mt->wantresize = 1 ;
+      mt->stop = 1 ;
+   }
+   mt_safepoint() ;
+}
+void hlifealgo::mt_exclusive() {
+   std::unique_lock<std::mutex> lk(mt->lock) ;
+   while (mt->parked < mt->running - 1)
+      mt->cv.wait(lk) ;
+   hashpop += mt->newnodes ;
+   mt->newnodes = 0 ;
+   if (mt->wantgc)
+      do_gc(0) ;
+   if (mt->wantresize && hashpop > hashlimit)
+      resize() ;
+   mt->wantgc = mt->wantresize = 0 ;
+   mt->stop = 0 ;
+   lk.unlock() ;
+   mt->cv.notify_all() ;
+}
+/*
+ *   Node allocation.  Each thread carves nodes off its own list, and
+ *   refills it a thousand at a time from the shared list (or a new
+ *   block).  When we're out of memory we ask for a gc once; if that
+ *   didn't free anything we go over the limit like the serial code.
+ */
+node *hlifealgo::mt_newnode() {
+   hthreadctx *c = curctx ;
+   while (c->freenodes == 0)
+      mt_refill(c) ;
+   node *r = c->freenodes ;
+   c->freenodes = nextof(r) ;
+   return r ;
+}
+void hlifealgo::mt_refill(hthreadctx *c) {
+   {
+      std::lock_guard<std::mutex> g(mt->alloclock) ;
+      if (freenodes == 0 && sweeping)
+         sweepslice() ;
+      if (freenodes) {
+         for (int i=0; freenodes && i<1000; i++) {
+            node *p = freenodes ;
+            freenodes = nextof(p) ;
+            setnext(p, c->freenodes) ;
+            c->freenodes = p ;
+         }
+         c->askedgc = 0 ;
+         return ;
+      }
+      if (compact && (c->askedgc || alloced + CCHUNKBYTES <= maxmem)) {
+         newchunk(c->freenodes) ;
+         c->askedgc = 0 ;
+         return ;
+      }
+      if (!compact && (c->askedgc || alloced + 1001 * sizeof(node) <= maxmem)) {
+         node *b = (node *)calloc(1001, sizeof(node)) ;
+         if (b == 0)
+            lifefatal("Out of memory; try reducing the hash memory limit.") ;
+         alloced += 1001 * sizeof(node) ;
+         b->next = nodeblocks ;
+         nodeblocks = b++ ;
+         for (int i=0; i<1000; i++, b++) {
+            b->next = c->freenodes ;
+            c->freenodes = b ;
+         }
+         totalthings += 1000 ;
+         c->askedgc = 0 ;
+         return ;
+      }
+   }
+   c->askedgc = 1 ;
+   mt_request(MT_GC) ;
+}
+/*
+ *   The hash table lookups.  We never allocate while holding a bucket
+ *   lock (allocation may have to wait for a gc), so if the node isn't
+ *   there we drop the lock, allocate, and look again.
+ */
+node *hlifealgo::mt_find_node(node *nw, node *ne, node *sw, node *se) {
+   node *p, *fresh = 0 ;
+   for (;;) {
+      node *pred = 0 ;
+      g_uintptr_t h = HASHMOD(node_hash(nw,ne,sw,se)) ;
+      lockbucket(mt, h) ;
+      for (p=bucket(h); p; p = nextof(p)) { /* make sure to compare nw *first* */
+         if (nw == nwof(p) && ne == neof(p) && sw == swof(p) && se == seof(p)) {
+            if (pred) { /* move this one to the front */
+               setnext(pred, nextof(p)) ;
+               setnext(p, bucket(h)) ;
+               setbucket(h, p) ;
+            }
+            break ;
+         }
+         pred = p ;
+      }
+      if (p == 0 && fresh != 0) {
+         p = fresh ;
+         fresh = 0 ;
+         setnw(p, nw) ;
+         setne(p, ne) ;
+         setsw(p, sw) ;
+         setse(p, se) ;
+         setres(p, 0) ;
+         setnext(p, bucket(h)) ;
+         setbucket(h, p) ;
+         unlockbucket(mt, h) ;
+         save(p) ;
+         if (hashpop + ++mt->newnodes > hashlimit)
+            mt_request(MT_RESIZE) ;
+         return p ;
+      }
+      unlockbucket(mt, h) ;
+      if (p)
+         break ;
+      fresh = mt_newnode() ;
+   }
+   if (fresh) { // somebody beat us to it
+      setnext(fresh, curctx->freenodes) ;
+      curctx->freenodes = fresh ;
+   }
+   return save(p) ;
+}
+leaf *hlifealgo::mt_find_leaf(unsigned short nw, unsigned short ne,
+                              unsigned short sw, unsigned short se) {
+   node *p, *fresh = 0 ;
+   for (;;) {
+      node *pred = 0 ;
+      g_uintptr_t h = HASHMOD(leaf_hash(nw, ne, sw, se)) ;
+      lockbucket(mt, h) ;
+      for (p=bucket(h); p; p = nextof(p)) {
+         leafbits *l = bits(p) ;
+         if (nw == l->nw && ne == l->ne && sw == l->sw && se == l->se &&
+             !notleaf(p)) {
+            if (pred) {
+               setnext(pred, nextof(p)) ;
+               setnext(p, bucket(h)) ;
+               setbucket(h, p) ;
+            }
+            break ;
+         }
+         pred = p ;
+      }
+      if (p == 0 && fresh != 0) {
+         p = fresh ;
+         fresh = 0 ;
+         setnext(p, bucket(h)) ;
+         setbucket(h, p) ;
+         unlockbucket(mt, h) ;
+         save(p) ;
+         if (hashpop + ++mt->newnodes > hashlimit)
+            mt_request(MT_RESIZE) ;
+         return (leaf *)p ;
+      }
+      unlockbucket(mt, h) ;
+      if (p)
+         break ;
+      fresh = mt_newnode() ;
+      setnw(fresh, 0) ;       /* the isnode field */
+      leafbits *l = bits(fresh) ;
+      l->nw = nw ;
+      l->ne = ne ;
+      l->sw = sw ;
+      l->se = se ;
+      leafres((leaf *)fresh) ;
+   }
+   if (fresh) {
+      setnext(fresh, curctx->freenodes) ;
+      curctx->freenodes = fresh ;
+   }
+   return (leaf *)save(p) ;
+}
+/*
+ *   The multi-threaded getres.  Only the stepping thread polls and
+ *   updates the performance counters.  The release fence makes sure
+ *   that anybody who sees our res also sees the node it points to.
+ */
+template <int C>
+node *hlifealgo::mt_getres(node *n, int depth) {
+   node *res = resof<C>(n) ;
+   std::atomic_thread_fence(std::memory_order_acquire) ;
+   if (res) {
+      if (gcage) {
+         setreused<C>(n) ;
+         save(res) ;
+      }
+      return res ;
+   }
+   hthreadctx *c = curctx ;
+   if (c->ismain) {
+      if (poller->poll() || softinterrupt)
+         mt->abort = 1 ;
+      if (running_hperf.fastinc(depth, ngens < depth))
+         running_hperf.report(inc_hperf, verbose) ;
+   }
+   if (mt->abort)
+      return zeronode(depth-1) ;
+   mt_safepoint() ;
+   int sp = c->gsp ;
+   depth-- ;
+   node *nw = nwof<C>(n), *ne = neof<C>(n), *sw = swof<C>(n),
+        *se = seof<C>(n) ;
+   if (ngens >= depth) {
+     if (depth >= threaddepth) {
+       res = mt_dorecurs(nw, ne, sw, se, depth) ;
+     } else if (notleaf<C>(nw)) {
+       res = dorecurs<C>(nw, ne, sw, se, depth) ;
+     } else {
+       res = (node *)dorecurs_leaf<C>((leaf *)nw, (leaf *)ne,
+                                      (leaf *)sw, (leaf *)se) ;
+     }
+   } else {
+     if (depth >= threaddepth) {
+       res = mt_dorecurs_half(nw, ne, sw, se, depth) ;
+     } else if (notleaf<C>(nw)) {
+       res = dorecurs_half<C>(nw, ne, sw, se, depth) ;
+     } else if (ngens == 0) {
+       res = (node *)dorecurs_leaf_quarter<C>((leaf *)nw, (leaf *)ne,
+                                              (leaf *)sw, (leaf *)se) ;
+     } else {
+       res = (node *)dorecurs_leaf_half<C>((leaf *)nw, (leaf *)ne,
+                                           (leaf *)sw, (leaf *)se) ;
+     }
+   }
+   c->gsp = sp ;
+   if (mt->abort) // don't assign this to the cache field!
+     return zeronode(depth) ;
+   if (ngens < depth)
+     c->halves++ ;
+   std::atomic_thread_fence(std::memory_order_release) ;
+   setres<C>(n, res) ;
+   if (gcage) {
+     setreused<C>(n) ;
+     save(res) ;
+   }
+   return res ;
+}
+/*
+ *   Get the results of cnt nodes into f.slot[base...].  Results that
+ *   are already cached are free; of the rest, we compute the first
+ *   ourselves and queue the others for whoever is idle.
+ */
+void hlifealgo::mt_resolve(hframe &f, node **q, int base, int cnt, int depth) {
+   hthreadctx *c = curctx ;
+   htask tasks[9] ;
+   int first = -1, ntasks = 0 ;
+   for (int i=0; i<cnt; i++) {
+      node *r = resof(q[i]) ;
+      std::atomic_thread_fence(std::memory_order_acquire) ;
+      if (r) {
+         if (gcage)
+            setreused(q[i]) ;
+         f.slot[base+i] = r ;
+      } else if (first < 0) {
+         first = i ;
+      } else {
+         htask &t = tasks[ntasks++] ;
+         t.n = q[i] ;
+         t.depth = depth ;
+         t.f = &f ;
+         t.slot = base + i ;
+      }
+   }
+   if (ntasks) {
+      f.pending.store(ntasks, std::memory_order_relaxed) ;
+      {
+         std::lock_guard<std::mutex> g(c->qlock) ;
+         for (int i=0; i<ntasks; i++)
+            c->q.push_back(tasks + i) ;
+      }
+      if (mt->idle)
+         mt->workcv.notify_all() ;
+   }
+   if (first >= 0)
+      f.slot[base+first] = getres(q[first], depth) ;
+   if (ntasks)
+      mt_join(c, f) ;
+}
+/*
+ *   Wait for the queued tasks of a frame, doing whatever work we can
+ *   find in the meantime.
+ */
+void hlifealgo::mt_join(hthreadctx *c, hframe &f) {
+   while (f.pending.load(std::memory_order_acquire) > 0) {
+      htask *t = findwork(mt, c) ;
+      if (t) {
+         int sp = c->gsp ;
+         t->f->slot[t->slot] = getres(t->n, t->depth) ;
+         c->gsp = sp ;
+         t->f->pending.fetch_sub(1, std::memory_order_release) ;
+         continue ;
+      }
+      if (c->ismain && (poller->poll() || softinterrupt))
+         mt->abort = 1 ;
+      mt_safepoint() ;
+      std::this_thread::yield() ;
+   }
+}
+/*
+ *   These are dorecurs and dorecurs_half with the independent getres
+ *   calls farmed out.
+ */
+node *hlifealgo::mt_dorecurs(node *n, node *ne, node *t, node *e, int depth) {
+   hthreadctx *c = curctx ;
+   int sp = c->gsp ;
+   hframe f ;
+   memset(f.slot, 0, sizeof(f.slot)) ;
+   f.prev = c->frames ;
+   c->frames = &f ;
+   node *q[9] ;
+   q[0] = n ;
+   q[1] = find_node(neof(n), nwof(ne), seof(n), swof(ne)) ;
+   q[2] = ne ;
+   q[3] = find_node(swof(n), seof(n), nwof(t), neof(t)) ;
+   q[4] = find_node(seof(n), swof(ne), neof(t), nwof(e)) ;
+   q[5] = find_node(swof(ne), seof(ne), nwof(e), neof(e)) ;
+   q[6] = t ;
+   q[7] = find_node(neof(t), nwof(e), seof(t), swof(e)) ;
+   q[8] = e ;
+   mt_resolve(f, q, 0, 9, depth) ;
+   node
+   *t00 = f.slot[0], *t01 = f.slot[1], *t02 = f.slot[2],
+   *t10 = f.slot[3], *t11 = f.slot[4], *t12 = f.slot[5],
+   *t20 = f.slot[6], *t21 = f.slot[7], *t22 = f.slot[8] ;
+   q[0] = find_node(t00, t01, t10, t11) ;
+   q[1] = find_node(t01, t02, t11, t12) ;
+   q[2] = find_node(t10, t11, t20, t21) ;
+   q[3] = find_node(t11, t12, t21, t22) ;
+   mt_resolve(f, q, 9, 4, depth) ;
+   n = find_node(f.slot[9], f.slot[10], f.slot[11], f.slot[12]) ;
+   c->frames = f.prev ;
+   c->gsp = sp ;
+   return save(n) ;
+}
+node *hlifealgo::mt_dorecurs_half(node *n, node *ne, node *t, node *e,
+                                  int depth) {
+   hthreadctx *c = curctx ;
+   int sp = c->gsp ;
+   hframe f ;
+   memset(f.slot, 0, sizeof(f.slot)) ;
+   f.prev = c->frames ;
+   c->frames = &f ;
+   node *q[9] ;
+   q[0] = n ;
+   q[1] = find_node(neof(n), nwof(ne), seof(n), swof(ne)) ;
+   q[2] = ne ;
+   q[3] = find_node(swof(n), seof(n), nwof(t), neof(t)) ;
+   q[4] = find_node(seof(n), swof(ne), neof(t), nwof(e)) ;
+   q[5] = find_node(swof(ne), seof(ne), nwof(e), neof(e)) ;
+   q[6] = t ;
+   q[7] = find_node(neof(t), nwof(e), seof(t), swof(e)) ;
+   q[8] = e ;
+   mt_resolve(f, q, 0, 9, depth) ;
+   node
+   *t00 = f.slot[0], *t01 = f.slot[1], *t02 = f.slot[2],
+   *t10 = f.slot[3], *t11 = f.slot[4], *t12 = f.slot[5],
+   *t20 = f.slot[6], *t21 = f.slot[7], *t22 = f.slot[8] ;
+   n = find_node(find_node(seof(t00), swof(t01), neof(t10), nwof(t11)),
+                 find_node(seof(t01), swof(t02), neof(t11), nwof(t12)),
+                 find_node(seof(t10), swof(t11), neof(t20), nwof(t21)),
+                 find_node(seof(t11), swof(t12), neof(t21), nwof(t22))) ;
+   c->frames = f.prev ;
+   c->gsp = sp ;
+   return save(n) ;
+}
+/*
+ *   Open (creating if need be) the persistent result cache.  If another
+ *   process is already writing to it we just read it.
+ */
+const char *hlifealgo::setResultCache(const char *filename, int maxmb,
+                                      int mindepth) {
+   poller->bailIfCalculating() ;
+   closeResultCache() ;
+   if (filename == 0 || *filename == 0)
+      return 0 ;
+#ifdef _WIN32
+   (void)maxmb ;
+   (void)mindepth ;
+   return "The result cache is not supported on this platform." ;
+#else
+   int writable = 1 ;
+   int fd = open(filename, O_RDWR | O_CREAT, 0666) ;
+   if (fd < 0) {
+      writable = 0 ;
+      fd = open(filename, O_RDONLY) ;
+   }
+   if (fd < 0)
+      return "Could not open the result cache file." ;
+   if (writable && flock(fd, LOCK_EX | LOCK_NB) != 0)
+      writable = 0 ;
+   struct stat st ;
+   if (fstat(fd, &st) != 0) {
+      close(fd) ;
+      return "Could not open the result cache file." ;
+   }
+   G_INT64 size = st.st_size ;
+   int fresh = (size == 0) ;
+   if (fresh) {
+      if (!writable) {
+         close(fd) ;
+         return "The result cache file is empty." ;
+      }
+      if (maxmb < 1)
+         maxmb = 1 ;
+      size = (G_INT64)maxmb << 20 ;
+      if (ftruncate(fd, (off_t)size) != 0) {
+         close(fd) ;
+         return "Could not create the result cache file." ;
+      }
+   }
+   void *p = mmap(0, (size_t)size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                  MAP_SHARED, fd, 0) ;
+   if (p == MAP_FAILED) {
+      close(fd) ;
+      return "Could not map the result cache file." ;
+   }
+   hdiskhdr *hdr = (hdiskhdr *)p ;
+   if (fresh) {
+      hdr->size = size ;
+      hdr->nslots = size / 64 ;
+      hdr->data = diskdata(hdr->nslots) ;
+      hdr->used = hdr->data ;
+      hdr->entries = 0 ;
+      memcpy(hdr->magic, DCMAGIC, 8) ;
+   }
+   if (size < (G_INT64)sizeof(hdiskhdr) || memcmp(hdr->magic, DCMAGIC, 8) != 0 ||
+       hdr->size != size || hdr->nslots < 1 ||
+       hdr->data != diskdata(hdr->nslots) ||
+       hdr->used < hdr->data || hdr->used > size ||
+       memchr(hdr->rule, 0, sizeof(hdr->rule)) == 0) {
+      munmap(p, (size_t)size) ;
+      close(fd) ;
+      return "Not a result cache file." ;
+   }
+   dc = new hdiskcache() ;
+   dc->fd = fd ;
+   dc->writable = writable ;
+   dc->mindepth = (mindepth < 4 ? 4 : mindepth) ;
+   dc->base = (char *)p ;
+   dc->hdr = hdr ;
+   dc->slots = (hdiskslot *)(dc->base + sizeof(hdiskhdr)) ;
+   dc->hits = dc->misses = dc->stores = 0 ;
+   setrulekey() ;
+   return 0 ;
+#endif
+}
+void hlifealgo::closeResultCache() {
+   if (dc == 0)
+      return ;
+#ifndef _WIN32
+   munmap(dc->base, (size_t)dc->hdr->size) ;
+   close(dc->fd) ;
+#endif
+   delete dc ;
+   dc = 0 ;
+}
+void hlifealgo::getResultCacheStats(double &hits, double &misses,
+                                    double &stores) {
+   hits = misses = stores = 0 ;
+   if (dc) {
+      hits = dc->hits ;
+      misses = dc->misses ;
+      stores = dc->stores ;
+   }
+}
+/*
+ *   Results depend on the rule, so it's part of every key, and the file
+ *   is only used for the rule (both its name and its table) that it was
+ *   first filled with.
+ */
+void hlifealgo::setrulekey() {
+   if (dc == 0)
+      return ;
+   unsigned G_INT64 h = 0 ;
+   for (int i=0; i<65536; i++)
+      h = hmix(h ^ (unsigned char)ruletable[i] ^ ((unsigned G_INT64)i << 8)) ;
+   dc->rulekey = h ;
+   dc->rulestate = DCNORULE ;
+   diskrule() ;
+}
+/*
+ *   Check the rule in the header against ours (once the writer has
+ *   stored something, if it hadn't when we last looked).
+ */
+int hlifealgo::diskrule() {
+   if (dc->rulestate != DCNORULE)
+      return dc->rulestate ;
+   const char *r = hliferules.getrule() ;
+   if (strlen(r) >= sizeof(dc->hdr->rule))
+      dc->rulestate = DCOTHERRULE ;
+   else if (dc->hdr->entries > 0) {
+      std::atomic_thread_fence(std::memory_order_acquire) ;
+      dc->rulestate = (dc->hdr->rulekey == dc->rulekey &&
+                       strcmp(dc->hdr->rule, r) == 0) ? DCTHISRULE : DCOTHERRULE ;
+   }
+   return dc->rulestate ;
+}
+/*
+ *   A hash of the content of a node.  We memoize it (until the next gc)
+ *   for nodes that aren't near the bottom of the tree, since there are
+ *   far fewer of those.
+ */
+hdiskkey hlifealgo::contenthash(node *n, int depth) {
+   hdiskkey h ;
+   if (depth == 2) {
+      leafbits *l = bits(n) ;
+      unsigned G_INT64 b = ((unsigned G_INT64)l->nw << 48) ^
+                           ((unsigned G_INT64)l->ne << 32) ^
+                           ((unsigned G_INT64)l->sw << 16) ^ l->se ;
+      h.key = hmix(0x2545f4914f6cdd1dULL ^ b) ;
+      h.check = hmix(hmix(b + 0x3c6ef372fe94f82bULL)) ;
+      return h ;
+   }
+   if (depth >= 5) {
+      std::unordered_map<node *, hdiskkey>::iterator it = dc->memo.find(n) ;
+      if (it != dc->memo.end())
+         return it->second ;
+   }
+   depth-- ;
+   // the check chains the children in a different way from the key
+   hdiskkey k = contenthash(nwof(n), depth) ;
+   h.key = hmix(k.key + 0x9e3779b97f4a7c15ULL) ;
+   h.check = hmix(k.check ^ 0xbb67ae8584caa73bULL) ;
+   k = contenthash(neof(n), depth) ;
+   h.key = hmix(h.key ^ k.key) ;
+   h.check = hmix(h.check + k.check) ;
+   k = contenthash(swof(n), depth) ;
+   h.key = hmix(h.key ^ k.key) ;
+   h.check = hmix(h.check + k.check) ;
+   k = contenthash(seof(n), depth) ;
+   h.key = hmix(h.key ^ k.key) ;
+   h.check = hmix(h.check + k.check) ;
+   if (depth >= 4)
+      dc->memo[n] = h ;
+   return h ;
+}
+/*
+ *   The key also depends on the depth and on how far the result is
+ *   stepped; that's a full step unless ngens is smaller.
+ */
+hdiskkey hlifealgo::diskkey(node *n, int depth) {
+   int g = (ngens >= depth - 1 ? 255 : ngens) ;
+   hdiskkey h = contenthash(n, depth) ;
+   h.key = hmix(h.key ^ hmix(dc->rulekey + depth * 256 + g)) ;
+   h.check = hmix(h.check + hmix(dc->rulekey ^ (depth * 256 + g))) ;
+   return h ;
+}
+/*
+ *   Rebuild the subtree stored at the given cell.  Returns 0 if what's
+ *   there isn't a tree of the right depth (another process may have
+ *   left a damaged file); since children are always stored before
+ *   their parents, a damaged file can't send us round in circles.
+ */
+node *hlifealgo::diskbuild(unsigned int cell, int depth) {
+   G_INT64 off = (G_INT64)cell << 4 ;
+   if (off < dc->hdr->data || off + 16 > dc->hdr->used)
+      return 0 ;
+   std::unordered_map<unsigned int, node *>::iterator it = dc->built.find(cell) ;
+   if (it != dc->built.end())
+      return it->second ;
+   unsigned int *c = (unsigned int *)(dc->base + off) ;
+   node *r ;
+   if (c[0] == DCLEAF) {
+      if (depth != 2)
+         return 0 ;
+      r = (node *)find_leaf((unsigned short)(c[2] >> 16), (unsigned short)c[2],
+                            (unsigned short)(c[3] >> 16), (unsigned short)c[3]) ;
+   } else {
+      node *k[4] ;
+      if (depth <= 2)
+         return 0 ;
+      for (int i=0; i<4; i++)
+         if (c[i] >= cell || (k[i] = diskbuild(c[i], depth-1)) == 0)
+            return 0 ;
+      r = find_node(k[0], k[1], k[2], k[3]) ;
+   }
+   dc->built[cell] = r ;
+   return r ;
+}
+/*
+ *   Look up the result of n in the cache file, and if it's there
+ *   rebuild it.
+ */
+node *hlifealgo::diskget(node *n, int depth) {
+   hdiskslot *s = 0 ;
+   node *r = 0 ;
+   if (diskrule() == DCTHISRULE)
+      s = diskslot(dc, diskkey(n, depth), 0) ;
+   if (s) {
+      r = diskbuild((unsigned int)(s->off >> 4), depth - 1) ;
+      dc->built.clear() ;
+   }
+   if (r)
+      dc->hits++ ;
+   else
+      dc->misses++ ;
+   return r ;
+}
+/*
+ *   Store a subtree in the cache file, returning the cell of its root,
+ *   or 0 if we've run out of room.  Nodes are stored once, keyed by
+ *   their content, so we stop as soon as we find one that's there.
+ */
+unsigned int hlifealgo::diskstore(node *n, int depth) {
+   std::unordered_map<node *, unsigned int>::iterator it = dc->stored.find(n) ;
+   if (it != dc->stored.end())
+      return it->second ;
+   hdiskkey key = contenthash(n, depth) ;
+   key.key = hmix(key.key ^ DCNODETAG) ;
+   key.check = hmix(key.check + DCNODETAG) ;
+   hdiskslot *s = diskslot(dc, key, 0) ;
+   unsigned int cell ;
+   if (s) {
+      cell = (unsigned int)(s->off >> 4) ;
+   } else {
+      unsigned int c[4] ;
+      if (depth == 2) {
+         leafbits *l = bits(n) ;
+         c[0] = DCLEAF ;
+         c[1] = 0 ;
+         c[2] = ((unsigned int)l->nw << 16) | l->ne ;
+         c[3] = ((unsigned int)l->sw << 16) | l->se ;
+      } else {
+         node *k[4] = { nwof(n), neof(n), swof(n), seof(n) } ;
+         for (int i=0; i<4; i++)
+            if ((c[i] = diskstore(k[i], depth-1)) == 0)
+               return 0 ;
+      }
+      G_INT64 off = dc->hdr->used ;
+      if (off + 16 > dc->hdr->size || (off >> 4) >= DCLEAF)
+         return 0 ;
+      memcpy(dc->base + off, c, 16) ;
+      dc->hdr->used = off + 16 ;
+      cell = (unsigned int)(off >> 4) ;
+      s = diskslot(dc, key, 1) ;
+      if (s) { // if the index is too crowded we just don't share it
+         s->key = key.key ;
+         s->check = key.check ;
+         std::atomic_thread_fence(std::memory_order_release) ;
+         s->off = off ;
+      }
+   }
+   dc->stored[n] = cell ;
+   return cell ;
+}
+/*
+ *   Store a newly computed result in the cache file, if there's room.
+ */
+void hlifealgo::diskput(node *n, int depth, node *res) {
+   if (!dc->writable || diskrule() == DCOTHERRULE)
+      return ;
+   hdiskkey key = diskkey(n, depth) ;
+   if (diskslot(dc, key, 1) == 0)
+      return ;
+   unsigned int cell = diskstore(res, depth - 1) ;
+   hdiskslot *s = diskslot(dc, key, 1) ; // storing may have taken the slot
+   if (cell == 0 || s == 0)
+      return ;
+   if (dc->rulestate == DCNORULE) {
+      // the first result claims the file for our rule
+      dc->hdr->rulekey = dc->rulekey ;
+      strcpy(dc->hdr->rule, hliferules.getrule()) ;
+      dc->rulestate = DCTHISRULE ;
+   }
+   s->key = key.key ;
+   s->check = key.check ;
+   std::atomic_thread_fence(std::memory_order_release) ;
+   s->off = (G_INT64)cell << 4 ;
+   dc->hdr->entries++ ;
+   dc->stores++ ;
+}
 char hlifealgo::statusline[200] ;
 static lifealgo *creator() { return new hlifealgo() ; }
 void hlifealgo::doInitializeAlgoInfo(staticAlgoInfo &ai) {
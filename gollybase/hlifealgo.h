@@ -6,6 +6,7 @@
 #include "lifealgo.h"
 #include "liferules.h"
 #include "util.h"
+#include <vector>
 /*
  *   Into instances of this node structure is where almost all of the
  *   memory allocated by this program goes.  Thus, it is imperative we
@@ -124,14 +125,54 @@ struct leaf {
    node *next ;              /* hash link */
    node *isnode ;            /* must always be zero for leaves */
    unsigned short nw, ne, sw, se ;  /* constant */
-   bigint leafpop ;         /* how many set bits */
    unsigned short res1, res2 ;      /* constant */
+   unsigned int leafpop ;           /* how many set bits */
 } ;
 /*
  *   If it is a struct node, this returns a non-zero value, otherwise it
  *   returns a zero value.
  */
 #define is_node(n) (((node *)(n))->nw)
+/*
+ *   Even at 48 bytes a node is mostly pointers, so we also support a
+ *   compact node store (selected when the hlifealgo is constructed)
+ *   where nodes and leaves live in large chunks and are named by a
+ *   32-bit index rather than by their address.  The hash link, the
+ *   children and the result are then all indices, and a node shrinks
+ *   to 24 bytes.  Index zero is never used, so zero is still null.
+ *   Inside hlifealgo a node pointer in compact mode is really such an
+ *   index cast to a pointer, so it must never be dereferenced
+ *   directly; see the accessors in the class.
+ */
+struct cnode {
+   unsigned int next ;              /* hash link */
+   unsigned int nw, ne, sw, se ;    /* constant; nw != 0 means nonleaf */
+   unsigned int res ;               /* cache */
+} ;
+struct cleaf {
+   unsigned int next ;              /* hash link */
+   unsigned int isnode ;            /* must always be zero for leaves */
+   unsigned short nw, ne, sw, se ;  /* constant */
+   unsigned short res1, res2 ;      /* constant */
+   unsigned int leafpop ;           /* how many set bits */
+} ;
+/*
+ *   The part of a leaf that is laid out the same way in both stores.
+ */
+struct leafbits {
+   unsigned short nw, ne, sw, se ;
+   unsigned short res1, res2 ;
+   unsigned int leafpop ;
+} ;
+/*
+ *   Each compact chunk holds this many slots, followed by one byte per
+ *   slot that holds the marks the default store keeps in the low bits
+ *   of next and res.
+ */
+const int CCHUNKBITS = 16 ;
+const int CCHUNKSIZE = 1 << CCHUNKBITS ;
+const int CMAXCHUNKS = 1 << (32 - CCHUNKBITS) ;
+const int CCHUNKBYTES = CCHUNKSIZE * (sizeof(cnode) + 1) ;
 /*
  *   For explicit prefetching we retain some state on our lookup
  *   calculations.
@@ -143,20 +184,68 @@ struct setup_t {
    void prefetch(node **addr) const { PREFETCH(addr) ; }
 } ;
 #endif
+/*
+ *   The optional multi-threaded mode keeps its pool, per-thread gc
+ *   stacks and locks in these; they are only defined in hlifealgo.cpp
+ *   so users of this header don't need the threading headers.
+ */
+struct hlifethreads ;
+struct hthreadctx ;
+struct hframe ;
+struct hdiskcache ;
+/*
+ *   Keys in the result cache are two independent 64-bit hashes; an
+ *   entry is only used when both match.
+ */
+struct hdiskkey {
+   unsigned G_INT64 key, check ;
+} ;
+/*
+ *   The state of a getruns walk; only defined in hlifealgo.cpp.
+ */
+struct hrunwalk ;
+/*
+ *   A pattern pinned by snapshot(); only defined in hlifealgo.cpp.
+ */
+struct hsnapshot ;
+/*
+ *   What the population, edge and hash queries remember about a node;
+ *   the table of them is only defined in hlifealgo.cpp.
+ */
+struct nodesum {
+   node *n ;
+   G_INT64 pop ;
+   G_INT64 top, left, bottom, right ;
+   cellhash::value hash ;        // all ones until a hash query wants it
+} ;
+struct hsumtable ;
+/*
+ *   A change to one leaf made by setcells or setruns; only defined in
+ *   hlifealgo.cpp.
+ */
+struct hleafedit ;
 /**
  *   Our hlifealgo class.
  */
 class hlifealgo : public lifealgo {
 public:
-   hlifealgo() ;
+   hlifealgo(int compactstore=0) ;
    virtual ~hlifealgo() ;
    // note that for hlifealgo, clearall() releases no memory; it retains
    // the full cache information but just sets the current pattern to
    // the empty pattern.
-   virtual void clearall() ; // not implemented
+   virtual void clearall() ;
    virtual int setcell(int x, int y, int newstate) ;
    virtual int getcell(int x, int y) ;
    virtual int nextcell(int x, int y, int &state) ;
+   virtual int setcells(const int *cells, size_t n, int multistate,
+                        int dx, int dy) ;
+   virtual int setruns(const int *runs, size_t n, int dx, int dy) ;
+   virtual int getruns(const bigint &top, const bigint &left,
+                       const bigint &bottom, const bigint &right,
+                       liferunsink &sink) ;
+   virtual cellhash::value gethash(const bigint &top, const bigint &left,
+                                   const bigint &bottom, const bigint &right) ;
    virtual void endofpattern() ;
    virtual void setIncrement(bigint inc) ;
    virtual void setIncrement(int inc) { setIncrement(bigint(inc)) ; }
@@ -166,11 +255,31 @@ public:
    virtual int hyperCapable() { return 1 ; }
    virtual void setMaxMemory(int m) ;
    virtual int getMaxMemory() { return (int)(maxmem >> 20) ; }
+   virtual void setNumThreads(int n) ;
+   // results of nodes at least this deep are computed in parallel
+   void setThreadDepth(int d) { threaddepth = (d < 4 ? 4 : d) ; }
+   virtual void setGCMode(int incremental, int age) ;
+   // a result cache file shared across runs; the size (in megabytes)
+   // applies when the file is created, and only nodes at least mindepth
+   // deep are looked up.  Returns an error message, or 0.
+   const char *setResultCache(const char *filename, int maxmb, int mindepth) ;
+   void getResultCacheStats(double &hits, double &misses, double &stores) ;
+   // for benchmarking the node stores:  nodes in the hash, node slots
+   // allocated, and total bytes allocated
+   void getNodeStats(g_uintptr_t &nodes, g_uintptr_t &slots,
+                     g_uintptr_t &bytes) {
+      nodes = hashpop ;
+      slots = totalthings ;
+      bytes = alloced ;
+   }
    virtual const char *setrule(const char *s) ;
    virtual const char *getrule() { return hliferules.getrule() ; }
    virtual void step() ;
    virtual void* getcurrentstate() { return root ; }
    virtual void setcurrentstate(void *n) ;
+   virtual void *pinstate() ;
+   virtual void unpinstate(void *n) ;
+   virtual double getkeptfraction() { return keptfraction ; }
    /*
     *   The contract of draw() is that it render every pixel in the
     *   viewport precisely once.  This allows us to eliminate all
@@ -180,8 +289,21 @@ public:
    virtual void fit(viewport &view, int force) ;
    virtual void lowerRightPixel(bigint &x, bigint &y, int mag) ;
    virtual void findedges(bigint *t, bigint *l, bigint *b, bigint *r) ;
-   virtual const char *readmacrocell(char *line) ;
+   virtual const char *readmacrocell(patternreader &reader, char *line) ;
    virtual const char *writeNativeFormat(std::ostream &os, char *comments) ;
+   virtual const char *readbinarymacrocell(const char *data, size_t len) ;
+   virtual const char *writeBinaryFormat(std::ostream &os, char *comments,
+                                         int withpops) ;
+   /**
+    *   Pin the current pattern so gc keeps its nodes, which never
+    *   change, until releasesnapshot.  writesnapshot writes it as a
+    *   macrocell file and only reads the pinned nodes, so it may run on
+    *   another thread while this one goes on stepping.
+    */
+   hsnapshot *snapshot() ;
+   const char *writesnapshot(hsnapshot *snap, std::ostream &os,
+                             const char *comments) const ;
+   void releasesnapshot(hsnapshot *snap) ;
    static void doInitializeAlgoInfo(staticAlgoInfo &) ;
 private:
 /*
@@ -207,6 +329,8 @@ private:
  */
    node **stack ;
    int stacksize ;
+   std::vector<node *> pinned ;   // the roots of snapshots and pinstate
+   double keptfraction ;          // of the nodes, by the last gc
    g_uintptr_t hashpop, hashlimit, hashprime ;
 #ifndef PRIMEMOD
    g_uintptr_t hashmask ;
@@ -245,26 +369,164 @@ private:
    hperf running_hperf, step_hperf, inc_hperf ;
    int softinterrupt ;
    static char statusline[] ;
+   /*
+    *   Multi-threaded stepping.  When numthreads is more than one,
+    *   runpattern() sets parallel and the getres() calls at depth
+    *   threaddepth and above hand their independent subresults to a
+    *   pool of worker threads.
+    */
+   int numthreads, threaddepth ;
+   int parallel ;
+   hlifethreads *mt ;
+   /*
+    *   The persistent result cache, if there is one.  Results are keyed
+    *   by a hash of the content of the node, so getres() can use results
+    *   computed by earlier runs.
+    */
+   hdiskcache *dc ;
+   /*
+    *   The populations and boxes of the nodes queries have reached.
+    */
+   hsumtable *sums ;
+   /*
+    *   Garbage collection modes.  With incgc the mark rebuilds the hash
+    *   from the live nodes, and the sweep that finds the free ones is
+    *   done a slice at a time by newnode; sweepblock (or sweepidx, up
+    *   to sweepend, in the compact store) is how far it has got.  With
+    *   gcage a collection drops the results that were not reused since
+    *   the one before, if the one before freed less than half the nodes
+    *   (agenow); the reused flag is bit 2 of res (bit 3 of the mark byte
+    *   in the compact store).
+    */
+   int incgc, gcage, agenow, sweeping ;
+   node *sweepblock ;
+   g_uintptr_t sweepidx, sweepend ;
+   /*
+    *   The compact node store, if it's in use.  The chunk table is
+    *   allocated at its full size up front so that other threads can
+    *   decode indices while we add chunks.  The hash table holds
+    *   indices too (so hashtab is really an unsigned int array).
+    */
+   int compact ;
+   cnode **cchunks ;
+   int ncchunks ;
+   cnode *cn(const void *n) const {
+      g_uintptr_t i = (g_uintptr_t)n ;
+      return cchunks[i >> CCHUNKBITS] + (i & (CCHUNKSIZE - 1)) ;
+   }
+   unsigned char &cmark(const void *n) const {
+      g_uintptr_t i = (g_uintptr_t)n ;
+      return ((unsigned char *)(cchunks[i >> CCHUNKBITS] + CCHUNKSIZE))
+                                                 [i & (CCHUNKSIZE - 1)] ;
+   }
+   static node *ch(unsigned int i) { return (node *)(g_uintptr_t)i ; }
+   static unsigned int ci(const void *n) { return (unsigned int)(g_uintptr_t)n ; }
+   /*
+    *   Field access that works with either node store.  The templated
+    *   forms take the store as a constant; the stepping recursion is
+    *   instantiated once for each store so it never tests compact.
+    */
+   template <int C> node *nwof(node *n) const { return C ? ch(cn(n)->nw) : n->nw ; }
+   template <int C> node *neof(node *n) const { return C ? ch(cn(n)->ne) : n->ne ; }
+   template <int C> node *swof(node *n) const { return C ? ch(cn(n)->sw) : n->sw ; }
+   template <int C> node *seof(node *n) const { return C ? ch(cn(n)->se) : n->se ; }
+   template <int C> node *resof(node *n) const {
+      return C ? ch(cn(n)->res) : (node *)(~(g_uintptr_t)4 & (g_uintptr_t)n->res) ;
+   }
+   template <int C> void setres(node *n, node *v) {
+      if (C) cn(n)->res = ci(v) ; else n->res = v ;
+   }
+   template <int C> void setreused(node *n) {
+      if (C)
+         cmark(n) |= 8 ;
+      else
+         n->res = (node *)(4 | (g_uintptr_t)n->res) ;
+   }
+   template <int C> int notleaf(const void *n) const {
+      return C ? cn(n)->nw != 0 : is_node(n) != 0 ;
+   }
+   template <int C> leafbits *bits(const void *l) const {
+      return C ? (leafbits *)&((cleaf *)cn(l))->nw
+               : (leafbits *)&((leaf *)l)->nw ;
+   }
+   node *nwof(node *n) const { return compact ? nwof<1>(n) : nwof<0>(n) ; }
+   node *neof(node *n) const { return compact ? neof<1>(n) : neof<0>(n) ; }
+   node *swof(node *n) const { return compact ? swof<1>(n) : swof<0>(n) ; }
+   node *seof(node *n) const { return compact ? seof<1>(n) : seof<0>(n) ; }
+   node *resof(node *n) const { return compact ? resof<1>(n) : resof<0>(n) ; }
+   node *nextof(node *n) const { return compact ? ch(cn(n)->next) : n->next ; }
+   void setnw(node *n, node *v) { if (compact) cn(n)->nw = ci(v) ; else n->nw = v ; }
+   void setne(node *n, node *v) { if (compact) cn(n)->ne = ci(v) ; else n->ne = v ; }
+   void setsw(node *n, node *v) { if (compact) cn(n)->sw = ci(v) ; else n->sw = v ; }
+   void setse(node *n, node *v) { if (compact) cn(n)->se = ci(v) ; else n->se = v ; }
+   void setres(node *n, node *v) { if (compact) setres<1>(n, v) ; else setres<0>(n, v) ; }
+   void setnext(node *n, node *v) { if (compact) cn(n)->next = ci(v) ; else n->next = v ; }
+   void setkid(node *n, int q, node *v) {     /* 0=nw, 1=ne, 2=sw, 3=se */
+      if (q == 0) setnw(n, v) ; else if (q == 1) setne(n, v) ;
+      else if (q == 2) setsw(n, v) ; else setse(n, v) ;
+   }
+   void setreused(node *n) {
+      if (compact) setreused<1>(n) ; else setreused<0>(n) ;
+   }
+   int takereused(node *n) {     /* test and clear the reused flag */
+      int r ;
+      if (compact) {
+         r = cmark(n) & 8 ;
+         cmark(n) &= ~8 ;
+      } else {
+         r = (int)(4 & (g_uintptr_t)n->res) ;
+         n->res = (node *)(~(g_uintptr_t)4 & (g_uintptr_t)n->res) ;
+      }
+      return r ;
+   }
+   int notleaf(const void *n) const {
+      return compact ? notleaf<1>(n) : notleaf<0>(n) ;
+   }
+   leafbits *bits(const void *l) const {
+      return compact ? bits<1>(l) : bits<0>(l) ;
+   }
+   node *bucket(g_uintptr_t h) const {
+      return compact ? ch(((unsigned int *)hashtab)[h]) : hashtab[h] ;
+   }
+   void setbucket(g_uintptr_t h, node *p) {
+      if (compact)
+         ((unsigned int *)hashtab)[h] = ci(p) ;
+      else
+         hashtab[h] = p ;
+   }
 //
    void leafres(leaf *n) ;
    void resize() ;
    node *find_node(node *nw, node *ne, node *sw, node *se) ;
+   template <int C> node *find_node(node *nw, node *ne, node *sw, node *se) ;
 #ifdef USEPREFETCH
-   node *find_node(setup_t &su) ;
-   void setupprefetch(setup_t &su, node *nw, node *ne, node *sw, node *se) ;
+   template <int C> node *find_node(setup_t &su) ;
+   template <int C> void setupprefetch(setup_t &su, node *nw, node *ne,
+                                       node *sw, node *se) ;
 #endif
    void unhash_node(node *n) ;
    void unhash_node2(node *n) ;
    void rehash_node(node *n) ;
    leaf *find_leaf(unsigned short nw, unsigned short ne,
                    unsigned short sw, unsigned short se) ;
+   template <int C> leaf *find_leaf(unsigned short nw, unsigned short ne,
+                                    unsigned short sw, unsigned short se) ;
+   node *cfind_node(node *nw, node *ne, node *sw, node *se) ;
+   leaf *cfind_leaf(unsigned short nw, unsigned short ne,
+                    unsigned short sw, unsigned short se) ;
    node *getres(node *n, int depth) ;
-   node *dorecurs(node *n, node *ne, node *t, node *e, int depth) ;
-   node *dorecurs_half(node *n, node *ne, node *t, node *e, int depth) ;
-   leaf *dorecurs_leaf(leaf *n, leaf *ne, leaf *t, leaf *e) ;
-   leaf *dorecurs_leaf_half(leaf *n, leaf *ne, leaf *t, leaf *e) ;
-   leaf *dorecurs_leaf_quarter(leaf *n, leaf *ne, leaf *t, leaf *e) ;
+   template <int C> node *getres(node *n, int depth) ;
+   template <int C> node *dorecurs(node *n, node *ne, node *t, node *e,
+                                   int depth) ;
+   template <int C> node *dorecurs_half(node *n, node *ne, node *t, node *e,
+                                        int depth) ;
+   template <int C> leaf *dorecurs_leaf(leaf *n, leaf *ne, leaf *t, leaf *e) ;
+   template <int C> leaf *dorecurs_leaf_half(leaf *n, leaf *ne, leaf *t,
+                                             leaf *e) ;
+   template <int C> leaf *dorecurs_leaf_quarter(leaf *n, leaf *ne, leaf *t,
+                                                leaf *e) ;
    node *newnode() ;
+   void newchunk(node *&list) ;
    leaf *newleaf() ;
    node *newclearednode() ;
    leaf *newclearedleaf() ;
@@ -274,19 +536,43 @@ private:
    node *pushroot(node *n) ;
    node *make_internal_node(node *n);
    node *gsetbit(node *n, int x, int y, int newstate, int depth) ;
+   int setbatch(const int *p, size_t n, int stride, int dx, int dy) ;
+   node *setleaves(node *n, int depth, const hleafedit *b,
+                   const hleafedit *e) ;
    int getbit(node *n, int x, int y, int depth) ;
    int nextbit(node *n, int x, int y, int depth) ;
+   int bandruns(hrunwalk &w, int depth, G_INT64 y) ;
+   int splitroot(const bigint &top, const bigint &left,
+                 const bigint &bottom, const bigint &right,
+                 vector<std::pair<std::pair<G_INT64, G_INT64>, node *> >
+                                                                 &start) ;
+   cellhash::value nodehash(node *n, int depth) ;
+   cellhash::value recthash(node *n, int depth, G_INT64 x, G_INT64 y,
+                            cellhash::value fx, cellhash::value fy,
+                            G_INT64 wd, G_INT64 ht) ;
    node *hashpattern(node *root, int depth) ;
    node *popzeros(node *n) ;
-   const bigint &calcpop(node *root, int depth) ;
-   void aftercalcpop2(node *root, int depth) ;
+   nodesum summarize(node *n, int depth) ;
+   void addsum(const nodesum &s) ;
+   void purgesums() ;
+   bigint bigpop(node *n, int depth) ;
+   void bigbox(node *n, int depth, bigint box[4]) ;
    void afterwritemc(node *root, int depth) ;
+   g_uintptr_t writesnapcell(std::ostream &os, node *n, int depth,
+                             hsnapshot &snap) const ;
+   void mcbnumber(node *root, int depth, vector<vector<node *> > &levels) ;
+   g_uintptr_t mcbindex(node *n, int depth) ;
    void calcPopulation() ;
    node *save(node *n) ;
    void pop(int n) ;
+   int stackpos() ;
    void clearstack() ;
    void clearcache() ;
    void gc_mark(node *root, int invalidate) ;
+   void gc_rehash(node *root, int invalidate) ;
+   g_uintptr_t hashof(node *p) ;
+   int inhash(node *p, g_uintptr_t h) ;
+   void sweepslice() ;
    void do_gc(int invalidate) ;
    void clearcache(node *n, int depth, int clearto) ;
    void clearcache_p1(node *n, int depth, int clearto) ;
@@ -297,13 +583,42 @@ private:
    void renderbm(int x, int y) ;
    void fill_ll(int d) ;
    void drawnode(node *n, int llx, int lly, int depth, node *z) ;
+   int getbitsfromleaves(const std::vector<node *> &v) ;
    void ensure_hashed() ;
    g_uintptr_t writecell(std::ostream &os, node *root, int depth) ;
    g_uintptr_t writecell_2p1(node *root, int depth) ;
    g_uintptr_t writecell_2p2(std::ostream &os, node *root, int depth) ;
    void unpack8x8(unsigned short nw, unsigned short ne,
                   unsigned short sw, unsigned short se,
-                  unsigned int *top, unsigned int *bot) ;
+                  unsigned int *top, unsigned int *bot) const ;
+   void mt_startthreads() ;
+   void mt_stopthreads() ;
+   void mt_worker(int i) ;
+   void mt_beginstep() ;
+   void mt_endstep() ;
+   template <int C> node *mt_getres(node *n, int depth) ;
+   node *mt_dorecurs(node *n, node *ne, node *t, node *e, int depth) ;
+   node *mt_dorecurs_half(node *n, node *ne, node *t, node *e, int depth) ;
+   void mt_resolve(hframe &f, node **q, int base, int cnt, int depth) ;
+   void mt_join(hthreadctx *c, hframe &f) ;
+   void mt_safepoint() ;
+   void mt_request(int what) ;
+   void mt_exclusive() ;
+   void mt_park() ;
+   node *mt_find_node(node *nw, node *ne, node *sw, node *se) ;
+   leaf *mt_find_leaf(unsigned short nw, unsigned short ne,
+                      unsigned short sw, unsigned short se) ;
+   node *mt_newnode() ;
+   void mt_refill(hthreadctx *c) ;
+   void closeResultCache() ;
+   void setrulekey() ;
+   int diskrule() ;
+   hdiskkey contenthash(node *n, int depth) ;
+   hdiskkey diskkey(node *n, int depth) ;
+   node *diskget(node *n, int depth) ;
+   node *diskbuild(unsigned int cell, int depth) ;
+   void diskput(node *n, int depth, node *res) ;
+   unsigned int diskstore(node *n, int depth) ;
    liferules hliferules ;
 } ;
 #endif
@@ -47,16 +47,6 @@ void draw4x4_1(unsigned short sw, unsigned short se,
    if (ne) *p |= (bit >> 1) ;
 }
 
-void draw4x4_1(node *n, node *z, int llx, int lly) {
-   unsigned char *p = bigbuf + ((bmsize-1+lly) << (logbmsize-3)) + ((-llx) >> 3) ;
-   int bit = 128 >> ((-llx) & 0x7) ;
-   if (n->sw != z) *p |= bit ;
-   if (n->se != z) *p |= (bit >> 1) ;
-   p -= byteoff ;
-   if (n->nw != z) *p |= bit ;
-   if (n->ne != z) *p |= (bit >> 1) ;
-}
-
 static unsigned char compress4x4[256] ;
 static bool inited = false;
 
@@ -145,27 +135,29 @@ void hlifealgo::drawnode(node *n, int llx, int lly, int depth, node *z) {
    if (n == z) {
       // don't do anything
    } else if (depth > 2 && sw > 2) {
-      z = z->nw ;
+      z = nwof(z) ;
       sw >>= 1 ;
       depth-- ;
       if (sw == (bmsize >> 1)) {
-         drawnode(n->sw, 0, 0, depth, z) ;
-         drawnode(n->se, -(bmsize/2), 0, depth, z) ;
-         drawnode(n->nw, 0, -(bmsize/2), depth, z) ;
-         drawnode(n->ne, -(bmsize/2), -(bmsize/2), depth, z) ;
+         drawnode(swof(n), 0, 0, depth, z) ;
+         drawnode(seof(n), -(bmsize/2), 0, depth, z) ;
+         drawnode(nwof(n), 0, -(bmsize/2), depth, z) ;
+         drawnode(neof(n), -(bmsize/2), -(bmsize/2), depth, z) ;
          renderbm(-llx, -lly) ;
       } else {
-         drawnode(n->sw, llx, lly, depth, z) ;
-         drawnode(n->se, llx-sw, lly, depth, z) ;
-         drawnode(n->nw, llx, lly-sw, depth, z) ;
-         drawnode(n->ne, llx-sw, lly-sw, depth, z) ;
+         drawnode(swof(n), llx, lly, depth, z) ;
+         drawnode(seof(n), llx-sw, lly, depth, z) ;
+         drawnode(nwof(n), llx, lly-sw, depth, z) ;
+         drawnode(neof(n), llx-sw, lly-sw, depth, z) ;
       }
    } else if (depth > 2 && sw == 2) {
-      draw4x4_1(n, z->nw, llx, lly) ;
+      z = nwof(z) ;
+      draw4x4_1(swof(n) != z, seof(n) != z, nwof(n) != z, neof(n) != z,
+                llx, lly) ;
    } else if (sw == 1) {
       drawpixel(-llx, -lly) ;
    } else {
-      struct leaf *l = (struct leaf *)n ;
+      leafbits *l = bits(n) ;
       sw >>= 1 ;
       if (sw == 1) {
          draw4x4_1(l->sw, l->se, l->nw, l->ne, llx, lly) ;
@@ -306,30 +298,30 @@ void hlifealgo::draw(viewport &viewarg, liferender &rendererarg) {
       lly = (lly << 1) + llyb[d] ;
       if (llx >= 1) {
          if (lly >= 1) {
-            ne = ne->sw ;
-            nw = nw->se ;
-            se = se->nw ;
-            sw = sw->ne ;
+            ne = swof(ne) ;
+            nw = seof(nw) ;
+            se = nwof(se) ;
+            sw = neof(sw) ;
             lly-- ;
          } else {
-            ne = se->nw ;
-            nw = sw->ne ;
-            se = se->sw ;
-            sw = sw->se ;
+            ne = nwof(se) ;
+            nw = neof(sw) ;
+            se = swof(se) ;
+            sw = seof(sw) ;
          }
          llx-- ;
       } else {
          if (lly >= 1) {
-            ne = nw->se ;
-            nw = nw->sw ;
-            se = sw->ne ;
-            sw = sw->nw ;
+            ne = seof(nw) ;
+            nw = swof(nw) ;
+            se = neof(sw) ;
+            sw = nwof(sw) ;
             lly-- ;
          } else {
-            ne = sw->ne ;
-            nw = sw->nw ;
-            se = sw->se ;
-            sw = sw->sw ;
+            ne = neof(sw) ;
+            nw = nwof(sw) ;
+            se = seof(sw) ;
+            sw = swof(sw) ;
          }
       }
       if (llx > 2*maxd || lly > 2*maxd || llx < -2*maxd || lly < -2*maxd) {
@@ -374,11 +366,11 @@ bail:
    renderer = 0 ;
    view = 0 ;
 }
-int getbitsfromleaves(const vector<node *> &v) {
+int hlifealgo::getbitsfromleaves(const vector<node *> &v) {
   unsigned short nw=0, ne=0, sw=0, se=0 ;
   int i;
   for (i=0; i<(int)v.size(); i++) {
-    leaf *p = (leaf *)v[i] ;
+    leafbits *p = bits(v[i]) ;
     nw |= p->nw ;
     ne |= p->ne ;
     sw |= p->sw ;
@@ -417,16 +409,8 @@ void sortunique(vector<node *> &dest, vector<node *> &src) {
 }
 
 void hlifealgo::findedges(bigint *ptop, bigint *pleft, bigint *pbottom, bigint *pright) {
-   // AKT: following code is from fit() but all goal/size stuff
-   // has been removed so it finds the exact pattern edges
    ensure_hashed() ;
-   bigint xmin = -1 ;
-   bigint xmax = 1 ;
-   bigint ymin = -1 ;
-   bigint ymax = 1 ;
-   int currdepth = depth ;
-   int i;
-   if (root == zeronode(currdepth)) {
+   if (root == zeronode(depth)) {
       // AKT: return impossible edges to indicate empty pattern;
       // not really a problem because caller should check first
       *ptop = 1 ;
@@ -435,166 +419,22 @@ void hlifealgo::findedges(bigint *ptop, bigint *pleft, bigint *pbottom, bigint *
       *pright = 0 ;
       return ;
    }
-   vector<node *> top, left, bottom, right ;
-   top.push_back(root) ;
-   left.push_back(root) ;
-   bottom.push_back(root) ;
-   right.push_back(root) ;
-   int topbm = 0, bottombm = 0, rightbm = 0, leftbm = 0 ;
-   while (currdepth >= 0) {
-      currdepth-- ;
-      if (currdepth == 1) { // we have leaf nodes; turn them into bitmasks
-         topbm = getbitsfromleaves(top) & 0xff ;
-         bottombm = getbitsfromleaves(bottom) & 0xff ;
-         leftbm = getbitsfromleaves(left) >> 8 ;
-         rightbm = getbitsfromleaves(right) >> 8 ;
-      }
-      if (currdepth <= 1) {
-          int sz = 1 << (currdepth + 2) ;
-          int maskhi = (1 << sz) - (1 << (sz >> 1)) ;
-          int masklo = (1 << (sz >> 1)) - 1 ;
-          ymax += ymax ;
-          if ((topbm & maskhi) == 0) {
-             ymax.add_smallint(-2) ;
-          } else {
-             topbm >>= (sz >> 1) ;
-          }
-          ymin += ymin ;
-          if ((bottombm & masklo) == 0) {
-            ymin.add_smallint(2) ;
-            bottombm >>= (sz >> 1) ;
-          }
-          xmax += xmax ;
-          if ((rightbm & masklo) == 0) {
-             xmax.add_smallint(-2) ;
-             rightbm >>= (sz >> 1) ;
-          }
-          xmin += xmin ;
-          if ((leftbm & maskhi) == 0) {
-            xmin.add_smallint(2) ;
-          } else {
-            leftbm >>= (sz >> 1) ;
-          }
-      } else {
-         node *z = 0 ;
-         if (hashed)
-            z = zeronode(currdepth) ;
-         vector<node *> newv ;
-         int outer = 0 ;
-         for (i=0; i<(int)top.size(); i++) {
-            node *t = top[i] ;
-            if (!outer && (t->nw != z || t->ne != z)) {
-               newv.clear() ;
-               outer = 1 ;
-            }
-            if (outer) {
-               if (t->nw != z)
-                  newv.push_back(t->nw) ;
-               if (t->ne != z)
-                  newv.push_back(t->ne) ;
-            } else {
-               if (t->sw != z)
-                  newv.push_back(t->sw) ;
-               if (t->se != z)
-                  newv.push_back(t->se) ;
-            }
-         }
-         sortunique(top, newv) ;
-         ymax += ymax ;
-         if (!outer) {
-            ymax.add_smallint(-2) ;
-         }
-         outer = 0 ;
-         for (i=0; i<(int)bottom.size(); i++) {
-            node *t = bottom[i] ;
-            if (!outer && (t->sw != z || t->se != z)) {
-               newv.clear() ;
-               outer = 1 ;
-            }
-            if (outer) {
-               if (t->sw != z)
-                  newv.push_back(t->sw) ;
-               if (t->se != z)
-                  newv.push_back(t->se) ;
-            } else {
-               if (t->nw != z)
-                  newv.push_back(t->nw) ;
-               if (t->ne != z)
-                  newv.push_back(t->ne) ;
-            }
-         }
-         sortunique(bottom, newv) ;
-         ymin += ymin ;
-         if (!outer) {
-            ymin.add_smallint(2) ;
-         }
-         outer = 0 ;
-         for (i=0; i<(int)right.size(); i++) {
-            node *t = right[i] ;
-            if (!outer && (t->ne != z || t->se != z)) {
-               newv.clear() ;
-               outer = 1 ;
-            }
-            if (outer) {
-               if (t->ne != z)
-                  newv.push_back(t->ne) ;
-               if (t->se != z)
-                  newv.push_back(t->se) ;
-            } else {
-               if (t->nw != z)
-                  newv.push_back(t->nw) ;
-               if (t->sw != z)
-                  newv.push_back(t->sw) ;
-            }
-         }
-         sortunique(right, newv) ;
-         xmax += xmax ;
-         if (!outer) {
-            xmax.add_smallint(-2) ;
-         }
-         outer = 0 ;
-         for (i=0; i<(int)left.size(); i++) {
-            node *t = left[i] ;
-            if (!outer && (t->nw != z || t->sw != z)) {
-               newv.clear() ;
-               outer = 1 ;
-            }
-            if (outer) {
-               if (t->nw != z)
-                  newv.push_back(t->nw) ;
-               if (t->sw != z)
-                  newv.push_back(t->sw) ;
-            } else {
-               if (t->ne != z)
-                  newv.push_back(t->ne) ;
-               if (t->se != z)
-                  newv.push_back(t->se) ;
-            }
-         }
-         sortunique(left, newv) ;
-         xmin += xmin ;
-         if (!outer) {
-            xmin.add_smallint(2) ;
-         }
-      }
-   }
-   xmin >>= 1 ;
-   xmax >>= 1 ;
-   ymin >>= 1 ;
-   ymax >>= 1 ;
-   xmin <<= (currdepth + 1) ;
-   ymin <<= (currdepth + 1) ;
-   xmax <<= (currdepth + 1) ;
-   ymax <<= (currdepth + 1) ;
-   xmax -= 1 ;
-   ymax -= 1 ;
-   ymin.mul_smallint(-1) ;
-   ymax.mul_smallint(-1) ;
-   // set pattern edges
-   *ptop = ymax ;          // due to y flip
-   *pbottom = ymin ;       // due to y flip
-   *pleft = xmin ;
-   *pright = xmax ;
+   // the box is relative to the root's top left cell, which is at
+   // (-2^depth, 1-2^depth)
+   bigint box[4] ;
+   bigbox(root, depth, box) ;
+   bigint x0 = 0, y0 = 1, half = 1 ;
+   half <<= depth ;
+   x0 -= half ;
+   y0 -= half ;
+   *ptop = box[0] ;
+   *ptop += y0 ;
+   *pleft = box[1] ;
+   *pleft += x0 ;
+   *pbottom = box[2] ;
+   *pbottom += y0 ;
+   *pright = box[3] ;
+   *pright += x0 ;
 }
 
 void hlifealgo::fit(viewport &view, int force) {
@@ -672,20 +512,20 @@ void hlifealgo::fit(viewport &view, int force) {
          int outer = 0 ;
          for (i=0; i<(int)top.size(); i++) {
             node *t = top[i] ;
-            if (!outer && (t->nw != z || t->ne != z)) {
+            if (!outer && (nwof(t) != z || neof(t) != z)) {
                newv.clear() ;
                outer = 1 ;
             }
             if (outer) {
-               if (t->nw != z)
-                  newv.push_back(t->nw) ;
-               if (t->ne != z)
-                  newv.push_back(t->ne) ;
+               if (nwof(t) != z)
+                  newv.push_back(nwof(t)) ;
+               if (neof(t) != z)
+                  newv.push_back(neof(t)) ;
             } else {
-               if (t->sw != z)
-                  newv.push_back(t->sw) ;
-               if (t->se != z)
-                  newv.push_back(t->se) ;
+               if (swof(t) != z)
+                  newv.push_back(swof(t)) ;
+               if (seof(t) != z)
+                  newv.push_back(seof(t)) ;
             }
          }
          top = newv ;
@@ -698,20 +538,20 @@ void hlifealgo::fit(viewport &view, int force) {
          outer = 0 ;
          for (i=0; i<(int)bottom.size(); i++) {
             node *t = bottom[i] ;
-            if (!outer && (t->sw != z || t->se != z)) {
+            if (!outer && (swof(t) != z || seof(t) != z)) {
                newv.clear() ;
                outer = 1 ;
             }
             if (outer) {
-               if (t->sw != z)
-                  newv.push_back(t->sw) ;
-               if (t->se != z)
-                  newv.push_back(t->se) ;
+               if (swof(t) != z)
+                  newv.push_back(swof(t)) ;
+               if (seof(t) != z)
+                  newv.push_back(seof(t)) ;
             } else {
-               if (t->nw != z)
-                  newv.push_back(t->nw) ;
-               if (t->ne != z)
-                  newv.push_back(t->ne) ;
+               if (nwof(t) != z)
+                  newv.push_back(nwof(t)) ;
+               if (neof(t) != z)
+                  newv.push_back(neof(t)) ;
             }
          }
          bottom = newv ;
@@ -725,20 +565,20 @@ void hlifealgo::fit(viewport &view, int force) {
          outer = 0 ;
          for (i=0; i<(int)right.size(); i++) {
             node *t = right[i] ;
-            if (!outer && (t->ne != z || t->se != z)) {
+            if (!outer && (neof(t) != z || seof(t) != z)) {
                newv.clear() ;
                outer = 1 ;
             }
             if (outer) {
-               if (t->ne != z)
-                  newv.push_back(t->ne) ;
-               if (t->se != z)
-                  newv.push_back(t->se) ;
+               if (neof(t) != z)
+                  newv.push_back(neof(t)) ;
+               if (seof(t) != z)
+                  newv.push_back(seof(t)) ;
             } else {
-               if (t->nw != z)
-                  newv.push_back(t->nw) ;
-               if (t->sw != z)
-                  newv.push_back(t->sw) ;
+               if (nwof(t) != z)
+                  newv.push_back(nwof(t)) ;
+               if (swof(t) != z)
+                  newv.push_back(swof(t)) ;
             }
          }
          right = newv ;
@@ -751,20 +591,20 @@ void hlifealgo::fit(viewport &view, int force) {
          outer = 0 ;
          for (i=0; i<(int)left.size(); i++) {
             node *t = left[i] ;
-            if (!outer && (t->nw != z || t->sw != z)) {
+            if (!outer && (nwof(t) != z || swof(t) != z)) {
                newv.clear() ;
                outer = 1 ;
             }
             if (outer) {
-               if (t->nw != z)
-                  newv.push_back(t->nw) ;
-               if (t->sw != z)
-                  newv.push_back(t->sw) ;
+               if (nwof(t) != z)
+                  newv.push_back(nwof(t)) ;
+               if (swof(t) != z)
+                  newv.push_back(swof(t)) ;
             } else {
-               if (t->ne != z)
-                  newv.push_back(t->ne) ;
-               if (t->se != z)
-                  newv.push_back(t->se) ;
+               if (neof(t) != z)
+                  newv.push_back(neof(t)) ;
+               if (seof(t) != z)
+                  newv.push_back(seof(t)) ;
             }
          }
          left = newv ;
@@ -58,7 +58,7 @@ const char* jvnalgo::setrule(const char *s)
 
 const char* jvnalgo::getrule() {
    // return canonical rule string
-   static char canonrule[MAXRULESIZE];
+   static thread_local char canonrule[MAXRULESIZE];
    sprintf(canonrule, "%s", RULE_STRINGS[current_rule]);
    if (gridwd > 0 || gridht > 0) {
       // setgridsize() was successfully called above, so append suffix
@@ -245,6 +245,11 @@ state jvnalgo::slowcalc(state, state n, state, state w, state c, state e,
    	return slowcalc_Hutton32(c,n,s,e,w);
 }
 
+void jvnalgo::slowcalcblock(state *out, const state *in, int stride,
+                            int wd, int ht) {
+   ghslowcalcblock(this, out, in, stride, wd, ht) ;
+}
+
 // XPM data for the 31 7x7 icons used in JvN algo
 static const char* jvn7x7[] = {
 // width height ncolors chars_per_pixel
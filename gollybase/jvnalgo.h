@@ -13,6 +13,8 @@ public:
    virtual ~jvnalgo() ;
    virtual state slowcalc(state nw, state n, state ne, state w, state c,
                           state e, state sw, state s, state se) ;
+   virtual void slowcalcblock(state *out, const state *in, int stride,
+                              int wd, int ht) ;
    virtual const char* setrule(const char* s) ;
    virtual const char* getrule() ;
    virtual const char* DefaultRule() ;
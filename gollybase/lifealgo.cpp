@@ -4,12 +4,119 @@
 #include "lifealgo.h"
 #include "util.h"       // for lifestatus
 #include "string.h"
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 using namespace std ;
 lifealgo::~lifealgo() {
+   destroytimeline() ;
    poller = 0 ;
    maxCellStates = 2 ;
 }
 int lifealgo::verbose ;
+/*
+ *   The cell lists of the delta timeline hold x, y and state for each
+ *   live cell in row-major order, as getcells gives them; a batch of
+ *   changes made by diffcells is in the same order.
+ */
+static int cellorder(const int *a, const int *b) {
+   if (a[1] != b[1])
+      return a[1] < b[1] ? -1 : 1 ;
+   if (a[0] != b[0])
+      return a[0] < b[0] ? -1 : 1 ;
+   return 0 ;
+}
+static void diffcells(const vector<int> &a, const vector<int> &b,
+                      cellchanges &d) {
+   size_t i = 0, j = 0 ;
+   while (i < a.size() || j < b.size()) {
+      int c = i >= a.size() ? 1 : j >= b.size() ? -1
+                                : cellorder(&a[i], &b[j]) ;
+      if (c < 0) {
+         d.add(a[i], a[i+1], a[i+2], 0) ;
+         i += 3 ;
+      } else if (c > 0) {
+         d.add(b[j], b[j+1], 0, b[j+2]) ;
+         j += 3 ;
+      } else {
+         if (a[i+2] != b[j+2])
+            d.add(a[i], a[i+1], a[i+2], b[j+2]) ;
+         i += 3 ;
+         j += 3 ;
+      }
+   }
+   d.trim() ;
+}
+// x, y, old and new state for each changed cell
+static void expandchanges(const cellchanges &d, vector<int> &quads) {
+   vector<int> runs ;
+   d.getruns(runs) ;
+   quads.clear() ;
+   for (size_t r=0; r<runs.size(); r+=5)
+      for (int k=0; k<runs[r+2]; k++) {
+         quads.push_back(runs[r] + k) ;
+         quads.push_back(runs[r+1]) ;
+         quads.push_back(runs[r+3]) ;
+         quads.push_back(runs[r+4]) ;
+      }
+}
+static void applychanges(const vector<int> &cells, const cellchanges &d,
+                         int undo, vector<int> &out) {
+   vector<int> q ;
+   expandchanges(d, q) ;
+   out.clear() ;
+   size_t i = 0, j = 0 ;
+   while (i < cells.size() || j < q.size()) {
+      int c = i >= cells.size() ? 1 : j >= q.size() ? -1
+                                    : cellorder(&cells[i], &q[j]) ;
+      if (c < 0) {
+         out.insert(out.end(), &cells[i], &cells[i] + 3) ;
+         i += 3 ;
+      } else {
+         int state = q[j + (undo ? 2 : 3)] ;
+         if (state) {
+            out.push_back(q[j]) ;
+            out.push_back(q[j+1]) ;
+            out.push_back(state) ;
+         }
+         if (c == 0)
+            i += 3 ;
+         j += 4 ;
+      }
+   }
+}
+// add the changes of d to those of p (x, y, old and new state for each
+// changed cell, as expandchanges gives them)
+static void mergechanges(vector<int> &p, const cellchanges &d) {
+   vector<int> q, out ;
+   expandchanges(d, q) ;
+   size_t i = 0, j = 0 ;
+   while (i < p.size() || j < q.size()) {
+      int c = i >= p.size() ? 1 : j >= q.size() ? -1 : cellorder(&p[i], &q[j]) ;
+      if (c < 0) {
+         out.insert(out.end(), &p[i], &p[i] + 4) ;
+         i += 4 ;
+      } else if (c > 0) {
+         out.insert(out.end(), &q[j], &q[j] + 4) ;
+         j += 4 ;
+      } else {
+         if (p[i+2] != q[j+3]) {
+            out.insert(out.end(), &p[i], &p[i] + 3) ;
+            out.push_back(q[j+3]) ;
+         }
+         i += 4 ;
+         j += 4 ;
+      }
+   }
+   p.swap(out) ;
+}
+static void packchanges(const vector<int> &p, cellchanges &d) {
+   d.clear() ;
+   for (size_t i=0; i<p.size(); i+=4)
+      d.add(p[i], p[i+1], p[i+2], p[i+3]) ;
+   d.trim() ;
+}
 /*
  *   Right now, the base/expo should match the current increment.
  *   We do not check this.
@@ -21,12 +128,27 @@ int lifealgo::startrecording(int basearg, int expoarg) {
   } else {
     // use the current frame and increment to start a new timeline
     void *now = getcurrentstate() ;
-    if (now == 0)
+    vector<int> cells ;
+    if (now == 0 && !timelinecells(cells))
       return 0 ;
     timeline.base = basearg ;
     timeline.expo = expoarg ;
-    timeline.frames.push_back(now) ;
+    timeline.usedeltas = (now == 0) ;
+    if (now) {
+      timeline.frames.push_back(now) ;
+    } else {
+      // the first frame's changes are from an empty universe
+      cellchanges *d = new cellchanges ;
+      diffcells(vector<int>(), cells, *d) ;
+      timeline.deltas.push_back(d) ;
+      timeline.keys.push_back(0) ;
+      timeline.deltabytes = timeline.keybytes = d->bytes() ;
+      timeline.sincekey = 0 ;
+      timeline.cells.swap(cells) ;
+      timeline.at = 0 ;
+    }
     timeline.framecount = 1 ;
+    touchframe(0) ;
     timeline.end = timeline.start = generation ;
     timeline.inc = increment ;
   }
@@ -41,14 +163,41 @@ pair<int, int> lifealgo::stoprecording() {
   return make_pair(timeline.base, timeline.expo) ;
 }
 void lifealgo::extendtimeline() {
-  if (timeline.recording && generation == timeline.next) {
-    void *now = getcurrentstate() ;
-    if (now && timeline.framecount < MAX_FRAME_COUNT) {
+  if (timeline.recording && generation == timeline.next &&
+      timeline.framecount < getmaxframecount()) {
+    if (timeline.usedeltas) {
+      vector<int> now ;
+      if (!timelinecells(now))
+        return ;
+      seekcells(timeline.framecount-1) ;
+      cellchanges *d = new cellchanges ;
+      diffcells(timeline.cells, now, *d) ;
+      timeline.deltas.push_back(d) ;
+      timeline.keys.push_back(0) ;
+      timeline.deltabytes += d->bytes() ;
+      timeline.sincekey += d->bytes() ;
+      if (timeline.sincekey > 4 * timeline.keybytes) {
+        // the changes since the last whole frame are well beyond its size
+        cellchanges *k = new cellchanges ;
+        diffcells(vector<int>(), now, *k) ;
+        timeline.keys.back() = k ;
+        timeline.deltabytes += k->bytes() ;
+        timeline.keybytes = k->bytes() ;
+        timeline.sincekey = 0 ;
+      }
+      timeline.cells.swap(now) ;
+      timeline.at = timeline.framecount ;
+    } else {
+      void *now = getcurrentstate() ;
+      if (now == 0)
+        return ;
       timeline.frames.push_back(now) ;
-      timeline.framecount++ ;
-      timeline.end = timeline.next ;
-      timeline.next += timeline.inc ;
     }
+    timeline.framecount++ ;
+    touchframe(timeline.framecount-1) ;
+    timeline.end = timeline.next ;
+    timeline.next += timeline.inc ;
+    trimframes() ;
   }
 }
 /*
@@ -61,14 +210,34 @@ void lifealgo::extendtimeline() {
  */
 void lifealgo::pruneframes() {
    if (timeline.framecount > 1) {
-      for (int i=2; i<timeline.framecount; i += 2)
-         timeline.frames[i >> 1]  = timeline.frames[i] ;
-      timeline.framecount = (timeline.framecount + 1) >> 1 ;
-      timeline.frames.resize(timeline.framecount) ;
+      int n = timeline.framecount ;
+      if (timeline.usedeltas) {
+         vector<char> gone(n) ;
+         for (int i=1; i<n; i += 2)
+            gone[i] = 1 ;
+         dropframes(gone) ;
+      }
+      touchframe(0) ;
+      for (int i=2; i<n; i += 2) {
+         if (timeline.usedeltas) {
+            timeline.deltas[i >> 1] = timeline.deltas[i] ;
+            timeline.keys[i >> 1] = timeline.keys[i] ;
+         } else {
+            timeline.frames[i >> 1] = timeline.frames[i] ;
+         }
+         timeline.used[i >> 1] = timeline.used[i] ;
+      }
+      timeline.framecount = (n + 1) >> 1 ;
+      if (timeline.usedeltas) {
+         timeline.deltas.resize(timeline.framecount) ;
+         timeline.keys.resize(timeline.framecount) ;
+         timeline.at = -1 ;
+      } else {
+         timeline.frames.resize(timeline.framecount) ;
+      }
+      timeline.used.resize(timeline.framecount) ;
       timeline.inc += timeline.inc ;
-      timeline.end = timeline.inc ;
-      timeline.end.mul_smallint(timeline.framecount-1) ;
-      timeline.end += timeline.start ;
+      timeline.end = framegen(timeline.framecount-1) ;
       timeline.next = timeline.end ;
       timeline.next += timeline.inc ;
       if (timeline.base == 2)
@@ -78,19 +247,62 @@ void lifealgo::pruneframes() {
 int lifealgo::gotoframe(int i) {
   if (i < 0 || i >= timeline.framecount)
     return 0 ;
-  setcurrentstate(timeline.frames[i]) ;
-  // AKT: avoid mul_smallint(i) crashing with divide-by-zero if i is 0
-  if (i > 0) {
-    generation = timeline.inc ;
-    generation.mul_smallint(i) ;
+  int k = i ;
+  while (!iskept(k))
+    k-- ;
+  if (timeline.usedeltas) {
+    seekcells(k) ;
+    loadcells(k) ;
   } else {
-    generation = 0;
+    setcurrentstate(timeline.frames[k]) ;
+    generation = framegen(k) ;
+  }
+  touchframe(k) ;
+  if (k < i) {
+    // step from the kept frame, keeping the roots found on the way
+    bigint saveinc = increment ;
+    setIncrement(timeline.inc) ;
+    while (k < i) {
+      step() ;
+      if (poller->isInterrupted())
+        break ;
+      k++ ;
+      if (!timeline.usedeltas) {
+        timeline.frames[k] = getcurrentstate() ;
+        touchframe(k) ;
+      }
+    }
+    setIncrement(saveinc) ;
+    trimframes() ;
   }
-  generation += timeline.start ;
   return timeline.framecount ;
 }
+int lifealgo::nearestkeptframe(int i) {
+  if (i <= 0 || i >= timeline.framecount - 1)
+    return i ;
+  // the first and last frames are always kept
+  for (int d=0; ; d++) {
+    if (iskept(i - d))
+      return i - d ;
+    if (iskept(i + d))
+      return i + d ;
+  }
+}
 void lifealgo::destroytimeline() {
+  for (size_t i=0; i<timeline.deltas.size(); i++) {
+    delete timeline.deltas[i] ;
+    delete timeline.keys[i] ;
+  }
+  timeline.deltas.clear() ;
+  timeline.keys.clear() ;
+  timeline.cells.clear() ;
+  timeline.usedeltas = 0 ;
+  timeline.deltabytes = timeline.sincekey = timeline.keybytes = 0 ;
+  timeline.at = -1 ;
   timeline.frames.clear() ;
+  timeline.used.clear() ;
+  timeline.clock = 0 ;
+  timeline.lastkept = 0 ;
   timeline.recording = 0 ;
   timeline.framecount = 0 ;
   timeline.end = 0 ;
@@ -98,6 +310,403 @@ void lifealgo::destroytimeline() {
   timeline.inc = 0 ;
   timeline.next = 0 ;
 }
+// start + inc * i, without the small multiplier of mul_smallint
+bigint lifealgo::framegen(int i) {
+  bigint gen = timeline.start, step = timeline.inc ;
+  for (; i > 0; i >>= 1) {
+    if (i & 1)
+      gen += step ;
+    step += step ;
+  }
+  return gen ;
+}
+int lifealgo::iskept(int i) {
+  if (timeline.usedeltas)
+    return i == 0 || timeline.deltas[i] != 0 ;
+  return timeline.frames[i] != 0 ;
+}
+/*
+ *   Evicted frames are recomputed with step, which can't emulate a
+ *   bounded grid by itself.
+ */
+int lifealgo::cantrim() {
+  return timeline.framecount > 2 &&
+         !(unbounded && (gridwd > 0 || gridht > 0)) ;
+}
+double lifealgo::budgetbytes() {
+  double budget = timeline.budget > 0 ? timeline.budget : getMaxMemory() / 2 ;
+  if (budget <= 0)
+    budget = 256 ;
+  return budget * 1048576.0 ;
+}
+// what each frame costs even when evicted:  its entries in used and in
+// frames (or deltas and keys)
+double lifealgo::framebytes() {
+  return sizeof(unsigned int) +
+         (timeline.usedeltas ? 2 : 1) * sizeof(void *) ;
+}
+int lifealgo::getmaxframecount() {
+  double n = budgetbytes() / 4 / framebytes() ;
+  return n < MAX_FRAME_COUNT ? (int)n : MAX_FRAME_COUNT ;
+}
+void lifealgo::touchframe(int i) {
+  // the readers add frames without this
+  if ((int)timeline.used.size() < timeline.framecount)
+    timeline.used.resize(timeline.framecount, 0) ;
+  timeline.used[i] = ++timeline.clock ;
+}
+/*
+ *   A hashing algorithm's frames share nodes with each other and with
+ *   the current pattern, so what they cost is only known after a
+ *   garbage collection:  we take the part of the node store it kept.
+ */
+void lifealgo::trimframes() {
+  if (!cantrim())
+    return ;
+  double budget = budgetbytes() - timeline.framecount * framebytes() ;
+  double size ;
+  if (timeline.usedeltas) {
+    size = (double)timeline.deltabytes ;
+  } else {
+    double kept = getkeptfraction() ;
+    if (kept == timeline.lastkept)
+      return ;
+    timeline.lastkept = kept ;
+    size = kept * getMaxMemory() * 1048576.0 ;
+  }
+  // aim a quarter below the budget so this isn't done for every frame;
+  // merging the changes of evicted delta frames saves less than they
+  // took, so we go on until the budget is met
+  if (size > budget) {
+    evictframes(1.0 - 0.75 * budget / size) ;
+    while (timeline.usedeltas && timeline.deltabytes > 0.75 * budget &&
+           evictframes(1.0 - 0.75 * budget / timeline.deltabytes))
+      ;
+  }
+}
+/*
+ *   Evict the given fraction of the kept frames (at least one, if any
+ *   can go), least recently shown first, and return how many went.
+ *   Anchors (frames spaced so there are about a thousand) go last, so
+ *   reaching any frame takes a bounded number of steps while they stay.
+ */
+int lifealgo::evictframes(double fraction) {
+  const int anchors = 1024 ;
+  int n = timeline.framecount ;
+  int spacing = 1 ;
+  while (n / spacing > anchors)
+    spacing += spacing ;
+  touchframe(0) ;
+  vector<pair<unsigned G_INT64, int> > cand ;
+  for (int i=1; i<n-1; i++)
+    if (iskept(i)) {
+      unsigned G_INT64 rank = timeline.used[i] ;
+      if (i % spacing == 0)
+        rank |= G_MAKEINT64(0x100000000) ;
+      cand.push_back(make_pair(rank, i)) ;
+    }
+  size_t want = (size_t)(fraction * (cand.size() + 2)) ;
+  if (want < 1)
+    want = 1 ;
+  if (want > cand.size())
+    want = cand.size() ;
+  if (want == 0)
+    return 0 ;
+  nth_element(cand.begin(), cand.begin() + (want - 1), cand.end()) ;
+  if (timeline.usedeltas) {
+    vector<char> gone(n) ;
+    for (size_t j=0; j<want; j++)
+      gone[cand[j].second] = 1 ;
+    dropframes(gone) ;
+  } else {
+    for (size_t j=0; j<want; j++)
+      timeline.frames[cand[j].second] = 0 ;
+  }
+  return (int)want ;
+}
+/*
+ *   Evict delta frames:  the changes of each go into those of the next
+ *   kept frame.  Changes after the last kept frame are discarded.
+ */
+void lifealgo::dropframes(const vector<char> &gone) {
+  vector<int> pending ;
+  int merging = 0 ;
+  for (int i=1; i<timeline.framecount; i++) {
+    cellchanges *d = timeline.deltas[i] ;
+    if (d == 0 || (!gone[i] && !merging))
+      continue ;
+    if (merging)
+      mergechanges(pending, *d) ;
+    else
+      expandchanges(*d, pending) ;
+    timeline.deltabytes -= d->bytes() ;
+    if (gone[i]) {
+      if (timeline.keys[i]) {
+        timeline.deltabytes -= timeline.keys[i]->bytes() ;
+        delete timeline.keys[i] ;
+        timeline.keys[i] = 0 ;
+      }
+      delete d ;
+      timeline.deltas[i] = 0 ;
+      if (timeline.at == i)
+        timeline.at = -1 ;
+      merging = 1 ;
+    } else {
+      packchanges(pending, *d) ;
+      timeline.deltabytes += d->bytes() ;
+      merging = 0 ;
+    }
+  }
+}
+// the live cells, or 0 if they are beyond the editing limits
+int lifealgo::timelinecells(vector<int> &cells) {
+  cells.clear() ;
+  if (isEmpty())
+    return 1 ;
+  bigint top, left, bottom, right ;
+  findedges(&top, &left, &bottom, &right) ;
+  if (top < bigint::min_coord || left < bigint::min_coord ||
+      bottom > bigint::max_coord || right > bigint::max_coord)
+    return 0 ;
+  int x = left.toint(), y = top.toint() ;
+  G_INT64 wd = right.toint64() - x + 1, ht = bottom.toint64() - y + 1 ;
+  if (wd > 0x7fffffff || ht > 0x7fffffff)
+    return 0 ;
+  cellbuffer buf ;
+  getcells(buf, x, y, (int)wd, (int)ht) ;
+  size_t n = buf.count() ;
+  cells.reserve(3 * n) ;
+  for (size_t i=0; i<n; i++) {
+    const int *c = buf.data() + (buf.multistate ? 3 : 2) * i ;
+    cells.push_back(c[0]) ;
+    cells.push_back(c[1]) ;
+    cells.push_back(buf.multistate ? c[2] : 1) ;
+  }
+  return 1 ;
+}
+/*
+ *   Bring cells to kept frame i, from the frame it holds or from the
+ *   nearest whole frame at or before i, whichever has fewer changes
+ *   on the way.
+ */
+void lifealgo::seekcells(int i) {
+  int at = timeline.at ;
+  if (at == i)
+    return ;
+  size_t fromkey = 0 ;
+  int k = i ;
+  for (; k > 0 && timeline.keys[k] == 0; k--)
+    if (timeline.deltas[k])
+      fromkey += timeline.deltas[k]->bytes() ;
+  const cellchanges *key = k ? timeline.keys[k] : timeline.deltas[0] ;
+  fromkey += key->bytes() ;
+  if (at >= 0) {
+    size_t fromat = 0 ;
+    for (int j=min(at, i)+1; j<=max(at, i) && fromat <= fromkey; j++)
+      if (timeline.deltas[j])
+        fromat += timeline.deltas[j]->bytes() ;
+    if (fromat > fromkey)
+      at = -1 ;
+  }
+  vector<int> next ;
+  if (at < 0) {
+    applychanges(vector<int>(), *key, 0, timeline.cells) ;
+    at = k ;
+  }
+  while (at < i) {
+    do
+      at++ ;
+    while (timeline.deltas[at] == 0) ;
+    applychanges(timeline.cells, *timeline.deltas[at], 0, next) ;
+    timeline.cells.swap(next) ;
+  }
+  while (at > i) {
+    applychanges(timeline.cells, *timeline.deltas[at], 1, next) ;
+    timeline.cells.swap(next) ;
+    do
+      at-- ;
+    while (at > 0 && timeline.deltas[at] == 0) ;
+  }
+  timeline.at = at ;
+}
+/*
+ *   Put the cells of frame i in the universe.  QuickLife keeps two
+ *   generations and shows one by the parity of the generation count,
+ *   so we start from an empty universe rather than changing the cells
+ *   that differ.
+ */
+void lifealgo::loadcells(int i) {
+  bigint saveinc = increment ;
+  timeline_t keep ;
+  std::swap(keep, timeline) ;      // clearall may destroy the timeline
+  clearall() ;
+  std::swap(keep, timeline) ;
+  setGeneration(framegen(i)) ;
+  if (!timeline.cells.empty())
+    setcells(&timeline.cells[0], timeline.cells.size(), 1, 0, 0) ;
+  endofpattern() ;
+  setIncrement(saveinc) ;
+}
+
+// -----------------------------------------------------------------------------
+
+// support for the binary macrocell format (see mcbheader in lifealgo.h)
+
+static size_t mcbround(size_t n) {
+   return (n + 7) & ~(size_t)7 ;
+}
+/*
+ *   Check that everything the header describes is inside the buffer
+ *   (taking care not to overflow on a damaged header) and find the
+ *   start of each part.
+ */
+const char *mcbimage::parse(const char *data, size_t len) {
+   const char *badfile = "Damaged binary macrocell file." ;
+   hdr = (const mcbheader *)data ;
+   if (len < sizeof(mcbheader) || memcmp(hdr->magic, MCBMAGIC, 8) != 0)
+      return "Not a binary macrocell file." ;
+   if (hdr->order != MCBORDER)
+      return "Binary macrocell file was written with a different byte order." ;
+   if (hdr->version != MCBVERSION)
+      return "Unknown binary macrocell file version." ;
+   if ((hdr->leafbytes != 8 && hdr->leafbytes != 4) ||
+       (hdr->idxbytes != 8 && hdr->idxbytes != 4) ||
+       hdr->framecount > MAX_FRAME_COUNT || hdr->nlevels > 1000 ||
+       (hdr->rootindex && hdr->rootlevel >= hdr->nlevels))
+      return badfile ;
+   size_t pos = sizeof(mcbheader) ;
+   size_t need = (size_t)hdr->nlevels * 8 + (size_t)hdr->framecount * 16 ;
+   if (need > len - pos)
+      return badfile ;
+   counts = (const unsigned G_INT64 *)(data + pos) ;
+   frames = counts + hdr->nlevels ;
+   pos += need ;
+   const unsigned int lens[4] = { hdr->rulelen, hdr->genlen, hdr->startlen,
+                                  hdr->commentlen } ;
+   std::string *strs[4] = { &rule, &gen, &start, &comments } ;
+   for (int i=0; i<4; i++) {
+      if (lens[i] > len - pos)
+         return badfile ;
+      strs[i]->assign(data + pos, lens[i]) ;
+      pos += lens[i] ;
+   }
+   levels.clear() ;
+   for (unsigned int l=0; l<hdr->nlevels; l++) {
+      pos = mcbround(pos) ;
+      size_t recbytes = recordbytes(l) ;
+      if (hdr->flags & MCB_POPULATIONS)
+         recbytes += 8 ;
+      if (pos > len || counts[l] > (len - pos) / recbytes)
+         return badfile ;
+      levels.push_back(data + pos) ;
+      pos += (size_t)counts[l] * recordbytes(l) ;
+      if (hdr->flags & MCB_POPULATIONS)
+         pos = mcbround(pos) + (size_t)counts[l] * 8 ;
+   }
+   if (pos > len || (hdr->rootindex && hdr->rootindex > counts[hdr->rootlevel]))
+      return badfile ;
+   for (unsigned int i=0; i<hdr->framecount; i++)
+      if (frames[2*i] == MCBNOFRAME ? i == 0 || i + 1 == hdr->framecount :
+          frames[2*i] >= hdr->nlevels || frames[2*i+1] == 0 ||
+          frames[2*i+1] > counts[frames[2*i]])
+         return badfile ;
+   return 0 ;
+}
+unsigned G_INT64 mcbimage::totalnodes() const {
+   unsigned G_INT64 n = 0 ;
+   for (unsigned int l=0; l<hdr->nlevels; l++)
+      n += counts[l] ;
+   return n ;
+}
+void mcbwriter::writeheader(mcbheader &h, const vector<unsigned G_INT64> &counts,
+                            const vector<unsigned G_INT64> &frames,
+                            const char *rule, const char *gen,
+                            const char *start, const char *comments) {
+   h.nlevels = (unsigned int)counts.size() ;
+   h.framecount = (unsigned int)(frames.size() / 2) ;
+   h.rulelen = (unsigned int)strlen(rule) ;
+   h.genlen = (unsigned int)strlen(gen) ;
+   h.startlen = (unsigned int)strlen(start) ;
+   h.commentlen = comments ? (unsigned int)strlen(comments) : 0 ;
+   put(&h, sizeof(h)) ;
+   if (counts.size())
+      put(&counts[0], counts.size() * 8) ;
+   if (frames.size())
+      put(&frames[0], frames.size() * 8) ;
+   put(rule, h.rulelen) ;
+   put(gen, h.genlen) ;
+   put(start, h.startlen) ;
+   put(comments, h.commentlen) ;
+   pad() ;
+}
+void mcbwriter::put(const void *p, size_t n) {
+   const char *s = (const char *)p ;
+   while (n > 0) {
+      if (used == sizeof(buf))
+         flush() ;
+      size_t k = sizeof(buf) - used ;
+      if (k > n)
+         k = n ;
+      memcpy(buf + used, s, k) ;
+      used += k ;
+      s += k ;
+      n -= k ;
+   }
+}
+void mcbwriter::putindex(unsigned G_INT64 i, int idxbytes) {
+   if (idxbytes == 4) {
+      unsigned int i32 = (unsigned int)i ;
+      put(&i32, 4) ;
+   } else {
+      put(&i, 8) ;
+   }
+}
+void mcbwriter::pad() {
+   static const char zeros[8] = { 0 } ;
+   put(zeros, (size_t)(-(G_INT64)(written + used) & 7)) ;
+}
+bool mcbwriter::flush() {
+   os.write(buf, used) ;
+   written += used ;
+   used = 0 ;
+   return !os.fail() ;
+}
+const char *lifealgo::setupfrommcb(const mcbimage &f) {
+   const char *err = setrule(f.rule.c_str()) ;
+   if (err)
+      return err ;
+   generation = bigint(f.gen.c_str()) ;
+   destroytimeline() ;
+   if (f.hdr->framecount) {
+      if (f.hdr->framebase < 2)
+         return "Bad timeline in binary macrocell file." ;
+      timeline.start = bigint(f.start.c_str()) ;
+      timeline.end = timeline.start ;
+      timeline.next = timeline.start ;
+      timeline.base = f.hdr->framebase ;
+      timeline.expo = f.hdr->frameexpo ;
+      timeline.inc = 1 ;
+      for (unsigned int i=0; i<f.hdr->frameexpo; i++)
+         timeline.inc.mul_smallint(f.hdr->framebase) ;
+   }
+   return 0 ;
+}
+void lifealgo::initmcbheader(mcbheader &h, int withpops, int framestosave,
+                             std::string &gen, std::string &start) {
+   memset(&h, 0, sizeof(h)) ;
+   memcpy(h.magic, MCBMAGIC, 8) ;
+   h.order = MCBORDER ;
+   h.version = MCBVERSION ;
+   h.flags = withpops ? MCB_POPULATIONS : 0 ;
+   // tostring's result only lasts until the next call
+   gen = generation.tostring('\0') ;
+   start = "" ;
+   if (framestosave) {
+      h.framebase = timeline.base ;
+      h.frameexpo = timeline.expo ;
+      start = timeline.start.tostring('\0') ;
+   }
+}
 
 // -----------------------------------------------------------------------------
 
@@ -255,7 +864,7 @@ const char* lifealgo::setgridsize(const char* suffix) {
 
 const char* lifealgo::canonicalsuffix() {
    if (gridwd > 0 || gridht > 0) {
-      static char bounds[64];
+      static thread_local char bounds[64];
       if (boundedplane) {
          sprintf(bounds, ":P%u,%u", gridwd, gridht);
       } else if (sphere) {
@@ -884,6 +1493,363 @@ void lifealgo::getcells(unsigned char *buf, int x, int y, int w, int h) {
    draw(vp, hsr) ;
 }
 
+// number of zero bits above the highest set bit; w must not be zero
+static inline int leadingzeros(unsigned int w) {
+#if defined(__GNUC__)
+   return __builtin_clz(w) ;
+#elif defined(_MSC_VER)
+   unsigned long r ;
+   _BitScanReverse(&r, w) ;
+   return 31 - (int)r ;
+#else
+   int n = 0 ;
+   while ((w & 0x80000000) == 0) {
+      w <<= 1 ;
+      n++ ;
+   }
+   return n ;
+#endif
+}
+
+int runjoiner::addbits(G_INT64 nx, G_INT64 ny, unsigned int bits, int nbits) {
+   // move the cells to the top of the word and take a run at a time
+   unsigned int w = bits << (32 - nbits) ;
+   int pos = 0 ;
+   while (w && !stopped) {
+      int skip = leadingzeros(w) ;
+      w <<= skip ;
+      pos += skip ;
+      int n = ~w ? leadingzeros(~w) : 32 ;
+      add(nx + pos, ny, n, 1) ;
+      pos += n ;
+      w = n < 32 ? w << n : 0 ;
+   }
+   return stopped ;
+}
+
+int lifealgo::getruns(const bigint &top, const bigint &left,
+                      const bigint &bottom, const bigint &right,
+                      liferunsink &sink) {
+   bigint t = top, l = left, b = bottom, r = right ;
+   if (t < bigint::min_coord) t = bigint::min_coord ;
+   if (l < bigint::min_coord) l = bigint::min_coord ;
+   if (b > bigint::max_coord) b = bigint::max_coord ;
+   if (r > bigint::max_coord) r = bigint::max_coord ;
+   if (t > b || l > r)
+      return 0 ;
+   // offsets of the clipped rectangle within the given one
+   bigint dx = l, dy = t ;
+   dx -= left ;
+   dy -= top ;
+   G_INT64 x0 = dx.toint64(), y0 = dy.toint64() ;
+   bigint wd = right ;
+   wd -= left ;
+   wd += 1 ;
+   runjoiner runs(sink, wd.toint64()) ;
+   int itop = t.toint(), ileft = l.toint() ;
+   int ibottom = b.toint(), iright = r.toint() ;
+   int v = 0 ;
+   for (int cy=itop; cy<=ibottom; cy++) {
+      for (int cx=ileft; cx<=iright; cx++) {
+         int skip = nextcell(cx, cy, v) ;
+         if (skip < 0 || skip > iright - cx)
+            break ;
+         cx += skip ;
+         if (runs.add(x0 + cx - ileft, y0 + cy - itop, 1, v))
+            return 1 ;
+      }
+   }
+   return runs.finish() ;
+}
+
+// -----------------------------------------------------------------------------
+
+cellhash::value cellhash::rowtab[4][256], cellhash::weights[256] ;
+cellhash::value cellhash::xpow2tab[64], cellhash::ypow2tab[64] ;
+cellhash::value cellhash::xinv, cellhash::yinv, cellhash::xm1inv ;
+static struct cellhashinit {
+   cellhashinit() { cellhash::init() ; }
+} cellhashinit_instance ;
+void cellhash::init() {
+   for (int s=0; s<256; s++) {
+      // any fixed nonzero values will do for states past 1
+      value z = (value)(s + 1) * G_MAKEINT64(0x1d8e4e27c47d124f) ;
+      z = (z ^ (z >> 31)) * G_MAKEINT64(0x14afb3e8d7a2e8d5) ;
+      z = (z ^ (z >> 29)) % P ;
+      weights[s] = s == 0 ? 0 : s == 1 ? 1 : z ? z : 1 ;
+   }
+   xpow2tab[0] = X ;
+   ypow2tab[0] = Y ;
+   for (int k=1; k<64; k++) {
+      xpow2tab[k] = mul(xpow2tab[k-1], xpow2tab[k-1]) ;
+      ypow2tab[k] = mul(ypow2tab[k-1], ypow2tab[k-1]) ;
+   }
+   xinv = power(X, P - 2) ;
+   yinv = power(Y, P - 2) ;
+   xm1inv = power(X - 1, P - 2) ;
+   for (int k=0; k<4; k++) {
+      value base = power(X, 8 * k) ;
+      for (int b=0; b<256; b++) {
+         value h = 0, xp = base ;
+         for (int i=0; i<8; i++, xp = mul(xp, X))
+            if (b & (0x80 >> i))
+               h = add(h, xp) ;
+         rowtab[k][b] = h ;
+      }
+   }
+}
+cellhash::value cellhash::power(value b, unsigned G_INT64 e) {
+   value r = 1 ;
+   while (e) {
+      if (e & 1)
+         r = mul(r, b) ;
+      b = mul(b, b) ;
+      e >>= 1 ;
+   }
+   return r ;
+}
+cellhash::value cellhash::xpow(G_INT64 e) {
+   return e >= 0 ? power(X, e) : power(xinv, 0 - (unsigned G_INT64)e) ;
+}
+cellhash::value cellhash::ypow(G_INT64 e) {
+   return e >= 0 ? power(Y, e) : power(yinv, 0 - (unsigned G_INT64)e) ;
+}
+cellhash::value cellhash::run(G_INT64 len, int state) {
+   // 1 + X + ... + X^(len-1)
+   value geo = mul(add(power(X, len), P - 1), xm1inv) ;
+   return mul(geo, weight(state)) ;
+}
+/*
+ *   What the default gethash gives getruns; the power of Y is kept
+ *   from run to run since they come a row at a time.
+ */
+class cellhashsink : public liferunsink {
+public:
+   cellhashsink() : h(0), lasty(0), ypow(1) {}
+   virtual int run(G_INT64 x, G_INT64 y, G_INT64 len, int state) {
+      if (y != lasty) {
+         ypow = cellhash::mul(ypow, cellhash::ypow(y - lasty)) ;
+         lasty = y ;
+      }
+      cellhash::value v = cellhash::mul(cellhash::run(len, state),
+                                        cellhash::xpow(x)) ;
+      h = cellhash::add(h, cellhash::mul(v, ypow)) ;
+      return 0 ;
+   }
+   cellhash::value h ;
+private:
+   G_INT64 lasty ;
+   cellhash::value ypow ;
+} ;
+cellhash::value lifealgo::gethash(const bigint &top, const bigint &left,
+                                  const bigint &bottom, const bigint &right) {
+   cellhashsink sink ;
+   getruns(top, left, bottom, right, sink) ;
+   return sink.h ;
+}
+/*
+ *   Unpacks runs into a cell list.
+ */
+class cellbuffersink : public liferunsink {
+public:
+   cellbuffersink(cellbuffer &bufarg, int xarg, int yarg) :
+      buf(bufarg), x0(xarg), y0(yarg) {}
+   virtual int run(G_INT64 x, G_INT64 y, G_INT64 len, int state) {
+      int cx = x0 + (int)x, cy = y0 + (int)y ;
+      for (G_INT64 i=0; i<len; i++)
+         buf.add(cx++, cy, state) ;
+      return 0 ;
+   }
+private:
+   cellbuffer &buf ;
+   int x0, y0 ;
+} ;
+void lifealgo::getcells(cellbuffer &buf, int x, int y, int wd, int ht) {
+   buf.clear(NumCellStates() > 2) ;
+   if (wd > 0 && ht > 0) {
+      cellbuffersink sink(buf, x, y) ;
+      bigint bottom = y, right = x ;
+      bottom += ht - 1 ;
+      right += wd - 1 ;
+      getruns(bigint(y), bigint(x), bottom, right, sink) ;
+   }
+   buf.finish() ;
+}
+int lifealgo::setcells(const int *cells, size_t n, int multistate,
+                       int dx, int dy) {
+   size_t step = multistate ? 3 : 2 ;
+   for (size_t i=0; i+step<=n; i+=step)
+      if (setcell(cells[i] + dx, cells[i+1] + dy,
+                  multistate ? cells[i+2] : 1) < 0)
+         return -1 ;
+   return 0 ;
+}
+int lifealgo::setruns(const int *runs, size_t n, int dx, int dy) {
+   for (size_t i=0; i+4<=n; i+=4)
+      for (int k=0; k<runs[i+2]; k++)
+         if (setcell(runs[i] + dx + k, runs[i+1] + dy, runs[i+3]) < 0)
+            return -1 ;
+   return 0 ;
+}
+cellchanges &cellchanges::operator=(const cellchanges &c) {
+   if (this == &c)
+      return *this ;
+   free(buf) ;
+   buf = 0 ;
+   len = cap = 0 ;
+   if (c.len) {
+      buf = (unsigned char *)malloc(c.len) ;
+      if (buf == 0) {
+         clear() ;
+         nomem = 1 ;
+         return *this ;
+      }
+      memcpy(buf, c.buf, c.len) ;
+      len = cap = c.len ;
+   }
+   ncells = c.ncells ;
+   lastx = c.lastx ;
+   lasty = c.lasty ;
+   runx = c.runx ;
+   runy = c.runy ;
+   runlen = c.runlen ;
+   runold = c.runold ;
+   runnew = c.runnew ;
+   nomem = c.nomem ;
+   return *this ;
+}
+void cellchanges::swap(cellchanges &c) {
+   std::swap(buf, c.buf) ;
+   std::swap(len, c.len) ;
+   std::swap(cap, c.cap) ;
+   std::swap(ncells, c.ncells) ;
+   std::swap(lastx, c.lastx) ;
+   std::swap(lasty, c.lasty) ;
+   std::swap(runx, c.runx) ;
+   std::swap(runy, c.runy) ;
+   std::swap(runlen, c.runlen) ;
+   std::swap(runold, c.runold) ;
+   std::swap(runnew, c.runnew) ;
+   std::swap(nomem, c.nomem) ;
+}
+void cellchanges::trim() {
+   flushrun() ;
+   if (len < cap && len > 0) {
+      unsigned char *nbuf = (unsigned char *)realloc(buf, len) ;
+      if (nbuf) {
+         buf = nbuf ;
+         cap = len ;
+      }
+   }
+}
+void cellchanges::clear() {
+   free(buf) ;
+   buf = 0 ;
+   len = cap = ncells = 0 ;
+   lastx = lasty = 0 ;
+   runx = runy = runlen = runold = runnew = 0 ;
+   nomem = 0 ;
+}
+void cellchanges::putnum(unsigned int v) {
+   if (cap - len < 5) {
+      size_t ncap = cap ? 2 * cap : 64 ;
+      unsigned char *nbuf = (unsigned char *)realloc(buf, ncap) ;
+      if (nbuf == 0) {
+         nomem = 1 ;
+         return ;
+      }
+      buf = nbuf ;
+      cap = ncap ;
+   }
+   while (v >= 128) {
+      buf[len++] = (unsigned char)(v | 128) ;
+      v >>= 7 ;
+   }
+   buf[len++] = (unsigned char)v ;
+}
+/*
+ *   Offsets are zigzag coded so small negative ones stay short too.
+ */
+static unsigned int zigzag(int d) {
+   return ((unsigned int)d << 1) ^ (unsigned int)(d >> 31) ;
+}
+static int unzigzag(unsigned int v) {
+   return (int)(v >> 1) ^ -(int)(v & 1) ;
+}
+void cellchanges::flushrun() {
+   if (runlen == 0 || nomem)
+      return ;
+   size_t was = len ;
+   putnum(zigzag((int)((unsigned int)runx - (unsigned int)lastx))) ;
+   putnum(zigzag((int)((unsigned int)runy - (unsigned int)lasty))) ;
+   putnum((unsigned int)runlen) ;
+   putnum((unsigned int)runold) ;
+   putnum((unsigned int)runnew) ;
+   if (nomem) {
+      len = was ;
+      return ;
+   }
+   lastx = (int)((unsigned int)runx + (unsigned int)runlen) ;
+   lasty = runy ;
+   runlen = 0 ;
+}
+void cellchanges::getruns(vector<int> &runs) const {
+   runs.clear() ;
+   size_t i = 0 ;
+   int x = 0, y = 0 ;
+   while (i < len) {
+      unsigned int v[5] ;
+      for (int k=0; k<5; k++) {
+         v[k] = 0 ;
+         for (int shift=0; i < len; shift += 7) {
+            unsigned char b = buf[i++] ;
+            v[k] |= (unsigned int)(b & 127) << shift ;
+            if ((b & 128) == 0)
+               break ;
+         }
+      }
+      x = (int)((unsigned int)x + (unsigned int)unzigzag(v[0])) ;
+      y = (int)((unsigned int)y + (unsigned int)unzigzag(v[1])) ;
+      runs.push_back(x) ;
+      runs.push_back(y) ;
+      for (int k=2; k<5; k++)
+         runs.push_back((int)v[k]) ;
+      x = (int)((unsigned int)x + v[2]) ;
+   }
+   if (runlen && !nomem) {
+      runs.push_back(runx) ;
+      runs.push_back(runy) ;
+      runs.push_back(runlen) ;
+      runs.push_back(runold) ;
+      runs.push_back(runnew) ;
+   }
+}
+void cellchanges::apply(lifealgo &imp, int undo) const {
+   vector<int> all ;
+   getruns(all) ;
+   // runs as setruns wants them:  x, y, length and state
+   vector<int> runs ;
+   runs.reserve(all.size() / 5 * 4) ;
+   for (size_t r=0; r<all.size(); r+=5) {
+      runs.insert(runs.end(), &all[r], &all[r] + 3) ;
+      runs.push_back(all[r + (undo ? 3 : 4)]) ;
+   }
+   if (runs.empty())
+      return ;
+   if (undo) {
+      // later runs win, so the earliest change's old state must come last
+      for (size_t a=0, b=runs.size()-4; a<b; a+=4, b-=4)
+         for (int k=0; k<4; k++)
+            std::swap(runs[a+k], runs[b+k]) ;
+   }
+   if (imp.setruns(&runs[0], runs.size(), 0, 0) < 0) {
+      // a state is out of range; set what we can one cell at a time
+      for (size_t r=0; r<runs.size(); r+=4)
+         for (int k=0; k<runs[r+2]; k++)
+            imp.setcell(runs[r] + k, runs[r+1], runs[r+3]) ;
+   }
+}
+
 // -----------------------------------------------------------------------------
 
 int staticAlgoInfo::nextAlgoId = 0 ;
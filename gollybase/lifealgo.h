@@ -15,6 +15,7 @@
 #include "readpattern.h"
 #include "platform.h"
 #include <cstdio>
+#include <cstdlib>
 // moving the include vector *before* platform.h breaks compilation
 #ifdef _MSC_VER
    #pragma warning(disable:4702)   // disable "unreachable code" warnings from MSVC
@@ -25,21 +26,295 @@
 #endif
 using std::vector;
 #include <iostream>
+#include <string>
 
-// this must not be increased beyond 32767, because we use a bigint
-// multiply that only supports multiplicands up to that size.
-const int MAX_FRAME_COUNT = 32000 ;
+// frame numbers are ints; this bounds the frame counts accepted from
+// files, while getmaxframecount bounds recording by the budget
+const int MAX_FRAME_COUNT = 0x3fffffff ;
+
+class cellchanges ;
 
 /**
- *   Timeline support is pretty generic.
+ *   Timeline support is pretty generic.  The hashing algorithms keep
+ *   each frame as a root node; the others (whose getcurrentstate gives
+ *   0) keep the cell changes from the frame before, with the whole
+ *   frame now and then so a far frame can be reached quickly.  When
+ *   the frames use more than the budget, those least recently shown
+ *   are evicted (but not the first and last, nor evenly spaced anchors
+ *   unless there is nothing else); gotoframe recomputes an evicted
+ *   frame by stepping from the nearest kept one.
  */
 class timeline_t {
 public:
    timeline_t() : recording(0), framecount(0), savetimeline(1),
-                  start(0), inc(0), next(0), end(0), frames() {}
+                  start(0), inc(0), next(0), end(0), frames(), budget(0),
+                  clock(0), lastkept(0), usedeltas(0),
+                  deltabytes(0), sincekey(0), keybytes(0), at(-1) {}
    int recording, framecount, base, expo, savetimeline ;
    bigint start, inc, next, end ;
-   vector<void *> frames ;
+   vector<void *> frames ;          // the root of each frame, 0 if evicted
+   int budget ;                     // in MB; 0 means half the max memory
+   vector<unsigned int> used ;      // when each frame was last shown
+   unsigned int clock ;
+   double lastkept ;                // getkeptfraction when last trimmed
+   // for algorithms that can't give a state
+   int usedeltas ;
+   vector<cellchanges *> deltas ;   // from the kept frame before; 0 if evicted
+   vector<cellchanges *> keys ;     // the whole frame (from empty), or 0
+   size_t deltabytes, sincekey, keybytes ;
+   int at ;                         // the kept frame cells holds, or -1
+   vector<int> cells ;              // x, y and state, in row-major order
+} ;
+
+/**
+ *   The binary macrocell format (.mcb) holds the same tree as a .mc
+ *   file, but with fixed-width records that can be hashed straight
+ *   into the node store from a memory-mapped file.  The file is:
+ *
+ *      mcbheader
+ *      nlevels 64-bit node counts, one per level
+ *      framecount pairs of 64-bit level and index (level MCBNOFRAME
+ *         for a frame that was evicted; the first and last never are)
+ *      the rule, generation, timeline start and comments (no nuls)
+ *      for each level, starting with the leaves:
+ *         count records, then (if MCB_POPULATIONS) count 64-bit
+ *         populations, saturating at 2^64-1
+ *
+ *   and each part starts on an 8-byte boundary.  Level 0 holds the
+ *   leaves; for two-state algorithms these are 8x8 squares held as
+ *   four 16-bit 4x4 quadrants (nw, ne, sw, se; bit 15 is the top left
+ *   cell and each row takes 4 bits), and for multi-state algorithms
+ *   they are 2x2 squares of one-byte states.  A record in level L > 0
+ *   holds the indices of its four children (nw, ne, sw, se) in level
+ *   L-1, where index 0 is the empty node and the first record is 1.
+ *   Each level has the records its parents use in increasing order,
+ *   so children always come before their parents.  Everything is in
+ *   the byte order of the machine that wrote the file.
+ */
+const char MCBMAGIC[] = "GollyMCB" ;
+const unsigned int MCBORDER = 0x01020304 ;
+const unsigned int MCBVERSION = 1 ;
+const unsigned int MCB_POPULATIONS = 1 ;     // each level has populations
+const unsigned G_INT64 MCBNOFRAME = ~(unsigned G_INT64)0 ;
+struct mcbheader {
+   char magic[8] ;                  // MCBMAGIC without the nul
+   unsigned int order ;             // MCBORDER as written
+   unsigned int version ;           // MCBVERSION
+   unsigned int flags ;             // MCB_* bits
+   unsigned int leafbytes ;         // 8 for 8x8 bit leaves, 4 for 2x2 states
+   unsigned int idxbytes ;          // child indices are 4 or 8 bytes
+   unsigned int nlevels ;
+   unsigned int rootlevel ;
+   unsigned int framecount ;        // timeline frames saved
+   unsigned int framebase, frameexpo ;
+   unsigned int rulelen, genlen, startlen, commentlen ;
+   unsigned G_INT64 rootindex ;     // 0 if the pattern is empty
+} ;
+
+/**
+ *   A binary macrocell file that has been checked and split into its
+ *   parts; the pointers point into the caller's buffer.
+ */
+class mcbimage {
+public:
+   const char *parse(const char *data, size_t len) ;
+   unsigned G_INT64 count(int level) const { return counts[level] ; }
+   const char *records(int level) const { return levels[level] ; }
+   size_t recordbytes(int level) const
+      { return level ? 4 * hdr->idxbytes : hdr->leafbytes ; }
+   unsigned G_INT64 child(const char *rec, int i) const {
+      return hdr->idxbytes == 4 ? ((const unsigned int *)rec)[i]
+                                : ((const unsigned G_INT64 *)rec)[i] ;
+   }
+   unsigned G_INT64 totalnodes() const ;
+   const mcbheader *hdr ;
+   const unsigned G_INT64 *counts ;
+   const unsigned G_INT64 *frames ;    // level and index of each frame
+   std::string rule, gen, start, comments ;
+   vector<const char *> levels ;
+} ;
+
+/**
+ *   Buffered writing of a binary macrocell file.
+ */
+class mcbwriter {
+public:
+   mcbwriter(std::ostream &osarg) : os(osarg), written(0), used(0) {}
+   void writeheader(mcbheader &h, const vector<unsigned G_INT64> &counts,
+                    const vector<unsigned G_INT64> &frames, const char *rule,
+                    const char *gen, const char *start, const char *comments) ;
+   void put(const void *p, size_t n) ;
+   void putindex(unsigned G_INT64 i, int idxbytes) ;
+   void pad() ;
+   bool flush() ;
+   double size() const { return (double)(written + used) ; }
+private:
+   std::ostream &os ;
+   unsigned G_INT64 written ;
+   size_t used ;
+   char buf[65536] ;
+} ;
+
+/**
+ *   Receives the live cells of a rectangle as runs of one state, in
+ *   row-major order; x and y are relative to the top left corner of
+ *   the rectangle.  Return nonzero to stop early.
+ */
+class liferunsink {
+public:
+   virtual ~liferunsink() {}
+   virtual int run(G_INT64 x, G_INT64 y, G_INT64 len, int state) = 0 ;
+} ;
+
+/**
+ *   The algorithms pass their runs through this; it clips them to the
+ *   width of the rectangle and joins runs of the same state that touch.
+ *   Rows must already be clipped and cells must come in order.
+ */
+class runjoiner {
+public:
+   runjoiner(liferunsink &sinkarg, G_INT64 wdarg) :
+      sink(sinkarg), wd(wdarg), x(0), y(0), len(0), st(0), stopped(0) {}
+   int add(G_INT64 nx, G_INT64 ny, G_INT64 nlen, int state) {
+      if (nx < 0) {
+         nlen += nx ;
+         nx = 0 ;
+      }
+      if (nx + nlen > wd)
+         nlen = wd - nx ;
+      if (nlen <= 0)
+         return stopped ;
+      if (len && ny == y && nx == x + len && state == st) {
+         len += nlen ;
+      } else {
+         if (len && sink.run(x, y, len, st))
+            stopped = 1 ;
+         x = nx ;
+         y = ny ;
+         len = nlen ;
+         st = state ;
+      }
+      return stopped ;
+   }
+   // the low nbits of bits are cells nx.. with the leftmost cell in the
+   // highest bit
+   int addbits(G_INT64 nx, G_INT64 ny, unsigned int bits, int nbits) ;
+   int finish() {
+      if (len && !stopped && sink.run(x, y, len, st))
+         stopped = 1 ;
+      len = 0 ;
+      return stopped ;
+   }
+private:
+   liferunsink &sink ;
+   G_INT64 wd, x, y, len ;
+   int st, stopped ;
+} ;
+
+/**
+ *   A cell list packed the way scripts see one:  x,y pairs, or for
+ *   multi-state patterns x,y,state triples with a 0 on the end if that
+ *   is needed to make the length odd.  The ints are contiguous so a
+ *   script can be handed them as they are.
+ */
+class cellbuffer {
+public:
+   cellbuffer() : multistate(0) {}
+   void clear(int multistatearg) {
+      cells.clear() ;
+      multistate = multistatearg ;
+   }
+   void add(int x, int y, int state) {
+      cells.push_back(x) ;
+      cells.push_back(y) ;
+      if (multistate)
+         cells.push_back(state) ;
+   }
+   void finish() {
+      if (multistate && cells.size() && (cells.size() & 1) == 0)
+         cells.push_back(0) ;
+   }
+   size_t count() const { return cells.size() / (multistate ? 3 : 2) ; }
+   const int *data() const { return cells.empty() ? 0 : &cells[0] ; }
+   size_t size() const { return cells.size() ; }
+   int multistate ;
+   vector<int> cells ;
+} ;
+
+/**
+ *   The hashing algorithms set a batch of cells by sorting them into
+ *   quadtree order; this is the key of square (x,y), counted from the
+ *   top left, with the quadrant (nw, ne, sw, se) at each level in two
+ *   bits and the top level highest.
+ */
+inline unsigned G_INT64 spreadbits(unsigned int v) {
+   unsigned G_INT64 b = v ;
+   b = (b | (b << 16)) & G_MAKEINT64(0x0000ffff0000ffff) ;
+   b = (b | (b << 8)) & G_MAKEINT64(0x00ff00ff00ff00ff) ;
+   b = (b | (b << 4)) & G_MAKEINT64(0x0f0f0f0f0f0f0f0f) ;
+   b = (b | (b << 2)) & G_MAKEINT64(0x3333333333333333) ;
+   b = (b | (b << 1)) & G_MAKEINT64(0x5555555555555555) ;
+   return b ;
+}
+inline unsigned G_INT64 quadkey(unsigned int x, unsigned int y) {
+   return spreadbits(x) | (spreadbits(y) << 1) ;
+}
+
+/**
+ *   The hash gethash gives a rectangle:  the sum over its live cells of
+ *   weight(state) * X^x * Y^y modulo the prime 2^61-1, with x and y
+ *   measured from the top left corner.  It doesn't depend on where the
+ *   rectangle is, and moving cells by (dx,dy) just multiplies their part
+ *   of the sum by X^dx * Y^dy, so an algorithm can keep the hash of each
+ *   node or tile and put the rectangle's together from them.
+ */
+class cellhash {
+public:
+   typedef unsigned G_INT64 value ;
+   static const value P = (value)G_MAKEINT64(0x1fffffffffffffff) ;
+   static const value X = (value)G_MAKEINT64(0x0a5c9e3d1f27b4e1) ;
+   static const value Y = (value)G_MAKEINT64(0x13f1b86b0e1c2a5d) ;
+   static value add(value a, value b) {
+      a += b ;
+      return a >= P ? a - P : a ;
+   }
+   static value mul(value a, value b) {
+#ifdef __SIZEOF_INT128__
+      unsigned __int128 t = (unsigned __int128)a * b ;
+      value r = ((value)t & P) + (value)(t >> 61) ;
+#else
+      // 2^61 is 1 modulo P, so the bits above it fold back in
+      value ah = a >> 32, al = a & 0xffffffff ;
+      value bh = b >> 32, bl = b & 0xffffffff ;
+      value mid = ah * bl + al * bh ;
+      value lo = al * bl ;
+      value r = (ah * bh << 3) + (mid >> 29) + ((mid & 0x1fffffff) << 32) +
+                (lo & P) + (lo >> 61) ;
+      r = (r & P) + (r >> 61) ;
+#endif
+      return r >= P ? r - P : r ;
+   }
+   static value power(value b, unsigned G_INT64 e) ;
+   // X^e and Y^e for any e, and X^(2^k) and Y^(2^k) for k < 64
+   static value xpow(G_INT64 e) ;
+   static value ypow(G_INT64 e) ;
+   static value xpow2(int k) { return xpow2tab[k] ; }
+   static value ypow2(int k) { return ypow2tab[k] ; }
+   // 1 for state 1, so two-state patterns just add up powers
+   static value weight(int state) { return weights[state & 255] ; }
+   // the cells of a row, x = 0 in the highest bit
+   static value row(unsigned int bits) {
+      return add(add(rowtab[0][bits >> 24], rowtab[1][(bits >> 16) & 255]),
+                 add(rowtab[2][(bits >> 8) & 255], rowtab[3][bits & 255])) ;
+   }
+   static value row8(unsigned int bits) { return rowtab[0][bits] ; }
+   // a run of len cells of one state starting at x = 0
+   static value run(G_INT64 len, int state) ;
+   static void init() ;
+private:
+   static value rowtab[4][256], weights[256] ;
+   static value xpow2tab[64], ypow2tab[64] ;
+   static value xinv, yinv, xm1inv ;
 } ;
 
 class lifealgo {
@@ -50,12 +325,36 @@ public:
          unbounded = true ;         // most algorithms use an unbounded universe
       }
    virtual ~lifealgo() ;
+   // empty the universe and go back to generation 0, keeping the rule
+   // (and, where the algorithm can, its memory for the next pattern)
    virtual void clearall() = 0 ;
    // returns <0 if error
    virtual int setcell(int x, int y, int newstate) = 0 ;
    virtual int getcell(int x, int y) = 0 ;
    virtual int nextcell(int x, int y, int &v) = 0 ;
    void getcells(unsigned char *buf, int x, int y, int w, int h) ;
+   // the live cells in the given rectangle as a cell list (replacing
+   // what buf held), built from getruns
+   void getcells(cellbuffer &buf, int x, int y, int wd, int ht) ;
+   // set the n ints of a cell list (laid out as in cellbuffer), moved
+   // by dx,dy; a state of 0 clears the cell.  Returns -1 if a state is
+   // out of range.  Call endofpattern after, as with setcell.
+   virtual int setcells(const int *cells, size_t n, int multistate,
+                        int dx, int dy) ;
+   // the same for runs:  n ints holding x,y,len,state for each run
+   virtual int setruns(const int *runs, size_t n, int dx, int dy) ;
+   // pass the live cells in the given rectangle to the sink as runs,
+   // walking the universe once; the sides must be less than 2^62, and
+   // it returns nonzero if the sink stopped it.  The default uses
+   // nextcell within the editing limits.
+   virtual int getruns(const bigint &top, const bigint &left,
+                       const bigint &bottom, const bigint &right,
+                       liferunsink &sink) ;
+   // the hash of the cells in the given rectangle (see cellhash), the
+   // same whatever the algorithm; the sides must be less than 2^62.
+   // The default hashes what getruns gives.
+   virtual cellhash::value gethash(const bigint &top, const bigint &left,
+                                   const bigint &bottom, const bigint &right) ;
    // call after setcell/clearcell calls
    virtual void endofpattern() = 0 ;
    virtual void setIncrement(bigint inc) = 0 ;
@@ -67,8 +366,22 @@ public:
    virtual int isEmpty() = 0 ;
    // can we do the gen count doubling? only hashlife
    virtual int hyperCapable() = 0 ;
+   // nonzero if a B0-not-Smax rule is being emulated with different
+   // rules on odd and even generations
+   virtual int alternatingRules() { return 0 ; }
    virtual void setMaxMemory(int m) = 0 ;          // never alloc more than this
    virtual int getMaxMemory() = 0 ;
+   // how many threads step() may use; algorithms that can't use more
+   // than one simply ignore this
+   virtual void setNumThreads(int) {}
+   // garbage collection tuning for the hashing algorithms:  incremental
+   // means the sweep is done a slice at a time as nodes are needed, and
+   // age means results not reused since the last collection are dropped
+   // when the cache is crowding out everything else
+   virtual void setGCMode(int /* incremental */, int /* age */) {}
+   // the multi-state hashing algorithms step squares of this many cells
+   // (4, 8 or 16) directly instead of recursing into smaller nodes
+   virtual void setLeafBlock(int /* cells */) {}
    virtual const char *setrule(const char *) = 0 ; // new rules; returns err msg
    virtual const char *getrule() = 0 ;             // get current rule set
    virtual void step() = 0 ;                       // do inc gens
@@ -78,7 +391,16 @@ public:
    virtual void lowerRightPixel(bigint &x, bigint &y, int mag) = 0 ;
    virtual const char *writeNativeFormat(std::ostream &os, char *comments) = 0 ;
    void setpoll(lifepoll *pollerarg) { poller = pollerarg ; }
-   virtual const char *readmacrocell(char *) { return "Cannot read macrocell format." ; }
+   lifepoll *getpoll() { return poller ; }
+   virtual const char *readmacrocell(patternreader &, char *) {
+      return "Cannot read macrocell format." ;
+   }
+   // the binary macrocell format (see mcbheader); withpops adds the
+   // population of every node
+   virtual const char *readbinarymacrocell(const char *, size_t)
+      { return "Cannot read binary macrocell format." ; }
+   virtual const char *writeBinaryFormat(std::ostream &, char *, int /* withpops */)
+      { return "Cannot write binary macrocell format." ; }
    
    // Verbosity crosses algorithms.  We need to embed this sort of option
    // into some global shared thing or something rather than use static.
@@ -99,15 +421,37 @@ public:
    pair<int, int> getbaseexpo()
                        { return make_pair(timeline.base, timeline.expo) ; }
    void extendtimeline() ;
+   // drop every other frame and double the timeline's increment
    void pruneframes() ;
    const bigint &gettimelinestart() { return timeline.start ; }
    const bigint &gettimelineend() { return timeline.end ; }
    const bigint &gettimelineinc() { return timeline.inc ; }
    int getframecount() { return timeline.framecount ; }
+   // how many frames recording can reach; evicted frames still cost
+   // a few bytes each, which may use at most a quarter of the budget
+   int getmaxframecount() ;
    int isrecording() { return timeline.recording ; }
+   // show frame i; an evicted frame is recomputed, stopping at the
+   // frame reached if the poller is interrupted
    int gotoframe(int i) ;
+   // the frame nearest i that gotoframe can show without stepping
+   int nearestkeptframe(int i) ;
    void destroytimeline() ;
    void savetimelinewithframe(int yesno) { timeline.savetimeline = yesno ; }
+   // the memory the timeline's frames may use, in MB; 0 (the default)
+   // means half of getMaxMemory
+   void settimelinebudget(int mb) { timeline.budget = mb ; }
+   int gettimelinebudget() { return timeline.budget ; }
+   // undo support:  pinstate keeps the current pattern from garbage
+   // collection until unpinstate is given what it returned, which can
+   // be restored with setcurrentstate (after endofpattern).  Pinning a
+   // state twice needs two unpinstate calls.  Returns 0 if the
+   // algorithm can't keep old patterns.
+   virtual void *pinstate() { return 0 ; }
+   virtual void unpinstate(void *) {}
+   // the fraction of the node store the last garbage collection had to
+   // keep (0 before the first one); pinned states push it up
+   virtual double getkeptfraction() { return 0 ; }
 
    // support for a bounded universe with various topologies:
    // plane, cylinder, torus, Klein bottle, cross-surface, sphere
@@ -155,8 +499,26 @@ protected:
    bigint increment ;
    timeline_t timeline ;
    TGridType grid_type ;
+   // set the rule, generation and timeline from a binary macrocell file;
+   // the algorithm then adds the frames
+   const char *setupfrommcb(const mcbimage &f) ;
+   // fill in the parts of a header the algorithms share
+   void initmcbheader(mcbheader &h, int withpops, int framestosave,
+                      std::string &gen, std::string &start) ;
 
 private:
+   bigint framegen(int i) ;
+   int iskept(int i) ;
+   int cantrim() ;
+   double budgetbytes() ;
+   double framebytes() ;
+   void touchframe(int i) ;
+   void trimframes() ;
+   int evictframes(double fraction) ;
+   void dropframes(const vector<char> &gone) ;
+   int timelinecells(vector<int> &cells) ;
+   void seekcells(int i) ;
+   void loadcells(int i) ;
    // following are called by CreateBorderCells() to join edges in various ways
    void JoinTwistedEdges() ;
    void JoinTwistedAndShiftedEdges() ;
@@ -167,6 +529,58 @@ private:
    void ClearRect(int top, int left, int bottom, int right) ;
 } ;
 
+/**
+ *   A batch of cell changes (x, y, old state, new state), as the GUI's
+ *   undo history keeps them.  Horizontally adjacent changes with the
+ *   same states are joined into a run, and each run is stored as five
+ *   variable-length numbers:  its offset from the end of the previous
+ *   run, its length and the two states.  A line drawn across the
+ *   pattern takes a few bytes per run rather than 16 per cell.  If
+ *   memory runs out the changes after that are lost and failed() says
+ *   so.
+ */
+class cellchanges {
+public:
+   cellchanges() : buf(0), len(0), cap(0) { clear() ; }
+   cellchanges(const cellchanges &c) : buf(0), len(0), cap(0) { *this = c ; }
+   ~cellchanges() { free(buf) ; }
+   cellchanges &operator=(const cellchanges &c) ;
+   void swap(cellchanges &c) ;
+   void clear() ;
+   // once no more changes will be added, free the unused space
+   void trim() ;
+   void add(int x, int y, int oldstate, int newstate) {
+      if (runlen && y == runy && x == runx + runlen &&
+          oldstate == runold && newstate == runnew) {
+         runlen++ ;
+      } else {
+         flushrun() ;
+         runx = x ;
+         runy = y ;
+         runlen = 1 ;
+         runold = oldstate ;
+         runnew = newstate ;
+      }
+      ncells++ ;
+   }
+   size_t count() const { return ncells ; }
+   size_t bytes() const { return len ; }
+   int failed() const { return nomem ; }
+   // x, y, length, old and new state of each run, in the order added
+   void getruns(vector<int> &runs) const ;
+   // set the cells to their new states, or (if undo) to their old
+   // states with the last change undone first; call endofpattern after
+   void apply(lifealgo &imp, int undo) const ;
+private:
+   void flushrun() ;
+   void putnum(unsigned int v) ;
+   unsigned char *buf ;
+   size_t len, cap, ncells ;
+   int lastx, lasty ;                        // where the last run ended
+   int runx, runy, runlen, runold, runnew ;  // the run being added to
+   int nomem ;
+} ;
+
 /**
  *   If you need any static information from a lifealgo, this class can be
  *   called (or overridden) to set up all that data.  Right now the
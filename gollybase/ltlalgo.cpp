@@ -11,6 +11,9 @@
 #include <limits.h>     // for INT_MIN and INT_MAX
 #include <string.h>     // for memset and strchr
 #include <cstddef>      // for ptrdiff_t
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 // -----------------------------------------------------------------------------
 
@@ -30,6 +33,23 @@ static const int MAXNCOLS = 2 * MAXRANGE + 1;
 // range is 1 or 2, similar when 5, but much faster when 10 or above
 #define SMALL_NN_RANGE 4
 
+// bands of rows updated by separate threads are at least this tall
+#define MIN_BAND_ROWS 16
+
+// the column counts of a row are summed 8 at a time with vector
+// instructions if the compiler lets us shuffle vector lanes
+#if defined(__GNUC__) && defined(__has_builtin)
+#if __has_builtin(__builtin_shufflevector) && __has_builtin(__builtin_convertvector)
+#define LTLVECTOR
+typedef int ltlvec __attribute__((vector_size(32)));
+typedef unsigned char ltlbytes __attribute__((vector_size(8)));
+typedef signed char ltlmask __attribute__((vector_size(8)));
+#endif
+#endif
+
+// the band being updated by the current thread
+static thread_local ltlband* curband;
+
 // valid neighborhoods (upper case)
 static const char *VALIDNEIGHBORHOODS = "MNC+X*2HB#@3ALGW";
 
@@ -61,6 +81,8 @@ ltlalgo::ltlalgo()
     stateweights = NULL;
     customneighborhood = NULL;
     customlength = 0;
+    numthreads = 1;
+    mt = NULL;
 }
 
 // -----------------------------------------------------------------------------
@@ -82,6 +104,7 @@ static int bitcount(int v) {
 
 ltlalgo::~ltlalgo()
 {
+    mt_stopthreads();
     free(outergrid1);
     if (outergrid2) free(outergrid2);
     if (colcounts) free(colcounts);
@@ -103,7 +126,7 @@ void ltlalgo::allocate_colcounts()
     if (colcounts) free(colcounts);
     if (ntype == 'M') {
         colcounts = (int*) malloc(outerbytes * sizeof(int));
-        // if NULL then use fast_Moore, otherwise faster_Moore_*
+        // if NULL then use fast_Moore, otherwise faster_Moore
     } else if (ntype == 'N') {
         if (range <= SMALL_NN_RANGE) {
             // use fast_Neumann (faster than faster_Neumann_* for small ranges)
@@ -128,7 +151,7 @@ void ltlalgo::create_grids(int wd, int ht)
     // create a bounded universe of given width and height
     gwd = wd;
     ght = ht;
-    border = range + 1;                 // the extra 1 is needed by faster_Moore_*
+    border = range + 1;                 // the extra 1 is needed by faster_Moore
     outerwd = gwd + border * 2;         // add left and right border
     outerht = ght + border * 2;         // add top and bottom border
     outerbytes = outerwd * outerht;
@@ -191,7 +214,13 @@ void ltlalgo::empty_boundaries()
 
 void ltlalgo::clearall()
 {
-    lifefatal("clearall is not implemented");
+    // empty the grids but keep them (and the rule) for the next pattern
+    memset(outergrid1, 0, outerbytes);
+    if (outergrid2) memset(outergrid2, 0, outerbytes);
+    population = 0;
+    empty_boundaries();
+    generation = 0;
+    increment = 1;
 }
 
 // -----------------------------------------------------------------------------
@@ -468,7 +497,7 @@ void ltlalgo::update_current_grid(unsigned char &state, int ncount)
         if (births[ncount]) {
             // new cell is born
             state = 1;
-            population++;
+            curband->population++;
         }
     } else if (state == 1) {
         // this cell is alive
@@ -480,8 +509,7 @@ void ltlalgo::update_current_grid(unsigned char &state, int ncount)
             } else {
                 // cell dies
                 state = 0;
-                population--;
-                if (population == 0) empty_boundaries();
+                curband->population--;
             }
         }
     } else {
@@ -491,8 +519,7 @@ void ltlalgo::update_current_grid(unsigned char &state, int ncount)
         } else {
             // cell dies
             state = 0;
-            population--;
-            if (population == 0) empty_boundaries();
+            curband->population--;
         }
     }
 }
@@ -502,6 +529,7 @@ void ltlalgo::update_current_grid(unsigned char &state, int ncount)
 void ltlalgo::update_next_grid(int x, int y, int xyoffset, int ncount)
 {
     // x,y cell in nextgrid might change based on the given neighborhood count
+    ltlband& b = *curband;
     unsigned char state = *(currgrid + xyoffset);
     if (state == 0) {
         // this cell is dead
@@ -509,11 +537,11 @@ void ltlalgo::update_next_grid(int x, int y, int xyoffset, int ncount)
             // new cell is born in nextgrid
             unsigned char* nextcell = nextgrid + xyoffset;
             *nextcell = 1;
-            population++;
-            if (x < minx) minx = x;
-            if (x > maxx) maxx = x;
-            if (y < miny) miny = y;
-            if (y > maxy) maxy = y;
+            b.population++;
+            if (x < b.minx) b.minx = x;
+            if (x > b.maxx) b.maxx = x;
+            if (y < b.miny) b.miny = y;
+            if (y > b.maxy) b.maxy = y;
         }
     } else if (state == 1) {
         // this cell is alive
@@ -522,23 +550,22 @@ void ltlalgo::update_next_grid(int x, int y, int xyoffset, int ncount)
             unsigned char* nextcell = nextgrid + xyoffset;
             *nextcell = 1;
             // population doesn't change but pattern limits in nextgrid might
-            if (x < minx) minx = x;
-            if (x > maxx) maxx = x;
-            if (y < miny) miny = y;
-            if (y > maxy) maxy = y;
+            if (x < b.minx) b.minx = x;
+            if (x > b.maxx) b.maxx = x;
+            if (y < b.miny) b.miny = y;
+            if (y > b.maxy) b.maxy = y;
         } else if (maxCellStates > 2) {
             // cell decays to state 2
             unsigned char* nextcell = nextgrid + xyoffset;
             *nextcell = 2;
             // population doesn't change but pattern limits in nextgrid might
-            if (x < minx) minx = x;
-            if (x > maxx) maxx = x;
-            if (y < miny) miny = y;
-            if (y > maxy) maxy = y;
+            if (x < b.minx) b.minx = x;
+            if (x > b.maxx) b.maxx = x;
+            if (y < b.miny) b.miny = y;
+            if (y > b.maxy) b.maxy = y;
         } else {
             // cell dies
-            population--;
-            if (population == 0) empty_boundaries();
+            b.population--;
         }
     } else {
         // state is > 1 so this cell will eventually die
@@ -546,876 +573,210 @@ void ltlalgo::update_next_grid(int x, int y, int xyoffset, int ncount)
             unsigned char* nextcell = nextgrid + xyoffset;
             *nextcell = state + 1;
             // population doesn't change but pattern limits in nextgrid might
-            if (x < minx) minx = x;
-            if (x > maxx) maxx = x;
-            if (y < miny) miny = y;
-            if (y > maxy) maxy = y;
+            if (x < b.minx) b.minx = x;
+            if (x > b.maxx) b.maxx = x;
+            if (y < b.miny) b.miny = y;
+            if (y > b.maxy) b.maxy = y;
         } else {
             // cell dies
-            population--;
-            if (population == 0) empty_boundaries();
+            b.population--;
         }
     }
 }
 
 // -----------------------------------------------------------------------------
 
-void ltlalgo::faster_Moore_bounded(int mincol, int minrow, int maxcol, int maxrow)
-{
-    // use Adam P. Goucher's algorithm to calculate Moore neighborhood counts
-    // in a bounded universe; note that currgrid is surrounded by a border that
-    // might contain live cells (the border is range+1 cells thick and the
-    // outermost cells are always dead)
-    
-    // the given limits are relative to currgrid so we need to add border
-    // so they are relative to outergrid1, and then expand them by range
-    int bmr = border - range;
-    int bpr = border + range;
-    minrow += bmr;
-    mincol += bmr;
-    maxrow += bpr;
-    maxcol += bpr;
-
-    // calculate cumulative counts for each column and store in colcounts
-
-    unsigned char* cellptr = outergrid1 + minrow * outerwd + mincol;
-    int* ccptr = colcounts + minrow * outerwd + mincol;
-    int *prevptr = NULL;
-    int width = (maxcol - mincol + 1);
-    int nextrow = outerwd - width;
-    int rowcount = 0;
+// Store the running totals of the state-1 cells in a row of the given width,
+// plus the totals in the row above (prevptr) if there is one.
 
-    for (int j = mincol; j <= maxcol; j++) {
-        if (*cellptr == 1) rowcount++;
-        *ccptr = rowcount;
-        cellptr++;
-        ccptr++;
-    }
-    cellptr += nextrow;
-    ccptr += nextrow;
-    prevptr = ccptr - outerwd;
-    for (int i = minrow + 1; i <= maxrow; i++) {
-        rowcount = 0;
-        for (int j = mincol; j <= maxcol; j++) {
-            if (*cellptr == 1) rowcount++;
-            *ccptr = *prevptr + rowcount;
-            cellptr++;
-            ccptr++;
-            prevptr++;
-        }
-        cellptr += nextrow;
-        ccptr += nextrow;
-        prevptr += nextrow;
-    }
-    
-    // restore given limits (necessary for update_current_grid calls)
-    minrow -= bmr;
-    mincol -= bmr;
-    maxrow -= bpr;
-    maxcol -= bpr;
-
-    // calculate final neighborhood counts using values in colcounts
-    // and update the corresponding cells in current grid
-    
-    int* colptr = colcounts + (minrow + bpr) * outerwd;
-    ccptr = colptr + mincol + bpr;
-    unsigned char* stateptr = currgrid + minrow*outerwd+mincol;
-    unsigned char state = *stateptr;
-    update_current_grid(state, *ccptr);
-    *stateptr = state;
-    if (state) {
-        if (mincol < minx) minx = mincol;
-        if (mincol > maxx) maxx = mincol;
-        if (minrow < miny) miny = minrow;
-        if (minrow > maxy) maxy = minrow;
-    }
-
-    bool rowchanged = false;
-    int bmrm1 = border - range - 1;
-    stateptr = currgrid + minrow*outerwd + mincol+1;
-    for (int j = mincol+1; j <= maxcol; j++) {
-        // do i == minrow
-        int* ccptr1 = colptr + (j + bpr);
-        int* ccptr2 = colptr + (j + bmrm1);
-        state = *stateptr;
-        update_current_grid(state, *ccptr1 - *ccptr2);
-        *stateptr++ = state;
-        if (state) {
-            if (j < minx) minx = j;
-            if (j > maxx) maxx = j;
-            rowchanged = true;
-        }
-    }
-    if (rowchanged) {
-        if (minrow < miny) miny = minrow;
-        if (minrow > maxy) maxy = minrow;
-    }
-    
-    bool colchanged = false;
-    colptr = colcounts + mincol + bpr;
-    stateptr = currgrid + (minrow+1)*outerwd + mincol;
-    for (int i = minrow+1; i <= maxrow; i++) {
-        // do j == mincol
-        int* ccptr1 = colptr + (i + bpr) * outerwd;
-        int* ccptr2 = colptr + (i + bmrm1) * outerwd;
-        state = *stateptr;
-        update_current_grid(state, *ccptr1 - *ccptr2);
-        *stateptr = state;
-        stateptr += outerwd;
-        if (state) {
-            if (i < miny) miny = i;
-            if (i > maxy) maxy = i;
-            colchanged = true;
-        }
-    }
-    if (colchanged) {
-        if (mincol < minx) minx = mincol;
-        if (mincol > maxx) maxx = mincol;
-    }
-    
-    rowchanged = false;
-    for (int i = minrow+1; i <= maxrow; i++) {
-        int* ipr = colcounts + (i + bpr) * outerwd;
-        int* imrm1 = colcounts + (i + bmrm1) * outerwd;
-        stateptr = currgrid + i*outerwd + mincol+1;
-        for (int j = mincol+1; j <= maxcol; j++) {
-            int jpr = j + bpr;
-            int jmrm1 = j + bmrm1;
-            int* ccptr1 = ipr + jpr;
-            int* ccptr2 = imrm1 + jmrm1;
-            int* ccptr3 = ipr + jmrm1;
-            int* ccptr4 = imrm1 + jpr;
-            state = *stateptr;
-            update_current_grid(state, *ccptr1 + *ccptr2 - *ccptr3 - *ccptr4);
-            *stateptr++ = state;
-            if (state) {
-                if (j < minx) minx = j;
-                if (j > maxx) maxx = j;
-                rowchanged = true;
-            }
-        }
-        if (rowchanged) {
-            if (i < miny) miny = i;
-            if (i > maxy) maxy = i;
-            rowchanged = false;
-        }
-    }
-}
-
-// -----------------------------------------------------------------------------
-
-void ltlalgo::faster_Moore_bounded2(int mincol, int minrow, int maxcol, int maxrow)
+static void sum_row(const unsigned char* cellptr, int* ccptr, const int* prevptr, int width)
 {
-    // use Adam P. Goucher's algorithm to calculate Moore neighborhood counts
-    // in a bounded universe; note that currgrid is surrounded by a border that
-    // might contain live cells (the border is range+1 cells thick and the
-    // outermost cells are always dead)
-    
-    // the given limits are relative to currgrid so we need to add border
-    // so they are relative to outergrid1, and then expand them by range
-    int bmr = border - range;
-    int bpr = border + range;
-    minrow += bmr;
-    mincol += bmr;
-    maxrow += bpr;
-    maxcol += bpr;
-
-    // calculate cumulative counts for each column and store in colcounts
-
-    unsigned char* cellptr = outergrid1 + minrow * outerwd + mincol;
-    int* ccptr = colcounts + minrow * outerwd + mincol;
-    int *prevptr = NULL;
-    int width = (maxcol - mincol + 1);
-    int nextrow = outerwd - width;
     int rowcount = 0;
-
-    // compute 4 cell offset
-    int offset = (4 - ((g_uintptr_t)cellptr & 3)) & 3;
-    if (offset > width) offset = width;
-
-    // process in 4 cell chunks
-    int chunks = (width - offset) >> 2;
-    int remainder = (width - offset) - (chunks << 2);
     int j = 0;
-
-    // process cells in the first row
-
-    // process cells up to the first 4 cell chunk
-    for (j = 0; j < offset; j++) {
-        rowcount += *cellptr++;
-        *ccptr++ = rowcount;
-    }
-
-    // process any 4 cell chunks
-    unsigned int *lcellptr = (unsigned int*)cellptr;
-    for (j = 0; j < chunks; j++) {
-        if (*lcellptr++) {
-            rowcount += *cellptr++;
-            *ccptr++ = rowcount;
-            rowcount += *cellptr++;
-            *ccptr++ = rowcount;
-            rowcount += *cellptr++;
-            *ccptr++ = rowcount;
-            rowcount += *cellptr++;
-            *ccptr++ = rowcount;
+#ifdef LTLVECTOR
+    // do 8 cells at a time: the running totals within the 8 lanes take three
+    // shifted adds, then we add the total so far and the row above
+    const ltlvec zero = {0, 0, 0, 0, 0, 0, 0, 0};
+    for (; j + 8 <= width; j += 8) {
+        ltlvec v;
+        ltlbytes cells;
+        memcpy(&cells, cellptr + j, sizeof(cells));
+        G_INT64 any;
+        memcpy(&any, &cells, sizeof(any));
+        if (any == 0) {
+            v = zero + rowcount;
         } else {
-            *ccptr++ = rowcount;
-            *ccptr++ = rowcount;
-            *ccptr++ = rowcount;
-            *ccptr++ = rowcount;
-            cellptr += 4;
-        }
-    }
-
-    // process any remaining cells
-    for (j = 0; j < remainder; j++) {
-        rowcount += *cellptr++;
-        *ccptr++ = rowcount;
-    }
-    cellptr += nextrow;
-    ccptr += nextrow;
-    prevptr = ccptr - outerwd;
-
-    // process the remaining rows of cells
-
-    for (int i = minrow + 1; i <= maxrow; i++) {
-        rowcount = 0;
-
-        // compute 4 cell offset
-        offset = (4 - ((g_uintptr_t)cellptr & 3)) & 3;
-        if (offset > width) offset = width;
-
-        // process in 4 cell chunks
-        chunks = (width - offset) >> 2;
-        remainder = (width - offset) - (chunks << 2);
-
-        // process cells up to the first 4 cell chunk
-        for (j = 0; j < offset; j++) {
-            rowcount += *cellptr++;
-            *ccptr++ = *prevptr++ + rowcount;
-        }
-        lcellptr = (unsigned int*)cellptr;
-
-        // process any 4 cell chunks
-        for (j = 0; j < chunks; j++) {
-            // check if any of the cells are alive
-            if (*lcellptr++) {
-                rowcount += *cellptr++;
-                *ccptr++ = *prevptr++ + rowcount;
-                rowcount += *cellptr++;
-                *ccptr++ = *prevptr++ + rowcount;
-                rowcount += *cellptr++;
-                *ccptr++ = *prevptr++ + rowcount;
-                rowcount += *cellptr++;
-                *ccptr++ = *prevptr++ + rowcount;
-           } else {
-                *ccptr++ = *prevptr++ + rowcount;
-                *ccptr++ = *prevptr++ + rowcount;
-                *ccptr++ = *prevptr++ + rowcount;
-                *ccptr++ = *prevptr++ + rowcount;
-                cellptr += 4;
-            }
-        }
-
-        // process any remaining cells
-        for (j = 0; j < remainder; j++) {
-            rowcount += *cellptr++;
-            *ccptr++ = *prevptr++ + rowcount;
-        }
-        // next row
-        cellptr += nextrow;
-        ccptr += nextrow;
-        prevptr += nextrow;
+            ltlmask isone = (ltlmask)(cells == 1);
+            v = -__builtin_convertvector(isone, ltlvec);
+            v += __builtin_shufflevector(v, zero, 8, 0, 1, 2, 3, 4, 5, 6);
+            v += __builtin_shufflevector(v, zero, 8, 8, 0, 1, 2, 3, 4, 5);
+            v += __builtin_shufflevector(v, zero, 8, 8, 8, 8, 0, 1, 2, 3);
+            v += rowcount;
+        }
+        rowcount = v[7];
+        if (prevptr) {
+            ltlvec prev;
+            memcpy(&prev, prevptr + j, sizeof(prev));
+            v += prev;
+        }
+        memcpy(ccptr + j, &v, sizeof(v));
+    }
+#endif
+    for (; j < width; j++) {
+        if (cellptr[j] == 1) rowcount++;
+        ccptr[j] = prevptr ? prevptr[j] + rowcount : rowcount;
     }
-    
-    // restore given limits (necessary for update_current_grid calls)
-    minrow -= bmr;
-    mincol -= bmr;
-    maxrow -= bpr;
-    maxcol -= bpr;
-
-    // calculate final neighborhood counts using values in colcounts
-    // and update the corresponding cells in current grid
-    
-    int* colptr = colcounts + (minrow + bpr) * outerwd;
-    ccptr = colptr + mincol + bpr;
-    unsigned char* stateptr = currgrid + minrow*outerwd+mincol;
-    int ncount = *ccptr;
-    if (*stateptr == 0) {
-        if (births[ncount]) {
-            *stateptr = 1;
-            population++;
-            minx = mincol;
-            maxx = mincol;
-            miny = minrow;
-            maxy = minrow;
-        }
-    } else {
-        if (!survivals[ncount]) {
-            *stateptr = 0;
-            population--;
-        }
-        else {
-            minx = mincol;
-            maxx = maxcol;
-            miny = minrow;
-            maxy = maxrow;
-        }
-    }
-
-    bool rowchanged = false;
-    int bmrm1 = border - range - 1;
-    stateptr = currgrid + minrow*outerwd + mincol+1;
-    int* ccptr1 = colptr + (mincol+1 + bpr);
-    int* ccptr2 = colptr + (mincol+1 + bmrm1);
-    for (j = mincol+1; j <= maxcol; j++) {
-        // do i == minrow
-        ncount = *ccptr1++ - *ccptr2++;
-        if (*stateptr == 0) {
-            if (births[ncount]) {
-                *stateptr = 1;
-                population++;
-                if (j < minx) minx = j;
-                if (j > maxx) maxx = j;
-                rowchanged = true;
-            }
-        } else {
-            if (!survivals[ncount]) {
-                *stateptr = 0;
-                population--;
-            }
-            else {
-                if (j < minx) minx = j;
-                if (j > maxx) maxx = j;
-                rowchanged = true;
-            }
-        }
-        stateptr++;
-    }
-    if (rowchanged) {
-        if (minrow < miny) miny = minrow;
-        if (minrow > maxy) maxy = minrow;
-    }
-    
-    bool colchanged = false;
-    colptr = colcounts + mincol + bpr;
-    stateptr = currgrid + (minrow+1)*outerwd + mincol;
-    ccptr1 = colptr + (minrow+1 + bpr) * outerwd;
-    ccptr2 = colptr + (minrow+1 + bmrm1) * outerwd;
-    for (int i = minrow+1; i <= maxrow; i++) {
-        // do j == mincol
-        ncount = *ccptr1 - *ccptr2;
-        if (*stateptr == 0) {
-            if (births[ncount]) {
-                *stateptr = 1;
-                population++;
-                if (i < miny) miny = i;
-                if (i > maxy) maxy = i;
-                colchanged = true;
-            }
-        } else {
-            if (!survivals[ncount]) {
-                *stateptr = 0;
-                population--;
-            }
-            else {
-                if (i < miny) miny = i;
-                if (i > maxy) maxy = i;
-                colchanged = true;
-            }
-        }
-        stateptr += outerwd;
-        ccptr1 += outerwd;
-        ccptr2 += outerwd;
-    }
-    if (colchanged) {
-        if (mincol < minx) minx = mincol;
-        if (mincol > maxx) maxx = mincol;
-    }
-    
-    rowchanged = false;
-    for (int i = minrow+1; i <= maxrow; i++) {
-        int* ipr = colcounts + (i + bpr) * outerwd;
-        int* imrm1 = colcounts + (i + bmrm1) * outerwd;
-        int jpr = mincol+1 + bpr;
-        int jmrm1 = mincol+1 + bmrm1;
-        ccptr1 = ipr + jpr;
-        ccptr2 = imrm1 + jmrm1;
-        int* ccptr3 = ipr + jmrm1;
-        int* ccptr4 = imrm1 + jpr;
-        stateptr = currgrid + i*outerwd + mincol+1;
-        for (j = mincol+1; j <= maxcol; j++) {
-            ncount = *ccptr1++ + *ccptr2++ - *ccptr3++ - *ccptr4++;
-            if (*stateptr == 0) {
-                if (births[ncount]) {
-                    *stateptr = 1;
-                    population++;
-                    if (j < minx) minx = j;
-                    if (j > maxx) maxx = j;
-                    rowchanged = true;
-                }
-            } else {
-                if (!survivals[ncount]) {
-                    *stateptr = 0;
-                    population--;
-                }
-                else {
-                    if (j < minx) minx = j;
-                    if (j > maxx) maxx = j;
-                    rowchanged = true;
-                }
-            }
-            stateptr++;
-        }
-        if (rowchanged) {
-            if (i < miny) miny = i;
-            if (i > maxy) maxy = i;
-            rowchanged = false;
-        }
-    }
-    if (population == 0) empty_boundaries();
 }
 
 // -----------------------------------------------------------------------------
 
-void ltlalgo::faster_Moore_unbounded(int mincol, int minrow, int maxcol, int maxrow)
+void ltlalgo::Moore_colcounts(int mincol, int minrow, int maxcol, int maxrow)
 {
-    // use Adam P. Goucher's algorithm to calculate Moore neighborhood counts
-    // in an unbounded universe; note that we can safely assume there is at least
-    // a 2*range border of dead cells surrounding the pattern
-    
-    // temporarily expand the given limits
-    minrow -= range;
-    mincol -= range;
-    maxrow += range;
-    maxcol += range;
-    
-    int r2 = range * 2;
-    int minrowpr2 = minrow+r2;
-    int mincolpr2 = mincol+r2;
-    
-    // put zeros in top 2*range rows of colcounts
-    for (int i = minrow; i < minrowpr2; i++) {
-        int* ccptr = colcounts + i * outerwd + mincol;
-        for (int j = mincol; j <= maxcol; j++) {
-            *ccptr++ = 0;
-        }
-    }
-
-    // put zeros in left 2*range columns of colcounts
-    for (int j = mincol; j < mincolpr2; j++) {
-        int* ccptr = colcounts + minrowpr2 * outerwd + j;
-        for (int i = minrowpr2; i <= maxrow; i++) {
-            *ccptr = 0;
-            ccptr += outerwd;
-        }
-    }
-
-    unsigned char* cellptr = currgrid + minrowpr2 * outerwd + mincolpr2;
-    int* ccptr = colcounts + minrowpr2 * outerwd + mincolpr2;
-    int* prevptr = ccptr - outerwd;
-    int width = (maxcol - mincolpr2 + 1);
-    int nextrow = outerwd - width;
-    int rowcount = 0;
-    int j = 0;
-
-    for (int i = minrowpr2; i <= maxrow; i++) {
-        rowcount = 0;
-        for (j = mincolpr2; j <= maxcol; j++) {
-            if (*cellptr == 1) rowcount++;
-            *ccptr = *prevptr + rowcount;
-            cellptr++;
-            ccptr++;
-            prevptr++;
+    // calculate cumulative counts for each column over the given rectangle
+    // expanded by range and store them in colcounts; the limits are relative
+    // to currgrid so in a bounded universe we need to add border so they are
+    // relative to outergrid1
+    int b = unbounded ? 0 : border;
+    int r0 = minrow + b - range;
+    int r1 = maxrow + b + range;
+    int c0 = mincol + b - range;
+    int width = maxcol + b + range - c0 + 1;
+
+    // each band of rows is summed on its own...
+    int nb = numbands(r1 - r0 + 1);
+    run_bands(nb, [&](int k) {
+        int s, e;
+        band_rows(k, nb, r0, r1, s, e);
+        for (int i = s; i <= e; i++) {
+            int* ccptr = colcounts + i * outerwd + c0;
+            sum_row(outergrid1 + i * outerwd + c0, ccptr, i == s ? NULL : ccptr - outerwd, width);
+        }
+    });
+    if (nb == 1) return;
+
+    // ...then the totals in the last rows of the bands above are added to it
+    carries.resize((size_t)nb * width);
+    for (int k = 1; k < nb; k++) {
+        int s, e;
+        band_rows(k - 1, nb, r0, r1, s, e);
+        const int* last = colcounts + e * outerwd + c0;
+        int* carry = &carries[(size_t)k * width];
+        if (k == 1) {
+            memcpy(carry, last, width * sizeof(int));
+        } else {
+            const int* prev = carry - width;
+            for (int j = 0; j < width; j++) carry[j] = prev[j] + last[j];
         }
-        cellptr += nextrow;
-        ccptr += nextrow;
-        prevptr += nextrow;
-    }
-
-    // restore given limits
-    minrow += range;
-    mincol += range;
-    maxrow -= range;
-    maxcol -= range;
-
-    // calculate final neighborhood counts using values in colcounts
-    // and update the corresponding cells in current grid
-    
-    int* colptr = colcounts + (minrow + range) * outerwd;
-    ccptr = colptr + mincol + range;
-    unsigned char* stateptr = currgrid + minrow*outerwd+mincol;
-    unsigned char state = *stateptr;
-    update_current_grid(state, *ccptr);
-    *stateptr = state;
-    if (state) {
-        if (mincol < minx) minx = mincol;
-        if (mincol > maxx) maxx = mincol;
-        if (minrow < miny) miny = minrow;
-        if (minrow > maxy) maxy = minrow;
-    }
-
-    bool rowchanged = false;
-    int rangep1 = range + 1;
-    stateptr = currgrid + minrow*outerwd + mincol+1;
-    for (j = mincol+1; j <= maxcol; j++) {
-        // do i == minrow
-        int* ccptr1 = colptr + (j+range);
-        int* ccptr2 = colptr + (j-rangep1);
-        state = *stateptr;
-        update_current_grid(state, *ccptr1 - *ccptr2);
-        *stateptr++ = state;
-        if (state) {
-            if (j < minx) minx = j;
-            if (j > maxx) maxx = j;
-            rowchanged = true;
-        }
-    }
-    if (rowchanged) {
-        if (minrow < miny) miny = minrow;
-        if (minrow > maxy) maxy = minrow;
-    }
-
-    bool colchanged = false;
-    colptr = colcounts + mincol + range;
-    stateptr = currgrid + (minrow+1)*outerwd + mincol;
-    for (int i = minrow+1; i <= maxrow; i++) {
-        // do j == mincol
-        int* ccptr1 = colptr + (i+range) * outerwd;
-        int* ccptr2 = colptr + (i-rangep1) * outerwd;
-        state = *stateptr;
-        update_current_grid(state, *ccptr1 - *ccptr2);
-        *stateptr = state;
-        stateptr += outerwd;
-        if (state) {
-            if (i < miny) miny = i;
-            if (i > maxy) maxy = i;
-            colchanged = true;
-        }
-    }
-    if (colchanged) {
-        if (mincol < minx) minx = mincol;
-        if (mincol > maxx) maxx = mincol;
     }
-    
-    rowchanged = false;
-    for (int i = minrow+1; i <= maxrow; i++) {
-        int* ipr = colcounts + (i+range) * outerwd;
-        int* imrm1 = colcounts + (i-rangep1) * outerwd;
-        stateptr = currgrid + i*outerwd + mincol+1;
-        for (j = mincol+1; j <= maxcol; j++) {
-            int jpr = j+range;
-            int jmrm1 = j-rangep1;
-            int* ccptr1 = ipr + jpr;
-            int* ccptr2 = imrm1 + jmrm1;
-            int* ccptr3 = ipr + jmrm1;
-            int* ccptr4 = imrm1 + jpr;
-            state = *stateptr;
-            update_current_grid(state, *ccptr1 + *ccptr2 - *ccptr3 - *ccptr4);
-            *stateptr++ = state;
-            if (state) {
-                if (j < minx) minx = j;
-                if (j > maxx) maxx = j;
-                rowchanged = true;
-            }
+    run_bands(nb - 1, [&](int k) {
+        int s, e;
+        band_rows(k + 1, nb, r0, r1, s, e);
+        const int* carry = &carries[(size_t)(k + 1) * width];
+        for (int i = s; i <= e; i++) {
+            int* ccptr = colcounts + i * outerwd + c0;
+            for (int j = 0; j < width; j++) ccptr[j] += carry[j];
         }
-        if (rowchanged) {
-            if (i < miny) miny = i;
-            if (i > maxy) maxy = i;
-            rowchanged = false;
-        }
-    }
+    });
 }
 
 // -----------------------------------------------------------------------------
 
-void ltlalgo::faster_Moore_unbounded2(int mincol, int minrow, int maxcol, int maxrow)
+void ltlalgo::Moore_update_rows(int mincol, int minrow, int maxcol, int maxrow,
+                                int r0, int r1, int* nbuf)
 {
-    // use Adam P. Goucher's algorithm to calculate Moore neighborhood counts
-    // in an unbounded universe; note that we can safely assume there is at least
-    // a 2*range border of dead cells surrounding the pattern
-    
-    // temporarily expand the given limits
-    minrow -= range;
-    mincol -= range;
-    maxrow += range;
-    maxcol += range;
-    
-    int r2 = range * 2;
-    int minrowpr2 = minrow+r2;
-    int mincolpr2 = mincol+r2;
-    
-    // put zeros in top 2*range rows of colcounts
-    for (int i = minrow; i < minrowpr2; i++) {
-        int* ccptr = colcounts + i * outerwd + mincol;
-        for (int j = mincol; j <= maxcol; j++) {
-            *ccptr++ = 0;
-        }
-    }
-
-    // put zeros in left 2*range columns of colcounts
-    for (int j = mincol; j < mincolpr2; j++) {
-        int* ccptr = colcounts + minrowpr2 * outerwd + j;
-        for (int i = minrowpr2; i <= maxrow; i++) {
-            *ccptr = 0;
-            ccptr += outerwd;
-        }
-    }
-
-    // calculate cumulative counts for each column and store in colcounts
-
-    unsigned char* cellptr = currgrid + minrowpr2 * outerwd + mincolpr2;
-    int* ccptr = colcounts + minrowpr2 * outerwd + mincolpr2;
-    int* prevptr = ccptr - outerwd;
-    int width = (maxcol - mincolpr2 + 1);
-    int nextrow = outerwd - width;
-    int rowcount = 0;
-
-    // compute 4 cell offset
-    int offset = (4 - ((g_uintptr_t)cellptr & 3)) & 3;
-    if (offset > width) offset = width;
-
-    // process in 4 cell chunks
-    int chunks = (width - offset) >> 2;
-    int remainder = (width - offset) - (chunks << 2);
-    int j = 0;
-
-    // process cells in the first row
-
-    // process cells up to the first 4 cell chunk
-    for (j = 0; j < offset; j++) {
-        rowcount += *cellptr++;
-        *ccptr++ = rowcount;
-    }
-
-    // process any 4 cell chunks
-    unsigned int *lcellptr = (unsigned int*)cellptr;
-    for (j = 0; j < chunks; j++) {
-        if (*lcellptr++) {
-            rowcount += *cellptr++;
-            *ccptr++ = rowcount;
-            rowcount += *cellptr++;
-            *ccptr++ = rowcount;
-            rowcount += *cellptr++;
-            *ccptr++ = rowcount;
-            rowcount += *cellptr++;
-            *ccptr++ = rowcount;
-        } else {
-            *ccptr++ = rowcount;
-            *ccptr++ = rowcount;
-            *ccptr++ = rowcount;
-            *ccptr++ = rowcount;
-            cellptr += 4;
-        }
-    }
-
-    // process any remaining cells
-    for (j = 0; j < remainder; j++) {
-        rowcount += *cellptr++;
-        *ccptr++ = rowcount;
-    }
-    cellptr += nextrow;
-    ccptr += nextrow;
-    prevptr = ccptr - outerwd;
-
-    // process the remaining rows of cells
-
-    for (int i = minrowpr2 + 1; i <= maxrow; i++) {
-        rowcount = 0;
-
-        // compute 4 cell offset
-        offset = (4 - ((g_uintptr_t)cellptr & 3)) & 3;
-        if (offset > width) offset = width;
-
-        // process in 4 cell chunks
-        chunks = (width - offset) >> 2;
-        remainder = (width - offset) - (chunks << 2);
-
-        // process cells up to the first 4 cell chunk
-        for (j = 0; j < offset; j++) {
-            rowcount += *cellptr++;
-            *ccptr++ = *prevptr++ + rowcount;
-        }
-        lcellptr = (unsigned int*)cellptr;
-
-        // process any 4 cell chunks
-        for (j = 0; j < chunks; j++) {
-            // check if any of the cells are alive
-            if (*lcellptr++) {
-                rowcount += *cellptr++;
-                *ccptr++ = *prevptr++ + rowcount;
-                rowcount += *cellptr++;
-                *ccptr++ = *prevptr++ + rowcount;
-                rowcount += *cellptr++;
-                *ccptr++ = *prevptr++ + rowcount;
-                rowcount += *cellptr++;
-                *ccptr++ = *prevptr++ + rowcount;
-           } else {
-                *ccptr++ = *prevptr++ + rowcount;
-                *ccptr++ = *prevptr++ + rowcount;
-                *ccptr++ = *prevptr++ + rowcount;
-                *ccptr++ = *prevptr++ + rowcount;
-                cellptr += 4;
-            }
-        }
-
-        // process any remaining cells
-        for (j = 0; j < remainder; j++) {
-            rowcount += *cellptr++;
-            *ccptr++ = *prevptr++ + rowcount;
-        }
-        // next row
-        cellptr += nextrow;
-        ccptr += nextrow;
-        prevptr += nextrow;
-    }
-
-    // restore given limits
-    minrow += range;
-    mincol += range;
-    maxrow -= range;
-    maxcol -= range;
-
-    // calculate final neighborhood counts using values in colcounts
-    // and update the corresponding cells in current grid
-    
-    int* colptr = colcounts + (minrow + range) * outerwd;
-    ccptr = colptr + mincol + range;
-    unsigned char* stateptr = currgrid + minrow*outerwd+mincol;
-    int ncount = *ccptr;
-    if (*stateptr == 0) {
-        if (births[ncount]) {
-            *stateptr = 1;
-            population++;
-            minx = mincol;
-            maxx = mincol;
-            miny = minrow;
-            maxy = minrow;
-        }
-    } else {
-        if (!survivals[ncount]) {
-            *stateptr = 0;
-            population--;
-        }
-        else {
-            minx = mincol;
-            maxx = maxcol;
-            miny = minrow;
-            maxy = maxrow;
-        }
-    }
-
-    bool rowchanged = false;
-    int rangep1 = range + 1;
-    stateptr = currgrid + minrow*outerwd + mincol+1;
-    int* ccptr1 = colptr + (mincol+1 + range);
-    int* ccptr2 = colptr + (mincol+1 - rangep1);
-    for (j = mincol+1; j <= maxcol; j++) {
-        // do i == minrow
-        ncount = *ccptr1++ - *ccptr2++;
-        if (*stateptr == 0) {
-            if (births[ncount]) {
-                *stateptr = 1;
-                population++;
-                if (j < minx) minx = j;
-                if (j > maxx) maxx = j;
-                rowchanged = true;
+    // calculate final neighborhood counts for rows r0..r1 of the given
+    // rectangle using values in colcounts and update the corresponding
+    // cells in current grid
+    ltlband& band = *curband;
+    int b = unbounded ? 0 : border;
+    int hi = b + range;         // offset of bottom right corner of neighborhood
+    int lo = b - range - 1;     // offset of the row/column before its top left corner
+    int width = maxcol - mincol + 1;
+    bool twostate = maxCellStates == 2;
+
+    for (int i = r0; i <= r1; i++) {
+        // first get all the counts in this row (the row and column before
+        // the expanded rectangle weren't calculated and count as zero)
+        int* ipr = colcounts + (i + hi) * outerwd + mincol;
+        if (i == minrow) {
+            nbuf[0] = ipr[hi];
+            for (int j = 1; j < width; j++) {
+                nbuf[j] = ipr[j + hi] - ipr[j + lo];
             }
         } else {
-            if (!survivals[ncount]) {
-                *stateptr = 0;
-                population--;
-            }
-            else {
-                if (j < minx) minx = j;
-                if (j > maxx) maxx = j;
-                rowchanged = true;
-            }
-        }
-        stateptr++;
-    }
-    if (rowchanged) {
-        if (minrow < miny) miny = minrow;
-        if (minrow > maxy) maxy = minrow;
-    }
-
-    bool colchanged = false;
-    colptr = colcounts + mincol + range;
-    stateptr = currgrid + (minrow+1)*outerwd + mincol;
-    ccptr1 = colptr + (minrow+1+range) * outerwd;
-    ccptr2 = colptr + (minrow+1-rangep1) * outerwd;
-    for (int i = minrow+1; i <= maxrow; i++) {
-        // do j == mincol
-        ncount = *ccptr1 - *ccptr2;
-        if (*stateptr == 0) {
-            if (births[ncount]) {
-                *stateptr = 1;
-                population++;
-                if (i < miny) miny = i;
-                if (i > maxy) maxy = i;
-                colchanged = true;
+            int* imrm1 = colcounts + (i + lo) * outerwd + mincol;
+            nbuf[0] = ipr[hi] - imrm1[hi];
+            for (int j = 1; j < width; j++) {
+                nbuf[j] = ipr[j + hi] + imrm1[j + lo] - ipr[j + lo] - imrm1[j + hi];
+            }
+        }
+
+        // then update the cells and note the first and last live ones
+        unsigned char* stateptr = currgrid + i * outerwd + mincol;
+        int first = -1;
+        int last = -1;
+        if (twostate) {
+            for (int j = 0; j < width; j++) {
+                int ncount = nbuf[j];
+                if (stateptr[j] == 0) {
+                    if (!births[ncount]) continue;
+                    stateptr[j] = 1;
+                    band.population++;
+                } else if (!survivals[ncount]) {
+                    stateptr[j] = 0;
+                    band.population--;
+                    continue;
+                } else if (i == minrow && j == 0) {
+                    // a survivor in the top left corner gives the whole rectangle
+                    band.minx = mincol;
+                    band.maxx = maxcol;
+                    band.miny = minrow;
+                    band.maxy = maxrow;
+                }
+                if (first < 0) first = j;
+                last = j;
             }
         } else {
-            if (!survivals[ncount]) {
-                *stateptr = 0;
-                population--;
-            }
-            else {
-                if (i < miny) miny = i;
-                if (i > maxy) maxy = i;
-                colchanged = true;
-            }
-        }
-        stateptr += outerwd;
-        ccptr1 += outerwd;
-        ccptr2 += outerwd;
-    }
-    if (colchanged) {
-        if (mincol < minx) minx = mincol;
-        if (mincol > maxx) maxx = mincol;
-    }
-    
-    rowchanged = false;
-    for (int i = minrow+1; i <= maxrow; i++) {
-        int* ipr = colcounts + (i+range) * outerwd;
-        int* imrm1 = colcounts + (i-rangep1) * outerwd;
-        int jpr = mincol+1+range;
-        int jmrm1 = mincol+1-rangep1;
-        ccptr1 = ipr + jpr;
-        ccptr2 = imrm1 + jmrm1;
-        int* ccptr3 = ipr + jmrm1;
-        int* ccptr4 = imrm1 + jpr;
-        stateptr = currgrid + i*outerwd + mincol+1;
-        for (j = mincol+1; j <= maxcol; j++) {
-            ncount = *ccptr1++ + *ccptr2++ - *ccptr3++ - *ccptr4++;
-            if (*stateptr == 0) {
-                if (births[ncount]) {
-                    *stateptr = 1;
-                    population++;
-                    if (j < minx) minx = j;
-                    if (j > maxx) maxx = j;
-                    rowchanged = true;
-                }
-            } else {
-                if (!survivals[ncount]) {
-                    *stateptr = 0;
-                    population--;
-                }
-                else {
-                    if (j < minx) minx = j;
-                    if (j > maxx) maxx = j;
-                    rowchanged = true;
+            for (int j = 0; j < width; j++) {
+                unsigned char state = stateptr[j];
+                update_current_grid(state, nbuf[j]);
+                stateptr[j] = state;
+                if (state) {
+                    if (first < 0) first = j;
+                    last = j;
                 }
             }
-            stateptr++;
         }
-        if (rowchanged) {
-            if (i < miny) miny = i;
-            if (i > maxy) maxy = i;
-            rowchanged = false;
+        if (first >= 0) {
+            if (mincol + first < band.minx) band.minx = mincol + first;
+            if (mincol + last > band.maxx) band.maxx = mincol + last;
+            if (i < band.miny) band.miny = i;
+            if (i > band.maxy) band.maxy = i;
         }
     }
-    if (population == 0) empty_boundaries();
+}
+
+// -----------------------------------------------------------------------------
+
+void ltlalgo::faster_Moore(int mincol, int minrow, int maxcol, int maxrow)
+{
+    // use Adam P. Goucher's algorithm to calculate Moore neighborhood counts;
+    // in a bounded universe currgrid is surrounded by a border that might
+    // contain live cells (the border is range+1 cells thick and the outermost
+    // cells are always dead), and in an unbounded universe we can safely
+    // assume there is at least a 2*range border of dead cells surrounding
+    // the pattern
+    Moore_colcounts(mincol, minrow, maxcol, maxrow);
+
+    // the counts are complete so bands of rows can be updated in place
+    int nb = numbands(maxrow - minrow + 1);
+    run_bands(nb, [&](int k) {
+        int r0, r1;
+        band_rows(k, nb, minrow, maxrow, r0, r1);
+        curband = &bands[k];
+        vector<int> nbuf(maxcol - mincol + 1);
+        Moore_update_rows(mincol, minrow, maxcol, maxrow, r0, r1, &nbuf[0]);
+    });
 }
 
 // -----------------------------------------------------------------------------
@@ -1641,6 +1002,7 @@ void ltlalgo::faster_Neumann_bounded(int mincol, int minrow, int maxcol, int max
     mincol -= border;
 
     // calculate final neighborhood counts and update the corresponding cells in the grid
+    ltlband& band = *curband;
     bool rowchanged = false;
     for (int i = range; i < nrows-range; i++) {
         int im1 = i - 1;
@@ -1660,14 +1022,14 @@ void ltlalgo::faster_Neumann_bounded(int mincol, int minrow, int maxcol, int max
             *stateptr++ = state;
             if (state) {
                 int jpmincol = j + mincol;
-                if (jpmincol < minx) minx = jpmincol;
-                if (jpmincol > maxx) maxx = jpmincol;
+                if (jpmincol < band.minx) band.minx = jpmincol;
+                if (jpmincol > band.maxx) band.maxx = jpmincol;
                 rowchanged = true;
             }
         }
         if (rowchanged) {
-            if (ipminrow < miny) miny = ipminrow;
-            if (ipminrow > maxy) maxy = ipminrow;
+            if (ipminrow < band.miny) band.miny = ipminrow;
+            if (ipminrow > band.maxy) band.maxy = ipminrow;
             rowchanged = false;
         }
     }
@@ -1705,6 +1067,7 @@ void ltlalgo::faster_Neumann_unbounded(int mincol, int minrow, int maxcol, int m
     }
 
     // calculate final neighborhood counts and update the corresponding cells in the grid
+    ltlband& band = *curband;
     bool rowchanged = false;
     for (int i = 0; i < nrows; i++) {
         int im1 = i - 1;
@@ -1724,14 +1087,14 @@ void ltlalgo::faster_Neumann_unbounded(int mincol, int minrow, int maxcol, int m
             *stateptr++ = state;
             if (state) {
                 int jpmincol = j + mincol;
-                if (jpmincol < minx) minx = jpmincol;
-                if (jpmincol > maxx) maxx = jpmincol;
+                if (jpmincol < band.minx) band.minx = jpmincol;
+                if (jpmincol > band.maxx) band.maxx = jpmincol;
                 rowchanged = true;
             }
         }
         if (rowchanged) {
-            if (ipminrow < miny) miny = ipminrow;
-            if (ipminrow > maxy) maxy = ipminrow;
+            if (ipminrow < band.miny) band.miny = ipminrow;
+            if (ipminrow > band.maxy) band.maxy = ipminrow;
             rowchanged = false;
         }
     }
@@ -2319,104 +1682,116 @@ void ltlalgo::do_gen(int mincol, int minrow, int maxcol, int maxrow)
         survivals = altsurvivals;
     }
 
-    switch (ntype) {
-        case 'M':
-            if (unbounded) {
-                if (colcounts) {
-                    if (maxCellStates == 2) {
-                        faster_Moore_unbounded2(mincol, minrow, maxcol, maxrow);
-                    } else {
-                        faster_Moore_unbounded(mincol, minrow, maxcol, maxrow);
-                    }
-                } else {
-                    fast_Moore(mincol, minrow, maxcol, maxrow);
-                }
-            } else {
-                if (colcounts) {
-                    if (maxCellStates == 2) {
-                        faster_Moore_bounded2(mincol, minrow, maxcol, maxrow);
-                    } else {
-                        faster_Moore_bounded(mincol, minrow, maxcol, maxrow);
-                    }
-                } else {
-                    fast_Moore(mincol, minrow, maxcol, maxrow);
-                }
-            }
-            break;
+    // each band of rows records its own population change and boundary
+    ltlband nochange;
+    nochange.population = 0;
+    nochange.minx = INT_MAX;
+    nochange.miny = INT_MAX;
+    nochange.maxx = INT_MIN;
+    nochange.maxy = INT_MIN;
+    bands.assign(numthreads, nochange);
+    curband = &bands[0];
 
-        case 'N':
-            if (unbounded) {
-                if (colcounts) {
-                    faster_Neumann_unbounded(mincol, minrow, maxcol, maxrow);
-                } else {
-                    fast_Neumann(mincol, minrow, maxcol, maxrow);
-                }
-            } else {
-                if (colcounts) {
-                    faster_Neumann_bounded(mincol, minrow, maxcol, maxrow);
-                } else {
-                    fast_Neumann(mincol, minrow, maxcol, maxrow);
-                }
-            }
-            break;
+    if (ntype == 'M' && colcounts) {
+        // the column counts span all rows so faster_Moore makes its own bands
+        faster_Moore(mincol, minrow, maxcol, maxrow);
 
-        case 'C':
-        case '2':
-            fast_Shaped(mincol, minrow, maxcol, maxrow);
-            break;
+    } else if (ntype == 'N' && colcounts) {
+        // each count depends on the counts above so these run in one band
+        if (unbounded) {
+            faster_Neumann_unbounded(mincol, minrow, maxcol, maxrow);
+        } else {
+            faster_Neumann_bounded(mincol, minrow, maxcol, maxrow);
+        }
 
-        case 'A':
-            fast_Asterisk(mincol, minrow, maxcol, maxrow);
-            break;
+    } else {
+        // the fast_* routines only read currgrid and write nextgrid
+        // so bands of rows can be done at the same time
+        int nb = numbands(maxrow - minrow + 1);
+        run_bands(nb, [&](int k) {
+            int r0, r1;
+            band_rows(k, nb, minrow, maxrow, r0, r1);
+            curband = &bands[k];
+            switch (ntype) {
+                case 'M':
+                    fast_Moore(mincol, r0, maxcol, r1);
+                    break;
 
-        case '3':
-            fast_Tripod(mincol, minrow, maxcol, maxrow);
-            break;
+                case 'N':
+                    fast_Neumann(mincol, r0, maxcol, r1);
+                    break;
 
-        case 'W':
-            fast_Weighted(mincol, minrow, maxcol, maxrow);
-            break;
+                case 'C':
+                case '2':
+                    fast_Shaped(mincol, r0, maxcol, r1);
+                    break;
 
-        case '@':
-            fast_Custom(mincol, minrow, maxcol, maxrow);
-            break;
+                case 'A':
+                    fast_Asterisk(mincol, r0, maxcol, r1);
+                    break;
 
-        case '#':
-            fast_Hash(mincol, minrow, maxcol, maxrow);
-            break;
+                case '3':
+                    fast_Tripod(mincol, r0, maxcol, r1);
+                    break;
 
-        case 'B':
-            fast_Checker(mincol, minrow, maxcol, maxrow);
-            break;
+                case 'W':
+                    fast_Weighted(mincol, r0, maxcol, r1);
+                    break;
 
-        case 'H':
-            fast_Hex(mincol, minrow, maxcol, maxrow);
-            break;
+                case '@':
+                    fast_Custom(mincol, r0, maxcol, r1);
+                    break;
 
-        case 'X':
-            fast_Saltire(mincol, minrow, maxcol, maxrow);
-            break;
+                case '#':
+                    fast_Hash(mincol, r0, maxcol, r1);
+                    break;
 
-        case '*':
-            fast_Star(mincol, minrow, maxcol, maxrow);
-            break;
+                case 'B':
+                    fast_Checker(mincol, r0, maxcol, r1);
+                    break;
 
-        case '+':
-            fast_Cross(mincol, minrow, maxcol, maxrow);
-            break;
+                case 'H':
+                    fast_Hex(mincol, r0, maxcol, r1);
+                    break;
 
-        case 'L':
-            fast_Triangular(mincol, minrow, maxcol, maxrow);
-            break;
+                case 'X':
+                    fast_Saltire(mincol, r0, maxcol, r1);
+                    break;
 
-        case 'G':
-            fast_Gaussian(mincol, minrow, maxcol, maxrow);
-            break;
+                case '*':
+                    fast_Star(mincol, r0, maxcol, r1);
+                    break;
 
-        default:
-            lifefatal("unknown neighborhood in do_gen");
-            break;
+                case '+':
+                    fast_Cross(mincol, r0, maxcol, r1);
+                    break;
+
+                case 'L':
+                    fast_Triangular(mincol, r0, maxcol, r1);
+                    break;
+
+                case 'G':
+                    fast_Gaussian(mincol, r0, maxcol, r1);
+                    break;
+
+                default:
+                    lifefatal("unknown neighborhood in do_gen");
+                    break;
+            }
+        });
+    }
+    curband = NULL;
+
+    // merge the bands
+    for (size_t k = 0; k < bands.size(); k++) {
+        ltlband& b = bands[k];
+        population += b.population;
+        if (b.minx < minx) minx = b.minx;
+        if (b.maxx > maxx) maxx = b.maxx;
+        if (b.miny < miny) miny = b.miny;
+        if (b.maxy > maxy) maxy = b.maxy;
     }
+    if (population == 0) empty_boundaries();
 
     // reset births and survivals
     births = saveb;
@@ -2425,6 +1800,129 @@ void ltlalgo::do_gen(int mincol, int minrow, int maxcol, int maxrow)
 
 // -----------------------------------------------------------------------------
 
+// The pool of threads used by run_bands.
+
+struct ltlthreads {
+    int n;                                      // number of threads, including ours
+    std::thread** workers;
+    std::mutex lock;                            // guards the remaining fields
+    std::condition_variable workcv, donecv;
+    bool shutdown;
+    const std::function<void(int)>* job;        // the bands being run
+    int next, njobs, pending;
+};
+
+void ltlalgo::setNumThreads(int n)
+{
+    if (n < 1) n = 1;
+    if (n > 1024) n = 1024;
+    if (n != numthreads) mt_stopthreads();
+    numthreads = n;
+}
+
+// -----------------------------------------------------------------------------
+
+void ltlalgo::mt_startthreads()
+{
+    mt = new ltlthreads();
+    mt->n = numthreads;
+    mt->shutdown = false;
+    mt->job = NULL;
+    mt->next = mt->njobs = mt->pending = 0;
+    mt->workers = new std::thread*[numthreads];
+    mt->workers[0] = NULL;
+    for (int i = 1; i < numthreads; i++) {
+        mt->workers[i] = new std::thread(&ltlalgo::mt_worker, this);
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void ltlalgo::mt_stopthreads()
+{
+    if (mt == NULL) return;
+    {
+        std::lock_guard<std::mutex> g(mt->lock);
+        mt->shutdown = true;
+    }
+    mt->workcv.notify_all();
+    for (int i = 1; i < mt->n; i++) {
+        mt->workers[i]->join();
+        delete mt->workers[i];
+    }
+    delete [] mt->workers;
+    delete mt;
+    mt = NULL;
+}
+
+// -----------------------------------------------------------------------------
+
+void ltlalgo::mt_worker()
+{
+    std::unique_lock<std::mutex> lk(mt->lock);
+    for (;;) {
+        if (mt->shutdown) return;
+        if (mt->next >= mt->njobs) {
+            mt->workcv.wait(lk);
+            continue;
+        }
+        int k = mt->next++;
+        const std::function<void(int)>* job = mt->job;
+        lk.unlock();
+        (*job)(k);
+        lk.lock();
+        if (--mt->pending == 0) mt->donecv.notify_all();
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+int ltlalgo::numbands(int rows)
+{
+    int nb = rows / MIN_BAND_ROWS;
+    if (nb > numthreads) nb = numthreads;
+    return nb < 1 ? 1 : nb;
+}
+
+// -----------------------------------------------------------------------------
+
+void ltlalgo::band_rows(int k, int nb, int minrow, int maxrow, int& r0, int& r1)
+{
+    G_INT64 rows = maxrow - minrow + 1;
+    r0 = minrow + (int)(rows * k / nb);
+    r1 = minrow + (int)(rows * (k + 1) / nb) - 1;
+}
+
+// -----------------------------------------------------------------------------
+
+void ltlalgo::run_bands(int nb, const std::function<void(int)>& job)
+{
+    if (nb <= 1) {
+        if (nb == 1) job(0);
+        return;
+    }
+    if (mt == NULL) mt_startthreads();
+    std::unique_lock<std::mutex> lk(mt->lock);
+    mt->job = &job;
+    mt->next = 0;
+    mt->njobs = nb;
+    mt->pending = nb;
+    mt->workcv.notify_all();
+    // do bands ourselves until there are none left to start
+    while (mt->next < mt->njobs) {
+        int k = mt->next++;
+        lk.unlock();
+        job(k);
+        lk.lock();
+        mt->pending--;
+    }
+    while (mt->pending > 0) mt->donecv.wait(lk);
+    mt->job = NULL;
+    mt->njobs = 0;
+}
+
+// -----------------------------------------------------------------------------
+
 void ltlalgo::do_bounded_gen()
 {
     // limit processing to rectangle where births/deaths can occur
@@ -9,6 +9,18 @@
 #include "lifealgo.h"
 #include "liferules.h"  // for MAXRULESIZE
 #include <vector>
+#include <functional>
+
+// each band of rows being updated (possibly by its own thread) keeps its own
+// population change and boundary of live cells; these are merged after do_gen
+struct ltlband {
+    int population;                     // change in population
+    int minx, miny, maxx, maxy;         // boundary of live cells in nextgrid
+};
+
+// the thread pool used to update bands of rows in parallel (only defined in
+// ltlalgo.cpp so users of this header don't need the threading headers)
+struct ltlthreads;
 
 class ltlalgo : public lifealgo {
 public:
@@ -25,8 +37,10 @@ public:
     virtual const bigint& getPopulation();
     virtual int isEmpty();
     virtual int hyperCapable() { return 0; }
+    virtual int alternatingRules() { return b0; }
     virtual void setMaxMemory(int m) {}
     virtual int getMaxMemory() { return 0; }
+    virtual void setNumThreads(int n);
     virtual const char* setrule(const char* s);
     virtual const char* getrule();
     virtual const char* DefaultRule();
@@ -88,6 +102,11 @@ private:
     int* stateweights;                  // state weights
     int* customneighborhood;            // custom neighborhood list
     int customlength;                   // custom neighborhood list length
+
+    int numthreads;                     // number of threads used by do_gen
+    ltlthreads* mt;                     // thread pool (started when first needed)
+    vector<ltlband> bands;              // one per band of rows in do_gen
+    vector<int> carries;                // column count carries between bands
     
     const char* read_custom(const char *n, int r, int &c, TGridType &gt, const char *&nbrend); // read custom neighborhood
     const char* read_weighted(const char *n, int r, int states, int &c, TGridType &gt, const char *&nbrend); // read weighted neighborhood
@@ -104,15 +123,24 @@ private:
     bool do_unbounded_gen();            // calculate the next generation in an unbounded universe
     int getcount(int i, int j);         // used in faster_Neumann_*
 
+    int numbands(int rows);             // how many bands to split rows into
+    void run_bands(int nb, const std::function<void(int)>& job);
+    // run job(0..nb-1), in parallel if there is more than one band
+    void band_rows(int k, int nb, int minrow, int maxrow, int& r0, int& r1);
+    // set r0..r1 to the rows in band k of minrow..maxrow
+    void mt_startthreads();
+    void mt_stopthreads();
+    void mt_worker();
+
     const char* resize_grids(int up, int down, int left, int right);
     // try to resize an unbounded universe by the given amounts (possibly -ve);
     // if it fails then return a suitable error message
     
     void fast_Moore(int mincol, int minrow, int maxcol, int maxrow);
-    void faster_Moore_bounded(int mincol, int minrow, int maxcol, int maxrow);
-    void faster_Moore_bounded2(int mincol, int minrow, int maxcol, int maxrow);
-    void faster_Moore_unbounded(int mincol, int minrow, int maxcol, int maxrow);
-    void faster_Moore_unbounded2(int mincol, int minrow, int maxcol, int maxrow);
+    void faster_Moore(int mincol, int minrow, int maxcol, int maxrow);
+    void Moore_colcounts(int mincol, int minrow, int maxcol, int maxrow);
+    void Moore_update_rows(int mincol, int minrow, int maxcol, int maxrow,
+                           int r0, int r1, int* nbuf);
     void fast_Neumann(int mincol, int minrow, int maxcol, int maxrow);
     void faster_Neumann_bounded(int mincol, int minrow, int maxcol, int maxrow);
     void faster_Neumann_unbounded(int mincol, int minrow, int maxcol, int maxrow);
@@ -134,7 +162,8 @@ private:
     void update_current_grid(unsigned char &state, int ncount);
     void update_next_grid(int x, int y, int xyoffset, int ncount);
     // called from each of the fast* routines to set the state of the x,y cell
-    // in nextgrid based on the given neighborhood count
+    // in nextgrid based on the given neighborhood count; the population
+    // change and the new boundary go into the band of the calling thread
 };
 
 #endif
@@ -0,0 +1,172 @@
+// This file is part of Golly.
+// See docs/License.html for the copyright notice.
+
+#include "periodfinder.h"
+#include "lifepoll.h"
+using namespace std ;
+void periodfinder::sign(patternsig &sig) {
+   sig.hash = 0 ;
+   sig.gen = algo.getGeneration() ;
+   sig.pop = algo.getPopulation() ;
+   if (algo.isEmpty()) {
+      sig.left = sig.top = sig.wd = sig.ht = bigint::zero ;
+   } else {
+      bigint t, l, b, r ;
+      algo.findedges(&t, &l, &b, &r) ;
+      sig.hash = algo.gethash(t, l, b, r) ;
+      sig.left = l ;
+      sig.top = t ;
+      sig.wd = r ;
+      sig.wd -= l ;
+      sig.wd += 1 ;
+      sig.ht = b ;
+      sig.ht -= t ;
+      sig.ht += 1 ;
+   }
+}
+/*
+ *   Step n generations, going through the border cells if the algorithm
+ *   emulates a bounded grid; 0 if the step didn't happen or was cut
+ *   short.  The hashing algorithms step 2^k times a small odd number of
+ *   generations at a time, so a big odd n is stepped one set bit at a
+ *   time instead.
+ */
+int periodfinder::advance(const bigint &n) {
+   if (algo.hyperCapable()) {
+      bigint odd = n ;
+      while (odd > 0 && odd.even())
+         odd.div2() ;
+      if (odd > 1023) {
+         bigint rest = n, bit = 1 ;
+         while (rest > 0) {
+            if (rest.odd() && !advance(bit))
+               return 0 ;
+            rest.div2() ;
+            bit += bit ;
+         }
+         return 1 ;
+      }
+   }
+   int bordered = algo.unbounded && (algo.gridwd > 0 || algo.gridht > 0) ;
+   algo.setIncrement(n) ;
+   if (bordered && !algo.CreateBorderCells())
+      return 0 ;
+   algo.step() ;
+   if (bordered && !algo.DeleteBorderCells())
+      return 0 ;
+   return !algo.getpoll()->isInterrupted() ;
+}
+/*
+ *   Is now the same pattern as was, perhaps shifted?  With emulated
+ *   B0-not-Smax rules a repeat only counts an even number of generations
+ *   later, since odd generations are stepped with a different rule.
+ */
+int periodfinder::matches(const patternsig &was, const patternsig &now) {
+   if (!was.same(now))
+      return 0 ;
+   period = now.gen ;
+   period -= was.gen ;
+   if (algo.alternatingRules() && period.odd())
+      return 0 ;
+   dx = now.left ;
+   dx -= was.left ;
+   dy = now.top ;
+   dy -= was.top ;
+   start = was.gen ;
+   return 1 ;
+}
+int periodfinder::test(const bigint &p) {
+   patternsig was, now ;
+   bigint saveinc = algo.getIncrement() ;
+   found = 0 ;
+   sign(was) ;
+   if (advance(p)) {
+      sign(now) ;
+      found = matches(was, now) ;
+   }
+   algo.setIncrement(saveinc) ;
+   return found ;
+}
+/*
+ *   Step one generation at a time until the pattern matches one it has
+ *   been since this was called, or gens reaches until.
+ */
+int periodfinder::stepwise(bigint &gens, const bigint &until) {
+   unordered_multimap<cellhash::value, patternsig> seen ;
+   patternsig now ;
+   sign(now) ;
+   seen.insert(make_pair(now.hash, now)) ;
+   while (gens < until) {
+      if (!advance(bigint::one))
+         return -1 ;
+      gens += 1 ;
+      sign(now) ;
+      auto range = seen.equal_range(now.hash) ;
+      for (auto it=range.first; it!=range.second; ++it)
+         if (matches(it->second, now))
+            return 1 ;
+      seen.insert(make_pair(now.hash, now)) ;
+   }
+   return 0 ;
+}
+/*
+ *   Compare the pattern before and after steps of 1024, 2048, ...
+ *   generations, while those leave at least half of maxgens for looking
+ *   one generation at a time.  A match after a jump of 2^k means the
+ *   period divides 2^k, so the smaller powers of two are tried (from
+ *   wherever the pattern has got to) to find which it is.
+ */
+int periodfinder::jumps(bigint &gens, const bigint &maxgens) {
+   patternsig was, now ;
+   sign(was) ;
+   bigint jump = 1024 ;
+   for (int k=10; ; k++) {
+      bigint reach = gens ;
+      reach += jump ;
+      reach.mul_smallint(2) ;
+      if (reach > maxgens)
+         return 0 ;
+      if (!advance(jump))
+         return -1 ;
+      gens += jump ;
+      sign(now) ;
+      if (matches(was, now)) {
+         bigint jperiod = period, jdx = dx, jdy = dy, jstart = start ;
+         bigint p = 1 ;
+         for (int j=0; j<k; j++) {
+            if (!advance(p))
+               return -1 ;
+            was = now ;
+            sign(now) ;
+            if (matches(was, now))
+               return 1 ;
+            p += p ;
+         }
+         period = jperiod ;
+         dx = jdx ;
+         dy = jdy ;
+         start = jstart ;
+         return 1 ;
+      }
+      was = now ;
+      jump += jump ;
+   }
+}
+int periodfinder::find(const bigint &maxgens) {
+   bigint saveinc = algo.getIncrement() ;
+   bigint gens = 0 ;
+   int bordered = algo.unbounded && (algo.gridwd > 0 || algo.gridht > 0) ;
+   int r ;
+   if (jumpahead && algo.hyperCapable() && !bordered) {
+      bigint first = maxgens < 1024 ? maxgens : bigint(1024) ;
+      r = stepwise(gens, first) ;
+      if (r == 0)
+         r = jumps(gens, maxgens) ;
+      if (r == 0)
+         r = stepwise(gens, maxgens) ;
+   } else
+      r = stepwise(gens, maxgens) ;
+   found = r > 0 ;
+   algo.setIncrement(saveinc) ;
+   return found ;
+}
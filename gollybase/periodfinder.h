@@ -0,0 +1,73 @@
+// This file is part of Golly.
+// See docs/License.html for the copyright notice.
+
+/**
+ *   Finds the period of an oscillator or spaceship by stepping it in
+ *   its own algorithm and comparing the gethash hash of its bounding box
+ *   (the one g.hash gives).  That doesn't depend on where the box is, so
+ *   a pattern that has moved hashes the same as it did before and the
+ *   move gives the displacement.  A hash match is only believed if the
+ *   population and the size of the bounding box match too.
+ *
+ *   The hashing algorithms step by powers of two almost as cheaply as by
+ *   one, so if the first 1024 generations don't repeat, find has them
+ *   jump ahead 1024, 2048, ... generations (which gets past a long
+ *   settling down quickly and catches the many patterns whose period is
+ *   a power of two) before looking one generation at a time again.  test
+ *   checks a single candidate period, however big, in a few steps.
+ */
+#ifndef PERIODFINDER_H
+#define PERIODFINDER_H
+#include "bigint.h"
+#include "lifealgo.h"
+#include <unordered_map>
+/**
+ *   What periodfinder remembers about one generation.
+ */
+struct patternsig {
+   cellhash::value hash ;
+   bigint pop ;
+   bigint left, top, wd, ht ;     // wd is 0 if the pattern is empty
+   bigint gen ;
+   int same(const patternsig &o) const {
+      return hash == o.hash && pop == o.pop && wd == o.wd && ht == o.ht ;
+   }
+} ;
+class periodfinder {
+public:
+   periodfinder(lifealgo &algoarg) : jumpahead(1), found(0),
+                                     algo(algoarg) {}
+   /**
+    *   The signature of the current pattern.
+    */
+   void sign(patternsig &sig) ;
+   /**
+    *   Step the pattern until it repeats or maxgens generations have
+    *   gone by.  Returns 1 (and sets period, dx, dy and start) if a
+    *   period was found, 0 if not or if the poller interrupted it.  The
+    *   pattern is left at the generation where the repeat was seen.
+    */
+   int find(const bigint &maxgens) ;
+   /**
+    *   Step the pattern p generations in one go and return 1 (setting
+    *   period to p, and dx and dy) if it is then the same as before,
+    *   perhaps shifted.  p need not be the smallest period.
+    */
+   int test(const bigint &p) ;
+   /**
+    *   Let find jump ahead in powers of two on the hashing algorithms
+    *   (the default); without it the repeat is always found at the first
+    *   generation where it happens, whatever the algorithm.
+    */
+   int jumpahead ;
+   int found ;
+   bigint period, dx, dy ;
+   bigint start ;                 // generation of the earlier copy
+private:
+   int advance(const bigint &n) ;
+   int stepwise(bigint &gens, const bigint &until) ;
+   int jumps(bigint &gens, const bigint &maxgens) ;
+   int matches(const patternsig &was, const patternsig &now) ;
+   lifealgo &algo ;
+} ;
+#endif
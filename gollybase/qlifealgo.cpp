@@ -12,6 +12,12 @@
 #include <string.h>
 #include <limits.h>
 #include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <unordered_map>
+#include <chrono>
 using namespace std ;
 /*
  *   The ai array is used to figure out the index number of the bit set in
@@ -29,6 +35,63 @@ static unsigned char ai[129] ;
  *   memory for small universes.
  */
 #define MEMCHUNK (8192-16)
+/*
+ *   For multi-threaded generations, the supertiles at this level are
+ *   the unit of work.  Each is 256x256 cells, so a task does up to 64
+ *   tiles.
+ */
+#define QLIFETASKLEV 2
+/*
+ *   A task recomputes one supertile at QLIFETASKLEV with doquad01 or
+ *   doquad10.  It may start once the tasks (if any) for the neighbors
+ *   it reads have finished; these are the ones the serial code would
+ *   have recomputed just before it.  Since a task only writes within
+ *   its own supertile, and only reads its own and those neighbors,
+ *   the results are the same as the serial code's in any order.
+ *
+ *   The levels above are walked serially before any tasks run.  Each
+ *   supertile there gets an upper record that collects the changing
+ *   bits of its children, which are stored in its flags once all the
+ *   tasks are done.  The bits that the neighbors of a supertile read
+ *   from its flags only depend on the previous flags, so they are
+ *   stored right away.
+ */
+struct qtask {
+   supertile *zis, *edge, *par, *cor ;
+   int up, shift, ret ;
+   int waiting ;           // unfinished tasks we need to wait for
+   int ndeps ;
+   int deps[3] ;           // tasks that wait for us
+} ;
+struct qupper {
+   supertile *zis ;
+   int nchanging, up, shift ;
+} ;
+/*
+ *   Each thread takes its bricks, tiles and supertiles from its own
+ *   free lists, refilled in batches from the shared ones.
+ */
+struct qthreadctx {
+   linkedmem *tilelist, *supertilelist, *bricklist ;
+} ;
+struct qlifethreads {
+   int n ;                          // number of threads, including ours
+   qthreadctx *ctx ;                // ctx[0] belongs to the stepping thread
+   std::thread **workers ;
+   std::mutex lock ;                // guards the next group of fields
+   std::condition_variable workcv, donecv ;
+   int shutdown, odd, remaining ;
+   std::deque<int> ready ;
+   std::mutex alloclock ;           // guards the shared free lists
+   vector<qtask> tasks ;
+   vector<qupper> uppers ;
+   std::unordered_map<supertile *, int> taskof ;
+} ;
+/*
+ *   The thread context of the current thread while it is running
+ *   tasks; zero otherwise.
+ */
+static thread_local qthreadctx *curctx ;
 /*
  *   When we need a bunch more structures of a particular size, we call this.
  *   This code allocates the memory, adds it to our universe memory allocated
@@ -74,10 +137,12 @@ static int bricks, tiles, supertiles, rcc, dq, ds, rccs, dqs, dss ;
  */
 brick *qlifealgo::newbrick() {
    brick *r ;
-   if (bricklist == 0)
-      bricklist = filllist(sizeof(brick)) ;
-   r = (brick *)(bricklist) ;
-   bricklist = bricklist->next ;
+   linkedmem *&list = (curctx ? curctx->bricklist : bricklist) ;
+   if (list == 0)
+      list = (curctx ? mt_refill(bricklist, sizeof(brick)) :
+                       filllist(sizeof(brick))) ;
+   r = (brick *)(list) ;
+   list = list->next ;
    memset(r, 0, sizeof(brick)) ;
    STAT(bricks++) ;
    return r ;
@@ -88,10 +153,12 @@ brick *qlifealgo::newbrick() {
  */
 tile *qlifealgo::newtile() {
    tile *r ;
-   if (tilelist == 0)
-      tilelist = filllist(sizeof(tile)) ;
-   r = (tile *)(tilelist) ;
-   tilelist = tilelist->next ;
+   linkedmem *&list = (curctx ? curctx->tilelist : tilelist) ;
+   if (list == 0)
+      list = (curctx ? mt_refill(tilelist, sizeof(tile)) :
+                       filllist(sizeof(tile))) ;
+   r = (tile *)(list) ;
+   list = list->next ;
    r->b[0] = r->b[1] = r->b[2] = r->b[3] = emptybrick ;
    r->flags = -1 ;
    r->localdeltaforward = 0 ;
@@ -104,10 +171,12 @@ tile *qlifealgo::newtile() {
  */
 supertile *qlifealgo::newsupertile(int lev) {
    supertile *r ;
-   if (supertilelist == 0)
-      supertilelist = filllist(sizeof(supertile)) ;
-   r = (supertile *)supertilelist ;
-   supertilelist = supertilelist->next ;
+   linkedmem *&list = (curctx ? curctx->supertilelist : supertilelist) ;
+   if (list == 0)
+      list = (curctx ? mt_refill(supertilelist, sizeof(supertile)) :
+                       filllist(sizeof(supertile))) ;
+   r = (supertile *)list ;
+   list = list->next ;
    r->d[0] = r->d[1] = r->d[2] = r->d[3] = r->d[4] = r->d[5] =
                                  r->d[6] = r->d[7] = nullroots[lev-1] ;
    STAT(supertiles++) ;
@@ -199,30 +268,83 @@ qlifealgo::qlifealgo() {
       lifefatal("bad platform for this program") ;
    memused = 0 ;
    maxmemory = 0 ;
+   numthreads = 1 ;
+   mt = 0 ;
+   kernel = QLIFETABLE ;
+   slicable = 0 ;
+   curslicerule = &slicerules[0] ;
    clearall() ;
 }
 /*
- *   Clear everything.  This one also frees memory.
+ *   Put a (super)tile and everything under it that isn't shared back on
+ *   the free lists, cleared the way newtile and newsupertile expect.
+ */
+void qlifealgo::recycle(supertile *p, int lev) {
+   if (lev == 0) {
+      tile *pp = (tile *)p ;
+      if (pp == emptytile)
+         return ;
+      for (int i=0; i<4; i++)
+         if (pp->b[i] != emptybrick) {
+            STAT(bricks--) ;
+            ((linkedmem *)(pp->b[i]))->next = bricklist ;
+            bricklist = (linkedmem *)(pp->b[i]) ;
+         }
+      STAT(tiles--) ;
+      memset(pp, 0, sizeof(tile)) ;
+      ((linkedmem *)pp)->next = tilelist ;
+      tilelist = (linkedmem *)pp ;
+   } else {
+      if (p == nullroots[lev])
+         return ;
+      for (int i=0; i<8; i++)
+         recycle(p->d[i], lev-1) ;
+      STAT(supertiles--) ;
+      memset(p, 0, sizeof(supertile)) ;
+      ((linkedmem *)p)->next = supertilelist ;
+      supertilelist = (linkedmem *)p ;
+   }
+}
+/*
+ *   Clear everything.  The first time through we have nothing; after
+ *   that the structures in use go back on the free lists, so the memory
+ *   is kept for the next pattern rather than freed.
  */
 static int bc[256] ; // popcount
 void qlifealgo::clearall() {
    poller->bailIfCalculating() ;
-   while (memused) {
-      linkedmem *nu = memused->next ;
-      free(memused) ;
-      memused = nu ;
+   if (memused) {
+      destroytimeline() ;
+      recycle(root, rootlev) ;
+      for (int lev=1; lev<=rootlev; lev++) {
+         memset(nullroots[lev], 0, sizeof(supertile)) ;
+         ((linkedmem *)nullroots[lev])->next = supertilelist ;
+         supertilelist = (linkedmem *)nullroots[lev] ;
+      }
+      memset(emptytile, 0, sizeof(tile)) ;
+      ((linkedmem *)emptytile)->next = tilelist ;
+      tilelist = (linkedmem *)emptytile ;
+      ((linkedmem *)emptybrick)->next = bricklist ;
+      bricklist = (linkedmem *)emptybrick ;
+   } else {
+      tilelist = 0 ;
+      supertilelist = 0 ;
+      bricklist = 0 ;
+      usedmemory = 0 ;
+      llxb = 0 ;
+      llyb = 0 ;
+      llbits = 0 ;
+      llsize = 0 ;
    }
    generation = 0 ;
    increment = 1 ;
-   tilelist = 0 ;
-   supertilelist = 0 ;
-   bricklist = 0 ;
    rootlev = 0 ;
    cleandowncounter = 63 ;
-   usedmemory = 0 ;
    deltaforward = 0 ;
-   ai[0] = 4 ; ai[1] = 0 ; ai[2] = 1 ; ai[4] = 2 ; ai[8] = 3 ;
-   ai[16] = 4 ; ai[32] = 5 ; ai[64] = 6 ; ai[128] = 7 ;
+   if (ai[0] == 0) {
+      ai[0] = 4 ; ai[1] = 0 ; ai[2] = 1 ; ai[4] = 2 ; ai[8] = 3 ;
+      ai[16] = 4 ; ai[32] = 5 ; ai[64] = 6 ; ai[128] = 7 ;
+   }
    minlow32 = min = 0 ;
    max = 31 ;
    bmin = 0 ;
@@ -231,10 +353,6 @@ void qlifealgo::clearall() {
    nullroots[0] = nullroot = root = (supertile *)(emptytile = newtile()) ;
    uproot() ;
    popValid = 0 ;
-   llxb = 0 ;
-   llyb = 0 ;
-   llbits = 0 ;
-   llsize = 0 ;
    if (bc[255] == 0)
      for (int i=1; i<256; i++)
        bc[i] = bc[i & (i-1)] + 1 ;
@@ -243,6 +361,7 @@ void qlifealgo::clearall() {
  *   This subroutine frees a universe.
  */
 qlifealgo::~qlifealgo() {
+   mt_stopthreads() ;
    while (memused) {
       linkedmem *nu = memused->next ;
       free(memused) ;
@@ -294,6 +413,9 @@ void qlifealgo::setMaxMemory(int newmemlimit) {
 int qlifealgo::doquad01(supertile *zis, supertile *edge,
                         supertile *par, supertile *cor, int lev) {
 /*
+ *   (Tasks running on other threads leave polling to the stepping
+ *   thread, which does it between tasks.)
+ *
  *   First we figure out which subtiles we need to recalculate.  There will
  *   always be at least one if we got into this subroutine (except for the
  *   case of a static universe and at the root level).  To do this, we
@@ -304,7 +426,8 @@ int qlifealgo::doquad01(supertile *zis, supertile *edge,
  *   Note that the parallel and corner have already been recomputed so
  *   their changing bits are shifted up 10 positions in c.
  */
-   poller->poll() ;
+   if (curctx == 0)
+      poller->poll() ;
    int changing = (zis->flags | (par->flags >> 19) |
                    (((edge->flags >> 18) | (cor->flags >> 27)) & 1)) & 0xff ;
    int x, b, nchanging = (zis->flags & 0x3ff00) << 10 ;
@@ -371,7 +494,8 @@ int qlifealgo::doquad01(supertile *zis, supertile *edge,
  */
 int qlifealgo::doquad10(supertile *zis, supertile *edge,
                         supertile *par, supertile *cor, int lev) {
-   poller->poll() ;
+   if (curctx == 0)
+      poller->poll() ;
    int changing = (zis->flags | (par->flags >> 19) |
                    (((edge->flags >> 18) | (cor->flags >> 27)) & 1)) & 0xff ;
    int x, b, nchanging = (zis->flags & 0x3ff00) << 10 ;
@@ -412,6 +536,203 @@ int qlifealgo::doquad10(supertile *zis, supertile *edge,
    zis->flags = nchanging | 0xf0000000 ;
    return upchanging(nchanging) ;
 }
+/*
+ *   The bit-sliced kernels use the compiler's vector extensions, so they
+ *   are only built with gcc and clang; the AVX2 version is compiled for
+ *   that instruction set only and used only if the CPU reports it.
+ */
+#ifdef __GNUC__
+#define SLICEKERNELS
+#if defined(__x86_64__) || defined(__i386__)
+#define AVX2KERNEL
+#endif
+typedef unsigned int slicevec __attribute__((vector_size(32))) ;
+/*
+ *   Shift a slice one or two columns toward its left (right) edge, filling
+ *   from the next slice over, or one or two rows toward its top (bottom),
+ *   filling from the slice below (above).
+ */
+#define SLICECOL1(v, n) (back ? (((v) >> 1) & 0x77777777) | (((n) << 3) & 0x88888888) \
+                              : (((v) << 1) & 0xeeeeeeee) | (((n) >> 3) & 0x11111111))
+#define SLICECOL2(v, n) (back ? (((v) >> 2) & 0x33333333) | (((n) << 2) & 0xcccccccc) \
+                              : (((v) << 2) & 0xcccccccc) | (((n) >> 2) & 0x33333333))
+#define SLICEROW(v, n, k) (back ? ((v) >> (k)) | ((n) << (32 - (k))) \
+                                : ((v) << (k)) | ((n) >> (32 - (k))))
+#define SLICEMUX(s, a, b) ((a) ^ (((a) ^ (b)) & (s)))
+/*
+ *   Compute the new values of the eight slices of a brick, one slice per
+ *   32-bit lane.  The neighbors of each cell are lined up by shifting
+ *   whole slices, counted with full adders, and the count and the cell
+ *   itself then select the new state through a tree of bitwise muxes.
+ *   For p10 (back set) everything is turned around 180 degrees, which
+ *   doesn't change an outer-totalistic rule.
+ */
+template <int back>
+static inline __attribute__((always_inline))
+void slicekernel(const unsigned int *z, const unsigned int *zn,
+                 const unsigned int *u, const unsigned int *un,
+                 unsigned int *dst, const unsigned int *recomp,
+                 unsigned int forward, unsigned int *delta,
+                 const slicerule *r) {
+   slicevec zv, znv, uv, unv ;
+   memcpy(&zv, z, sizeof(zv)) ;
+   memcpy(&znv, zn, sizeof(znv)) ;
+   memcpy(&uv, u, sizeof(uv)) ;
+   memcpy(&unv, un, sizeof(unv)) ;
+   slicevec c0 = zv, c1 = SLICECOL1(zv, znv), c2 = SLICECOL2(zv, znv) ;
+   slicevec d0 = uv, d1 = SLICECOL1(uv, unv), d2 = SLICECOL2(uv, unv) ;
+   slicevec a = c0, b = c1, c = c2 ;
+   slicevec d = SLICEROW(c0, d0, 4), me = SLICEROW(c1, d1, 4),
+            e = SLICEROW(c2, d2, 4) ;
+   slicevec f = SLICEROW(c0, d0, 8), g = SLICEROW(c1, d1, 8),
+            h = SLICEROW(c2, d2, 8) ;
+   // add up the eight neighbors into the four bits s0..s3
+   slicevec t, ab = a ^ b, de = d ^ e ;
+   slicevec x0 = ab ^ c, y0 = (a & b) | (c & ab) ;
+   slicevec x1 = de ^ f, y1 = (d & e) | (f & de) ;
+   slicevec x2 = g ^ h, y2 = g & h ;
+   t = x0 ^ x1 ;
+   slicevec s0 = t ^ x2, y3 = (x0 & x1) | (x2 & t) ;
+   t = y0 ^ y1 ;
+   slicevec w = t ^ y2, z4 = (y0 & y1) | (y2 & t) ;
+   slicevec s1 = w ^ y3, z5 = w & y3 ;
+   slicevec s2 = z4 ^ z5, s3 = z4 & z5 ;
+   // the new state for each count, given the cell's current state
+   slicevec leaf[9] ;
+   for (int i=0; i<9; i++)
+      leaf[i] = r->born[i] ^ (me & (r->survive[i] ^ r->born[i])) ;
+   // only a count of 8 sets s3, and then the other bits are zero
+   leaf[0] = SLICEMUX(s3, leaf[0], leaf[8]) ;
+   slicevec m0 = SLICEMUX(s0, leaf[0], leaf[1]), m1 = SLICEMUX(s0, leaf[2], leaf[3]) ;
+   slicevec m2 = SLICEMUX(s0, leaf[4], leaf[5]), m3 = SLICEMUX(s0, leaf[6], leaf[7]) ;
+   m0 = SLICEMUX(s1, m0, m1) ;
+   m2 = SLICEMUX(s1, m2, m3) ;
+   slicevec res = SLICEMUX(s2, m0, m2) ;
+   // store the slices asked for, and what changed in them
+   slicevec old, rv ;
+   memcpy(&old, dst, sizeof(old)) ;
+   memcpy(&rv, recomp, sizeof(rv)) ;
+   slicevec dv = ((old ^ res) | forward) & rv ;
+   res = old ^ ((old ^ res) & rv) ;
+   memcpy(dst, &res, sizeof(res)) ;
+   memcpy(delta, &dv, sizeof(dv)) ;
+}
+__attribute__((noinline))
+static void slicebrick(int back, const unsigned int *z, const unsigned int *zn,
+                       const unsigned int *u, const unsigned int *un,
+                       unsigned int *dst, const unsigned int *recomp,
+                       unsigned int forward, unsigned int *delta,
+                       const slicerule *r) {
+   if (back)
+      slicekernel<1>(z, zn, u, un, dst, recomp, forward, delta, r) ;
+   else
+      slicekernel<0>(z, zn, u, un, dst, recomp, forward, delta, r) ;
+}
+#ifdef AVX2KERNEL
+__attribute__((target("avx2"), noinline))
+static void slicebrickavx2(int back, const unsigned int *z, const unsigned int *zn,
+                           const unsigned int *u, const unsigned int *un,
+                           unsigned int *dst, const unsigned int *recomp,
+                           unsigned int forward, unsigned int *delta,
+                           const slicerule *r) {
+   if (back)
+      slicekernel<1>(z, zn, u, un, dst, recomp, forward, delta, r) ;
+   else
+      slicekernel<0>(z, zn, u, un, dst, recomp, forward, delta, r) ;
+}
+#endif
+#endif
+/*
+ *   Recompute the slices of a brick flagged in recomp (one 0 or ~0 word
+ *   per slice) into dst, setting delta to the change flags p01 and p10
+ *   would have computed for each slice.
+ */
+static inline void slicebrick(int kernel, int back, const unsigned int *z,
+                              const unsigned int *zn, const unsigned int *u,
+                              const unsigned int *un, unsigned int *dst,
+                              const unsigned int *recomp, unsigned int forward,
+                              unsigned int *delta, const slicerule *r) {
+#ifdef AVX2KERNEL
+   if (kernel == qlifealgo::QLIFEAVX2) {
+      slicebrickavx2(back, z, zn, u, un, dst, recomp, forward, delta, r) ;
+      return ;
+   }
+#endif
+#ifdef SLICEKERNELS
+   slicebrick(back, z, zn, u, un, dst, recomp, forward, delta, r) ;
+#endif
+}
+/*
+ *   A bit-sliced kernel always computes all eight slices of a brick, so
+ *   it only pays when enough of them need it.
+ */
+#define SLICEMIN 5
+/*
+ *   Can the rule table be computed by the bit-sliced kernels?  If every
+ *   cell of every 4x4 entry only depends on its own state and how many of
+ *   its eight neighbors are alive, fill in the masks and return 1.
+ */
+static int makeslicerule(const char *rtab, slicerule &r) {
+   static const int outbit[4] = { 5, 4, 1, 0 } ;
+   int seen[2][9] ;
+   for (int n=0; n<9; n++)
+      seen[0][n] = seen[1][n] = -1 ;
+   for (int i=0; i<ALL4X4; i++) {
+      for (int k=0; k<4; k++) {
+         int x = 1 + (k & 1), y = 1 + (k >> 1), n = 0 ;
+         for (int dy=-1; dy<=1; dy++)
+            for (int dx=-1; dx<=1; dx++)
+               if (dx || dy)
+                  n += (i >> (15 - 4 * (y + dy) - (x + dx))) & 1 ;
+         int c = (i >> (15 - 4 * y - x)) & 1 ;
+         int v = (rtab[i] >> outbit[k]) & 1 ;
+         if (seen[c][n] < 0)
+            seen[c][n] = v ;
+         else if (seen[c][n] != v)
+            return 0 ;
+      }
+   }
+   for (int n=0; n<9; n++) {
+      r.survive[n] = seen[1][n] > 0 ? ~0U : 0 ;
+      r.born[n] = seen[0][n] > 0 ? ~0U : 0 ;
+   }
+   return 1 ;
+}
+static int hasavx2() {
+#ifdef AVX2KERNEL
+   return __builtin_cpu_supports("avx2") ;
+#else
+   return 0 ;
+#endif
+}
+const char *qlifealgo::kernelname(int k) {
+   switch (k) {
+      case QLIFETABLE: return "table" ;
+      case QLIFESLICE: return "bitslice" ;
+      case QLIFEAVX2: return "avx2" ;
+   }
+   return "?" ;
+}
+/*
+ *   The portable bit-sliced kernel (two 128-bit halves on SSE2 or NEON)
+ *   is about as fast as the table, so it isn't picked by default.
+ */
+int qlifealgo::bestkernel() {
+   if (slicable && hasavx2())
+      return QLIFEAVX2 ;
+   return QLIFETABLE ;
+}
+bool qlifealgo::setkernel(int k) {
+   if (k != QLIFETABLE) {
+#ifndef SLICEKERNELS
+      return false ;
+#endif
+      if (!slicable || (k == QLIFEAVX2 && !hasavx2()))
+         return false ;
+   }
+   kernel = k ;
+   return true ;
+}
 /*
  *   This is our monster subroutine that, with its mirror below, accounts for
  *   about 90% of the runtime.  It handles recomputation for a 32x32 tile.
@@ -434,10 +755,38 @@ int qlifealgo::p01(tile *p, tile *pr, tile *pd, tile *prd) {
  */
    for (i=3; i>=0; i--) {
       brick *b = p->b[i], *rb = pr->b[i] ;
+/*
+ *   With many slices to recompute, a bit-sliced kernel does the whole
+ *   brick at once.  From the changes it reports we rebuild the changing
+ *   flags that the slice-by-slice loop below accumulates in maskprev:
+ *   for each slice, whether it or its top neighbor changed at all and
+ *   whether their lowest two rows did.
+ */
+      if (recomp && kernel != QLIFETABLE && bc[recomp] >= SLICEMIN) {
+         unsigned int zn[8], un[8], rc[8], delta[9] ;
+         int j, anymask = 0, lowmask = 0 ;
+         p->flags |= 1 << i ;
+         if (b == emptybrick)
+            p->b[i] = b = newbrick() ;
+         for (j=0; j<8; j++) {
+            zn[j] = j < 7 ? b->d[j+1] : rb->d[0] ;
+            un[j] = j < 7 ? db->d[j+1] : rdb->d[0] ;
+            rc[j] = 0 - ((recomp >> (7 - j)) & 1) ;
+         }
+         slicebrick(kernel, 0, b->d, zn, db->d, un, b->d + 8, rc,
+                    deltaforward | p->localdeltaforward, delta, curslicerule) ;
+         delta[8] = 0 ;
+         for (j=-1; j<8; j++) {
+            unsigned int maska = delta[j+1] | (j >= 0 ? delta[j] & 0x33333333 : 0) ;
+            anymask |= (maska != 0) << (j + 1) ;
+            lowmask |= ((maska & 0xff) != 0) << (j + 1) ;
+         }
+         p->c[i+2] |= lowmask ;
+         p->c[i+1] = (short)(((p->c[i+1] & 0x100) << 1) | anymask) ;
 /*
  *   Do we need to recompute?
  */
-      if (recomp) {
+      } else if (recomp) {
          unsigned int traildata, trailunderdata ;
          int j, cdelta = 0, maska, maskb, maskprev = 0 ;
 /*
@@ -567,7 +916,28 @@ int qlifealgo::p10(tile *plu, tile *pu, tile *pl, tile *p) {
    p->flags |= 0x000fff00 ;
    for (i=0; i<=3; i++) {
       brick *b = p->b[i], *lb = pl->b[i] ;
-      if (recomp) {
+      if (recomp && kernel != QLIFETABLE && bc[recomp] >= SLICEMIN) {
+         unsigned int zn[8], un[8], rc[8], delta[10] ;
+         int j, anymask = 0, topmask = 0 ;
+         p->flags |= 1 << i ;
+         if (b == emptybrick)
+            p->b[i] = b = newbrick() ;
+         for (j=0; j<8; j++) {
+            zn[j] = j > 0 ? b->d[j+7] : lb->d[15] ;
+            un[j] = j > 0 ? ub->d[j+7] : lub->d[15] ;
+            rc[j] = 0 - ((recomp >> j) & 1) ;
+         }
+         slicebrick(kernel, 1, b->d + 8, zn, ub->d + 8, un, b->d, rc,
+                    deltaforward | p->localdeltaforward, delta + 1, curslicerule) ;
+         delta[0] = delta[9] = 0 ;
+         for (j=0; j<=8; j++) {
+            unsigned int maska = delta[j] | (delta[j+1] & 0xcccccccc) ;
+            anymask |= (maska != 0) << (8 - j) ;
+            topmask |= ((maska >> 24) != 0) << (8 - j) ;
+         }
+         p->c[i+1] = (short)(((p->c[i+1] & 0x100) << 1) | anymask) ;
+         p->c[i] |= topmask ;
+      } else if (recomp) {
          int maska, maskprev = 0, j, cdelta = 0 ;
          unsigned int traildata, trailoverdata ;
          p->flags |= 1 << i ;
@@ -934,6 +1304,209 @@ int qlifealgo::nextcell(int x, int y, supertile *n, int lev) {
    }
    return -1 ;
 }
+/*
+ *   getruns walks the universe a band at a time:  a band is the
+ *   nonempty (super)tiles of one level that cover the same rows, left
+ *   to right, each with the offset of its left edge from the rectangle.
+ *   Odd levels widen a band into their children; even levels split it
+ *   into eight bands, one per child, the highest child (the top one,
+ *   since y is flipped) first.  Each tile row is gathered from its
+ *   eight slices into one word.
+ */
+struct qrunwalk {
+   qrunwalk(liferunsink &sink, G_INT64 wdarg, G_INT64 htarg) :
+      runs(sink, wdarg), wd(wdarg), ht(htarg) {}
+   runjoiner runs ;
+   G_INT64 wd, ht ;
+   int add ;
+   vector<vector<pair<supertile *, G_INT64> > > bands ;
+} ;
+// the size of a (super)tile at the given level
+static G_INT64 qwidth(int lev) { return (G_INT64)32 << (3 * ((lev + 1) >> 1)) ; }
+static G_INT64 qheight(int lev) { return (G_INT64)32 << (3 * (lev >> 1)) ; }
+int qlifealgo::bandruns(qrunwalk &w, int lev, G_INT64 y) {
+   vector<pair<supertile *, G_INT64> > &band = w.bands[lev] ;
+   if (lev == 0) {
+      for (int r=0; r<32; r++) {
+         if (y + r < 0)
+            continue ;
+         if (y + r >= w.ht)
+            break ;
+         int j = (31 - r) >> 3 ;
+         int sh = 4 * (r & 7) ;
+         for (size_t i=0; i<band.size(); i++) {
+            brick *br = ((tile *)band[i].first)->b[j] ;
+            if (br == emptybrick)
+               continue ;
+            unsigned int *d = br->d + w.add ;
+            unsigned int row = 0 ;
+            for (int k=0; k<8; k++)
+               row |= ((d[k] >> sh) & 15) << (28 - 4 * k) ;
+            if (row && w.runs.addbits(band[i].second, y + r, row, 32))
+               return 1 ;
+         }
+      }
+      return 0 ;
+   }
+   supertile *z = nullroots[lev-1] ;
+   vector<pair<supertile *, G_INT64> > &sub = w.bands[lev-1] ;
+   if (lev & 1) {
+      G_INT64 cw = qwidth(lev-1) ;
+      sub.clear() ;
+      for (size_t i=0; i<band.size(); i++) {
+         supertile *p = band[i].first ;
+         for (int k=0; k<8; k++) {
+            G_INT64 x = band[i].second + k * cw ;
+            if (p->d[k] != z && x + cw > 0 && x < w.wd)
+               sub.push_back(make_pair(p->d[k], x)) ;
+         }
+      }
+      return !sub.empty() && bandruns(w, lev-1, y) ;
+   }
+   G_INT64 ch = qheight(lev-1) ;
+   for (int k=7; k>=0; k--) {
+      G_INT64 sy = y + (7 - k) * ch ;
+      if (sy + ch <= 0 || sy >= w.ht)
+         continue ;
+      sub.clear() ;
+      for (size_t i=0; i<band.size(); i++)
+         if (band[i].first->d[k] != z)
+            sub.push_back(make_pair(band[i].first->d[k], band[i].second)) ;
+      if (!sub.empty() && bandruns(w, lev-1, sy))
+         return 1 ;
+   }
+   return 0 ;
+}
+int qlifealgo::getruns(const bigint &top, const bigint &left,
+                       const bigint &bottom, const bigint &right,
+                       liferunsink &sink) {
+   if (top > bottom || left > right || root == nullroots[rootlev])
+      return 0 ;
+   /*
+    *   The root covers bmin.. in both directions in the flipped
+    *   coordinates, shifted by one in odd generations.
+    */
+   int odd = generation.odd() ;
+   bigint x0 = bmin, y0 = bmin ;
+   x0 += odd ;
+   y0 += qheight(rootlev) - 1 + odd ;
+   y0.mul_smallint(-1) ;
+   bigint x1 = x0, y1 = y0 ;
+   x1 += qwidth(rootlev) ;
+   y1 += qheight(rootlev) ;
+   if (x0 > right || x1 <= left || y0 > bottom || y1 <= top)
+      return 0 ;
+   x0 -= left ;
+   y0 -= top ;
+   bigint wd = right, ht = bottom ;
+   wd -= left ;
+   wd += 1 ;
+   ht -= top ;
+   ht += 1 ;
+   qrunwalk w(sink, wd.toint64(), ht.toint64()) ;
+   w.add = odd ? 8 : 0 ;
+   w.bands.resize(rootlev+1) ;
+   w.bands[rootlev].push_back(make_pair(root, x0.toint64())) ;
+   if (bandruns(w, rootlev, y0.toint64()))
+      return 1 ;
+   return w.runs.finish() ;
+}
+/*
+ *   gethash has to look at the bricks again each time, since they
+ *   change in place from one generation to the next; a tile is hashed
+ *   a 32-cell row at a time, and the (super)tiles are put together as
+ *   in cellhash.  xstep and ystep hold X and Y to the power of the
+ *   width or height of a child at each level.
+ */
+struct qhashwalk {
+   G_INT64 wd, ht ;
+   int add ;
+   vector<cellhash::value> xstep, ystep ;
+} ;
+cellhash::value qlifealgo::tilehash(qhashwalk &w, supertile *p, int lev,
+                                    G_INT64 x, G_INT64 y,
+                                    cellhash::value fx, cellhash::value fy) {
+   cellhash::value h = 0 ;
+   if (lev == 0) {
+      tile *t = (tile *)p ;
+      // drop the columns outside the rectangle
+      unsigned int mask = 0xffffffff ;
+      if (x < 0)
+         mask >>= -x ;
+      if (x + 32 > w.wd)
+         mask &= ~(0xffffffff >> (w.wd - x)) ;
+      cellhash::value yp = fy ;
+      for (int r=0; r<32; r++, yp=cellhash::mul(yp, cellhash::Y)) {
+         if (y + r < 0)
+            continue ;
+         if (y + r >= w.ht)
+            break ;
+         brick *br = t->b[(31 - r) >> 3] ;
+         if (br == emptybrick)
+            continue ;
+         int sh = 4 * (r & 7) ;
+         unsigned int *d = br->d + w.add ;
+         unsigned int row = 0 ;
+         for (int k=0; k<8; k++)
+            row |= ((d[k] >> sh) & 15) << (28 - 4 * k) ;
+         row &= mask ;
+         if (row)
+            h = cellhash::add(h, cellhash::mul(cellhash::row(row), yp)) ;
+      }
+      return cellhash::mul(h, fx) ;
+   }
+   supertile *z = nullroots[lev-1] ;
+   if (lev & 1) {
+      G_INT64 cw = qwidth(lev-1) ;
+      for (int k=0; k<8; k++, x+=cw, fx=cellhash::mul(fx, w.xstep[lev]))
+         if (p->d[k] != z && x + cw > 0 && x < w.wd)
+            h = cellhash::add(h, tilehash(w, p->d[k], lev-1, x, y, fx, fy)) ;
+   } else {
+      // the highest child is the top one
+      G_INT64 ch = qheight(lev-1) ;
+      for (int k=7; k>=0; k--, y+=ch, fy=cellhash::mul(fy, w.ystep[lev]))
+         if (p->d[k] != z && y + ch > 0 && y < w.ht)
+            h = cellhash::add(h, tilehash(w, p->d[k], lev-1, x, y, fx, fy)) ;
+   }
+   return h ;
+}
+cellhash::value qlifealgo::gethash(const bigint &top, const bigint &left,
+                                   const bigint &bottom, const bigint &right) {
+   if (top > bottom || left > right || root == nullroots[rootlev])
+      return 0 ;
+   // the root is where getruns finds it
+   int odd = generation.odd() ;
+   bigint x0 = bmin, y0 = bmin ;
+   x0 += odd ;
+   y0 += qheight(rootlev) - 1 + odd ;
+   y0.mul_smallint(-1) ;
+   bigint x1 = x0, y1 = y0 ;
+   x1 += qwidth(rootlev) ;
+   y1 += qheight(rootlev) ;
+   if (x0 > right || x1 <= left || y0 > bottom || y1 <= top)
+      return 0 ;
+   x0 -= left ;
+   y0 -= top ;
+   bigint wd = right, ht = bottom ;
+   wd -= left ;
+   wd += 1 ;
+   ht -= top ;
+   ht += 1 ;
+   qhashwalk w ;
+   w.wd = wd.toint64() ;
+   w.ht = ht.toint64() ;
+   w.add = odd ? 8 : 0 ;
+   w.xstep.assign(rootlev+1, 0) ;
+   w.ystep.assign(rootlev+1, 0) ;
+   for (int lev=1; lev<=rootlev; lev++)
+      if (lev & 1)
+         w.xstep[lev] = cellhash::xpow(qwidth(lev-1)) ;
+      else
+         w.ystep[lev] = cellhash::ypow(qheight(lev-1)) ;
+   G_INT64 x = x0.toint64(), y = y0.toint64() ;
+   return tilehash(w, root, rootlev, x, y, cellhash::xpow(x),
+                   cellhash::ypow(y)) ;
+}
 /*
  *   This subroutine calculates the population count of the universe.  It
  *   uses dirty bits number 1 and 2 of supertiles.
@@ -1133,7 +1706,9 @@ void qlifealgo::dogen() {
       while (uproot_needed())
          uproot() ;
    }
-   if (generation.odd())
+   if (numthreads > 1 && rootlev > QLIFETASKLEV)
+      mt_dogen() ;
+   else if (generation.odd())
       doquad10(root, nullroot, nullroot, nullroot, rootlev) ;
    else
       doquad01(root, nullroot, nullroot, nullroot, rootlev) ;
@@ -1148,6 +1723,303 @@ void qlifealgo::dogen() {
    dss += ds ; dqs += dq ; rccs += rcc ;
 #endif
 }
+/*
+ *   Set the number of threads to use for each generation.  The pool
+ *   itself is started lazily by the first generation that needs it.
+ */
+void qlifealgo::setNumThreads(int n) {
+   poller->bailIfCalculating() ;
+   if (n < 1)
+      n = 1 ;
+   if (n > 1024)
+      n = 1024 ;
+   if (n != numthreads)
+      mt_stopthreads() ;
+   numthreads = n ;
+}
+void qlifealgo::mt_startthreads() {
+   mt = new qlifethreads() ;
+   mt->n = numthreads ;
+   mt->ctx = new qthreadctx[numthreads] ;
+   for (int i=0; i<numthreads; i++)
+      mt->ctx[i].tilelist = mt->ctx[i].supertilelist =
+                            mt->ctx[i].bricklist = 0 ;
+   mt->shutdown = mt->odd = mt->remaining = 0 ;
+   mt->workers = new std::thread *[numthreads] ;
+   mt->workers[0] = 0 ;
+   for (int i=1; i<numthreads; i++)
+      mt->workers[i] = new std::thread(&qlifealgo::mt_worker, this, i) ;
+}
+void qlifealgo::mt_stopthreads() {
+   if (mt == 0)
+      return ;
+   {
+      std::lock_guard<std::mutex> g(mt->lock) ;
+      mt->shutdown = 1 ;
+   }
+   mt->workcv.notify_all() ;
+   for (int i=1; i<mt->n; i++) {
+      mt->workers[i]->join() ;
+      delete mt->workers[i] ;
+   }
+   delete [] mt->workers ;
+   delete [] mt->ctx ;
+   delete mt ;
+   mt = 0 ;
+}
+/*
+ *   Take a batch of up to 64 structures from a shared free list, or
+ *   allocate a new chunk of them if it is empty.
+ */
+linkedmem *qlifealgo::mt_refill(linkedmem *&shared, int size) {
+   std::lock_guard<std::mutex> g(mt->alloclock) ;
+   if (shared == 0)
+      return filllist(size) ;
+   linkedmem *r = shared, *p = shared ;
+   for (int i=1; i<64 && p->next; i++)
+      p = p->next ;
+   shared = p->next ;
+   p->next = 0 ;
+   return r ;
+}
+/*
+ *   Give a per-thread free list back to the shared one.
+ */
+static void giveback(linkedmem *&local, linkedmem *&shared) {
+   if (local == 0)
+      return ;
+   linkedmem *p = local ;
+   while (p->next)
+      p = p->next ;
+   p->next = shared ;
+   shared = local ;
+   local = 0 ;
+}
+void qlifealgo::mt_worker(int i) {
+   curctx = mt->ctx + i ;
+   std::unique_lock<std::mutex> lk(mt->lock) ;
+   for (;;) {
+      if (mt->shutdown)
+         return ;
+      if (mt->ready.empty()) {
+         mt->workcv.wait(lk) ;
+         continue ;
+      }
+      int t = mt->ready.front() ;
+      mt->ready.pop_front() ;
+      lk.unlock() ;
+      mt_runtask(t) ;
+      lk.lock() ;
+      mt_finishtask(t) ;
+   }
+}
+void qlifealgo::mt_runtask(int t) {
+   qtask &k = mt->tasks[t] ;
+   if (mt->odd)
+      k.ret = doquad10(k.zis, k.edge, k.par, k.cor, QLIFETASKLEV) ;
+   else
+      k.ret = doquad01(k.zis, k.edge, k.par, k.cor, QLIFETASKLEV) ;
+}
+/*
+ *   Called with the lock held:  release the tasks that were waiting
+ *   for this one.
+ */
+void qlifealgo::mt_finishtask(int t) {
+   qtask &k = mt->tasks[t] ;
+   int woke = 0 ;
+   for (int i=0; i<k.ndeps; i++)
+      if (--mt->tasks[k.deps[i]].waiting == 0) {
+         mt->ready.push_back(k.deps[i]) ;
+         woke++ ;
+      }
+   if (woke > 1)
+      mt->workcv.notify_all() ;
+   else if (woke)
+      mt->workcv.notify_one() ;
+   if (--mt->remaining == 0)
+      mt->donecv.notify_all() ;
+}
+/*
+ *   Add a task, making it wait for the tasks of the neighbors it reads.
+ */
+void qlifealgo::mt_addtask(supertile *zis, supertile *edge,
+                           supertile *par, supertile *cor, int up, int shift) {
+   int t = (int)mt->tasks.size() ;
+   qtask k ;
+   k.zis = zis ;
+   k.edge = edge ;
+   k.par = par ;
+   k.cor = cor ;
+   k.up = up ;
+   k.shift = shift ;
+   k.ret = 0 ;
+   k.waiting = 0 ;
+   k.ndeps = 0 ;
+   supertile *nb[3] = { edge, par, cor } ;
+   for (int i=0; i<3; i++) {
+      std::unordered_map<supertile *, int>::iterator it = mt->taskof.find(nb[i]) ;
+      if (it != mt->taskof.end()) {
+         qtask &d = mt->tasks[it->second] ;
+         d.deps[d.ndeps++] = t ;
+         k.waiting++ ;
+      }
+   }
+   mt->taskof[zis] = t ;
+   mt->tasks.push_back(k) ;
+}
+/*
+ *   These walk the levels above QLIFETASKLEV in the same order as
+ *   doquad01 and doquad10, making the same decisions about which
+ *   subtiles to recompute.
+ */
+void qlifealgo::mt_plan01(supertile *zis, supertile *edge,
+                          supertile *par, supertile *cor, int lev,
+                          int up, int shift) {
+   int changing = (zis->flags | (par->flags >> 19) |
+                   (((edge->flags >> 18) | (cor->flags >> 27)) & 1)) & 0xff ;
+   int x, b, me = (int)mt->uppers.size() ;
+   supertile *p, *pf, *pu, *pfu ;
+   qupper u ;
+   u.zis = zis ;
+   u.nchanging = (zis->flags & 0x3ff00) << 10 ;
+   u.up = up ;
+   u.shift = shift ;
+   mt->uppers.push_back(u) ;
+   if (changing & 1) {
+      x = 7 ;
+      b = 1 ;
+      pf = edge->d[0] ;
+      pfu = cor->d[0] ;
+   } else {
+      b = (changing & - changing) ;
+      x = 7 - ai[b] ;
+      pf = zis->d[x + 1] ;
+      pfu = par->d[x + 1] ;
+   }
+   for (;;) {
+      p = zis->d[x] ;
+      pu = par->d[x] ;
+      if (changing & b) {
+         if (zis->d[x] == nullroots[lev-1])
+            p = zis->d[x] = newsupertile(lev-1) ;
+         if (lev-1 == QLIFETASKLEV)
+            mt_addtask(p, pu, pf, pfu, me, x) ;
+         else
+            mt_plan01(p, pu, pf, pfu, lev-1, me, x) ;
+         changing -= b ;
+      } else if (changing == 0)
+         break ;
+      b <<= 1 ;
+      x-- ;
+      pfu = pu ;
+      pf = p ;
+   }
+   zis->flags = mt->uppers[me].nchanging | 0xf0000000 ;
+}
+void qlifealgo::mt_plan10(supertile *zis, supertile *edge,
+                          supertile *par, supertile *cor, int lev,
+                          int up, int shift) {
+   int changing = (zis->flags | (par->flags >> 19) |
+                   (((edge->flags >> 18) | (cor->flags >> 27)) & 1)) & 0xff ;
+   int x, b, me = (int)mt->uppers.size() ;
+   supertile *p, *pf, *pu, *pfu ;
+   qupper u ;
+   u.zis = zis ;
+   u.nchanging = (zis->flags & 0x3ff00) << 10 ;
+   u.up = up ;
+   u.shift = shift ;
+   mt->uppers.push_back(u) ;
+   if (changing & 1) {
+      x = 0 ;
+      b = 1 ;
+      pf = edge->d[7] ;
+      pfu = cor->d[7] ;
+   } else {
+      b = (changing & - changing) ;
+      x = ai[b] ;
+      pf = zis->d[x - 1] ;
+      pfu = par->d[x - 1] ;
+   }
+   for (;;) {
+      p = zis->d[x] ;
+      pu = par->d[x] ;
+      if (changing & b) {
+         if (zis->d[x] == nullroots[lev-1])
+            p = zis->d[x] = newsupertile(lev-1) ;
+         if (lev-1 == QLIFETASKLEV)
+            mt_addtask(p, pu, pf, pfu, me, 7-x) ;
+         else
+            mt_plan10(p, pu, pf, pfu, lev-1, me, 7-x) ;
+         changing -= b ;
+      } else if (changing == 0)
+         break ;
+      b <<= 1 ;
+      x++ ;
+      pfu = pu ;
+      pf = p ;
+   }
+   zis->flags = mt->uppers[me].nchanging | 0xf0000000 ;
+}
+/*
+ *   One generation on the thread pool.  The stepping thread plans the
+ *   tasks, runs tasks itself and polls while it waits for the rest,
+ *   and finally gathers the changing bits of the upper levels.
+ */
+void qlifealgo::mt_dogen() {
+   if (mt == 0)
+      mt_startthreads() ;
+   int odd = generation.odd() ;
+   mt->tasks.clear() ;
+   mt->uppers.clear() ;
+   mt->taskof.clear() ;
+   if (odd)
+      mt_plan10(root, nullroot, nullroot, nullroot, rootlev, -1, 0) ;
+   else
+      mt_plan01(root, nullroot, nullroot, nullroot, rootlev, -1, 0) ;
+   int ntasks = (int)mt->tasks.size() ;
+   {
+      std::unique_lock<std::mutex> lk(mt->lock) ;
+      mt->odd = odd ;
+      mt->remaining = ntasks ;
+      for (int t=0; t<ntasks; t++)
+         if (mt->tasks[t].waiting == 0)
+            mt->ready.push_back(t) ;
+      mt->workcv.notify_all() ;
+      curctx = mt->ctx ;
+      while (mt->remaining > 0) {
+         if (mt->ready.empty()) {
+            mt->donecv.wait_for(lk, std::chrono::milliseconds(1)) ;
+         } else {
+            int t = mt->ready.front() ;
+            mt->ready.pop_front() ;
+            lk.unlock() ;
+            mt_runtask(t) ;
+            lk.lock() ;
+            mt_finishtask(t) ;
+         }
+         lk.unlock() ;
+         poller->poll() ;
+         lk.lock() ;
+      }
+      curctx = 0 ;
+   }
+   for (int t=0; t<ntasks; t++) {
+      qtask &k = mt->tasks[t] ;
+      mt->uppers[k.up].nchanging |= k.ret << k.shift ;
+   }
+   for (int i=(int)mt->uppers.size()-1; i>=0; i--) {
+      qupper &u = mt->uppers[i] ;
+      u.zis->flags = u.nchanging | 0xf0000000 ;
+      if (u.up >= 0)
+         mt->uppers[u.up].nchanging |= upchanging(u.nchanging) << u.shift ;
+   }
+   for (int i=0; i<mt->n; i++) {
+      qthreadctx *c = mt->ctx + i ;
+      giveback(c->bricklist, bricklist) ;
+      giveback(c->tilelist, tilelist) ;
+      giveback(c->supertilelist, supertilelist) ;
+   }
+}
 /**
  *   Step.  Do increment generations.
  */
@@ -1157,12 +2029,16 @@ void qlifealgo::step() {
    while (t != 0) {
       if (qliferules.alternate_rules) {
          // emulate B0-not-Smax rule by changing rule table depending on gen parity
-         if (generation.odd())
+         if (generation.odd()) {
             ruletable = qliferules.rule1 ;
-         else
+            curslicerule = &slicerules[1] ;
+         } else {
             ruletable = qliferules.rule0 ;
+            curslicerule = &slicerules[0] ;
+         }
       } else {
          ruletable = qliferules.rule0 ;
+         curslicerule = &slicerules[0] ;
       }
       dogen() ;
       if (poller->isInterrupted())
@@ -1215,6 +2091,11 @@ const char *qlifealgo::setrule(const char *s) {
    
    // ruletable is set in step(), but play safe
    ruletable = qliferules.rule0 ;
+   curslicerule = &slicerules[0] ;
+   slicable = makeslicerule(qliferules.rule0, slicerules[0]) &&
+              (!qliferules.alternate_rules ||
+               makeslicerule(qliferules.rule1, slicerules[1])) ;
+   kernel = bestkernel() ;
    
    if (qliferules.isHexagonal())
       grid_type = HEX_GRID;
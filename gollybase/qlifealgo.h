@@ -153,6 +153,26 @@ struct supertile { /* 44 bytes */
 struct linkedmem {
    struct linkedmem *next ;
 } ;
+/*
+ *   For the bit-sliced kernels, an outer-totalistic rule is kept as a
+ *   mask per neighbor count:  all ones if a live (dead) cell with that
+ *   many neighbors is alive in the next generation, else zero.
+ */
+struct slicerule {
+   unsigned int survive[9], born[9] ;
+} ;
+/*
+ *   The optional multi-threaded generation keeps its pool, task lists
+ *   and per-thread free lists in this; it is only defined in
+ *   qlifealgo.cpp so users of this header don't need the threading
+ *   headers.
+ */
+struct qlifethreads ;
+/*
+ *   The state of a getruns or gethash walk; only defined in qlifealgo.cpp.
+ */
+struct qrunwalk ;
+struct qhashwalk ;
 /*
  *   This structure contains all of our variables that pertain to a
  *   particular universe.  (Thus, we support multiple universes.)
@@ -194,6 +214,11 @@ public:
    virtual int setcell(int x, int y, int newstate) ;
    virtual int getcell(int x, int y) ;
    virtual int nextcell(int x, int y, int &v) ;
+   virtual int getruns(const bigint &top, const bigint &left,
+                       const bigint &bottom, const bigint &right,
+                       liferunsink &sink) ;
+   virtual cellhash::value gethash(const bigint &top, const bigint &left,
+                                   const bigint &bottom, const bigint &right) ;
    // call after setcell/clearcell calls
    virtual void endofpattern() {
      // AKT: unnecessary (and prevents shrinking selection while generating)
@@ -207,8 +232,11 @@ public:
    virtual int isEmpty() ;
    // can we do the gen count doubling? only hashlife
    virtual int hyperCapable() { return 0 ; }
+   virtual int alternatingRules() { return qliferules.alternate_rules ; }
    virtual void setMaxMemory(int m) ;
    virtual int getMaxMemory() { return (int)(maxmemory >> 20) ; }
+   virtual void setNumThreads(int n) ;
+   int getNumThreads() { return numthreads ; }
    virtual const char *setrule(const char *s) ;
    virtual const char *getrule() { return qliferules.getrule() ; }
    virtual void step() ;
@@ -222,6 +250,18 @@ public:
       return "No native format for qlifealgo yet." ;
    }
    static void doInitializeAlgoInfo(staticAlgoInfo &) ;
+   /*
+    *   How p01 and p10 compute the slices of a brick:  eight lookups in
+    *   the 4x4 rule table per slice, or all eight slices at once with
+    *   bit-sliced adders, in 256-bit AVX2 registers if the CPU has them.
+    *   The bit-sliced kernels only handle outer-totalistic Moore rules.
+    *   setrule picks the fastest kernel that works for the rule;
+    *   setkernel returns false if the given one can't be used.
+    */
+   enum { QLIFETABLE, QLIFESLICE, QLIFEAVX2 } ;
+   int getkernel() { return kernel ; }
+   bool setkernel(int k) ;
+   static const char *kernelname(int k) ;
 private:
    linkedmem *filllist(int size) ;
    brick *newbrick() ;
@@ -245,12 +285,16 @@ private:
    void BlitCells(supertile *p, int xoff, int yoff, int wd, int ht, int lev) ;
    void ShrinkCells(supertile *p, int xoff, int yoff, int wd, int ht, int lev) ;
    int nextcell(int x, int y, supertile *n, int lev) ;
+   int bandruns(qrunwalk &w, int lev, G_INT64 y) ;
+   cellhash::value tilehash(qhashwalk &w, supertile *p, int lev, G_INT64 x,
+                            G_INT64 y, cellhash::value fx, cellhash::value fy) ;
    void fill_ll(int d) ;
    int lowsub(vector<supertile*> &src, vector<supertile*> &dst, int lev) ;
    int highsub(vector<supertile*> &src, vector<supertile*> &dst, int lev) ;
    void allsub(vector<supertile*> &src, vector<supertile*> &dst, int lev) ;
    int gethbitsfromleaves(vector<supertile *> v) ;
    int getvbitsfromleaves(vector<supertile *> v) ;
+   void recycle(supertile *p, int lev) ;
    supertile *markglobalchange(supertile *, int, int &) ;
    void markglobalchange() ; // call if the rule changes
    /* data elements */
@@ -267,6 +311,33 @@ private:
    int cleandowncounter ;
    g_uintptr_t maxmemory, usedmemory ;
    char *ruletable ;
+   int kernel ;
+   int slicable ;                // both rule tables are outer-totalistic Moore
+   slicerule slicerules[2] ;     // for even and odd generations, like rule0/1
+   slicerule *curslicerule ;
+   int bestkernel() ;
+   /*
+    *   Multi-threaded generations.  When numthreads is more than one,
+    *   dogen() walks the levels above QLIFETASKLEV itself, turns each
+    *   supertile at that level that needs recomputing into a task that
+    *   waits for its (up to three) already-recomputed neighbors, and
+    *   runs the tasks on a pool of threads.
+    */
+   int numthreads ;
+   qlifethreads *mt ;
+   void mt_startthreads() ;
+   void mt_stopthreads() ;
+   void mt_worker(int i) ;
+   void mt_dogen() ;
+   void mt_plan01(supertile *zis, supertile *edge,
+                  supertile *par, supertile *cor, int lev, int up, int shift) ;
+   void mt_plan10(supertile *zis, supertile *edge,
+                  supertile *par, supertile *cor, int lev, int up, int shift) ;
+   void mt_addtask(supertile *zis, supertile *edge,
+                   supertile *par, supertile *cor, int up, int shift) ;
+   void mt_runtask(int t) ;
+   void mt_finishtask(int t) ;
+   linkedmem *mt_refill(linkedmem *&shared, int size) ;
    // when drawing, these are used
    liferender *renderer ;
    viewport *view ;
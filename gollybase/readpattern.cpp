@@ -11,63 +11,241 @@
 #endif
 #include <cstdlib>
 #include <cstring>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
 
 #define LINESIZE 20000
 #define CR 13
 #define LF 10
 
-bool getedges = false;              // find pattern edges?
-bigint top, left, bottom, right;    // the pattern edges
+#ifdef ZLIB
+#define ZSTREAM ((gzFile)zinstream)
+
+// the position in the (compressed) file, for the progress dialog
+static double gzfilepos(gzFile f) {
+   #if ZLIB_VERNUM >= 0x1240
+      // gzoffset is only available in zlib 1.2.4 or later
+      return gzoffset(f);
+   #else
+      // use an approximation of file position if file is compressed
+      double filepos = gztell(f);
+      if (filepos > 0 && gzdirect(f) == 0) filepos /= 4;
+      return filepos;
+   #endif
+}
+#endif
+
+// Decompresses a gzipped file on a thread of its own, a few chunks ahead
+// of the parser.  The chunk being parsed stays put until the parser asks
+// for the next one.
+struct gzreadahead {
+#ifdef ZLIB
+   static const int CHUNKSIZE = 256 * 1024 ;
+   static const int NCHUNKS = 4 ;
+   gzreadahead(gzFile zf) : f(zf), head(0), tail(0), parsing(false),
+                            stop(false), done(false) {
+      for (int i = 0; i < NCHUNKS; i++) chunk[i].resize(CHUNKSIZE);
+      worker = std::thread(&gzreadahead::run, this);
+   }
+   ~gzreadahead() {
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         stop = true;
+      }
+      cv.notify_all();
+      worker.join();
+   }
+   void run() ;
+   // the next chunk, or false at the end of the file
+   bool next(const char **data, size_t *len, double *filepos) ;
+
+   gzFile f ;
+   std::vector<char> chunk[NCHUNKS] ;
+   size_t len[NCHUNKS] ;
+   double pos[NCHUNKS] ;               // file position after each chunk
+   unsigned int head, tail ;           // chunk being parsed, next to fill
+   bool parsing, stop, done ;
+   std::mutex mutex ;
+   std::condition_variable cv ;
+   std::thread worker ;
+#endif
+} ;
+
+#ifdef ZLIB
+void gzreadahead::run() {
+   std::unique_lock<std::mutex> lock(mutex);
+   while (!stop && !done) {
+      if (tail - head >= (unsigned int)NCHUNKS) {
+         cv.wait(lock);
+         continue;
+      }
+      int slot = tail % NCHUNKS;
+      lock.unlock();
+      int n = gzread(f, &chunk[slot][0], CHUNKSIZE);
+      double filepos = gzfilepos(f);
+      lock.lock();
+      if (n > 0) {
+         len[slot] = n;
+         pos[slot] = filepos;
+         tail++;
+      }
+      if (n < CHUNKSIZE) done = true;
+      cv.notify_all();
+   }
+}
+
+bool gzreadahead::next(const char **data, size_t *n, double *filepos) {
+   std::unique_lock<std::mutex> lock(mutex);
+   if (parsing) {
+      head++;
+      parsing = false;
+      cv.notify_all();
+   }
+   while (tail == head && !done) cv.wait(lock);
+   if (tail == head) return false;
+   int slot = head % NCHUNKS;
+   parsing = true;
+   *data = &chunk[slot][0];
+   *n = len[slot];
+   *filepos = pos[slot];
+   return true;
+}
+#endif
+
+patternreader::patternreader() :
+   showprogress(false), readahead(true), getedges(false),
+   top(0), left(0), bottom(0), right(0),
+   pattfile(0), zinstream(0), ahead(0), ownsfile(false), mem(0), buff(filebuff),
+   buffpos(0), bytesread(0), prevchar(0), ateof(true), filesize(0) {
+}
 
-#ifdef __APPLE__
-#define BUFFSIZE 4096      // 4K is best for Mac OS X
+patternreader::~patternreader() {
+   close();
+}
+
+bool patternreader::openfile(const char *filename) {
+   close();
+   FILE *f = fopen(filename, "r");
+   if (f == 0) return false;
+   fseek(f, 0L, SEEK_END);
+   filesize = ftell(f);
+#ifdef ZLIB
+   unsigned char magic[2] = { 0, 0 };
+   fseek(f, 0L, SEEK_SET);
+   bool compressed = fread(magic, 1, 2, f) == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+   fclose(f);
+   zinstream = gzopen(filename, "rb");       // rb needed on Windows
+   if (zinstream == 0) return false;
+   if (compressed && readahead) ahead = new gzreadahead(ZSTREAM);
 #else
-#define BUFFSIZE 8192      // 8K is best for Windows and other platforms???
+   fseek(f, 0L, SEEK_SET);
+   pattfile = f;
 #endif
+   ownsfile = true;
+   ateof = false;
+   return true;
+}
 
+bool patternreader::openstream(FILE *f) {
+   close();
 #ifdef ZLIB
-gzFile zinstream ;
+   // zlib reads from a duplicate descriptor so closing it leaves f open;
+   // input that isn't gzipped is passed through unchanged
+   int fd = dup(fileno(f));
+   if (fd < 0) return false;
+   zinstream = gzdopen(fd, "rb");
+   if (zinstream == 0) {
+      ::close(fd);
+      return false;
+   }
 #else
-FILE *pattfile ;
+   pattfile = f;
 #endif
+   ateof = false;
+   return true;
+}
 
-char filebuff[BUFFSIZE];
-int buffpos, bytesread, prevchar;
+void patternreader::openmemory(const char *data, size_t len) {
+   close();
+   mem = data;
+   buff = data;
+   bytesread = len;
+   filesize = (double)len;
+}
 
-long filesize;             // length of file in bytes
+void patternreader::close() {
+   // stop reading ahead before the stream goes away
+   delete ahead;
+   ahead = 0;
+#ifdef ZLIB
+   if (zinstream) gzclose(ZSTREAM);
+#endif
+   if (pattfile && ownsfile) fclose(pattfile);
+   pattfile = 0;
+   zinstream = 0;
+   ownsfile = false;
+   mem = 0;
+   buff = filebuff;
+   buffpos = bytesread = 0;
+   prevchar = 0;
+   ateof = true;
+   filesize = 0;
+}
 
-// use buffered getchar instead of slow fgetc
-// don't override the "getchar" name which is likely to be a macro
-int mgetchar() {
-   if (buffpos == BUFFSIZE) {
-      double filepos;
-      #ifdef ZLIB
-         bytesread = gzread(zinstream, filebuff, BUFFSIZE);
-         #if ZLIB_VERNUM >= 0x1240
-            // gzoffset is only available in zlib 1.2.4 or later
-            filepos = gzoffset(zinstream);
-         #else
-            // use an approximation of file position if file is compressed
-            filepos = gztell(zinstream);
-            if (filepos > 0 && gzdirect(zinstream) == 0) filepos /= 4;
-         #endif
-      #else
-         bytesread = fread(filebuff, 1, BUFFSIZE, pattfile);
-         filepos = ftell(pattfile);
-      #endif
+// refill the buffer from the stream; false at the end of the input
+bool patternreader::fill() {
+   if (ateof) return false;
+   double filepos;
+   int n;
+#ifdef ZLIB
+   if (ahead) {
       buffpos = 0;
-      lifeabortprogress(filepos / filesize, "");
+      if (!ahead->next(&buff, &bytesread, &filepos)) {
+         bytesread = 0;
+         ateof = true;
+         return false;
+      }
+      if (showprogress && filesize > 0)
+         lifeabortprogress(filepos / filesize, "");
+      return true;
    }
-   if (buffpos >= bytesread) return EOF;
-   return filebuff[buffpos++];
+   n = gzread(ZSTREAM, filebuff, BUFFSIZE);
+   filepos = gzfilepos(ZSTREAM);
+#else
+   n = (int)fread(filebuff, 1, BUFFSIZE, pattfile);
+   filepos = ftell(pattfile);
+#endif
+   buffpos = 0;
+   bytesread = n > 0 ? n : 0;
+   if (n < BUFFSIZE) ateof = true;
+   if (showprogress && filesize > 0)
+      lifeabortprogress(filepos / filesize, "");
+   return bytesread > 0;
 }
 
-// use getline instead of fgets so we can handle DOS/Mac/Unix line endings
-char *getline(char *line, int maxlinelen) {
+// use buffered getchar instead of slow fgetc
+int patternreader::mgetchar() {
+   if (buffpos >= bytesread && !fill()) return EOF;
+   return buff[buffpos++];
+}
+
+char *patternreader::getline(char *line, int maxlinelen) {
    int i = 0;
    while (i < maxlinelen) {
       int ch = mgetchar();
-      if (isaborted()) return NULL;
+      if (showprogress && isaborted()) return NULL;
       switch (ch) {
          case CR:
             prevchar = CR;
@@ -95,12 +273,37 @@ char *getline(char *line, int maxlinelen) {
    return line;
 }
 
+bool patternreader::isbinary() {
+   // this is called before any progress dialog has been started
+   bool saveprogress = showprogress;
+   showprogress = false;
+   if (buffpos >= bytesread) fill();
+   showprogress = saveprogress;
+   return bytesread - buffpos >= 8 && memcmp(buff + buffpos, MCBMAGIC, 8) == 0;
+}
+
+void patternreader::readrest(std::vector<char> &store, const char **data, size_t *len) {
+   if (mem) {
+      *data = mem + buffpos;
+      *len = bytesread - buffpos;
+      buffpos = bytesread;
+      return;
+   }
+   store.clear();
+   do {
+      store.insert(store.end(), buff + buffpos, buff + bytesread);
+      buffpos = bytesread;
+   } while (fill());
+   *data = store.empty() ? 0 : &store[0];
+   *len = store.size();
+}
+
 const char *SETCELLERROR = "Impossible; set cell error for state 1" ;
 
 // Read a text pattern like "...ooo$$$ooo" where '.', ',' and chars <= ' '
 // represent dead cells, '$' represents 10 dead cells, and all other chars
 // represent live cells.
-const char *readtextpattern(lifealgo &imp, char *line) {
+const char *readtextpattern(patternreader &reader, lifealgo &imp, char *line) {
    int x=0, y=0;
    char *p;
 
@@ -118,11 +321,11 @@ const char *readtextpattern(lifealgo &imp, char *line) {
          }
       }
       y++ ;
-      if (getedges && right.toint() < x - 1) right = x - 1;
+      if (reader.getedges && reader.right.toint() < x - 1) reader.right = x - 1;
       x = 0;
-   } while (getline(line, LINESIZE));
+   } while (reader.getline(line, LINESIZE));
 
-   if (getedges) bottom = y - 1;
+   if (reader.getedges) reader.bottom = y - 1;
    return 0 ;
 }
 
@@ -166,8 +369,38 @@ void ParseXRLELine(char *line, int *xoff, int *yoff, bool *sawpos, bigint &gen)
 /*
  *   Read an RLE pattern into given life algorithm implementation.
  */
-const char *readrle(lifealgo &imp, char *line) {
+/*
+ *   readrle collects the runs of cells and gives them to the algorithm
+ *   a batch at a time, so the hashing algorithms can build the tree in
+ *   one pass rather than going down from the root for each cell.
+ */
+class rlerunbatch {
+public:
+   rlerunbatch(lifealgo &imparg) : imp(imparg) {}
+   int add(int x, int y, int len, int state) {
+      runs.push_back(x) ;
+      runs.push_back(y) ;
+      runs.push_back(len) ;
+      runs.push_back(state) ;
+      if (runs.size() >= (1 << 18))
+         return flush() ;
+      return 0 ;
+   }
+   int flush() {
+      int r = runs.empty() ? 0 : imp.setruns(&runs[0], runs.size(), 0, 0) ;
+      runs.clear() ;
+      return r ;
+   }
+private:
+   lifealgo &imp ;
+   std::vector<int> runs ;
+} ;
+
+const char *BADRLESTATE = "Cell state out of range for this algorithm" ;
+
+const char *readrle(patternreader &reader, lifealgo &imp, char *line) {
    int n=0, x=0, y=0 ;
+   rlerunbatch batch(imp) ;
    char *p ;
    char *ruleptr;
    const char *errmsg;
@@ -180,7 +413,7 @@ const char *readrle(lifealgo &imp, char *line) {
    while (strncmp(line, "#CXRLE", 6) == 0) {
       ParseXRLELine(line, &xoff, &yoff, &sawpos, gen);
       imp.setGeneration(gen);
-      if (getline(line, LINESIZE) == NULL) return 0;
+      if (reader.getline(line, LINESIZE) == NULL) return 0;
    }
 
    do {
@@ -247,11 +480,11 @@ const char *readrle(lifealgo &imp, char *line) {
             }
          }
 
-         if (getedges) {
-            top = yoff;
-            left = xoff;
-            bottom = yoff + ht - 1;
-            right = xoff + wd - 1;
+         if (reader.getedges) {
+            reader.top = yoff;
+            reader.left = xoff;
+            reader.bottom = yoff + ht - 1;
+            reader.right = xoff + wd - 1;
          }
       } else {
          int gwd = (int)imp.gridwd;
@@ -269,7 +502,7 @@ const char *readrle(lifealgo &imp, char *line) {
                   x = 0 ;
                   y += n ;
                } else if (c == '!') {
-                  return 0;
+                  return batch.flush() < 0 ? BADRLESTATE : 0 ;
                } else if (('o' <= c && c <= 'y') || ('A' <= c && c <= 'X')) {
                   int state = -1 ;
                   if (c == 'o')
@@ -292,29 +525,28 @@ const char *readrle(lifealgo &imp, char *line) {
                   }
                   // write run of cells to grid checking cells are within any bounded grid
                   if (ght == 0 || y < ght) {
-                     while (n-- > 0) {
-                        if (gwd == 0 || x < gwd) {  
-                           if (imp.setcell(xoff + x, yoff + y, state) < 0)
-                              return "Cell state out of range for this algorithm" ;
-                        }
-                        x++;
-                     }
+                     int len = n ;
+                     if (gwd > 0 && x + len > gwd)
+                        len = gwd - x ;
+                     if (len > 0 && batch.add(xoff + x, yoff + y, len, state) < 0)
+                        return BADRLESTATE ;
                   }
+                  x += n ;
                }
                n = 0 ;
             }
          }
       }
-   } while (getline(line, LINESIZE));
+   } while (reader.getline(line, LINESIZE));
 
-   return 0;
+   return batch.flush() < 0 ? BADRLESTATE : 0 ;
 }
 
 /*
  *   This ugly bit of code will go undocumented.  It reads Alan Hensel's
  *   PC Life format, either 1.05 or 1.06.
  */
-const char *readpclife(lifealgo &imp, char *line) {
+const char *readpclife(patternreader &reader, lifealgo &imp, char *line) {
    int x=0, y=0 ;
    int leftx = x ;
    char *p ;
@@ -364,7 +596,7 @@ const char *readpclife(lifealgo &imp, char *line) {
          x = leftx ;
          y++ ;
       }
-   } while (getline(line, LINESIZE));
+   } while (reader.getline(line, LINESIZE));
 
    return 0;
 }
@@ -372,11 +604,11 @@ const char *readpclife(lifealgo &imp, char *line) {
 /*
  *   This routine reads David Bell's dblife format.
  */
-const char *readdblife(lifealgo &imp, char *line) {
+const char *readdblife(patternreader &reader, lifealgo &imp, char *line) {
    int n=0, x=0, y=0;
    char *p;
 
-   while (getline(line, LINESIZE)) {
+   while (reader.getline(line, LINESIZE)) {
       if (line[0] != '!') {
          // parse line like "23.O15.3O15.3O15.O4.4O"
          n = x = 0;
@@ -407,7 +639,7 @@ const char *readdblife(lifealgo &imp, char *line) {
 // Read Mirek Wojtowicz's MCell format.
 // See http://psoup.math.wisc.edu/mcell/ca_files_formats.html for details.
 //
-const char *readmcell(lifealgo &imp, char *line) {
+const char *readmcell(patternreader &reader, lifealgo &imp, char *line) {
    int x = 0, y = 0;
    int wd = 0, ht = 0;              // bounded if > 0
    int wrapped = 0;                 // plane if 0, torus if 1
@@ -420,7 +652,7 @@ const char *readmcell(lifealgo &imp, char *line) {
    int defwd = 0, defht = 0;        // default grid size for Larger than Life
    int Lcount = 0;                  // number of #L lines seen
 
-   while (getline(line, LINESIZE)) {
+   while (reader.getline(line, LINESIZE)) {
       if (line[0] == '#') {
          if (line[1] == 'L' && line[2] == ' ') {
             if (!sawrule) {
@@ -572,14 +804,14 @@ const char *readmcell(lifealgo &imp, char *line) {
       // shift pattern to middle of bounded grid
       imp.endofpattern();
       if (!imp.isEmpty()) {
-         imp.findedges(&top, &left, &bottom, &right);
+         imp.findedges(&reader.top, &reader.left, &reader.bottom, &reader.right);
          // pattern is currently in top left corner so shift down and right
          // (note that we add 1 to wd and ht to get same position as MCell)
-         int shiftx = (wd + 1 - (right.toint() - left.toint() + 1)) / 2;
-         int shifty = (ht + 1 - (bottom.toint() - top.toint() + 1)) / 2;
+         int shiftx = (wd + 1 - (reader.right.toint() - reader.left.toint() + 1)) / 2;
+         int shifty = (ht + 1 - (reader.bottom.toint() - reader.top.toint() + 1)) / 2;
          if (shiftx > 0 || shifty > 0) {
-            for (y = bottom.toint(); y >= top.toint(); y--) {
-               for (x = right.toint(); x >= left.toint(); x--) {
+            for (y = reader.bottom.toint(); y >= reader.top.toint(); y--) {
+               for (x = reader.right.toint(); x >= reader.left.toint(); x--) {
                   int state = imp.getcell(x, y);
                   if (state > 0) {
                      imp.setcell(x, y, 0);
@@ -643,7 +875,7 @@ static bool isplainrle(const char *line) {
    return have_digit || *end == '!';
 }
 
-const char *loadpattern(lifealgo &imp) {
+static const char *loadpattern(patternreader &reader, lifealgo &imp) {
    char line[LINESIZE + 1] ;
    const char *errmsg = 0;
 
@@ -661,167 +893,316 @@ const char *loadpattern(lifealgo &imp) {
       }
    }
 
-   if (getedges)
-      lifebeginprogress("Reading from clipboard");
-   else
-      lifebeginprogress("Reading pattern file");
+   if (reader.showprogress) {
+      if (reader.getedges)
+         lifebeginprogress("Reading from clipboard");
+      else
+         lifebeginprogress("Reading pattern file");
+   }
 
    // skip any blank lines at start to avoid problem when copying pattern
    // from Internet Explorer
-   while (getline(line, LINESIZE) && line[0] == 0) ;
+   while (reader.getline(line, LINESIZE) && line[0] == 0) ;
 
    // test for 'i' to cater for #LLAB comment in LifeLab file
    if (line[0] == '#' && line[1] == 'L' && line[2] == 'i') {
-      errmsg = readpclife(imp, line) ;
+      errmsg = readpclife(reader, imp, line) ;
       if (errmsg == 0) {
          imp.endofpattern() ;
-         if (getedges && !imp.isEmpty()) {
-            imp.findedges(&top, &left, &bottom, &right) ;
+         if (reader.getedges && !imp.isEmpty()) {
+            imp.findedges(&reader.top, &reader.left, &reader.bottom, &reader.right) ;
          }
       }
 
    } else if (line[0] == '#' && line[1] == 'P' && line[2] == ' ') {
       // WinLifeSearch creates clipboard patterns similar to
       // Life 1.05 format but without the header line
-      errmsg = readpclife(imp, line) ;
+      errmsg = readpclife(reader, imp, line) ;
       if (errmsg == 0) {
          imp.endofpattern() ;
-         if (getedges && !imp.isEmpty()) {
-            imp.findedges(&top, &left, &bottom, &right) ;
+         if (reader.getedges && !imp.isEmpty()) {
+            imp.findedges(&reader.top, &reader.left, &reader.bottom, &reader.right) ;
          }
       }
 
    } else if (line[0] == '#' && line[1] == 'M' && line[2] == 'C' &&
               line[3] == 'e' && line[4] == 'l' && line[5] == 'l' ) {
-      errmsg = readmcell(imp, line) ;
+      errmsg = readmcell(reader, imp, line) ;
       if (errmsg == 0) {
          imp.endofpattern() ;
-         if (getedges && !imp.isEmpty()) {
-            imp.findedges(&top, &left, &bottom, &right) ;
+         if (reader.getedges && !imp.isEmpty()) {
+            imp.findedges(&reader.top, &reader.left, &reader.bottom, &reader.right) ;
          }
       }
 
    } else if (line[0] == '#' || line[0] == 'x') {
-      errmsg = readrle(imp, line) ;
+      errmsg = readrle(reader, imp, line) ;
       if (errmsg == 0) {
          imp.endofpattern() ;
-         if (getedges && !imp.isEmpty()) {
+         if (reader.getedges && !imp.isEmpty()) {
             // readrle has set top,left,bottom,right based on the info given in
             // the header line and possibly a "#CXRLE Pos=..." line, but in case
             // that info is incorrect we find the true pattern edges and expand
             // top/left/bottom/right if necessary to avoid truncating the pattern
             bigint t, l, b, r ;
             imp.findedges(&t, &l, &b, &r) ;
-            if (t < top) top = t ;
-            if (l < left) left = l ;
-            if (b > bottom) bottom = b ;
-            if (r > right) right = r ;
+            if (t < reader.top) reader.top = t ;
+            if (l < reader.left) reader.left = l ;
+            if (b > reader.bottom) reader.bottom = b ;
+            if (r > reader.right) reader.right = r ;
          }
       }
 
    } else if (line[0] == '!') {
-      errmsg = readdblife(imp, line) ;
+      errmsg = readdblife(reader, imp, line) ;
       if (errmsg == 0) {
          imp.endofpattern() ;
-         if (getedges && !imp.isEmpty()) {
-            imp.findedges(&top, &left, &bottom, &right) ;
+         if (reader.getedges && !imp.isEmpty()) {
+            imp.findedges(&reader.top, &reader.left, &reader.bottom, &reader.right) ;
          }
       }
 
    } else if (line[0] == '[') {
-      errmsg = imp.readmacrocell(line) ;
+      errmsg = imp.readmacrocell(reader, line) ;
       if (errmsg == 0) {
          imp.endofpattern() ;
-         if (getedges && !imp.isEmpty()) {
-            imp.findedges(&top, &left, &bottom, &right) ;
+         if (reader.getedges && !imp.isEmpty()) {
+            imp.findedges(&reader.top, &reader.left, &reader.bottom, &reader.right) ;
          }
       }
 
    } else if (isplainrle(line)) {
-      errmsg = readrle(imp, line) ;
+      errmsg = readrle(reader, imp, line) ;
       if (errmsg == 0) {
          imp.endofpattern() ;
-         if (getedges && !imp.isEmpty()) {
-            imp.findedges(&top, &left, &bottom, &right) ;
+         if (reader.getedges && !imp.isEmpty()) {
+            imp.findedges(&reader.top, &reader.left, &reader.bottom, &reader.right) ;
          }
       }
 
    } else {
       // read a text pattern like "...ooo$$$ooo"
-      errmsg = readtextpattern(imp, line) ;
+      errmsg = readtextpattern(reader, imp, line) ;
       if (errmsg == 0) {
          imp.endofpattern() ;
          // if getedges is true then readtextpattern has set top,left,bottom,right
       }
    }
 
-   lifeendprogress();
+   if (reader.showprogress)
+      lifeendprogress();
    return errmsg ;
 }
 
+static const char *CANTOPEN = "Can't open pattern file";
+
 const char *build_err_str(const char *filename) {
    static char file_err_str[2048];
    sprintf(file_err_str, "Can't open pattern file:\n%s", filename);
    return file_err_str;
 }
 
-const char *readpattern(const char *filename, lifealgo &imp) {
-   filesize = getfilesize(filename);
+// Binary macrocell files (see mcbheader in lifealgo.h) aren't parsed a line
+// at a time; instead the whole file is mapped into memory (or decompressed
+// into it if gzipped) and handed to the algorithm.
+
+// Read the first len bytes of the (uncompressed) file; return how many we got
+// and set compressed if the file is gzipped.
+static size_t readstart(const char *filename, char *buf, size_t len, bool &compressed) {
+   size_t got = 0;
+   compressed = false;
 #ifdef ZLIB
-   zinstream = gzopen(filename, "rb") ;      // rb needed on Windows
-   if (zinstream == 0)
-      return build_err_str(filename) ;
+   gzFile f = gzopen(filename, "rb");
+   if (f == 0) return 0;
+   int n = gzread(f, buf, (unsigned int)len);
+   if (n > 0) got = n;
+   compressed = gzdirect(f) == 0;
+   gzclose(f);
 #else
-   pattfile = fopen(filename, "r") ;
-   if (pattfile == 0)
-      return build_err_str(filename) ;
+   FILE *f = fopen(filename, "rb");
+   if (f == 0) return 0;
+   got = fread(buf, 1, len, f);
+   fclose(f);
 #endif
-   buffpos = BUFFSIZE;                       // for 1st getchar call
-   prevchar = 0;                             // for 1st getline call
-   const char *errmsg = loadpattern(imp) ;
+   return got;
+}
+
+static bool isbinarymacrocell(const char *filename, bool &compressed) {
+   char magic[8];
+   return readstart(filename, magic, 8, compressed) == 8 &&
+          memcmp(magic, MCBMAGIC, 8) == 0;
+}
+
+static const char *loadbinarymacrocell(const char *filename, bool compressed,
+                                      lifealgo &imp, bool showprogress) {
+   char *data = 0;
+   size_t len = 0;
+   bool mapped = false;
+   if (compressed) {
 #ifdef ZLIB
-   gzclose(zinstream) ;
+      gzFile f = gzopen(filename, "rb");
+      if (f == 0) return CANTOPEN;
+      size_t cap = 0;
+      for (;;) {
+         if (len == cap) {
+            cap = cap ? 2 * cap : 1 << 24;
+            char *p = (char *)realloc(data, cap);
+            if (p == 0) {
+               free(data);
+               gzclose(f);
+               return "Not enough memory to load binary macrocell file!";
+            }
+            data = p;
+         }
+         unsigned int want = (unsigned int)(cap - len > (1 << 30) ? 1 << 30 : cap - len);
+         int n = gzread(f, data + len, want);
+         if (n <= 0) break;
+         len += n;
+      }
+      gzclose(f);
+#endif
+   } else {
+#ifndef _WIN32
+      int fd = open(filename, O_RDONLY);
+      if (fd < 0) return CANTOPEN;
+      struct stat st;
+      if (fstat(fd, &st) == 0 && st.st_size > 0) {
+         len = (size_t)st.st_size;
+         void *p = mmap(0, len, PROT_READ, MAP_PRIVATE, fd, 0);
+         if (p != MAP_FAILED) {
+            data = (char *)p;
+            mapped = true;
+            madvise(p, len, MADV_SEQUENTIAL);
+         }
+      }
+      close(fd);
 #else
-   fclose(pattfile) ;
+      FILE *f = fopen(filename, "rb");
+      if (f == 0) return CANTOPEN;
+      fseek(f, 0L, SEEK_END);
+      len = (size_t)ftell(f);
+      fseek(f, 0L, SEEK_SET);
+      data = (char *)malloc(len ? len : 1);
+      if (data && fread(data, 1, len, f) != len) {
+         free(data);
+         data = 0;
+      }
+      fclose(f);
 #endif
-   return errmsg ;
+   }
+   if (data == 0) return "Could not load binary macrocell file!";
+   if (showprogress) lifebeginprogress("Reading pattern file");
+   const char *errmsg = imp.readbinarymacrocell(data, len);
+   if (errmsg == 0) imp.endofpattern();
+   if (showprogress) lifeendprogress();
+#ifndef _WIN32
+   if (mapped) {
+      munmap(data, len);
+      data = 0;
+   }
+#endif
+   free(data);
+   return errmsg;
+}
+
+// Copy the comments from the header of a binary macrocell file.
+static int readbinarycomments(const char *filename, char *cptr, int maxcommlen) {
+   bool compressed;
+   mcbheader h;
+   if (readstart(filename, (char *)&h, sizeof(h), compressed) != sizeof(h) ||
+       h.order != MCBORDER || h.nlevels > 1000 || h.framecount > MAX_FRAME_COUNT)
+      return 0;
+   size_t skip = sizeof(h) + (size_t)h.nlevels * 8 + (size_t)h.framecount * 16 +
+                 (size_t)h.rulelen + h.genlen + h.startlen;
+   size_t commlen = h.commentlen;
+   if (commlen > (size_t)maxcommlen - 1) commlen = maxcommlen - 1;
+   std::vector<char> buf(skip + commlen);
+   size_t got = readstart(filename, &buf[0], buf.size(), compressed);
+   if (got <= skip) return 0;
+   memcpy(cptr, &buf[skip], got - skip);
+   return (int)(got - skip);
+}
+
+const char *readpattern(patternreader &reader, lifealgo &imp) {
+   if (!reader.isbinary())
+      return loadpattern(reader, imp);
+   // a binary macrocell file from a pipe or memory buffer
+   std::vector<char> store;
+   const char *data;
+   size_t len;
+   reader.readrest(store, &data, &len);
+   const char *errmsg = imp.readbinarymacrocell(data, len);
+   if (errmsg == 0) {
+      imp.endofpattern();
+      if (reader.getedges && !imp.isEmpty())
+         imp.findedges(&reader.top, &reader.left, &reader.bottom, &reader.right);
+   }
+   return errmsg;
+}
+
+// returns CANTOPEN if the file can't be opened
+static const char *readpatternfile(const char *filename, lifealgo &imp,
+                                   bool showprogress) {
+   bool compressed;
+   if (isbinarymacrocell(filename, compressed))
+      return loadbinarymacrocell(filename, compressed, imp, showprogress);
+   patternreader reader;
+   if (!reader.openfile(filename))
+      return CANTOPEN;
+   reader.showprogress = showprogress;
+   return readpattern(reader, imp);
+}
+
+const char *readpattern(const char *filename, lifealgo &imp) {
+   const char *errmsg = readpatternfile(filename, imp, true);
+   if (errmsg == CANTOPEN)
+      return build_err_str(filename);
+   return errmsg;
+}
+
+void readpatterns(std::vector<patternjob> &jobs, int numthreads) {
+   std::atomic<size_t> nextjob(0);
+   auto worker = [&]() {
+      for (;;) {
+         size_t i = nextjob++;
+         if (i >= jobs.size()) break;
+         patternjob &job = jobs[i];
+         // the default poller is shared by every algorithm
+         lifepoll poller;
+         lifepoll *oldpoller = job.imp->getpoll();
+         job.imp->setpoll(&poller);
+         const char *errmsg = readpatternfile(job.filename.c_str(), *job.imp, false);
+         job.imp->setpoll(oldpoller);
+         if (errmsg == CANTOPEN)
+            job.errmsg = std::string("Can't open pattern file:\n") + job.filename;
+         else
+            job.errmsg = errmsg ? errmsg : "";
+      }
+   };
+   if (numthreads > (int)jobs.size()) numthreads = (int)jobs.size();
+   std::vector<std::thread> threads;
+   for (int t = 1; t < numthreads; t++)
+      threads.push_back(std::thread(worker));
+   worker();
+   for (size_t t = 0; t < threads.size(); t++)
+      threads[t].join();
 }
 
 const char *readclipboard(const char *filename, lifealgo &imp,
                           bigint *t, bigint *l, bigint *b, bigint *r) {
-   filesize = getfilesize(filename);
-#ifdef ZLIB
-   zinstream = gzopen(filename, "rb") ;      // rb needed on Windows
-   if (zinstream == 0)
-      return "Can't open clipboard file!" ;
-#else
-   pattfile = fopen(filename, "r") ;
-   if (pattfile == 0)
+   patternreader reader;
+   if (!reader.openfile(filename))
       return "Can't open clipboard file!" ;
-#endif
-   buffpos = BUFFSIZE;                       // for 1st getchar call
-   prevchar = 0;                             // for 1st getline call
-
-   top = 0;
-   left = 0;
-   bottom = 0;
-   right = 0;
-   getedges = true;
-   const char *errmsg = loadpattern(imp);
-   getedges = false;
-   *t = top;
-   *l = left;
-   *b = bottom;
-   *r = right;
+   reader.showprogress = true;
+   reader.getedges = true;
+   const char *errmsg = readpattern(reader, imp);
+   *t = reader.top;
+   *l = reader.left;
+   *b = reader.bottom;
+   *r = reader.right;
    // make sure we return a valid rect
-   if (bottom < top) *b = top;
-   if (right < left) *r = left;
-
-#ifdef ZLIB
-   gzclose(zinstream) ;
-#else
-   fclose(pattfile) ;
-#endif
+   if (reader.bottom < reader.top) *b = reader.top;
+   if (reader.right < reader.left) *r = reader.left;
    return errmsg ;
 }
 
@@ -837,19 +1218,20 @@ const char *readcomments(const char *filename, char **commptr)
    char *cptr = *commptr;
    cptr[0] = 0;                              // safer to init to empty string
 
-   filesize = getfilesize(filename);
-#ifdef ZLIB
-   zinstream = gzopen(filename, "rb") ;      // rb needed on Windows
-   if (zinstream == 0)
-      return build_err_str(filename) ;
-#else
-   pattfile = fopen(filename, "r") ;
-   if (pattfile == 0)
+   bool compressed;
+   if (isbinarymacrocell(filename, compressed)) {
+      int commlen = readbinarycomments(filename, cptr, maxcommlen);
+      cptr[commlen] = 0;
+      return 0;
+   }
+
+   long filesize = getfilesize(filename);
+   patternreader reader;
+   reader.readahead = false;     // usually only the start is wanted
+   if (!reader.openfile(filename))
       return build_err_str(filename) ;
-#endif
+   reader.showprogress = true;
    char line[LINESIZE + 1] ;
-   buffpos = BUFFSIZE;                       // for 1st getchar call
-   prevchar = 0;                             // for 1st getline call
    int commlen = 0;
 
    // loading comments is likely to be quite fast so no real need to
@@ -859,7 +1241,7 @@ const char *readcomments(const char *filename, char **commptr)
 
    // skip any blank lines at start to avoid problem when copying pattern
    // from Internet Explorer
-   while (getline(line, LINESIZE) && line[0] == 0) ;
+   while (reader.getline(line, LINESIZE) && line[0] == 0) ;
 
    // test for 'i' to cater for #LLAB comment in LifeLab file
    if (line[0] == '#' && line[1] == 'L' && line[2] == 'i') {
@@ -877,13 +1259,13 @@ const char *readcomments(const char *filename, char **commptr)
             cptr[commlen] = '\n';      // getline strips off eol char(s)
             commlen++;
          }
-         if (getline(line, LINESIZE) == NULL) break;
+         if (reader.getline(line, LINESIZE) == NULL) break;
       }
 
    } else if (line[0] == '#' && line[1] == 'M' && line[2] == 'C' &&
               line[3] == 'e' && line[4] == 'l' && line[5] == 'l' ) {
       // extract "#D ..." lines from MCell file
-      while (getline(line, LINESIZE)) {
+      while (reader.getline(line, LINESIZE)) {
          if (line[0] != '#') break;
          if (line[1] == 'L' && line[2] == ' ') break;
          if (line[1] == 'D' && (line[2] == ' ' || line[2] == 0)) {
@@ -905,17 +1287,17 @@ const char *readcomments(const char *filename, char **commptr)
          commlen += linelen;
          cptr[commlen] = '\n';         // getline strips off eol char(s)
          commlen++;
-         if (getline(line, LINESIZE) == NULL) break;
+         if (reader.getline(line, LINESIZE) == NULL) break;
       }
       // also look for any lines after "!" but only if file is < 1MB
       // (ZLIB doesn't seem to provide a fast way to go to eof)
       if (filesize < 1024*1024) {
          bool foundexcl = false;
-         while (getline(line, LINESIZE)) {
+         while (reader.getline(line, LINESIZE)) {
             if (strrchr(line, '!')) { foundexcl = true; break; }
          }
          if (foundexcl) {
-            while (getline(line, LINESIZE)) {
+            while (reader.getline(line, LINESIZE)) {
                int linelen = (int)strlen(line);
                if (commlen + linelen + 1 > maxcommlen) break;
                strcpy(cptr + commlen, line);
@@ -935,12 +1317,12 @@ const char *readcomments(const char *filename, char **commptr)
          commlen += linelen;
          cptr[commlen] = '\n';            // getline strips off eol char(s)
          commlen++;
-         if (getline(line, LINESIZE) == NULL) break;
+         if (reader.getline(line, LINESIZE) == NULL) break;
       }
 
    } else if (line[0] == '[') {
       // extract "#C..." lines from macrocell file
-      while (getline(line, LINESIZE)) {
+      while (reader.getline(line, LINESIZE)) {
          if (line[0] != '#') break;
          if (line[1] == 'C') {
             int linelen = (int)strlen(line);
@@ -959,11 +1341,5 @@ const char *readcomments(const char *filename, char **commptr)
    lifeendprogress();
    if (commlen == maxcommlen) commlen--;
    cptr[commlen] = 0;
-
-#ifdef ZLIB
-   gzclose(zinstream) ;
-#else
-   fclose(pattfile) ;
-#endif
    return 0 ;
 }
@@ -4,7 +4,62 @@
 #ifndef READPATTERN_H
 #define READPATTERN_H
 #include "bigint.h"
+#include <cstdio>
+#include <string>
+#include <vector>
 class lifealgo ;
+struct gzreadahead ;    // defined in readpattern.cpp
+
+/*
+ *   Where a pattern is read from:  a file (which may be gzipped), an open
+ *   stream such as a pipe, or a buffer in memory.  A reader owns its buffer
+ *   and stream, so patterns can be read on several threads at once as long
+ *   as each reader has a lifealgo of its own.
+ */
+class patternreader {
+public:
+   patternreader() ;
+   ~patternreader() ;
+   bool openfile(const char *filename) ;     // false if it can't be opened
+   bool openstream(FILE *f) ;                // f is left open
+   void openmemory(const char *data, size_t len) ;
+   void close() ;
+
+   // don't use the "getchar" name which is likely to be a macro
+   int mgetchar() ;
+   // handles DOS/Mac/Unix line endings; returns NULL at the end
+   char *getline(char *line, int maxlinelen) ;
+   // does the input start with a binary macrocell header?
+   bool isbinary() ;
+   // get the rest of the input in one piece, copying it to store unless
+   // it is already in memory
+   void readrest(std::vector<char> &store, const char **data, size_t *len) ;
+
+   bool showprogress ;                 // call lifeabortprogress as we read?
+   bool readahead ;                    // decompress gzipped files on another
+                                       // thread while parsing? (set before
+                                       // openfile; the default is true)
+   bool getedges ;                     // find pattern edges?
+   bigint top, left, bottom, right ;   // the pattern edges
+private:
+   bool fill() ;
+#ifdef __APPLE__
+   static const int BUFFSIZE = 4096 ;  // 4K is best for Mac OS X
+#else
+   static const int BUFFSIZE = 8192 ;  // 8K is best for Windows and others???
+#endif
+   FILE *pattfile ;
+   void *zinstream ;                   // a gzFile when built with zlib
+   gzreadahead *ahead ;                // non-NULL if zinstream is read ahead
+   bool ownsfile ;
+   const char *mem ;                   // non-NULL if reading from memory
+   const char *buff ;                  // filebuff or mem
+   size_t buffpos, bytesread ;
+   int prevchar ;
+   bool ateof ;
+   double filesize ;                   // 0 if not known
+   char filebuff[BUFFSIZE] ;
+} ;
 
 /*
  *   Read pattern file into given life algorithm implementation.
@@ -12,9 +67,25 @@ class lifealgo ;
 const char *readpattern(const char *filename, lifealgo &imp) ;
 
 /*
- *   Get next line from current pattern file.
+ *   Read a pattern from an open reader.
+ */
+const char *readpattern(patternreader &reader, lifealgo &imp) ;
+
+/*
+ *   A pattern file for readpatterns to load.
+ */
+struct patternjob {
+   std::string filename ;
+   lifealgo *imp ;
+   std::string errmsg ;                // empty if the pattern was read
+} ;
+
+/*
+ *   Read each job's file into its own lifealgo, using up to numthreads
+ *   threads.  The algorithms must be distinct and already created (on this
+ *   thread), and no progress dialog is shown.
  */
-char *getline(char *line, int maxlinelen) ;
+void readpatterns(std::vector<patternjob> &jobs, int numthreads) ;
 
 /*
  *   Similar to readpattern but we return the pattern edges
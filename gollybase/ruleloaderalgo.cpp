@@ -165,7 +165,7 @@ const char* ruleloaderalgo::setrule(const char* s)
     }
     
     // make sure we show given rule string in final error msg (probably "File not found")
-    static std::string badrule;
+    static thread_local std::string badrule;
     badrule = err;
     badrule += "\nGiven rule: ";
     badrule += s;
@@ -209,6 +209,15 @@ state ruleloaderalgo::slowcalc(state nw, state n, state ne, state w, state c,
         return LocalRuleTree->slowcalc(nw, n, ne, w, c, e, sw, s, se);
 }
 
+void ruleloaderalgo::slowcalcblock(state *out, const state *in, int stride,
+                                   int wd, int ht)
+{
+    if (rule_type == TABLE)
+        LocalRuleTable->slowcalcblock(out, in, stride, wd, ht);
+    else // rule_type == TREE
+        LocalRuleTree->slowcalcblock(out, in, stride, wd, ht);
+}
+
 static lifealgo* creator()
 {
     return new ruleloaderalgo();
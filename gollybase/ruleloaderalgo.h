@@ -17,12 +17,17 @@ public:
     virtual ~ruleloaderalgo();
     virtual state slowcalc(state nw, state n, state ne, state w, state c,
                            state e, state sw, state s, state se);
+    virtual void slowcalcblock(state *out, const state *in, int stride,
+                               int wd, int ht);
     virtual const char* setrule(const char* s);
     virtual const char* getrule();
     virtual const char* DefaultRule();
     virtual int NumCellStates();
     static void doInitializeAlgoInfo(staticAlgoInfo &);
 
+    // the tree in use, or NULL if the current rule is a table
+    ruletreealgo* GetRuleTree() { return rule_type == TREE ? LocalRuleTree : NULL; }
+
 protected:
     
     ruletable_algo* LocalRuleTable;      // local instance of RuleTable algo
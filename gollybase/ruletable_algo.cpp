@@ -26,9 +26,9 @@ bool ruletable_algo::IsDefaultRule(const char* rulename)
     return (strcmp(rulename, DefaultRule()) == 0);
 }
 
-static FILE* static_rulefile = NULL;
-static int static_lineno = 0;
-static char static_endchar = 0;
+static thread_local FILE* static_rulefile = NULL;
+static thread_local int static_lineno = 0;
+static thread_local char static_endchar = 0;
 
 const char* ruletable_algo::LoadTable(FILE* rulefile, int lineno, char endchar, const char* s)
 {
@@ -64,7 +64,7 @@ const char* ruletable_algo::setrule(const char* s)
    if (colonptr) 
       rule_name.assign(s,colonptr);
 
-   static string ret;  // NOTE: don't initialize this statically!
+   static thread_local string ret;  // NOTE: don't initialize this statically!
    ret = LoadRuleTable(rule_name.c_str());
    if(!ret.empty())
    {
@@ -192,6 +192,85 @@ static FILE *OpenTableFile(string &rule, const char *dir, string &path)
    return fopen(path.c_str(), "rt");
 }
 
+// the compiled table for rule foo is kept in foo.tablecache in the user's
+// rules dir (never in Golly's own rules dir, which may be read-only); the
+// file records a hash of the table text so an edited table isn't matched
+static string TableCacheName(const string& rule)
+{
+   const char* dir = lifegetuserrules();
+   if (dir == 0 || dir[0] == 0)
+      return string();
+   string path = dir;
+   int istart = (int)path.size();
+   path += rule + ".tablecache";
+   // change "dangerous" characters to underscores
+   for (unsigned int i=istart; i<path.size(); i++)
+      if (path[i] == '/' || path[i] == '\\') path[i] = '_';
+   return path;
+}
+
+static const char TABLECACHE_MAGIC[8] = { 'G','o','l','T','C','0','0','1' };
+
+bool ruletable_algo::LoadTableCache(const string& filename, unsigned long long hash)
+{
+   FILE* f = fopen(filename.c_str(), "rb");
+   if (!f)
+      return false;
+   char magic[8];
+   unsigned long long filehash;
+   unsigned int header[3]; // n_states, neighborhood, number of entries
+   bool ok = fread(magic, 1, 8, f) == 8 && memcmp(magic, TABLECACHE_MAGIC, 8) == 0 &&
+             fread(&filehash, sizeof(filehash), 1, f) == 1 && filehash == hash &&
+             fread(header, sizeof(header), 1, f) == 1 &&
+             header[0] >= 2 && header[0] <= 256 && header[1] < N_SUPPORTED_NEIGHBORHOODS;
+   vector<state> table;
+   if (ok) {
+      table.resize(header[2]);
+      ok = table.size() > 0 && fread(&table[0], 1, table.size(), f) == table.size();
+   }
+   fclose(f);
+   if (!ok || table.size() != TableSize((TNeighborhood)header[1], header[0]))
+      return false;
+
+   this->neighborhood = (TNeighborhood)header[1];
+   this->n_states = header[0];
+   switch (this->neighborhood) {
+      case vonNeumann: grid_type = VN_GRID; break;
+      case Moore: grid_type = SQUARE_GRID; break;
+      case hexagonal: grid_type = HEX_GRID; break;
+      case oneDimensional: grid_type = SQUARE_GRID; break;
+   }
+   // no transitions are needed when every neighborhood is in the table
+   this->lut.clear();
+   this->output.clear();
+   this->n_compressed_rules = 0;
+   this->direct.swap(table);
+   this->memokey.clear();
+   this->memoout.clear();
+   return true;
+}
+
+void ruletable_algo::SaveTableCache(const string& filename, unsigned long long hash)
+{
+   // failing to write the cache (eg. a read-only rules folder) is harmless;
+   // write a private copy first so a table being loaded on another thread
+   // never sees a partly written cache
+   char suffix[32];
+   sprintf(suffix, ".%p.tmp", (void*)this);
+   string tmpname = filename + suffix;
+   FILE* f = fopen(tmpname.c_str(), "wb");
+   if (!f)
+      return;
+   unsigned int header[3] = { this->n_states, (unsigned int)this->neighborhood,
+                              (unsigned int)this->direct.size() };
+   bool ok = fwrite(TABLECACHE_MAGIC, 1, 8, f) == 8 &&
+             fwrite(&hash, sizeof(hash), 1, f) == 1 &&
+             fwrite(header, sizeof(header), 1, f) == 1 &&
+             fwrite(&this->direct[0], 1, this->direct.size(), f) == this->direct.size();
+   if (fclose(f) != 0 || !ok || rename(tmpname.c_str(), filename.c_str()) != 0)
+      remove(tmpname.c_str());
+}
+
 string ruletable_algo::LoadRuleTable(string rule)
 {
    const string comment_keyword = "#";
@@ -219,6 +298,7 @@ string ruletable_algo::LoadRuleTable(string rule)
    linereader line_reader(0);
    int lineno = 0;
    string full_filename;
+   string cache_filename;
    
    bool isDefaultRule = IsDefaultRule(rule.c_str());
    if (isDefaultRule) {
@@ -239,6 +319,33 @@ string ruletable_algo::LoadRuleTable(string rule)
       line_reader.setfile(in);
       line_reader.setcloseonfree(); // make sure it goes away if we return with an error
    }
+   if (!isDefaultRule)
+      cache_filename = TableCacheName(rule);
+
+   // read the whole table first so we can check for a compiled copy
+   double start_time = gollySecondCount();
+   vector<string> lines;
+   int first_lineno = lineno;
+   unsigned long long text_hash = 14695981039346656037ULL; // FNV-1a
+   for (;;)
+   {
+      if (isDefaultRule) {
+         if (defaultRuleData[lines.size()] == 0)
+            break;
+         line = defaultRuleData[lines.size()];
+      } else {
+         if (!line_reader.fgets(line_buffer,MAX_LINE_LEN))
+            break;
+         if (static_rulefile && line_buffer[0] == static_endchar)
+            break;
+         line = line_buffer;
+      }
+      lines.push_back(line);
+      for (unsigned int i=0; i<=line.size(); i++)
+         text_hash = (text_hash ^ (unsigned char)line.c_str()[i]) * 1099511628211ULL;
+   }
+   if (!cache_filename.empty() && LoadTableCache(cache_filename, text_hash))
+      return string(""); // success
 
    string symmetries = "rotate4"; // default
    TNeighborhood neighborhood = vonNeumann;  // default
@@ -250,19 +357,10 @@ string ruletable_algo::LoadRuleTable(string rule)
    // these line must have been read before the rest of the file
    bool n_states_parsed=false,neighborhood_parsed=false,symmetries_parsed=false;
 
-   for (;;) 
+   lineno = first_lineno;
+   for (unsigned int iLine=0; iLine<lines.size(); iLine++)
    {
-      if (isDefaultRule) {
-         if (defaultRuleData[lineno] == 0)
-            break;
-         line = defaultRuleData[lineno];
-      } else {
-         if (!line_reader.fgets(line_buffer,MAX_LINE_LEN))
-            break;
-         if (static_rulefile && line_buffer[0] == static_endchar)
-            break;
-         line = line_buffer;
-      }
+      line = lines[iLine];
       lineno++;
       // snip off any trailing comment
       if(line.find('#')!=string::npos)
@@ -539,6 +637,12 @@ string ruletable_algo::LoadRuleTable(string rule)
    this->neighborhood = neighborhood;
    this->n_states = n_states;
    PackTransitions(symmetries,n_inputs,transition_table);
+   CompileTable();
+
+   // only worth keeping if it took a noticeable time to build
+   if (!cache_filename.empty() && !this->direct.empty() &&
+       gollySecondCount() - start_time > 0.1)
+      SaveTableCache(cache_filename, text_hash);
 
    return string(""); // success
 }
@@ -689,9 +793,153 @@ ruletable_algo::~ruletable_algo()
 {
 }
 
+// --- the compiled table ---
+
+// limits on the compiled forms of the transitions
+static const unsigned long long MAXDIRECTENTRIES = 1 << 24;
+static const int MEMOBITS = 16;
+
+int ruletable_algo::NumInputs(TNeighborhood nbhd)
+{
+   switch (nbhd) {
+      case vonNeumann: return 5;
+      case Moore: return 9;
+      case hexagonal: return 7;
+      case oneDimensional: return 3;
+   }
+   return 0;
+}
+
+// the number of neighborhoods, or 0 if there are too many for a direct table
+unsigned long long ruletable_algo::TableSize(TNeighborhood nbhd, unsigned int ns)
+{
+   unsigned long long size = 1;
+   for (int i=0; i<NumInputs(nbhd); i++) {
+      size *= ns;
+      if (size > MAXDIRECTENTRIES)
+         return 0;
+   }
+   return size;
+}
+
+// the mixed-radix index of a neighborhood, ordered so that slowcalcblock
+// can share the codes of whole columns between adjacent cells
+inline unsigned long long ruletable_algo::Index(TNeighborhood nbhd, unsigned long long ns,
+                        state nw, state n, state ne, state w, state c, state e,
+                        state sw, state s, state se)
+{
+   switch (nbhd) {
+      case vonNeumann: return (((w*ns + n)*ns + c)*ns + s)*ns + e;
+      case Moore: return (((((((nw*ns + w)*ns + sw)*ns + n)*ns + c)*ns + s)*ns + ne)*ns + e)*ns + se;
+      case hexagonal: return (((((nw*ns + n)*ns + w)*ns + c)*ns + e)*ns + s)*ns + se;
+      case oneDimensional: return (w*ns + c)*ns + e;
+   }
+   return 0;
+}
+
+// expand the transitions into a table holding the output for every
+// neighborhood if it fits; otherwise fall back to a memo of matches
+void ruletable_algo::CompileTable()
+{
+   this->direct.clear();
+   this->memokey.clear();
+   this->memoout.clear();
+   int n_inputs = NumInputs(this->neighborhood);
+   unsigned long long size = TableSize(this->neighborhood, this->n_states);
+   if (size == 0) {
+      // a memo needs keys below ~0ULL (the empty marker)
+      unsigned long long keys = 1;
+      for (int i=0; i<n_inputs; i++) {
+         if (keys > (1ULL << 63) / this->n_states)
+            return;
+         keys *= this->n_states;
+      }
+      this->memokey.assign(1 << MEMOBITS, ~0ULL);
+      this->memoout.assign(1 << MEMOBITS, 0);
+      return;
+   }
+
+   // the power of n_states each lut input has in Index()
+   static const int moore_powers[9] = { 4, 5, 2, 1, 0, 3, 6, 7, 8 }; // c,n,ne,e,se,s,sw,w,nw
+   static const int vn_powers[5] = { 2, 3, 0, 1, 4 };                 // c,n,e,s,w
+   static const int hex_powers[7] = { 3, 5, 2, 0, 1, 4, 6 };          // c,n,e,se,s,w,nw
+   static const int oned_powers[3] = { 1, 2, 0 };                     // c,w,e
+   const int* powers = oned_powers;
+   switch (this->neighborhood) {
+      case vonNeumann: powers = vn_powers; break;
+      case Moore: powers = moore_powers; break;
+      case hexagonal: powers = hex_powers; break;
+      case oneDimensional: powers = oned_powers; break;
+   }
+   unsigned long long weight[9];
+   for (int i=0; i<n_inputs; i++) {
+      weight[i] = 1;
+      for (int j=0; j<powers[i]; j++)
+         weight[i] *= this->n_states;
+   }
+
+   // neighborhoods that match no transition keep their center state
+   this->direct.resize((size_t)size);
+   for (unsigned long long i=0; i<size; i++)
+      this->direct[(size_t)i] = (state)((i / weight[0]) % this->n_states);
+
+   vector< vector<TMatch> > active(n_inputs+1);
+   for (unsigned int iRuleC=0; iRuleC<this->n_compressed_rules; iRuleC++)
+      active[0].push_back(TMatch(iRuleC, ~(TBits)0));
+   if (!active[0].empty())
+      FillTable(0, 0, n_inputs, weight, active);
+}
+
+// fix the value of input i and recurse, keeping only the compressed rules
+// that can still match; whole subtrees with no match are skipped
+void ruletable_algo::FillTable(int i, unsigned long long index, int n_inputs,
+                               const unsigned long long* weight, vector< vector<TMatch> >& active)
+{
+   if (i == n_inputs) {
+      // the first matching rule wins, just as in MatchTransitions
+      const TMatch& first = active[i][0];
+      unsigned int iBit = 0;
+      while (!((first.second >> iBit) & 1))
+         ++iBit;
+      this->direct[(size_t)index] = this->output[ first.first*sizeof(TBits)*8 + iBit ];
+      return;
+   }
+   for (unsigned int v=0; v<this->n_states; v++) {
+      const vector<TBits>& lutv = this->lut[i][v];
+      vector<TMatch>& next = active[i+1];
+      next.clear();
+      for (unsigned int k=0; k<active[i].size(); k++) {
+         TBits is_match = active[i][k].second & lutv[active[i][k].first];
+         if (is_match)
+            next.push_back(TMatch(active[i][k].first, is_match));
+      }
+      if (!next.empty())
+         FillTable(i+1, index + v*weight[i], n_inputs, weight, active);
+   }
+}
+
 // --- the update function ---
 state ruletable_algo::slowcalc(state nw, state n, state ne, state w, state c, state e,
                         state sw, state s, state se) 
+{
+   if (!this->direct.empty())
+      return this->direct[(size_t)Index(this->neighborhood, this->n_states,
+                                        nw, n, ne, w, c, e, sw, s, se)];
+   if (this->memokey.empty())
+      return MatchTransitions(nw, n, ne, w, c, e, sw, s, se);
+   unsigned long long key = Index(this->neighborhood, this->n_states,
+                                  nw, n, ne, w, c, e, sw, s, se);
+   unsigned int slot = (unsigned int)((key * 0x9E3779B97F4A7C15ULL) >> (64 - MEMOBITS));
+   if (this->memokey[slot] != key) {
+      this->memokey[slot] = key;
+      this->memoout[slot] = MatchTransitions(nw, n, ne, w, c, e, sw, s, se);
+   }
+   return this->memoout[slot];
+}
+
+// scan the transitions in order for the first one that matches
+state ruletable_algo::MatchTransitions(state nw, state n, state ne, state w, state c, state e,
+                        state sw, state s, state se) 
 {
    TBits is_match = 0;  // AKT: explicitly initialized to avoid gcc warning
 
@@ -804,6 +1052,34 @@ state ruletable_algo::slowcalc(state nw, state n, state ne, state w, state c, st
    return c; // default: no change
 }
 
+void ruletable_algo::slowcalcblock(state *out, const state *in, int stride,
+                                   int wd, int ht)
+{
+   const int MAXW = 256;
+   if (this->direct.empty() || wd > MAXW ||
+       (this->neighborhood != Moore && this->neighborhood != vonNeumann)) {
+      ghslowcalcblock(this, out, in, stride, wd, ht);
+      return;
+   }
+   // adjacent cells share two of their three columns
+   const state *td = &this->direct[0];
+   unsigned int ns = this->n_states, ns3 = ns*ns*ns, ns6 = ns3*ns3;
+   unsigned int col[MAXW+2];
+   for (int y=0; y<ht; y++) {
+      const state *p = in + y * stride;
+      state *q = out + y * stride;
+      for (int x=0; x<wd+2; x++)
+         col[x] = (p[x]*ns + p[stride+x])*ns + p[2*stride+x];
+      if (this->neighborhood == vonNeumann) {
+         for (int x=0; x<wd; x++)
+            q[x] = td[(p[stride+x]*ns3 + col[x+1])*ns + p[stride+x+2]];
+      } else {
+         for (int x=0; x<wd; x++)
+            q[x] = td[col[x]*ns6 + col[x+1]*ns3 + col[x+2]];
+      }
+   }
+}
+
 static lifealgo *creator() { return new ruletable_algo(); }
 
 void ruletable_algo::doInitializeAlgoInfo(staticAlgoInfo &ai) 
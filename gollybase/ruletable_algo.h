@@ -18,6 +18,8 @@ public:
    virtual ~ruletable_algo() ;
    virtual state slowcalc(state nw, state n, state ne, state w, state c,
                           state e, state sw, state s, state se) ;
+   virtual void slowcalcblock(state *out, const state *in, int stride,
+                              int wd, int ht) ;
    virtual const char* setrule(const char* s) ;
    virtual const char* getrule() ;
    virtual const char* DefaultRule() ;
@@ -34,6 +36,11 @@ protected:
    void PackTransitions(const std::string& symmetries, int n_inputs, 
                         const std::vector< std::pair< std::vector< std::vector<state> >, state> > & transition_table);
    void PackTransition(const std::vector< std::vector<state> > & inputs, state output);
+   state MatchTransitions(state nw, state n, state ne, state w, state c,
+                          state e, state sw, state s, state se);
+   void CompileTable();
+   bool LoadTableCache(const std::string& filename, unsigned long long hash);
+   void SaveTableCache(const std::string& filename, unsigned long long hash);
                         
 protected:
 
@@ -49,5 +56,19 @@ protected:
    unsigned int n_compressed_rules;
    std::vector<state> output; // state output[n_rules];
 
+   // the compiled transitions: the output for every neighborhood (indexed
+   // by Index) when that fits, otherwise a direct-mapped memo of matches
+   std::vector<state> direct;
+   std::vector<unsigned long long> memokey;
+   std::vector<state> memoout;
+   typedef std::pair<unsigned int, TBits> TMatch; // compressed rule, bits still matching
+   void FillTable(int i, unsigned long long index, int n_inputs,
+                  const unsigned long long* weight, std::vector< std::vector<TMatch> >& active);
+   static int NumInputs(TNeighborhood nbhd);
+   static unsigned long long TableSize(TNeighborhood nbhd, unsigned int ns);
+   static unsigned long long Index(TNeighborhood nbhd, unsigned long long ns,
+                                   state nw, state n, state ne, state w, state c,
+                                   state e, state sw, state s, state se);
+
 };
 #endif
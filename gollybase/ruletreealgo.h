@@ -13,6 +13,8 @@ public:
    virtual ~ruletreealgo() ;
    virtual state slowcalc(state nw, state n, state ne, state w, state c,
                           state e, state sw, state s, state se) ;
+   virtual void slowcalcblock(state *out, const state *in, int stride,
+                              int wd, int ht) ;
    virtual const char* setrule(const char* s) ;
    virtual const char* getrule() ;
    virtual const char* DefaultRule() ;
@@ -23,10 +25,27 @@ public:
    bool IsDefaultRule(const char* rulename);
    const char* LoadTree(FILE* rulefile, int lineno, char endchar, const char* s);
 
+   // how slowcalc evaluates the tree:  by walking it one neighbor at a
+   // time, through tables indexed by pairs of neighbors, or through one
+   // table indexed by the whole neighborhood.  setrule picks the fastest
+   // one that fits in memory; setkernel builds the tables if needed and
+   // returns false if they would be too large for this rule.
+   enum { TREEWALK, TREEPAIRS, TREEDIRECT } ;
+   int getkernel() { return kernel ; }
+   bool setkernel(int k) ;
+   static const char *kernelname(int k) ;
+
 private:
    int *a, base ;
    state *b ;
-   int num_neighbors, num_states, num_nodes ;
+   int num_neighbors, num_states, num_nodes, asize ;
+   int kernel ;
+   int *pairs, pairbase ;      // TREEPAIRS:  ns*ns entries per node
+   state *direct ;             // TREEDIRECT:  ns^(num_neighbors+1) states
+   void compiletree() ;
+   bool compilepairs() ;
+   int compilepairs(int node, int lev, vector<int> &memo, vector<int> &pr) ;
+   bool compiledirect() ;
    char rule[MAXRULESIZE] ;
 };
 #endif
@@ -0,0 +1,463 @@
+// This file is part of Golly.
+// See docs/License.html for the copyright notice.
+
+#include "soupcensus.h"
+#include "periodfinder.h"
+#include "lifepoll.h"
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+using namespace std ;
+typedef pair<G_INT64, G_INT64> cellxy ;
+void soupcensus::sha256(const unsigned char *data, size_t len,
+                        unsigned char digest[32]) {
+   static const unsigned int k[64] = {
+      0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+      0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+      0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+      0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+      0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+      0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+      0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+      0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+      0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+      0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+      0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 } ;
+   unsigned int h[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                         0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 } ;
+   // the message, a 1 bit, zeros, and the length in bits
+   vector<unsigned char> m(data, data + len) ;
+   m.push_back(0x80) ;
+   while (m.size() % 64 != 56)
+      m.push_back(0) ;
+   unsigned long long bits = (unsigned long long)len * 8 ;
+   for (int i=7; i>=0; i--)
+      m.push_back((unsigned char)(bits >> (8 * i))) ;
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+   for (size_t off=0; off<m.size(); off+=64) {
+      unsigned int w[64] ;
+      for (int i=0; i<16; i++)
+         w[i] = (m[off+4*i] << 24) | (m[off+4*i+1] << 16) |
+                (m[off+4*i+2] << 8) | m[off+4*i+3] ;
+      for (int i=16; i<64; i++) {
+         unsigned int s0 = ROTR(w[i-15], 7) ^ ROTR(w[i-15], 18) ^ (w[i-15] >> 3) ;
+         unsigned int s1 = ROTR(w[i-2], 17) ^ ROTR(w[i-2], 19) ^ (w[i-2] >> 10) ;
+         w[i] = w[i-16] + s0 + w[i-7] + s1 ;
+      }
+      unsigned int a = h[0], b = h[1], c = h[2], d = h[3] ;
+      unsigned int e = h[4], f = h[5], g = h[6], hh = h[7] ;
+      for (int i=0; i<64; i++) {
+         unsigned int t1 = hh + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) +
+                           ((e & f) ^ (~e & g)) + k[i] + w[i] ;
+         unsigned int t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) +
+                           ((a & b) ^ (a & c) ^ (b & c)) ;
+         hh = g ;
+         g = f ;
+         f = e ;
+         e = d + t1 ;
+         d = c ;
+         c = b ;
+         b = a ;
+         a = t1 + t2 ;
+      }
+      h[0] += a ; h[1] += b ; h[2] += c ; h[3] += d ;
+      h[4] += e ; h[5] += f ; h[6] += g ; h[7] += hh ;
+   }
+#undef ROTR
+   for (int i=0; i<32; i++)
+      digest[i] = (unsigned char)(h[i >> 2] >> (24 - 8 * (i & 3))) ;
+}
+void soupcensus::makesoup(const string &seed, G_INT64 n) {
+   char num[32] ;
+   sprintf(num, "%lld", (long long)n) ;
+   string s = seed + num ;
+   unsigned char d[32] ;
+   sha256((const unsigned char *)s.data(), s.size(), d) ;
+   soup.clearall() ;
+   // each pair of bytes is a row, most significant bit at the left
+   for (int j=0; j<32; j++)
+      for (int b=0; b<8; b++)
+         if (d[j] & (1 << (7 - b)))
+            soup.setcell(b + 8 * (j & 1), j >> 1, 1) ;
+   soup.endofpattern() ;
+}
+/*
+ *   Collects live cells at their absolute positions.
+ */
+class cellsink : public liferunsink {
+public:
+   cellsink(vector<cellxy> &cellsarg, G_INT64 leftarg, G_INT64 toparg) :
+      cells(cellsarg), left(leftarg), top(toparg) {}
+   virtual int run(G_INT64 x, G_INT64 y, G_INT64 len, int) {
+      for (G_INT64 i=0; i<len; i++)
+         cells.push_back(cellxy(left + x + i, top + y)) ;
+      return 0 ;
+   }
+   vector<cellxy> &cells ;
+   G_INT64 left, top ;
+} ;
+static void getallcells(lifealgo &algo, vector<cellxy> &cells) {
+   cells.clear() ;
+   if (algo.isEmpty())
+      return ;
+   bigint t, l, b, r ;
+   algo.findedges(&t, &l, &b, &r) ;
+   cellsink sink(cells, l.toint64(), t.toint64()) ;
+   algo.getruns(t, l, b, r, sink) ;
+}
+/*
+ *   Fills a grid with the live cells, relative to the top left of the
+ *   rectangle given to getruns.
+ */
+class gridsink : public liferunsink {
+public:
+   gridsink(vector<unsigned char> &gridarg, int wdarg) :
+      grid(gridarg), wd(wdarg) {}
+   virtual int run(G_INT64 x, G_INT64 y, G_INT64 len, int) {
+      memset(&grid[(size_t)(y * wd + x)], 1, (size_t)len) ;
+      return 0 ;
+   }
+   vector<unsigned char> &grid ;
+   int wd ;
+} ;
+static void tallyone(censustally &tally, const string &code, G_INT64 n) {
+   censustally::iterator it = tally.find(code) ;
+   if (it == tally.end()) {
+      censusentry e = { 1, n } ;
+      tally[code] = e ;
+   } else {
+      it->second.count++ ;
+      if (n < it->second.firstsoup)
+         it->second.firstsoup = n ;
+   }
+}
+void soupcensus::merge(censustally &into, const censustally &from) {
+   for (censustally::const_iterator it=from.begin(); it!=from.end(); ++it) {
+      censustally::iterator there = into.find(it->first) ;
+      if (there == into.end()) {
+         into[it->first] = it->second ;
+      } else {
+         there->second.count += it->second.count ;
+         if (it->second.firstsoup < there->second.firstsoup)
+            there->second.firstsoup = it->second.firstsoup ;
+      }
+   }
+}
+static int advance(lifealgo &algo, int n) {
+   algo.setIncrement(n) ;
+   algo.step() ;
+   return !algo.getpoll()->isInterrupted() ;
+}
+/*
+ *   One orientation of a grid in apgsearch's extended Wechsler format:
+ *   strips 5 cells deep, each column of a strip a base-32 digit, with
+ *   runs of empty columns shortened and strips separated by z.  Cell
+ *   (u, along the strip; v, across it) is at x = ox + a*u + b*v,
+ *   y = oy + c*u + d*v in the grid.
+ */
+static string wechsler(const vector<unsigned char> &grid, int wd, int ht,
+                       int length, int breadth, int ox, int oy,
+                       int a, int b, int c, int d) {
+   static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz" ;
+   string s ;
+   for (int strip=0; strip<breadth; strip+=5) {
+      if (strip)
+         s += 'z' ;
+      int zeros = 0 ;
+      for (int u=0; u<length; u++) {
+         int digit = 0 ;
+         for (int w=0; w<5; w++) {
+            int v = strip + w ;
+            if (v < breadth) {
+               int x = ox + a * u + b * v ;
+               int y = oy + c * u + d * v ;
+               if (x >= 0 && x < wd && y >= 0 && y < ht && grid[y * wd + x])
+                  digit |= 1 << w ;
+            }
+         }
+         if (digit == 0) {
+            zeros++ ;
+            continue ;
+         }
+         for (; zeros > 39; zeros -= 39)
+            s += "yz" ;
+         if (zeros == 1)
+            s += '0' ;
+         else if (zeros == 2)
+            s += 'w' ;
+         else if (zeros == 3)
+            s += 'x' ;
+         else if (zeros > 3) {
+            s += 'y' ;
+            s += digits[zeros - 4] ;
+         }
+         zeros = 0 ;
+         s += digits[digit] ;
+      }
+   }
+   return s ;
+}
+// apgsearch prefers the shortest code, then the first in ASCII order
+static int better(const string &a, const string &b) {
+   if (b.empty())
+      return 1 ;
+   if (a.size() != b.size())
+      return a.size() < b.size() ;
+   return a < b ;
+}
+string soupcensus::apgcode(int period, const bigint &dx, const bigint &dy) {
+   string prefix ;
+   char buf[32] ;
+   if (dx != 0 || dy != 0)
+      sprintf(buf, "q%d", period) ;
+   else if (period > 1)
+      sprintf(buf, "p%d", period) ;
+   else
+      sprintf(buf, "s%s", scratch.getPopulation().tostring('\0')) ;
+   prefix = buf ;
+   // B0 rules are only right way round in even generations
+   int stride = scratch.alternatingRules() ? 2 : 1 ;
+   string best ;
+   vector<unsigned char> grid ;
+   for (int t=0; t<period; t+=stride) {
+      if (t > 0) {
+         scratch.setIncrement(stride) ;
+         scratch.step() ;
+      }
+      if (scratch.isEmpty())
+         continue ;
+      bigint top, left, bottom, right ;
+      scratch.findedges(&top, &left, &bottom, &right) ;
+      bigint bwd = right, bht = bottom ;
+      bwd -= left ;
+      bht -= top ;
+      if (bwd >= 40 || bht >= 40)
+         continue ;
+      int wd = bwd.toint() + 1, ht = bht.toint() + 1 ;
+      grid.assign(wd * ht, 0) ;
+      gridsink sink(grid, wd) ;
+      scratch.getruns(top, left, bottom, right, sink) ;
+      const int orient[8][8] = {
+         { wd, ht, 0, 0, 1, 0, 0, 1 },
+         { wd, ht, wd-1, 0, -1, 0, 0, 1 },
+         { wd, ht, 0, ht-1, 1, 0, 0, -1 },
+         { wd, ht, wd-1, ht-1, -1, 0, 0, -1 },
+         { ht, wd, 0, 0, 0, 1, 1, 0 },
+         { ht, wd, wd-1, 0, 0, -1, 1, 0 },
+         { ht, wd, 0, ht-1, 0, 1, -1, 0 },
+         { ht, wd, wd-1, ht-1, 0, -1, -1, 0 } } ;
+      for (int i=0; i<8; i++) {
+         const int *o = orient[i] ;
+         string s = wechsler(grid, wd, ht, o[0], o[1], o[2], o[3],
+                             o[4], o[5], o[6], o[7]) ;
+         if (better(s, best))
+            best = s ;
+      }
+   }
+   if (period > 1) {
+      // back to the phase it started in
+      scratch.setIncrement(stride) ;
+      scratch.step() ;
+   }
+   if (best.empty())
+      return "ov_" + prefix ;      // too big in every phase
+   return "x" + prefix + "_" + best ;
+}
+void soupcensus::load(const vector<cellxy> &cells) {
+   G_INT64 minx = cells[0].first, miny = cells[0].second ;
+   for (size_t i=1; i<cells.size(); i++) {
+      if (cells[i].first < minx)
+         minx = cells[i].first ;
+      if (cells[i].second < miny)
+         miny = cells[i].second ;
+   }
+   scratch.clearall() ;
+   for (size_t i=0; i<cells.size(); i++)
+      scratch.setcell((int)(cells[i].first - minx),
+                      (int)(cells[i].second - miny), 1) ;
+   scratch.endofpattern() ;
+}
+/*
+ *   Run a lone object in the scratch universe; 0 if it doesn't repeat
+ *   from its first generation within maxperiod generations.
+ */
+int soupcensus::classify(const vector<cellxy> &cells, string &code,
+                         int &period) {
+   load(cells) ;
+   periodfinder finder(scratch) ;
+   finder.jumpahead = 0 ;
+   if (!finder.find(maxperiod) || finder.start != 0)
+      return 0 ;
+   period = finder.period.toint() ;
+   code = apgcode(period, finder.dx, finder.dy) ;
+   return 1 ;
+}
+/*
+ *   Add the populations of the next n generations of the cells to pops.
+ */
+void soupcensus::addpops(const vector<cellxy> &cells, int n,
+                         vector<G_INT64> &pops) {
+   load(cells) ;
+   scratch.setIncrement(1) ;
+   pops.resize(n, 0) ;
+   for (int t=0; t<n; t++) {
+      scratch.step() ;
+      pops[t] += scratch.getPopulation().toint64() ;
+   }
+}
+static size_t findroot(vector<size_t> &parent, size_t i) {
+   while (parent[i] != i)
+      i = parent[i] = parent[parent[i]] ;
+   return i ;
+}
+static G_INT64 gcd64(G_INT64 a, G_INT64 b) {
+   while (b) {
+      G_INT64 t = a % b ;
+      a = b ;
+      b = t ;
+   }
+   return a ;
+}
+/*
+ *   Classify a cluster, as the pieces it is made of if those are
+ *   settled objects that leave each other alone.  They are taken to
+ *   leave each other alone if the population of the whole is the sum of
+ *   theirs for as long as it takes them all to repeat.
+ */
+int soupcensus::classifycluster(const vector<vector<cellxy> > &pieces,
+                                vector<string> &objects) {
+   vector<string> codes(pieces.size()) ;
+   G_INT64 cycle = 1 ;
+   int apart = pieces.size() > 1 ;
+   for (size_t i=0; apart && i<pieces.size(); i++) {
+      int period ;
+      if (!classify(pieces[i], codes[i], period))
+         apart = 0 ;
+      else
+         cycle = cycle / gcd64(cycle, period) * period ;
+   }
+   vector<cellxy> whole ;
+   for (size_t i=0; i<pieces.size(); i++)
+      whole.insert(whole.end(), pieces[i].begin(), pieces[i].end()) ;
+   if (apart) {
+      int n = (int)(cycle < maxperiod ? cycle : maxperiod) ;
+      vector<G_INT64> sum, all ;
+      for (size_t i=0; i<pieces.size(); i++)
+         addpops(pieces[i], n, sum) ;
+      addpops(whole, n, all) ;
+      if (sum == all) {
+         objects.insert(objects.end(), codes.begin(), codes.end()) ;
+         return 1 ;
+      }
+   }
+   string code ;
+   int period ;
+   if (!classify(whole, code, period))
+      return 0 ;
+   objects.push_back(code) ;
+   return 1 ;
+}
+static inline unsigned long long cellkey(G_INT64 x, G_INT64 y) {
+   return ((unsigned long long)(unsigned int)x << 32) | (unsigned int)y ;
+}
+/*
+ *   Run the soup on through a window of generations and group the cells
+ *   live over the last period of the population into clusters of cells
+ *   within two of each other (so cells that share a neighbor are never
+ *   split up), and each cluster into 8-connected pieces; then classify
+ *   the cells each cluster has at the end.  Returns 0 if some cluster
+ *   isn't a settled object.
+ */
+int soupcensus::separate(vector<string> &objects) {
+   const int window = 60 ;
+   int stride = soup.alternatingRules() ? 2 : 1 ;
+   vector<vector<cellxy> > gens(window + 1) ;
+   getallcells(soup, gens[0]) ;
+   lifealgo *w = &soup ;
+   if (soup.hyperCapable() && !gens[0].empty()) {
+      // changing a hashing algorithm's step clears its cache, so keep
+      // stepping the soup by 60 and run the window on a copy
+      load(gens[0]) ;
+      getallcells(scratch, gens[0]) ;
+      w = &scratch ;
+   }
+   for (int t=1; t<=window; t++) {
+      if (!advance(*w, stride))
+         return 0 ;
+      getallcells(*w, gens[t]) ;
+   }
+   int p = window ;
+   for (int q=1; q<=window/2 && p==window; q++) {
+      int t = 0 ;
+      while (t + q <= window && gens[t].size() == gens[t+q].size())
+         t++ ;
+      if (t + q > window)
+         p = q ;
+   }
+   unordered_map<unsigned long long, size_t> index ;
+   vector<cellxy> where ;
+   for (int t=window-p; t<=window; t++)
+      for (size_t i=0; i<gens[t].size(); i++) {
+         const cellxy &c = gens[t][i] ;
+         if (index.insert(make_pair(cellkey(c.first, c.second),
+                                    where.size())).second)
+            where.push_back(c) ;
+      }
+   vector<size_t> piece(where.size()), cluster ;
+   for (size_t i=0; i<where.size(); i++)
+      piece[i] = i ;
+   for (int ring=1; ring<=2; ring++) {
+      vector<size_t> &parent = ring == 1 ? piece : cluster ;
+      if (ring == 2)
+         cluster = piece ;
+      for (size_t i=0; i<where.size(); i++)
+         for (int dy=-ring; dy<=ring; dy++)
+            for (int dx=-ring; dx<=ring; dx++) {
+               unordered_map<unsigned long long, size_t>::iterator it =
+                  index.find(cellkey(where[i].first + dx, where[i].second + dy)) ;
+               if (it != index.end())
+                  parent[findroot(parent, i)] = findroot(parent, it->second) ;
+            }
+   }
+   map<size_t, map<size_t, vector<cellxy> > > clusters ;
+   const vector<cellxy> &now = gens[window] ;
+   for (size_t i=0; i<now.size(); i++) {
+      size_t j = index[cellkey(now[i].first, now[i].second)] ;
+      clusters[findroot(cluster, j)][findroot(piece, j)].push_back(now[i]) ;
+   }
+   for (map<size_t, map<size_t, vector<cellxy> > >::iterator it=clusters.begin();
+        it!=clusters.end(); ++it) {
+      vector<vector<cellxy> > pieces ;
+      for (map<size_t, vector<cellxy> >::iterator jt=it->second.begin();
+           jt!=it->second.end(); ++jt)
+         pieces.push_back(jt->second) ;
+      if (!classifycluster(pieces, objects))
+         return 0 ;
+   }
+   return 1 ;
+}
+void soupcensus::runsoup(const string &seed, G_INT64 n, censustally &tally) {
+   makesoup(seed, n) ;
+   vector<string> objects ;
+   bigint prevpop = -1 ;
+   int same = 0 ;
+   for (;;) {
+      if (!advance(soup, 60))
+         break ;
+      bigint pop = soup.getPopulation() ;
+      same = pop == prevpop ? same + 1 : 0 ;
+      prevpop = pop ;
+      if (same >= 2) {
+         objects.clear() ;
+         if (separate(objects)) {
+            for (size_t i=0; i<objects.size(); i++)
+               tallyone(tally, objects[i], n) ;
+            return ;
+         }
+         same = 0 ;
+      }
+      if (soup.getGeneration() >= maxgens)
+         break ;
+   }
+   tallyone(tally, "PATHOLOGICAL", n) ;
+}
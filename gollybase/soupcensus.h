@@ -0,0 +1,79 @@
+// This file is part of Golly.
+// See docs/License.html for the copyright notice.
+
+/**
+ *   A census of random soups, done the way apgsearch does it.  Soup n
+ *   of a seed is the 16x16 C1 soup apgsearch and Catagolue make from the
+ *   SHA-256 of the seed followed by n in decimal.  It is run in steps of
+ *   60 generations until its population stops changing, and then split
+ *   into objects:  the live cells over one period of the population are
+ *   grouped into clusters of cells within two of each other, and each
+ *   cluster is copied into a scratch universe and run on its own to find
+ *   its period and motion.  A cluster whose 8-connected pieces are
+ *   settled objects that don't disturb each other counts as those
+ *   pieces, so a block next to a blinker isn't one new object.  If any
+ *   cluster doesn't repeat from where it started, the soup hasn't
+ *   settled yet and is run on.  Each object is named by its apgcode
+ *   (xs4_33 for a block, xp2_7 for a blinker, xq4_153 for a glider),
+ *   canonical over all phases and orientations.  A soup still unsettled
+ *   after maxgens generations is counted as PATHOLOGICAL; so is one whose
+ *   population doesn't repeat every 60 generations by then.
+ *
+ *   The census of each soup depends only on the seed and the soup number,
+ *   so soups can be shared out among threads in any order; the tallies
+ *   are merged by summing counts and keeping the lowest soup number, so
+ *   the result doesn't depend on the number of threads.
+ */
+#ifndef SOUPCENSUS_H
+#define SOUPCENSUS_H
+#include "bigint.h"
+#include "lifealgo.h"
+#include <map>
+#include <string>
+#include <vector>
+struct censusentry {
+   G_INT64 count ;
+   G_INT64 firstsoup ;            // the lowest soup number it was seen in
+} ;
+typedef std::map<std::string, censusentry> censustally ;
+class soupcensus {
+public:
+   /**
+    *   Both universes must already have the rule (two-state, on an
+    *   unbounded plane) and are cleared as needed.
+    */
+   soupcensus(lifealgo &soupalgo, lifealgo &scratchalgo) :
+      maxgens(65536), maxperiod(1024), soup(soupalgo),
+      scratch(scratchalgo) {}
+   /**
+    *   Clear the soup universe and put soup n of the seed in it.
+    */
+   void makesoup(const std::string &seed, G_INT64 n) ;
+   /**
+    *   Make, run and separate soup n, adding its objects to the tally.
+    */
+   void runsoup(const std::string &seed, G_INT64 n, censustally &tally) ;
+   /**
+    *   The apgcode of the pattern in the scratch universe, which must
+    *   repeat after period generations moving dx, dy; the pattern is
+    *   left where it was.
+    */
+   std::string apgcode(int period, const bigint &dx, const bigint &dy) ;
+   static void sha256(const unsigned char *data, size_t len,
+                      unsigned char digest[32]) ;
+   static void merge(censustally &into, const censustally &from) ;
+   bigint maxgens ;               // give up on a soup after this many gens
+   int maxperiod ;                // longest period looked for in an object
+private:
+   typedef std::pair<G_INT64, G_INT64> cellxy ;
+   int separate(std::vector<std::string> &objects) ;
+   int classifycluster(const std::vector<std::vector<cellxy> > &pieces,
+                       std::vector<std::string> &objects) ;
+   int classify(const std::vector<cellxy> &cells, std::string &code,
+                int &period) ;
+   void load(const std::vector<cellxy> &cells) ;
+   void addpops(const std::vector<cellxy> &cells, int n,
+                std::vector<G_INT64> &pops) ;
+   lifealgo &soup, &scratch ;
+} ;
+#endif
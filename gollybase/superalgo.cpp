@@ -1729,6 +1729,11 @@ state superalgo::slowcalc(state nw, state n, state ne, state w, state c,
    return result ;
 }
 
+void superalgo::slowcalcblock(state *out, const state *in, int stride,
+                              int wd, int ht) {
+   ghslowcalcblock(this, out, in, stride, wd, ht) ;
+}
+
 static lifealgo *creator() { return new superalgo() ; }
 
 void superalgo::doInitializeAlgoInfo(staticAlgoInfo &ai) {
@@ -4,6 +4,7 @@
 #include "util.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -243,6 +244,10 @@ void hperf::reportStep(hperf &mark, hperf &ratemark, double newGen, int verbose)
           "PERF gps %g nps %g fps %g depth %g half %g npg %g nodes %g",
           genspersec, nodeCount/elapsed, fps, 1+depthDelta/nodeCount, halfFrac,
           nodespergen, nodeCount) ;
+      if (gcCount > mark.gcCount)
+         sprintf(perfstatusline+strlen(perfstatusline),
+                 " gcs %g gctime %g maxpause %g", gcCount - mark.gcCount,
+                 gcTime - mark.gcTime, gcMaxPause) ;
       lifestatus(perfstatusline) ;
    }
    genval = newGen ;
@@ -81,6 +81,9 @@ struct hperf {
       genval = 0 ;
       frames = 0 ;
       halfNodes = 0 ;
+      gcCount = 0 ;
+      gcTime = 0 ;
+      gcMaxPause = 0 ;
    }
    void report(hperf&, int verbose) ;
    void reportStep(hperf&, hperf&, double genval, int verbose) ;
@@ -93,6 +96,13 @@ struct hperf {
       else
          return 0 ;
    }
+   // note a garbage collection pause of the given length
+   void gcpause(double secs) {
+      gcCount++ ;
+      gcTime += secs ;
+      if (secs > gcMaxPause)
+         gcMaxPause = secs ;
+   }
    double getReportInterval() {
       return reportInterval ;
    }
@@ -106,6 +116,9 @@ struct hperf {
    double depthSum ;
    double timeStamp ;
    double genval ;
+   double gcCount ;
+   double gcTime ;
+   double gcMaxPause ;
    static int reportMask ;
    static double reportInterval ;
 } ;
@@ -11,6 +11,12 @@
 #ifdef ZLIB
 #include <zlib.h>
 #include <streambuf>
+#include <cstdio>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #endif
 
 #ifdef __APPLE__
@@ -44,27 +50,27 @@ const int WRLE_NEWLINE = -1 ;
 void AddRun(std::ostream &f,
             int state,                // in: state of cell to write
             int multistate,           // true if #cell states > 2
-            unsigned int &run,        // in and out
+            G_INT64 &run,             // in and out
             unsigned int &linelen)    // ditto
 {
-   unsigned int i, numlen;
+   unsigned int numlen = 0;
    char numstr[32];
 
+   // sprintf is the bulk of the cost when writing huge patterns, so
+   // convert the run count ourselves (backwards from the end of numstr)
    if ( run > 1 ) {
-      sprintf(numstr, "%u", run);
-      numlen = (int)strlen(numstr);
-   } else {
-      numlen = 0;                      // no run count shown if 1
-   }
+      G_INT64 n = run;
+      do {
+         numstr[31 - numlen++] = (char)('0' + n % 10);
+         n /= 10;
+      } while (n > 0);
+   }                                   // no run count shown if 1
    if ( linelen + numlen + 1 + multistate > 70 ) {
       putchar('\n', f);
       linelen = 0;
    }
-   i = 0;
-   while (i < numlen) {
+   for (unsigned int i = 32 - numlen; i < 32; i++)
       putchar(numstr[i], f);
-      i++;
-   }
    if (multistate) {
       if (state <= 0)
          putchar(".$!"[-state], f) ;
@@ -83,16 +89,60 @@ void AddRun(std::ostream &f,
    run = 0;                           // reset run count
 }
 
+// the algorithm hands us runs of live cells; the dead cells and the
+// row ends between them follow from where the runs are
+class rlesink : public liferunsink {
+public:
+   rlesink(std::ostream &osarg, int multistatearg, double maxcountarg) :
+      os(osarg), multistate(multistatearg), linelen(0), curx(0), cury(0),
+      maxcount(maxcountarg), accumcount(0), currcount(0) {}
+   virtual int run(G_INT64 x, G_INT64 y, G_INT64 len, int state) {
+      G_INT64 n ;
+      if (y > cury) {
+         // output the $ chars for the rows we have finished
+         n = y - cury;
+         AddRun(os, WRLE_NEWLINE, multistate, n, linelen);
+         accumcount += (double)(y - cury);
+         cury = y;
+         curx = 0;
+      }
+      if (x > curx) {
+         // output the dead cells before this run
+         n = x - curx;
+         AddRun(os, 0, multistate, n, linelen);
+      }
+      n = len;
+      AddRun(os, state, multistate, n, linelen);
+      curx = x + len;
+      accumcount += (double)len;
+      if (++currcount > 1024) {
+         char msg[128];
+         currcount = 0;
+         sprintf(msg, "File size: %.2f MB", os.tellp() / 1048576.0);
+         if (lifeabortprogress(accumcount / maxcount, msg)) return 1;
+      }
+      return 0;
+   }
+   std::ostream &os;
+   int multistate;
+   unsigned int linelen;
+private:
+   G_INT64 curx, cury;
+   double maxcount, accumcount;
+   int currcount;
+};
+
 // write current pattern to file using extended RLE format
 const char *writerle(std::ostream &os, char *comments, lifealgo &imp,
-                     int top, int left, int bottom, int right,
+                     const bigint &top, const bigint &left,
+                     const bigint &bottom, const bigint &right,
                      bool xrle)
 {
    badwrite = false;
    if (xrle) {
       // write out #CXRLE line; note that the XRLE indicator is prefixed
       // with #C so apps like Life32 and MCell will ignore the line
-      os << "#CXRLE Pos=" << left << ',' << top;
+      os << "#CXRLE Pos=" << left.tostring('\0') << ',' << top.tostring('\0');
       if (imp.getGeneration() > bigint::zero)
          os << " Gen=" << imp.getGeneration().tostring('\0');
       os << '\n';
@@ -122,90 +172,30 @@ const char *writerle(std::ostream &os, char *comments, lifealgo &imp,
       os << "x = 0, y = 0, rule = " << imp.getrule() << "\n!\n";
    } else {
       // do header line
-      unsigned int wd = right - left + 1;
-      unsigned int ht = bottom - top + 1;
-      sprintf(outbuff, "x = %u, y = %u, rule = %s\n", wd, ht, imp.getrule());
-      outpos = strlen(outbuff);
-
-      // do RLE data
-      unsigned int linelen = 0;
-      unsigned int brun = 0;
-      unsigned int orun = 0;
-      unsigned int dollrun = 0;
-      int laststate = WRLE_NONE ;
-      int multistate = imp.NumCellStates() > 2 ;
-      int cx, cy;
-      
+      bigint wd = right;
+      wd -= left;
+      wd += 1;
+      bigint ht = bottom;
+      ht -= top;
+      ht += 1;
+      // runs and offsets are 64-bit
+      bigint maxsize = 1;
+      maxsize <<= 62;
+      if (wd >= maxsize || ht >= maxsize)
+         return "Pattern is too large to write in RLE format.";
+      os << "x = " << wd.tostring('\0') << ", y = " << ht.tostring('\0')
+         << ", rule = " << imp.getrule() << '\n';
+      outpos = 0;
+
       // for showing accurate progress we need to add pattern height to pop count
       // in case this is a huge pattern with many blank rows
-      double maxcount = imp.getPopulation().todouble() + ht;
-      double accumcount = 0;
-      int currcount = 0;
-      int v = 0 ;
-      for ( cy=top; cy<=bottom; cy++ ) {
-         // set lastchar to anything except 'o' or 'b'
-         laststate = WRLE_NONE ;
-         currcount++;
-         for ( cx=left; cx<=right; cx++ ) {
-            int skip = imp.nextcell(cx, cy, v);
-            if (skip + cx > right)
-               skip = -1;           // pretend we found no more live cells
-            if (skip > 0) {
-               // have exactly "skip" dead cells here
-               if (laststate == 0) {
-                  brun += skip;
-               } else {
-                  if (orun > 0) {
-                     // output current run of live cells
-                     AddRun(os, laststate, multistate, orun, linelen);
-                  }
-                  laststate = 0 ;
-                  brun = skip;
-               }
-            }
-            if (skip >= 0) {
-               // found next live cell in this row
-               cx += skip;
-               if (laststate == v) {
-                  orun++;
-               } else {
-                  if (dollrun > 0)
-                     // output current run of $ chars
-                     AddRun(os, WRLE_NEWLINE, multistate, dollrun, linelen);
-                  if (brun > 0)
-                     // output current run of dead cells
-                     AddRun(os, 0, multistate, brun, linelen);
-                  if (orun > 0)
-                     AddRun(os, laststate, multistate, orun, linelen) ;
-                  laststate = v ;
-                  orun = 1;
-               }
-               currcount++;
-            } else {
-               cx = right + 1;  // done this row
-            }
-            if (currcount > 1024) {
-               char msg[128];
-               accumcount += currcount;
-               currcount = 0;
-               sprintf(msg, "File size: %.2f MB", os.tellp() / 1048576.0);
-               if (lifeabortprogress(accumcount / maxcount, msg)) break;
-            }
-         }
-         // end of current row
-         if (isaborted()) break;
-         if (laststate == 0)
-            // forget dead cells at end of row
-            brun = 0;
-         else if (laststate >= 0)
-            // output current run of live cells
-            AddRun(os, laststate, multistate, orun, linelen);
-         dollrun++;
-      }
-      
+      rlesink rle(os, imp.NumCellStates() > 2,
+                  imp.getPopulation().todouble() + ht.todouble());
+      imp.getruns(top, left, bottom, right, rle);
+
       // terminate RLE data
-      dollrun = 1;
-      AddRun(os, WRLE_EOP, multistate, dollrun, linelen);
+      G_INT64 dollrun = 1;
+      AddRun(os, WRLE_EOP, rle.multistate, dollrun, rle.linelen);
       putchar('\n', os);
 
       // flush outbuff
@@ -229,6 +219,13 @@ const char *writemacrocell(std::ostream &os, char *comments, lifealgo &imp)
       return "Not yet implemented.";
 }
 
+static int gzipthreads = 0;     // 0 means one per core
+
+void setgzipthreads(int n)
+{
+   gzipthreads = n;
+}
+
 #ifdef ZLIB
 class gzbuf : public std::streambuf
 {
@@ -290,16 +287,238 @@ public:
 private:
    gzFile file;
 };
+
+// A gzip stream deflated on several threads.  The data is cut into blocks
+// that are compressed independently, each primed with the 32K before it
+// and ended on a byte boundary (or finished, for the last), so the pieces
+// can be written in order as one deflate stream; the CRCs are combined.
+class pgzbuf : public std::streambuf
+{
+public:
+   pgzbuf() : file(NULL), nthreads(0), failed(false), quit(false),
+              crc(0), total(0), written(0) { }
+   ~pgzbuf() { close(); }
+
+   pgzbuf *open(const char *path, int threads)
+   {
+      if (file) return NULL;
+      file = fopen(path, "wb");
+      if (!file) return NULL;
+      // gzip header:  no file name or time stamp
+      static const unsigned char header[10] =
+         { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+      failed = fwrite(header, 1, 10, file) != 10;
+      written = 10;
+      crc = crc32(0L, Z_NULL, 0);
+      total = 0;
+      buf.resize(BLOCKSIZE);
+      setp(&buf[0], &buf[0] + BLOCKSIZE);
+      quit = false;
+      nthreads = threads;
+      for (int i = 0; i < nthreads; i++)
+         workers.push_back(std::thread(&pgzbuf::compressor, this));
+      return this;
+   }
+
+   pgzbuf *close()
+   {
+      if (!file) return NULL;
+      submit(true);
+      writeblocks(0);
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         quit = true;
+      }
+      ready.notify_all();
+      for (size_t i = 0; i < workers.size(); i++)
+         workers[i].join();
+      workers.clear();
+      unsigned char trailer[8];
+      for (int i = 0; i < 4; i++) {
+         trailer[i] = (unsigned char)(crc >> (8 * i));
+         trailer[i + 4] = (unsigned char)(total >> (8 * i));
+      }
+      if (fwrite(trailer, 1, 8, file) != 8) failed = true;
+      if (fclose(file) != 0) failed = true;
+      file = NULL;
+      prevtail.clear();
+      return failed ? NULL : this;
+   }
+
+   bool is_open() const { return file!=NULL; }
+
+   int overflow(int c=EOF)
+   {
+      submit(false);
+      writeblocks(2 * nthreads);
+      if (c != EOF) {
+         *pptr() = (char)c;
+         pbump(1);
+      }
+      return failed ? EOF : 0;
+   }
+
+   int sync()
+   {
+      if (pptr() > pbase()) submit(false);
+      writeblocks(0);
+      if (fflush(file) != 0) failed = true;
+      return failed ? -1 : 0;
+   }
+
+   pos_type seekoff(off_type off, std::ios_base::seekdir way, std::ios_base::openmode which)
+   {
+      // only used to show the file size in the progress dialog
+      if (file && off == 0 && way == std::ios_base::cur && which == std::ios_base::out)
+         return pos_type(off_type(written));
+      return pos_type(off_type(-1));
+   }
+private:
+   static const int BLOCKSIZE = 128 * 1024;
+   static const int DICTSIZE = 32 * 1024;
+
+   struct block {
+      std::vector<char> in;            // the dictionary then the data
+      size_t dictlen;
+      std::vector<unsigned char> out;
+      uLong crc;
+      bool last, done, failed;
+   };
+
+   // queue the data in the put area (possibly none if last)
+   void submit(bool last)
+   {
+      block *b = new block;
+      size_t len = pptr() - pbase();
+      b->dictlen = prevtail.size();
+      b->in.reserve(b->dictlen + len);
+      b->in.insert(b->in.end(), prevtail.begin(), prevtail.end());
+      b->in.insert(b->in.end(), pbase(), pptr());
+      b->last = last;
+      b->done = b->failed = false;
+      if (len >= (size_t)DICTSIZE) {
+         prevtail.assign(pptr() - DICTSIZE, pptr());
+      } else {
+         prevtail.insert(prevtail.end(), pbase(), pptr());
+         if (prevtail.size() > (size_t)DICTSIZE)
+            prevtail.erase(prevtail.begin(), prevtail.end() - DICTSIZE);
+      }
+      setp(&buf[0], &buf[0] + BLOCKSIZE);
+      {
+         std::lock_guard<std::mutex> lock(mutex);
+         pending.push_back(b);
+         todo.push_back(b);
+      }
+      ready.notify_one();
+   }
+
+   // write finished blocks in order until at most maxpending are left
+   void writeblocks(size_t maxpending)
+   {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (!pending.empty()) {
+         block *b = pending.front();
+         if (!b->done) {
+            if (pending.size() <= maxpending) break;
+            finished.wait(lock);
+            continue;
+         }
+         pending.pop_front();
+         lock.unlock();
+         size_t len = b->in.size() - b->dictlen;
+         if (b->failed || b->out.empty() ||
+             fwrite(&b->out[0], 1, b->out.size(), file) != b->out.size())
+            failed = true;
+         written += b->out.size();
+         crc = crc32_combine(crc, b->crc, (z_off_t)len);
+         total += len;
+         delete b;
+         lock.lock();
+      }
+   }
+
+   static void compress(block &b, z_stream &z)
+   {
+      size_t len = b.in.size() - b.dictlen;
+      Bytef *in = (Bytef *)(b.in.empty() ? 0 : &b.in[0]);
+      b.crc = crc32(crc32(0L, Z_NULL, 0), in + b.dictlen, (uInt)len);
+      deflateReset(&z);
+      if (b.dictlen > 0 && deflateSetDictionary(&z, in, (uInt)b.dictlen) != Z_OK) {
+         b.failed = true;
+         return;
+      }
+      b.out.resize(deflateBound(&z, (uLong)len) + 64);
+      z.next_in = in + b.dictlen;
+      z.avail_in = (uInt)len;
+      size_t used = 0;
+      for (;;) {
+         z.next_out = &b.out[used];
+         z.avail_out = (uInt)(b.out.size() - used);
+         int err = deflate(&z, b.last ? Z_FINISH : Z_SYNC_FLUSH);
+         used = b.out.size() - z.avail_out;
+         if (err == Z_STREAM_ERROR) {
+            b.failed = true;
+            break;
+         }
+         if (z.avail_out > 0 && (!b.last || err == Z_STREAM_END)) break;
+         b.out.resize(2 * b.out.size());
+      }
+      b.out.resize(used);
+   }
+
+   void compressor()
+   {
+      z_stream z;
+      memset(&z, 0, sizeof(z));
+      bool ok = deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8,
+                             Z_DEFAULT_STRATEGY) == Z_OK;
+      std::unique_lock<std::mutex> lock(mutex);
+      for (;;) {
+         while (todo.empty() && !quit) ready.wait(lock);
+         if (todo.empty()) break;
+         block *b = todo.front();
+         todo.pop_front();
+         lock.unlock();
+         if (ok)
+            compress(*b, z);
+         else
+            b->failed = true;
+         lock.lock();
+         b->done = true;
+         finished.notify_all();
+      }
+      if (ok) deflateEnd(&z);
+   }
+
+   FILE *file;
+   int nthreads;
+   bool failed, quit;
+   uLong crc;
+   unsigned long long total, written;
+   std::vector<char> buf;              // the put area
+   std::vector<char> prevtail;         // the last 32K written
+   std::deque<block *> pending;        // in file order
+   std::deque<block *> todo;           // not yet started
+   std::vector<std::thread> workers;
+   std::mutex mutex;
+   std::condition_variable ready, finished;
+};
 #endif
 
 const char *writepattern(const char *filename, lifealgo &imp,
                          pattern_format format, output_compression compression,
-                         int top, int left, int bottom, int right)
+                         const bigint &top, const bigint &left,
+                         const bigint &bottom, const bigint &right,
+                         const char *newcomments)
 {
    // extract any comments if file exists so we can copy them to new file
    char *commptr = NULL;
-   FILE *f = fopen(filename, "r");
-   if (f) {
+   FILE *f = newcomments ? NULL : fopen(filename, "r");
+   if (newcomments) {
+      commptr = (char *)malloc(strlen(newcomments) + 1);
+      if (commptr == NULL) return "Not enough memory for comments!";
+      strcpy(commptr, newcomments);
+   } else if (f) {
       fclose(f);
       const char *err = readcomments(filename, &commptr);
       if (err) {
@@ -322,17 +541,25 @@ const char *writepattern(const char *filename, lifealgo &imp,
    std::filebuf filebuf;
 #ifdef ZLIB
    gzbuf gzbuf;
+   pgzbuf pgzbuf;
+   int nthreads = gzipthreads > 0 ? gzipthreads : (int)std::thread::hardware_concurrency();
 #endif
 
    switch (compression)
    {
    default:  /* no output compression */
-      streambuf = filebuf.open(filename, std::ios_base::out);
+      if (format == MCB_format || format == MCBP_format)
+         streambuf = filebuf.open(filename, std::ios_base::out | std::ios_base::binary);
+      else
+         streambuf = filebuf.open(filename, std::ios_base::out);
       break;
 
    case gzip_compression:
 #ifdef ZLIB
-      streambuf = gzbuf.open(filename);
+      if (nthreads > 1)
+         streambuf = pgzbuf.open(filename, nthreads);
+      else
+         streambuf = gzbuf.open(filename);
       break;
 #else
       if (commptr) free(commptr);
@@ -362,12 +589,23 @@ const char *writepattern(const char *filename, lifealgo &imp,
          errmsg = writemacrocell(os, comments, imp);
          break;
 
+      case MCB_format:
+      case MCBP_format:
+         // binary macrocell format also ignores given edges
+         errmsg = imp.writeBinaryFormat(os, comments, format == MCBP_format);
+         break;
+
       default:
          errmsg = "Unsupported pattern format!";
    }
 
    if (errmsg == NULL && !os.flush())
       errmsg = "Error occurred writing file; maybe disk is full?";
+#ifdef ZLIB
+   // the last block and the gzip trailer are only written on closing
+   if (pgzbuf.is_open() && !pgzbuf.close() && errmsg == NULL)
+      errmsg = "Error occurred writing file; maybe disk is full?";
+#endif
 
    lifeendprogress();
 
@@ -3,12 +3,15 @@
 
 #ifndef WRITEPATTERN_H
 #define WRITEPATTERN_H
+#include "bigint.h"
 class lifealgo;
 
 typedef enum {
    RLE_format,          // run length encoded
    XRLE_format,         // extended RLE
-   MC_format            // macrocell (native hashlife format)
+   MC_format,           // macrocell (native hashlife format)
+   MCB_format,          // binary macrocell (see mcbheader in lifealgo.h)
+   MCBP_format          // binary macrocell with node populations
 } pattern_format;
 
 typedef enum {
@@ -17,12 +20,23 @@ typedef enum {
 } output_compression;
 
 /*
- *   Save current pattern to a file.
+ *   Save current pattern to a file.  The comments of any existing file
+ *   of that name are kept, unless other comment lines are given.
  */
 const char *writepattern(const char *filename,
                          lifealgo &imp,
                          pattern_format format,
                          output_compression compression,
-                         int top, int left, int bottom, int right);
+                         const bigint &top, const bigint &left,
+                         const bigint &bottom, const bigint &right,
+                         const char *newcomments = 0);
+
+/*
+ *   How many threads compress gzipped output; the default (0) is one per
+ *   core.  With more than one the data is deflated in independent blocks
+ *   (like pigz), so the file differs from a single-threaded one but
+ *   decompresses to the same thing.
+ */
+void setgzipthreads(int n);
 
 #endif
@@ -293,12 +293,25 @@ void ResetPattern(bool resetundo)
 // -----------------------------------------------------------------------------
 
 void RestorePattern(bigint& gen, const char* filename,
-                    bigint& x, bigint& y, int mag, int base, int expo)
+                    bigint& x, bigint& y, int mag, int base, int expo,
+                    void* state)
 {
     // called to undo/redo a generating change
     if (gen == currlayer->startgen) {
         // restore starting pattern (false means don't call SyncUndoHistory)
         ResetPattern(false);
+    } else if (state) {
+        // restore pattern pinned in the current universe (the algorithm
+        // can't have changed because that saves pinned patterns to files)
+        currlayer->algo->endofpattern();
+        currlayer->algo->setcurrentstate(state);
+        currlayer->algo->setGeneration(gen);
+
+        currlayer->currbase = base;
+        currlayer->currexpo = expo;
+        SetGenIncrement();
+        if (restoreview) currlayer->view->setpositionmag(x, y, mag);
+        UpdatePatternAndStatus();
     } else {
         // restore pattern in given filename
         LoadPattern(filename, "");
@@ -381,6 +394,7 @@ const char* ChangeGenCount(const char* genstring, bool inundoredo)
             return "Failed to copy pattern.";
         }
         // switch to new universe
+        currlayer->undoredo->SavePinnedPatterns();
         delete currlayer->algo;
         currlayer->algo = newalgo;
         SetGenIncrement();
@@ -980,6 +994,7 @@ void ChangeAlgorithm(algo_type newalgotype, const char* newrule, bool inundoredo
     }
 
     // delete old universe and point current universe to new universe
+    currlayer->undoredo->SavePinnedPatterns();
     delete currlayer->algo;
     currlayer->algo = newalgo;
     SetGenIncrement();
@@ -20,7 +20,8 @@ void StopGenerating();
 void NextGeneration(bool useinc);
 void ResetPattern(bool resetundo = true);
 void RestorePattern(bigint& gen, const char* filename,
-                    bigint& x, bigint& y, int mag, int base, int expo);
+                    bigint& x, bigint& y, int mag, int base, int expo,
+                    void* state = NULL);
 void SetMinimumStepExponent();
 void SetStepExponent(int newexpo);
 void SetGenIncrement();
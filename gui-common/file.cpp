@@ -91,6 +91,7 @@ void CreateUniverse()
     std::string oldrule = currlayer->algo->getrule();
 
     // delete old universe and create new one of same type
+    currlayer->undoredo->SavePinnedPatterns();
     delete currlayer->algo;
     currlayer->algo = CreateNewUniverse(currlayer->algtype);
 
@@ -183,6 +184,7 @@ bool LoadPattern(const char* path, const char* newtitle)
     std::string oldrule = currlayer->algo->getrule();
 
     // delete old universe and create new one of same type
+    currlayer->undoredo->SavePinnedPatterns();
     delete currlayer->algo;
     currlayer->algo = CreateNewUniverse(currlayer->algtype);
 
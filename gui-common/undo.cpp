@@ -203,15 +203,17 @@ public:
     // rotate/flip operation) then cancel the undo/redo
 
     void ChangeCells(bool undo);
-    // change cell states using cellinfo
+    // change cell states using cells
+
+    void SavePinnedStates();
+    // save oldstate/newstate to oldfile/newfile and unpin them
 
     change_type changeid;                   // specifies the type of change
     bool olddirty;                          // layer's dirty state before change
     bool newdirty;                          // layer's dirty state after change
 
     // cellstates info
-    cell_change* cellinfo;                  // dynamic array of cell changes
-    unsigned int cellcount;                 // number of cell changes in array
+    cellchanges cells;                      // compressed cell changes
 
     // rotatecw/rotateacw/selchange info
     Selection oldsel, newsel;               // old and new selections
@@ -219,6 +221,8 @@ public:
     // genchange info
     bool scriptgen;                         // gen change was done by script?
     std::string oldfile, newfile;           // old and new pattern files
+    void* oldstate, *newstate;              // or old and new pinned patterns
+    lifealgo* pinalgo;                      // universe holding pinned patterns
     bigint oldgen, newgen;                  // old and new generation counts
     bigint oldx, oldy, newx, newy;          // old and new positions
     int oldmag, newmag;                     // old and new scales
@@ -258,8 +262,9 @@ ChangeNode::ChangeNode(change_type id)
     changeid = id;
     startinfo = NULL;
     whichlayer = NULL;      // simplifies UndoRedo::DeletingClone
-    cellinfo = NULL;
-    cellcount = 0;
+    oldstate = NULL;
+    newstate = NULL;
+    pinalgo = NULL;
     oldfile.clear();
     newfile.clear();
     oldtempstart.clear();
@@ -275,7 +280,11 @@ bool delete_all_temps = false;   // ok to delete all temporary files?
 ChangeNode::~ChangeNode()
 {
     if (startinfo) delete startinfo;
-    if (cellinfo) free(cellinfo);
+
+    // the universe holding any pinned patterns is deleted after the undo
+    // history, or SavePinnedPatterns has been called
+    if (oldstate) pinalgo->unpinstate(oldstate);
+    if (newstate) pinalgo->unpinstate(newstate);
     
     // it's always ok to delete oldfile and newfile if they exist
 
@@ -318,37 +327,67 @@ ChangeNode::~ChangeNode()
 
 void ChangeNode::ChangeCells(bool undo)
 {
-    // avoid possible pattern update during a setcell call (can happen if cellcount is large)
+    // avoid possible pattern update during a setcell call (can happen if there are many changes)
     nopattupdate = true;
 
-    // change state of cell(s) stored in cellinfo array
-    if (undo) {
-        // we must undo the cell changes in reverse order in case
-        // a script has changed the same cell more than once
-        unsigned int i = cellcount;
-        while (i > 0) {
-            i--;
-            currlayer->algo->setcell(cellinfo[i].x, cellinfo[i].y, cellinfo[i].oldstate);
-        }
-    } else {
-        unsigned int i = 0;
-        while (i < cellcount) {
-            currlayer->algo->setcell(cellinfo[i].x, cellinfo[i].y, cellinfo[i].newstate);
-            i++;
-        }
-    }
-    if (cellcount > 0) currlayer->algo->endofpattern();
+    // change state of cell(s) stored in cells (apply undoes the changes
+    // in reverse order in case a script has changed the same cell more than once)
+    cells.apply(*currlayer->algo, undo);
+    if (cells.count() > 0) currlayer->algo->endofpattern();
 
     nopattupdate = false;
 }
 
 // -----------------------------------------------------------------------------
 
+static void WritePinnedPattern(void* state, bigint& gen, std::string& tempfile)
+{
+    // temporarily make the given pinned pattern the current one and save it
+    // in a unique temporary file, as SaveCurrentPattern would have done
+    lifealgo* algo = currlayer->algo;
+    bigint savegen = algo->getGeneration();
+    void* savestate = algo->pinstate();
+    algo->setcurrentstate(state);
+    algo->setGeneration(gen);
+
+    tempfile = CreateTempFileName(genchange_prefix);
+    const char* err = WritePattern(tempfile.c_str(), MC_format, no_compression, 0, 0, 0, 0);
+
+    algo->setcurrentstate(savestate);
+    algo->setGeneration(savegen);
+    algo->unpinstate(savestate);
+    if (err) Warning(err);
+}
+
+// -----------------------------------------------------------------------------
+
+void ChangeNode::SavePinnedStates()
+{
+    if (oldstate == NULL && newstate == NULL) return;
+
+    if (pinalgo != currlayer->algo) {
+        Warning("Bug detected in SavePinnedStates!");
+        return;
+    }
+    if (oldstate) {
+        WritePinnedPattern(oldstate, oldgen, oldfile);
+        pinalgo->unpinstate(oldstate);
+        oldstate = NULL;
+    }
+    if (newstate) {
+        WritePinnedPattern(newstate, newgen, newfile);
+        pinalgo->unpinstate(newstate);
+        newstate = NULL;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
 bool ChangeNode::DoChange(bool undo)
 {
     switch (changeid) {
         case cellstates:
-            if (cellcount > 0) ChangeCells(undo);
+            if (cells.count() > 0) ChangeCells(undo);
             break;
 
         case fliptb:
@@ -365,7 +404,7 @@ bool ChangeNode::DoChange(bool undo)
 
         case rotatecw:
         case rotateacw:
-            if (cellcount > 0) ChangeCells(undo);
+            if (cells.count() > 0) ChangeCells(undo);
             // rotate selection edges
             if (undo) {
                 currlayer->currsel = oldsel;
@@ -388,14 +427,16 @@ bool ChangeNode::DoChange(bool undo)
             currlayer->startfile = oldstartfile;
             if (undo) {
                 currlayer->currsel = oldsel;
-                RestorePattern(oldgen, oldfile.c_str(), oldx, oldy, oldmag, oldbase, oldexpo);
+                RestorePattern(oldgen, oldfile.c_str(), oldx, oldy, oldmag, oldbase, oldexpo,
+                               oldstate);
             } else {
                 if (startinfo) {
                     // restore starting info for use by ResetPattern
                     startinfo->Restore();
                 }
                 currlayer->currsel = newsel;
-                RestorePattern(newgen, newfile.c_str(), newx, newy, newmag, newbase, newexpo);
+                RestorePattern(newgen, newfile.c_str(), newx, newy, newmag, newbase, newexpo,
+                               newstate);
             }
             break;
 
@@ -450,7 +491,7 @@ bool ChangeNode::DoChange(bool undo)
                 RestoreRule(newrule.c_str());
                 currlayer->currsel = newsel;
             }
-            if (cellcount > 0) {
+            if (cells.count() > 0) {
                 ChangeCells(undo);
             }
             // switch to default colors for new rule
@@ -466,7 +507,7 @@ bool ChangeNode::DoChange(bool undo)
                 ChangeAlgorithm(newalgo, newrule.c_str(), true);
                 currlayer->currsel = newsel;
             }
-            if (cellcount > 0) {
+            if (cells.count() > 0) {
                 ChangeCells(undo);
             }
             // ChangeAlgorithm has called UpdateLayerColors()
@@ -485,14 +526,12 @@ bool ChangeNode::DoChange(bool undo)
 
 UndoRedo::UndoRedo()
 {
-    numchanges = 0;               // for 1st SaveCellChange
-    maxchanges = 0;               // ditto
-    badalloc = false;             // true if malloc/realloc fails
-    cellarray = NULL;             // play safe
     savecellchanges = false;      // no script cell changes are pending
     savegenchanges = false;       // no script gen changes are pending
     doingscriptchanges = false;   // not undoing/redoing script changes
     prevfile.clear();             // play safe for ClearUndoRedo
+    prevstate = NULL;             // ditto
+    pinalgo = NULL;               // ditto
     startcount = 0;               // unfinished RememberGenStart calls
 
     // need to remember if script has created a new layer (not a clone)
@@ -530,87 +569,38 @@ void UndoRedo::ClearRedoHistory()
 
 void UndoRedo::SaveCellChange(int x, int y, int oldstate, int newstate)
 {
-    if (numchanges == maxchanges) {
-        if (numchanges == 0) {
-            // initially allocate room for 1 cell change
-            maxchanges = 1;
-            cellarray = (cell_change*) malloc(maxchanges * sizeof(cell_change));
-            if (cellarray == NULL) {
-                badalloc = true;
-                return;
-            }
-            // ~ChangeNode or ForgetCellChanges will free cellarray
-        } else {
-            // double size of cellarray
-            cell_change* newptr =
-            (cell_change*) realloc(cellarray, maxchanges * 2 * sizeof(cell_change));
-            if (newptr == NULL) {
-                badalloc = true;
-                return;
-            }
-            cellarray = newptr;
-            maxchanges *= 2;
-        }
-    }
-
-    cellarray[numchanges].x = x;
-    cellarray[numchanges].y = y;
-    cellarray[numchanges].oldstate = oldstate;
-    cellarray[numchanges].newstate = newstate;
-
-    numchanges++;
+    // consecutive changes along a row are merged into runs
+    cellbatch.add(x, y, oldstate, newstate);
 }
 
 // -----------------------------------------------------------------------------
 
 void UndoRedo::ForgetCellChanges()
 {
-    if (numchanges > 0) {
-        if (cellarray) {
-            free(cellarray);
-        } else {
-            Warning("Bug detected in ForgetCellChanges!");
-        }
-        numchanges = 0;      // reset for next SaveCellChange
-        maxchanges = 0;      // ditto
-        badalloc = false;
-    }
+    cellbatch.clear();
 }
 
 // -----------------------------------------------------------------------------
 
 bool UndoRedo::RememberCellChanges(const char* action, bool olddirty)
 {
-    if (numchanges > 0) {
-        if (numchanges < maxchanges) {
-            // reduce size of cellarray
-            cell_change* newptr =
-            (cell_change*) realloc(cellarray, numchanges * sizeof(cell_change));
-            if (newptr != NULL) cellarray = newptr;
-            // in the unlikely event that newptr is NULL, cellarray should
-            // still point to valid data
-        }
-
+    if (cellbatch.count() > 0) {
         ClearRedoHistory();
 
         // add cellstates node to head of undo list
         ChangeNode* change = new ChangeNode(cellstates);
         if (change == NULL) Fatal("Failed to create cellstates node!");
 
-        change->cellinfo = cellarray;
-        change->cellcount = numchanges;
+        change->cells.swap(cellbatch);
+        change->cells.trim();
         change->olddirty = olddirty;
         change->newdirty = true;
 
         undolist.push_front(change);
 
-        numchanges = 0;      // reset for next SaveCellChange
-        maxchanges = 0;      // ditto
+        cellbatch.clear();   // reset for next SaveCellChange
 
-        if (badalloc) {
-            Warning(lack_of_memory);
-            badalloc = false;
-        }
+        if (change->cells.failed()) Warning(lack_of_memory);
         return true;    // at least one cell changed state
     }
     return false;       // no cells changed state (SaveCellChange wasn't called)
@@ -664,24 +654,12 @@ void UndoRedo::RememberRotation(bool clockwise, Selection& oldsel, Selection& ne
     change->olddirty = olddirty;
     change->newdirty = true;
 
-    // if numchanges == 0 we still need to rotate selection edges
-    if (numchanges > 0) {
-        if (numchanges < maxchanges) {
-            // reduce size of cellarray
-            cell_change* newptr =
-            (cell_change*) realloc(cellarray, numchanges * sizeof(cell_change));
-            if (newptr != NULL) cellarray = newptr;
-        }
-
-        change->cellinfo = cellarray;
-        change->cellcount = numchanges;
-
-        numchanges = 0;      // reset for next SaveCellChange
-        maxchanges = 0;      // ditto
-        if (badalloc) {
-            Warning(lack_of_memory);
-            badalloc = false;
-        }
+    // if there are no cell changes we still need to rotate selection edges
+    if (cellbatch.count() > 0) {
+        change->cells.swap(cellbatch);
+        change->cells.trim();
+        cellbatch.clear();   // reset for next SaveCellChange
+        if (change->cells.failed()) Warning(lack_of_memory);
     }
 
     undolist.push_front(change);
@@ -768,6 +746,11 @@ void UndoRedo::RememberGenStart()
     if (prevgen == currlayer->startgen) {
         // we can just reset to starting pattern
         prevfile.clear();
+    } else if ((prevstate = currlayer->algo->pinstate()) != NULL) {
+        // the algorithm can keep the current pattern in memory, and it will
+        // share most of its structure with the patterns generated from it
+        prevfile.clear();
+        pinalgo = currlayer->algo;
     } else {
         // save starting pattern in a unique temporary file
         prevfile = CreateTempFileName(genchange_prefix);
@@ -816,13 +799,20 @@ void UndoRedo::RememberGenFinish()
             RemoveFile(prevfile);
         }
         prevfile.clear();
+        if (prevstate) pinalgo->unpinstate(prevstate);
+        prevstate = NULL;
         return;
     }
 
     std::string fpath;
+    void* fstate = NULL;
     if (currlayer->algo->getGeneration() == currlayer->startgen) {
         // this can happen if script called reset() so just use starting pattern
         fpath.clear();
+    } else if ((fstate = currlayer->algo->pinstate()) != NULL) {
+        // keep finishing pattern in memory (see RememberGenStart)
+        fpath.clear();
+        pinalgo = currlayer->algo;
     } else {
         // save finishing pattern in a unique temporary file
         fpath = CreateTempFileName(genchange_prefix);
@@ -840,6 +830,9 @@ void UndoRedo::RememberGenFinish()
     change->newgen = currlayer->algo->getGeneration();
     change->oldfile = prevfile;
     change->newfile = fpath;
+    change->oldstate = prevstate;
+    change->newstate = fstate;
+    if (prevstate || fstate) change->pinalgo = pinalgo;
     change->oldx = prevx;
     change->oldy = prevy;
     change->newx = currlayer->view->x;
@@ -865,8 +858,51 @@ void UndoRedo::RememberGenFinish()
 
     // prevfile has been saved in change->oldfile (~ChangeNode will delete it)
     prevfile.clear();
+    prevstate = NULL;
 
     undolist.push_front(change);
+
+    if (change->pinalgo) SpillOldPatterns();
+}
+
+// -----------------------------------------------------------------------------
+
+void UndoRedo::SpillOldPatterns()
+{
+    // pinned patterns share most of their nodes with the current pattern,
+    // but if the last garbage collection had to keep more than half of the
+    // universe's memory then save all but the newest change to files
+    if (pinalgo == NULL || pinalgo->getkeptfraction() <= 0.5) return;
+
+    std::list<ChangeNode*>::iterator node = undolist.begin();
+    if (node != undolist.end()) node++;
+    while (node != undolist.end()) {
+        (*node)->SavePinnedStates();
+        node++;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void UndoRedo::SavePinnedPatterns()
+{
+    if (pinalgo == NULL) return;
+
+    std::list<ChangeNode*>::iterator node;
+    for (node = undolist.begin(); node != undolist.end(); node++) {
+        (*node)->SavePinnedStates();
+    }
+    for (node = redolist.begin(); node != redolist.end(); node++) {
+        (*node)->SavePinnedStates();
+    }
+
+    if (prevstate) {
+        WritePinnedPattern(prevstate, prevgen, prevfile);
+        pinalgo->unpinstate(prevstate);
+        prevstate = NULL;
+    }
+
+    pinalgo = NULL;
 }
 
 // -----------------------------------------------------------------------------
@@ -1072,23 +1108,11 @@ void UndoRedo::RememberRuleChange(const char* oldrule)
     change->newsel = currlayer->currsel;
 
     // SaveCellChange may have been called
-    if (numchanges > 0) {
-        if (numchanges < maxchanges) {
-            // reduce size of cellarray
-            cell_change* newptr =
-            (cell_change*) realloc(cellarray, numchanges * sizeof(cell_change));
-            if (newptr != NULL) cellarray = newptr;
-        }
-
-        change->cellinfo = cellarray;
-        change->cellcount = numchanges;
-
-        numchanges = 0;      // reset for next SaveCellChange
-        maxchanges = 0;      // ditto
-        if (badalloc) {
-            Warning(lack_of_memory);
-            badalloc = false;
-        }
+    if (cellbatch.count() > 0) {
+        change->cells.swap(cellbatch);
+        change->cells.trim();
+        cellbatch.clear();   // reset for next SaveCellChange
+        if (change->cells.failed()) Warning(lack_of_memory);
     }
 
     undolist.push_front(change);
@@ -1114,23 +1138,11 @@ void UndoRedo::RememberAlgoChange(algo_type oldalgo, const char* oldrule)
     change->newsel = currlayer->currsel;
 
     // SaveCellChange may have been called
-    if (numchanges > 0) {
-        if (numchanges < maxchanges) {
-            // reduce size of cellarray
-            cell_change* newptr =
-            (cell_change*) realloc(cellarray, numchanges * sizeof(cell_change));
-            if (newptr != NULL) cellarray = newptr;
-        }
-
-        change->cellinfo = cellarray;
-        change->cellcount = numchanges;
-
-        numchanges = 0;      // reset for next SaveCellChange
-        maxchanges = 0;      // ditto
-        if (badalloc) {
-            Warning(lack_of_memory);
-            badalloc = false;
-        }
+    if (cellbatch.count() > 0) {
+        change->cells.swap(cellbatch);
+        change->cells.trim();
+        cellbatch.clear();   // reset for next SaveCellChange
+        if (change->cells.failed()) Warning(lack_of_memory);
     }
 
     undolist.push_front(change);
@@ -1318,7 +1330,7 @@ void UndoRedo::RedoChange()
 
 void UndoRedo::ClearUndoRedo()
 {
-    // free cellarray in case there were SaveCellChange calls not followed
+    // free cellbatch in case there were SaveCellChange calls not followed
     // by ForgetCellChanges or RememberCellChanges
     ForgetCellChanges();
 
@@ -1328,6 +1340,8 @@ void UndoRedo::ClearUndoRedo()
             RemoveFile(prevfile);
         }
         prevfile.clear();
+        if (prevstate) pinalgo->unpinstate(prevstate);
+        prevstate = NULL;
         startcount = 0;
     }
     
@@ -1337,6 +1351,7 @@ void UndoRedo::ClearUndoRedo()
     // clear the undo/redo lists (and delete each node's data)
     ClearUndoHistory();
     ClearRedoHistory();
+    pinalgo = NULL;
     
     delete_all_temps = false;
 
@@ -1439,9 +1454,7 @@ void UndoRedo::DuplicateHistory(Layer* oldlayer, Layer* newlayer)
     savecellchanges = history->savecellchanges;
     savegenchanges = history->savegenchanges;
     doingscriptchanges = history->doingscriptchanges;
-    numchanges = history->numchanges;
-    maxchanges = history->maxchanges;
-    badalloc = history->badalloc;
+    cellbatch = history->cellbatch;
     prevfile = history->prevfile;
     prevgen = history->prevgen;
     prevx = history->prevx;
@@ -1461,16 +1474,13 @@ void UndoRedo::DuplicateHistory(Layer* oldlayer, Layer* newlayer)
         }
     }
 
-    // do a deep copy of dynamically allocated data
-    cellarray = NULL;
-    if (numchanges > 0 && history->cellarray) {
-        cellarray = (cell_change*) malloc(maxchanges * sizeof(cell_change));
-        if (cellarray == NULL) {
-            Warning("Could not allocate cellarray!");
-            return;
-        }
-        // copy history->cellarray data to this cellarray
-        memcpy(cellarray, history->cellarray, numchanges * sizeof(cell_change));
+    // patterns pinned in the old layer's universe are saved in files
+    // (the new layer has its own universe)
+    if (history->prevstate) WritePinnedPattern(history->prevstate, prevgen, prevfile);
+
+    if (cellbatch.failed() && !history->cellbatch.failed()) {
+        Warning("Could not copy cell changes!");
+        return;
     }
 
     std::list<ChangeNode*>::iterator node;
@@ -1487,19 +1497,15 @@ void UndoRedo::DuplicateHistory(Layer* oldlayer, Layer* newlayer)
             return;
         }
 
-        // shallow copy the change node
+        // shallow copy the change node (this also copies the cell changes)
         *newchange = *change;
-
-        // deep copy any dynamically allocated data
-        if (change->cellinfo) {
-            int bytes = change->cellcount * sizeof(cell_change);
-            newchange->cellinfo = (cell_change*) malloc(bytes);
-            if (newchange->cellinfo == NULL) {
-                Warning("Could not copy undolist!");
-                ClearUndoHistory();
-                return;
-            }
-            memcpy(newchange->cellinfo, change->cellinfo, bytes);
+        newchange->oldstate = NULL;
+        newchange->newstate = NULL;
+        newchange->pinalgo = NULL;
+        if (change->cells.failed() != newchange->cells.failed()) {
+            Warning("Could not copy undolist!");
+            ClearUndoHistory();
+            return;
         }
         
         if (change->startinfo) {
@@ -1522,6 +1528,10 @@ void UndoRedo::DuplicateHistory(Layer* oldlayer, Layer* newlayer)
             return;
         }
 
+        // save any patterns pinned in the old layer's universe
+        if (change->oldstate) WritePinnedPattern(change->oldstate, newchange->oldgen, newchange->oldfile);
+        if (change->newstate) WritePinnedPattern(change->newstate, newchange->newgen, newchange->newfile);
+
         undolist.push_back(newchange);
         node++;
     }
@@ -1538,19 +1548,15 @@ void UndoRedo::DuplicateHistory(Layer* oldlayer, Layer* newlayer)
             return;
         }
 
-        // shallow copy the change node
+        // shallow copy the change node (this also copies the cell changes)
         *newchange = *change;
-
-        // deep copy any dynamically allocated data
-        if (change->cellinfo) {
-            int bytes = change->cellcount * sizeof(cell_change);
-            newchange->cellinfo = (cell_change*) malloc(bytes);
-            if (newchange->cellinfo == NULL) {
-                Warning("Could not copy redolist!");
-                ClearRedoHistory();
-                return;
-            }
-            memcpy(newchange->cellinfo, change->cellinfo, bytes);
+        newchange->oldstate = NULL;
+        newchange->newstate = NULL;
+        newchange->pinalgo = NULL;
+        if (change->cells.failed() != newchange->cells.failed()) {
+            Warning("Could not copy redolist!");
+            ClearRedoHistory();
+            return;
         }
         
         if (change->startinfo) {
@@ -1573,6 +1579,10 @@ void UndoRedo::DuplicateHistory(Layer* oldlayer, Layer* newlayer)
             return;
         }
 
+        // save any patterns pinned in the old layer's universe
+        if (change->oldstate) WritePinnedPattern(change->oldstate, newchange->oldgen, newchange->oldfile);
+        if (change->newstate) WritePinnedPattern(change->newstate, newchange->newgen, newchange->newfile);
+
         redolist.push_back(newchange);
         node++;
     }
@@ -5,6 +5,7 @@
 #define _UNDO_H_
 
 #include "bigint.h"     // for bigint class
+#include "lifealgo.h"   // for lifealgo, cellchanges
 #include "select.h"     // for Selection class
 #include "algos.h"      // for algo_type
 
@@ -16,13 +17,6 @@ class Layer;
 
 // Golly supports unlimited undo/redo:
 
-typedef struct {
-    int x;              // cell's x position
-    int y;              // cell's y position
-    int oldstate;       // old state
-    int newstate;       // new state
-} cell_change;          // stores a single cell change
-
 class UndoRedo {
 public:
     UndoRedo();
@@ -98,6 +92,10 @@ public:
     void DuplicateHistory(Layer* oldlayer, Layer* newlayer);
     // duplicate old layer's undo/redo history in new layer
 
+    void SavePinnedPatterns();
+    // the current layer's universe is about to be deleted, so save any
+    // generated patterns still kept in it to temporary files
+
     bool savecellchanges;         // script's cell changes need to be remembered?
     bool savegenchanges;          // script's gen changes need to be remembered?
     bool doingscriptchanges;      // are script's changes being undone/redone?
@@ -114,12 +112,11 @@ private:
     std::list<ChangeNode*> undolist;    // list of undoable changes
     std::list<ChangeNode*> redolist;    // list of redoable changes
 
-    cell_change* cellarray;       // dynamic array of cell changes
-    unsigned int numchanges;      // number of cell changes
-    unsigned int maxchanges;      // number allocated
-    bool badalloc;                // malloc/realloc failed?
+    cellchanges cellbatch;        // cell changes saved by SaveCellChange
 
     std::string prevfile;         // for saving pattern at start of gen change
+    void* prevstate;              // or pinned pattern at start of gen change
+    lifealgo* pinalgo;            // universe holding prevstate (or NULL)
     bigint prevgen;               // generation count at start of gen change
     bigint prevx, prevy;          // viewport position at start of gen change
     int prevmag;                  // scale at start of gen change
@@ -133,6 +130,10 @@ private:
 
     void SaveCurrentPattern(const char* tempfile);
     // save current pattern to given temporary file
+
+    void SpillOldPatterns();
+    // save pinned patterns older than the current one to temporary files
+    // if they keep too much of the universe's memory from being reused
 };
 
 #endif
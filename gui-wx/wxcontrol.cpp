@@ -239,12 +239,25 @@ void MainFrame::ResetPattern(bool resetundo)
 // -----------------------------------------------------------------------------
 
 void MainFrame::RestorePattern(bigint& gen, const wxString& filename,
-                               bigint& x, bigint& y, int mag, int base, int expo)
+                               bigint& x, bigint& y, int mag, int base, int expo,
+                               void* state)
 {
     // called to undo/redo a generating change
     if (gen == currlayer->startgen) {
         // restore starting pattern (false means don't call SyncUndoHistory)
         ResetPattern(false);
+    } else if (state) {
+        // restore pattern pinned in the current universe (the algorithm
+        // can't have changed because that saves pinned patterns to files)
+        currlayer->algo->endofpattern();
+        currlayer->algo->setcurrentstate(state);
+        currlayer->algo->setGeneration(gen);
+        
+        currlayer->currbase = base;
+        currlayer->currexpo = expo;
+        SetGenIncrement();
+        if (restoreview) viewptr->SetPosMag(x, y, mag);
+        UpdatePatternAndStatus();
     } else {
         // restore pattern in given filename;
         // false means don't update status bar (algorithm should NOT change)
@@ -326,6 +339,7 @@ const char* MainFrame::ChangeGenCount(const char* genstring, bool inundoredo)
             return "Failed to copy pattern.";
         }
         // switch to new universe
+        currlayer->undoredo->SavePinnedPatterns();
         delete currlayer->algo;
         currlayer->algo = newalgo;
         SetGenIncrement();
@@ -903,7 +917,7 @@ void MainFrame::OnGenTimer(wxTimerEvent& WXUNUSED(event))
     
     if (currlayer->algo->isrecording()) {
         if (showtimeline) UpdateTimelineBar();
-        if (currlayer->algo->getframecount() == MAX_FRAME_COUNT) {
+        if (currlayer->algo->getframecount() >= currlayer->algo->getmaxframecount()) {
             if (generating) {
                 // call StopGenerating() to stop gentimer
                 Stop();
@@ -912,7 +926,8 @@ void MainFrame::OnGenTimer(wxTimerEvent& WXUNUSED(event))
                 FinishUp();
             }
             wxString msg;
-            msg.Printf(_("No more frames can be recorded (maximum = %d)."), MAX_FRAME_COUNT);
+            msg.Printf(_("No more frames can be recorded (maximum = %d)."),
+                       currlayer->algo->getmaxframecount());
             Warning(msg);
             in_timer = false;
             return;
@@ -1576,6 +1591,7 @@ void MainFrame::ChangeAlgorithm(algo_type newalgotype, const wxString& newrule,
     }
     
     // delete old universe and point current universe to new universe
+    currlayer->undoredo->SavePinnedPatterns();
     delete currlayer->algo;
     currlayer->algo = newalgo;   
     SetGenIncrement();
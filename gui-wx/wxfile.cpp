@@ -118,6 +118,7 @@ void MainFrame::CreateUniverse()
     wxString oldrule = wxString(currlayer->algo->getrule(), wxConvLocal);
     
     // delete old universe and create new one of same type
+    currlayer->undoredo->SavePinnedPatterns();
     delete currlayer->algo;
     currlayer->algo = CreateNewUniverse(currlayer->algtype);
     
@@ -297,6 +298,7 @@ void MainFrame::LoadPattern(const wxString& path, const wxString& newtitle,
     wxString oldrule = wxString(currlayer->algo->getrule(), wxConvLocal);
     
     // delete old universe and create new one of same type
+    currlayer->undoredo->SavePinnedPatterns();
     delete currlayer->algo;
     currlayer->algo = CreateNewUniverse(currlayer->algtype);
     
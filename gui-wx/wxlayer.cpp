@@ -2959,9 +2959,10 @@ Layer::~Layer()
         }
         
     } else {
-        // this layer is not a clone, so delete universe and undo/redo history
-        delete algo;
+        // this layer is not a clone, so delete undo/redo history and universe
+        // (the history may have patterns pinned in the universe)
         delete undoredo;
+        delete algo;
         
         // delete tempstart file if it exists
         if (wxFileExists(tempstart)) wxRemoveFile(tempstart);
@@ -915,6 +915,69 @@ static int g_evolve(lua_State* L)
 
 // -----------------------------------------------------------------------------
 
+// a cell buffer is a userdata holding a packed cell array (see cellbuffer
+// in lifealgo.h); it can be indexed like a cell array, # gives its length
+// and buf:totable() converts it to a cell array
+
+static const char* CELLBUF = "golly.cellbuf";
+
+static int cellbuf_gc(lua_State* L)
+{
+    cellbuffer* buf = (cellbuffer*) luaL_checkudata(L, 1, CELLBUF);
+    buf->~cellbuffer();
+    return 0;
+}
+
+static int cellbuf_len(lua_State* L)
+{
+    cellbuffer* buf = (cellbuffer*) luaL_checkudata(L, 1, CELLBUF);
+    lua_pushinteger(L, buf->size());
+    return 1;
+}
+
+static int cellbuf_totable(lua_State* L)
+{
+    cellbuffer* buf = (cellbuffer*) luaL_checkudata(L, 1, CELLBUF);
+    int numints = (int)buf->size();
+    lua_createtable(L, numints, 0);
+    for (int i = 0; i < numints; i++) {
+        lua_pushinteger(L, buf->cells[i]); lua_rawseti(L, -2, i+1);
+    }
+    return 1;   // result is a cell array
+}
+
+static int cellbuf_index(lua_State* L)
+{
+    cellbuffer* buf = (cellbuffer*) luaL_checkudata(L, 1, CELLBUF);
+    if (lua_isinteger(L, 2)) {
+        lua_Integer i = lua_tointeger(L, 2);
+        if (i >= 1 && i <= (lua_Integer)buf->size()) {
+            lua_pushinteger(L, buf->cells[i-1]);
+            return 1;
+        }
+    } else if (lua_type(L, 2) == LUA_TSTRING && strcmp(lua_tostring(L, 2), "totable") == 0) {
+        lua_pushcfunction(L, cellbuf_totable);
+        return 1;
+    }
+    lua_pushnil(L);
+    return 1;
+}
+
+static cellbuffer* NewCellBuf(lua_State* L)
+{
+    // push a new empty cell buffer
+    cellbuffer* buf = new (lua_newuserdatauv(L, sizeof(cellbuffer), 0)) cellbuffer();
+    if (luaL_newmetatable(L, CELLBUF)) {
+        lua_pushcfunction(L, cellbuf_gc);    lua_setfield(L, -2, "__gc");
+        lua_pushcfunction(L, cellbuf_len);   lua_setfield(L, -2, "__len");
+        lua_pushcfunction(L, cellbuf_index); lua_setfield(L, -2, "__index");
+    }
+    lua_setmetatable(L, -2);
+    return buf;
+}
+
+// -----------------------------------------------------------------------------
+
 static const char* BAD_STATE = "putcells error: state value is out of range.";
 
 static int g_putcells(lua_State* L)
@@ -922,7 +985,8 @@ static int g_putcells(lua_State* L)
     AUTORELEASE_POOL
     CheckEvents(L);
     
-    luaL_checktype(L, 1, LUA_TTABLE);   // cell array
+    cellbuffer* cellbuf = (cellbuffer*) luaL_testudata(L, 1, CELLBUF);
+    if (!cellbuf) luaL_checktype(L, 1, LUA_TTABLE);   // cell array
 
     // defaults for optional params
     int x0  = 0;
@@ -954,6 +1018,14 @@ static int g_putcells(lua_State* L)
         GollyError(L, "putcells error: unknown mode.");
     }
     
+    if (cellbuf) {
+        // the algorithm reads the packed cells where they are
+        const char* err = GSF_putcellbuf(cellbuf->data(), (int)cellbuf->size(),
+                                         x0, y0, axx, axy, ayx, ayy, mode, BAD_STATE);
+        if (err) GollyError(L, err);
+        return 0;   // no result
+    }
+    
     // save cell changes if undo/redo is enabled and script isn't constructing a pattern
     bool savecells = allowundo && !currlayer->stayclean;
     // use ChangeCell below and combine all changes due to consecutive setcell/putcells
@@ -1144,6 +1216,35 @@ static int g_getcells(lua_State* L)
 
 // -----------------------------------------------------------------------------
 
+static int g_getcellbuf(lua_State* L)
+{
+    AUTORELEASE_POOL
+    CheckEvents(L);
+
+    luaL_checktype(L, 1, LUA_TTABLE);   // rect array with 0 or 4 ints
+
+    cellbuffer* buf = NewCellBuf(L);
+    
+    int numints = luaL_len(L, 1);
+    if (numints == 0) {
+        // return empty cell buffer
+    } else if (numints == 4) {
+        lua_rawgeti(L, 1, 1); int ileft = luaL_checkinteger(L,-1); lua_pop(L,1);
+        lua_rawgeti(L, 1, 2); int itop  = luaL_checkinteger(L,-1); lua_pop(L,1);
+        lua_rawgeti(L, 1, 3); int wd    = luaL_checkinteger(L,-1); lua_pop(L,1);
+        lua_rawgeti(L, 1, 4); int ht    = luaL_checkinteger(L,-1); lua_pop(L,1);
+        
+        const char* err = GSF_getcellbuf(ileft, itop, wd, ht, *buf);
+        if (err) GollyError(L, err);
+    } else {
+        GollyError(L, "getcellbuf error: array must be {} or {x,y,wd,ht}.");
+    }
+    
+    return 1;   // result is a cell buffer
+}
+
+// -----------------------------------------------------------------------------
+
 // maybe only use algo->getcells method if algo is hash-based???!!!
 // (needs more thought and more testing)
 
@@ -1308,6 +1409,57 @@ static int g_hash(lua_State* L)
 
 // -----------------------------------------------------------------------------
 
+static int g_findperiod(lua_State* L)
+{
+    AUTORELEASE_POOL
+    CheckEvents(L);
+    
+    int maxgens = luaL_checkinteger(L, 1);
+    
+    bool found;
+    bigint period, dx, dy;
+    const char* err = GSF_findperiod(bigint(maxgens), false, found, period, dx, dy);
+    if (err) GollyError(L, err);
+    
+    lua_newtable(L);
+    if (found) {
+        lua_pushinteger(L, period.toint64()); lua_rawseti(L, -2, 1);
+        lua_pushinteger(L, dx.toint64());     lua_rawseti(L, -2, 2);
+        lua_pushinteger(L, dy.toint64());     lua_rawseti(L, -2, 3);
+    }
+    
+    return 1;   // result is a table (empty or {period, dx, dy})
+}
+
+// -----------------------------------------------------------------------------
+
+static int g_testperiod(lua_State* L)
+{
+    AUTORELEASE_POOL
+    CheckEvents(L);
+    
+    const char* genstring = luaL_checkstring(L, 1);
+    bigint gens(genstring);
+    if (gens <= bigint::zero) {
+        GollyError(L, "testperiod error: number of generations must be positive.");
+    }
+    
+    bool found;
+    bigint period, dx, dy;
+    const char* err = GSF_findperiod(gens, true, found, period, dx, dy);
+    if (err) GollyError(L, err);
+    
+    lua_newtable(L);
+    if (found) {
+        lua_pushinteger(L, dx.toint64()); lua_rawseti(L, -2, 1);
+        lua_pushinteger(L, dy.toint64()); lua_rawseti(L, -2, 2);
+    }
+    
+    return 1;   // result is a table (empty or {dx, dy})
+}
+
+// -----------------------------------------------------------------------------
+
 static int g_getclip(lua_State* L)
 {
     AUTORELEASE_POOL
@@ -2977,11 +3129,14 @@ static const struct luaL_Reg gollyfuncs [] = {
     { "parse",        g_parse },        // parse RLE or Life 1.05 string and return cell array
     { "transform",    g_transform },    // apply an affine transformation to cell array
     { "evolve",       g_evolve },       // generate pattern contained in given cell array
-    { "putcells",     g_putcells },     // paste given cell array into current universe
+    { "putcells",     g_putcells },     // paste given cell array or buffer into current universe
     { "getcells",     g_getcells },     // return cell array in given rectangle
+    { "getcellbuf",   g_getcellbuf },   // return packed cell buffer for given rectangle
     // { "getcells2",     g_getcells2 },     // experimental version (needs more thought!!!)
     { "join",         g_join },         // return concatenation of given cell arrays
     { "hash",         g_hash },         // return hash value for pattern in given rectangle
+    { "findperiod",   g_findperiod },   // return period and displacement of pattern, if it repeats
+    { "testperiod",   g_testperiod },   // return displacement if pattern repeats after given gens
     { "getclip",      g_getclip },      // return pattern in clipboard (as wd, ht, cell array)
     { "select",       g_select },       // select {x, y, wd, ht} rectangle or remove if {}
     { "getrect",      g_getrect },      // return pattern rectangle as {} or {x, y, wd, ht}
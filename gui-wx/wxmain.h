@@ -74,7 +74,8 @@ public:
     // edit functions
     void ToggleAllowUndo();
     void RestorePattern(bigint& gen, const wxString& filename,
-                        bigint& x, bigint& y, int mag, int base, int expo);
+                        bigint& x, bigint& y, int mag, int base, int expo,
+                        void* state = NULL);
     
     // prefs functions
     void SetRandomFillPercentage();
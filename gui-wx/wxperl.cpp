@@ -1297,10 +1297,13 @@ XS(pl_putcells)
         PERL_ERROR("Usage: g_putcells($cells,$x=0,$y=0,$axx=1,$axy=0,$ayx=0,$ayy=1,$mode='or').");
     
     SV* cells = ST(0);
-    if ( (!SvROK(cells)) || (SvTYPE(SvRV(cells)) != SVt_PVAV) ) {
+    // the cells can also be a string of native ints packed as g_getcellbuf
+    // returns them
+    bool packed = !SvROK(cells) && SvPOK(cells);
+    if ( !packed && ((!SvROK(cells)) || (SvTYPE(SvRV(cells)) != SVt_PVAV)) ) {
         PERL_ERROR("g_putcells error: 1st parameter is not a valid array reference.");
     }
-    AV* inarray = (AV*)SvRV(cells);
+    AV* inarray = packed ? NULL : (AV*)SvRV(cells);
     
     // default values for optional params
     int x0  = 0;
@@ -1333,6 +1336,28 @@ XS(pl_putcells)
         PERL_ERROR("g_putcells error: unknown mode.");
     }
     
+    if (packed) {
+        STRLEN len;
+        const char* p = SvPV(cells, len);
+        if (len % sizeof(int) != 0)
+            PERL_ERROR("g_putcells error: packed string length must be a multiple of 4.");
+        // the algorithm reads the packed cells where they are (unless the
+        // string isn't aligned for ints)
+        const char* err;
+        {
+            std::vector<int> aligned;
+            if ((size_t)p % sizeof(int) != 0) {
+                aligned.resize(len / sizeof(int));
+                if (len) memcpy(&aligned[0], p, len);
+                p = (const char*)(len ? &aligned[0] : NULL);
+            }
+            err = GSF_putcellbuf((const int*)p, (int)(len / sizeof(int)),
+                                 x0, y0, axx, axy, ayx, ayy, mode, BAD_STATE);
+        }
+        if (err) PERL_ERROR(err);
+        XSRETURN(0);
+    }
+    
     // save cell changes if undo/redo is enabled and script isn't constructing a pattern
     bool savecells = allowundo && !currlayer->stayclean;
     // use ChangeCell below and combine all changes due to consecutive setcell/putcells
@@ -1524,6 +1549,33 @@ XS(pl_getcells)
 
 // -----------------------------------------------------------------------------
 
+XS(pl_getcellbuf)
+{
+    IGNORE_UNUSED_PARAMS;
+    RETURN_IF_ABORTED;
+    dXSARGS;
+    if (items != 0 && items != 4) PERL_ERROR("Usage: $packed = g_getcellbuf(@rect).");
+    
+    // convert pattern in given rect into a cell array packed as native ints
+    cellbuffer buf;
+    
+    if (items == 4) {
+        int x  = SvIV(ST(0));
+        int y  = SvIV(ST(1));
+        int wd = SvIV(ST(2));
+        int ht = SvIV(ST(3));
+        const char* err = GSF_getcellbuf(x, y, wd, ht, buf);
+        if (err) PERL_ERROR(err);
+    }
+    
+    SP -= items;
+    const char* p = buf.size() ? (const char*)buf.data() : "";
+    ST(0) = sv_2mortal( newSVpvn(p, buf.size() * sizeof(int)) );
+    XSRETURN(1);
+}
+
+// -----------------------------------------------------------------------------
+
 XS(pl_join)
 {
     IGNORE_UNUSED_PARAMS;
@@ -3128,6 +3180,7 @@ EXTERN_C void xs_init(pTHX)
     newXS((char*)"g_evolve",       pl_evolve,       (char*)file);
     newXS((char*)"g_putcells",     pl_putcells,     (char*)file);
     newXS((char*)"g_getcells",     pl_getcells,     (char*)file);
+    newXS((char*)"g_getcellbuf",   pl_getcellbuf,   (char*)file);
     newXS((char*)"g_join",         pl_join,         (char*)file);
     newXS((char*)"g_hash",         pl_hash,         (char*)file);
     newXS((char*)"g_getclip",      pl_getclip,      (char*)file);
@@ -117,12 +117,21 @@ extern "C"
     PyObject*(*G_PyList_GetItem)(PyObject*, int) = NULL;
     int(*G_PyList_Append)(PyObject*, PyObject*) = NULL;
 
+    // bytes (packed cell lists)
+    PyTypeObject *G_PyBytes_Type = NULL;
+    PyTypeObject *G_PyByteArray_Type = NULL;
+    PyObject*(*G_PyBytes_FromStringAndSize)(const char*, Py_ssize_t) = NULL;
+    int(*G_PyBytes_AsStringAndSize)(PyObject*, char**, Py_ssize_t*) = NULL;
+    char*(*G_PyByteArray_AsString)(PyObject*) = NULL;
+    Py_ssize_t(*G_PyByteArray_Size)(PyObject*) = NULL;
+
     // parsing arguments and building values
     int(*G_PyArg_ParseTuple)(PyObject*, char*, ...) = NULL;
     PyObject*(*G_Py_BuildValue)(const char*, ...) = NULL;
 
     // general objects
     PyObject*(*G_PyObject_GetAttrString)(PyObject*, const char*) = NULL;
+    int(*G_PyType_IsSubtype)(PyTypeObject*, PyTypeObject*) = NULL;
 
     // Modules
     int(*G_PyImport_AppendInittab)(const char*, PyObject*(*)(void)) = NULL;
@@ -250,9 +259,16 @@ static bool LoadPythonLib()
         LOAD_PYTHON_SYMBOL(PyList_Append);
         LOAD_PYTHON_SYMBOL(PyList_GetItem);
         LOAD_PYTHON_SYMBOL(PyList_Size);
+        LOAD_PYTHON_SYMBOL(PyBytes_Type);
+        LOAD_PYTHON_SYMBOL(PyByteArray_Type);
+        LOAD_PYTHON_SYMBOL(PyBytes_FromStringAndSize);
+        LOAD_PYTHON_SYMBOL(PyBytes_AsStringAndSize);
+        LOAD_PYTHON_SYMBOL(PyByteArray_AsString);
+        LOAD_PYTHON_SYMBOL(PyByteArray_Size);
         LOAD_PYTHON_SYMBOL(Py_BuildValue);
         LOAD_PYTHON_SYMBOL(PyArg_ParseTuple);
         LOAD_PYTHON_SYMBOL(PyObject_GetAttrString);
+        LOAD_PYTHON_SYMBOL(PyType_IsSubtype);
         LOAD_PYTHON_SYMBOL(PyImport_ImportModule);
         LOAD_PYTHON_SYMBOL(PyImport_AppendInittab);
         LOAD_PYTHON_SYMBOL(PyModule_Create2);
@@ -298,6 +314,11 @@ static void GetPythonObjects()
 #define G_Py_RETURN_NONE return G_Py_IncRef(G_Py_None), G_Py_None
 #define PYTHON_ERROR(msg) { G_PyErr_SetString(G_PyExc_RuntimeError, msg); return NULL; }
 
+// the same tests as PyList_Check etc (which need symbols from the Python lib)
+#define G_PyList_Check(op) G_PyType_IsSubtype(Py_TYPE(op), G_PyList_Type)
+#define G_PyBytes_Check(op) G_PyType_IsSubtype(Py_TYPE(op), G_PyBytes_Type)
+#define G_PyByteArray_Check(op) G_PyType_IsSubtype(Py_TYPE(op), G_PyByteArray_Type)
+
 #define CheckRGB(r,g,b,cmd)                                            \
     if (r < 0 || r > 255 || g < 0 || g > 255 || g < 0 || g > 255) {    \
         char msg[128];                                                 \
@@ -1185,10 +1206,26 @@ static PyObject* py_putcells(PyObject* self, PyObject* args)
     // have dead cells so in that case 'copy' mode is not the same as 'or' mode
     const char* mode = "or";
     
-    if (!G_PyArg_ParseTuple(args, (char*)"O!|lllllls", G_PyList_Type, &list,
+    if (!G_PyArg_ParseTuple(args, (char*)"O|lllllls", &list,
                           &x0, &y0, &axx, &axy, &ayx, &ayy, &mode))
         return NULL;
     
+    // the cells can also be packed as native ints in a bytes or bytearray
+    // object, as getcellbuf returns them
+    char* packed = NULL;
+    Py_ssize_t packedlen = 0;
+    bool islist = G_PyList_Check(list) != 0;
+    if (islist) {
+        // the usual cell list
+    } else if (G_PyBytes_Check(list)) {
+        if (G_PyBytes_AsStringAndSize(list, &packed, &packedlen) < 0) return NULL;
+    } else if (G_PyByteArray_Check(list)) {
+        packed = G_PyByteArray_AsString(list);
+        packedlen = G_PyByteArray_Size(list);
+    } else {
+        PYTHON_ERROR("putcells error: 1st arg must be a cell list or bytes.");
+    }
+    
     wxString modestr = wxString(mode, PY_ENC);
     if ( !(  modestr.IsSameAs(wxT("or"), false)
            || modestr.IsSameAs(wxT("xor"), false)
@@ -1198,6 +1235,16 @@ static PyObject* py_putcells(PyObject* self, PyObject* args)
         PYTHON_ERROR("putcells error: unknown mode.");
     }
     
+    if (!islist) {
+        if (packedlen % sizeof(int) != 0)
+            PYTHON_ERROR("putcells error: bytes length must be a multiple of 4.");
+        // the algorithm reads the packed cells where they are
+        const char* err = GSF_putcellbuf((const int*)packed, (int)(packedlen / sizeof(int)),
+                                         x0, y0, axx, axy, ayx, ayy, mode, BAD_STATE);
+        if (err) PYTHON_ERROR(err);
+        G_Py_RETURN_NONE;
+    }
+    
     // save cell changes if undo/redo is enabled and script isn't constructing a pattern
     bool savecells = allowundo && !currlayer->stayclean;
     // use ChangeCell below and combine all changes due to consecutive setcell/putcells
@@ -1409,6 +1456,37 @@ static PyObject* py_getcells(PyObject* self, PyObject* args)
 
 // -----------------------------------------------------------------------------
 
+static PyObject* py_getcellbuf(PyObject* self, PyObject* args)
+{
+    AUTORELEASE_POOL
+    if (PythonScriptAborted()) return NULL;
+    wxUnusedVar(self);
+    PyObject* rect_list;
+    
+    if (!G_PyArg_ParseTuple(args, (char*)"O!", G_PyList_Type, &rect_list)) return NULL;
+    
+    // convert pattern in given rect into a cell list packed as native ints
+    cellbuffer buf;
+    
+    int numitems = G_PyList_Size(rect_list);
+    if (numitems == 0) {
+        // return empty bytes
+    } else if (numitems == 4) {
+        int ileft = G_PyLong_AsLong( G_PyList_GetItem(rect_list, 0) );
+        int itop = G_PyLong_AsLong( G_PyList_GetItem(rect_list, 1) );
+        int wd = G_PyLong_AsLong( G_PyList_GetItem(rect_list, 2) );
+        int ht = G_PyLong_AsLong( G_PyList_GetItem(rect_list, 3) );
+        const char* err = GSF_getcellbuf(ileft, itop, wd, ht, buf);
+        if (err) PYTHON_ERROR(err);
+    } else {
+        PYTHON_ERROR("getcellbuf error: arg must be [] or [x,y,wd,ht].");
+    }
+    
+    return G_PyBytes_FromStringAndSize((const char*)buf.data(), buf.size() * sizeof(int));
+}
+
+// -----------------------------------------------------------------------------
+
 static PyObject* py_join(PyObject* self, PyObject* args)
 {
     AUTORELEASE_POOL
@@ -1502,6 +1580,60 @@ static PyObject* py_hash(PyObject* self, PyObject* args)
 
 // -----------------------------------------------------------------------------
 
+static PyObject* py_findperiod(PyObject* self, PyObject* args)
+{
+    AUTORELEASE_POOL
+    if (PythonScriptAborted()) return NULL;
+    wxUnusedVar(self);
+    int maxgens;
+    
+    if (!G_PyArg_ParseTuple(args, (char*)"i", &maxgens)) return NULL;
+    
+    bool found;
+    bigint period, dx, dy;
+    const char* err = GSF_findperiod(bigint(maxgens), false, found, period, dx, dy);
+    if (err) PYTHON_ERROR(err);
+    
+    // return [period, dx, dy], or [] if the pattern didn't repeat
+    PyObject* outlist = G_PyList_New(0);
+    if (found) {
+        AddState(outlist, period.toint());
+        AddTwoInts(outlist, dx.toint(), dy.toint());
+    }
+    
+    return outlist;
+}
+
+// -----------------------------------------------------------------------------
+
+static PyObject* py_testperiod(PyObject* self, PyObject* args)
+{
+    AUTORELEASE_POOL
+    if (PythonScriptAborted()) return NULL;
+    wxUnusedVar(self);
+    const char* genstring = NULL;
+    
+    if (!G_PyArg_ParseTuple(args, (char*)"s", &genstring)) return NULL;
+    
+    bigint gens(genstring);
+    if (gens <= bigint::zero) {
+        PYTHON_ERROR("testperiod error: number of generations must be positive.");
+    }
+    
+    bool found;
+    bigint period, dx, dy;
+    const char* err = GSF_findperiod(gens, true, found, period, dx, dy);
+    if (err) PYTHON_ERROR(err);
+    
+    // return [dx, dy], or [] if the pattern isn't the same after gens
+    PyObject* outlist = G_PyList_New(0);
+    if (found) AddTwoInts(outlist, dx.toint(), dy.toint());
+    
+    return outlist;
+}
+
+// -----------------------------------------------------------------------------
+
 static PyObject* py_getclip(PyObject* self, PyObject* args)
 {
     AUTORELEASE_POOL
@@ -3063,8 +3195,11 @@ static PyMethodDef py_methods[] = {
     { "evolve",       py_evolve,     METH_VARARGS, "generate pattern contained in given cell list" },
     { "putcells",     py_putcells,   METH_VARARGS, "paste given cell list into current universe" },
     { "getcells",     py_getcells,   METH_VARARGS, "return cell list in given rectangle" },
+    { "getcellbuf",   py_getcellbuf, METH_VARARGS, "return cell list in given rectangle packed in bytes" },
     { "join",         py_join,       METH_VARARGS, "return concatenation of given cell lists" },
     { "hash",         py_hash,       METH_VARARGS, "return hash value for pattern in given rectangle" },
+    { "findperiod",   py_findperiod, METH_VARARGS, "return period and displacement of pattern, if it repeats" },
+    { "testperiod",   py_testperiod, METH_VARARGS, "return displacement if pattern repeats after given gens" },
     { "getclip",      py_getclip,    METH_VARARGS, "return pattern in clipboard (as cell list)" },
     { "select",       py_select,     METH_VARARGS, "select [x, y, wd, ht] rectangle or remove if []" },
     { "getrect",      py_getrect,    METH_VARARGS, "return pattern rectangle as [] or [x, y, wd, ht]" },
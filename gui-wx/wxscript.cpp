@@ -28,6 +28,7 @@
 #include "wxpython.h"      // for RunPythonScript, AbortPythonScript
 #include "wxoverlay.h"     // for curroverlay
 #include "wxscript.h"
+#include "periodfinder.h"
 
 // =============================================================================
 
@@ -566,37 +567,174 @@ const char* GSF_checkrect(int x, int y, int wd, int ht)
 
 // -----------------------------------------------------------------------------
 
-int GSF_hash(int x, int y, int wd, int ht)
+const char* GSF_getcellbuf(int x, int y, int wd, int ht, cellbuffer& buf)
+{
+    // get the cells in given rect as a packed cell list; the algorithm
+    // fills the buffer a run at a time
+    const char* err = GSF_checkrect(x, y, wd, ht);
+    if (err) return err;
+    currlayer->algo->getcells(buf, x, y, wd, ht);
+    return NULL;
+}
+
+// -----------------------------------------------------------------------------
+
+const char* GSF_putcellbuf(const int* cells, int numints, int x0, int y0,
+                           int axx, int axy, int ayx, int ayy, const char* mode,
+                           const char* badstate)
 {
-    // calculate a hash value for pattern in given rect
-    int hash = 31415962;
-    int right = x + wd - 1;
-    int bottom = y + ht - 1;
-    int cx, cy;
-    int v = 0;
+    // paste a packed cell list into the current universe; this is what
+    // putcells does with a cell list, but the ints are read in place;
+    // badstate is the caller's message for a state value out of range
+    wxString modestr = wxString(mode, wxConvLocal);
+    bool ormode = modestr.IsSameAs(wxT("or"), false);
+    bool copymode = modestr.IsSameAs(wxT("copy"), false);
+    bool notmode = modestr.IsSameAs(wxT("not"), false);
+    bool andmode = modestr.IsSameAs(wxT("and"), false);
+    bool xormode = modestr.IsSameAs(wxT("xor"), false);
+    if (!(ormode || copymode || notmode || andmode || xormode)) return "Unknown mode.";
+
+    bool savecells = allowundo && !currlayer->stayclean;
+    bool multistate = (numints & 1) == 1;
+    int ints_per_cell = multistate ? 3 : 2;
+    int num_cells = numints / ints_per_cell;
     lifealgo* curralgo = currlayer->algo;
-    bool multistate = curralgo->NumCellStates() > 2;
-
-    for ( cy=y; cy<=bottom; cy++ ) {
-        int yshift = cy - y;
-        for ( cx=x; cx<=right; cx++ ) {
-            int skip = curralgo->nextcell(cx, cy, v);
-            if (skip >= 0) {
-                // found next live cell in this row (v is >= 1 if multistate)
-                cx += skip;
-                if (cx <= right) {
-                    // need to use a good hash function for patterns like AlienCounter.rle
-                    hash = (hash * 1000003) ^ yshift;
-                    hash = (hash * 1000003) ^ (cx - x);
-                    if (multistate) hash = (hash * 1000003) ^ v;
-                }
+    const char* err = NULL;
+    bool pattchanged = false;
+
+    // if nothing has to be remembered for undo and each cell just gets its
+    // own state then the algorithm can set them all at once
+    bool bulk = !savecells && axx == 1 && axy == 0 && ayx == 0 && ayy == 1;
+    if (bulk && ormode && multistate) {
+        // dead cells in 'or' mode leave the old state, so can't be set
+        for (int n = 0; n < num_cells && bulk; n++)
+            if (cells[3 * n + 2] == 0) bulk = false;
+    }
+    if (bulk && (ormode || copymode)) {
+        if (curralgo->gridwd > 0 || curralgo->gridht > 0) {
+            for (int n = 0; n < num_cells; n++) {
+                int item = ints_per_cell * n;
+                err = GSF_checkpos(curralgo, x0 + cells[item], y0 + cells[item + 1]);
+                if (err) return err;
+            }
+        }
+        if (num_cells == 0) return NULL;
+        if (curralgo->setcells(cells, numints, multistate, x0, y0) < 0)
+            err = badstate;
+        curralgo->endofpattern();
+        MarkLayerDirty();
+        DoAutoUpdate();
+        return err;
+    }
+
+    if (andmode && curralgo->isEmpty()) return NULL;
+
+    int numstates = curralgo->NumCellStates();
+    for (int n = 0; n < num_cells; n++) {
+        int item = ints_per_cell * n;
+        int x = cells[item];
+        int y = cells[item + 1];
+        int newx = x0 + x * axx + y * axy;
+        int newy = y0 + x * ayx + y * ayy;
+        // check if newx,newy is outside bounded grid
+        err = GSF_checkpos(curralgo, newx, newy);
+        if (err) break;
+        int oldstate = curralgo->getcell(newx, newy);
+        // multi-state lists can contain dead cells so newstate might be 0
+        int newstate = multistate ? cells[item + 2] : 1;
+        if (andmode) {
+            if (newstate == oldstate || oldstate == 0) continue;
+            newstate = 0;
+        } else if (xormode) {
+            if (!multistate) {
+                newstate = 1 - oldstate;
+            } else if (newstate == oldstate) {
+                if (oldstate != 0) newstate = 0;
             } else {
-                cx = right;  // done this row
+                newstate = newstate ^ oldstate;
+                // if xor overflows then don't change current state
+                if (newstate >= numstates) newstate = oldstate;
+            }
+        } else if (notmode) {
+            newstate = multistate ? numstates - 1 - newstate : 0;
+        } else if (ormode && newstate == 0) {
+            newstate = oldstate;
+        }
+        if (newstate != oldstate) {
+            // paste (possibly transformed) cell into current universe
+            if (curralgo->setcell(newx, newy, newstate) < 0) {
+                err = badstate;
+                break;
             }
+            if (savecells) ChangeCell(newx, newy, oldstate, newstate);
+            pattchanged = true;
         }
     }
 
-    return hash;
+    if (pattchanged) {
+        curralgo->endofpattern();
+        MarkLayerDirty();
+        DoAutoUpdate();
+    }
+    return err;
+}
+
+// -----------------------------------------------------------------------------
+
+int GSF_hash(int x, int y, int wd, int ht)
+{
+    // calculate a hash value for pattern in given rect; the algorithm
+    // builds it from the hashes of its nodes or tiles, so the time taken
+    // depends on the pattern and not the size of the rect
+    cellhash::value h = currlayer->algo->gethash(bigint(y), bigint(x),
+                                                 bigint(y + ht - 1), bigint(x + wd - 1));
+    return (int)(h ^ (h >> 32));
+}
+
+// -----------------------------------------------------------------------------
+
+const char* GSF_findperiod(const bigint& gens, bool test, bool& found,
+                           bigint& period, bigint& dx, bigint& dy)
+{
+    // look for the period of the current pattern within gens generations,
+    // or if test is true see if it repeats after exactly gens generations;
+    // this is done in a copy so the current layer is left alone
+    found = false;
+    bigint top, left, bottom, right;
+    currlayer->algo->findedges(&top, &left, &bottom, &right);
+    if (!currlayer->algo->isEmpty() && viewptr->OutsideLimits(top, left, bottom, right)) {
+        return "Pattern is too big to copy.";
+    }
+    lifealgo* tempalgo = CreateNewUniverse(currlayer->algtype);
+    const char* err = tempalgo->setrule(currlayer->algo->getrule());
+    if (err) {
+        delete tempalgo;
+        return "Current rule is no longer valid!";
+    }
+    // same gen count so qlife's B0 emulation starts on the right parity
+    tempalgo->setGeneration(currlayer->algo->getGeneration());
+    if (!currlayer->algo->isEmpty()) {
+        if ( !viewptr->CopyRect(top.toint(), left.toint(), bottom.toint(), right.toint(),
+                                currlayer->algo, tempalgo, false, _("Copying pattern")) ) {
+            delete tempalgo;
+            return "Failed to copy pattern.";
+        }
+    }
+    
+    wxGetApp().PollerReset();
+    periodfinder finder(*tempalgo);
+    if (test)
+        finder.test(gens);
+    else
+        finder.find(gens);
+    found = finder.found != 0;
+    if (found) {
+        period = finder.period;
+        dx = finder.dx;
+        dy = finder.dy;
+    }
+    delete tempalgo;
+    return NULL;
 }
 
 // -----------------------------------------------------------------------------
@@ -97,7 +97,13 @@ const char* GSF_setcell(int x, int y, int newstate);
 const char* GSF_paste(int x, int y, const char* mode);
 const char* GSF_checkpos(lifealgo* algo, int x, int y);
 const char* GSF_checkrect(int x, int y, int wd, int ht);
+const char* GSF_getcellbuf(int x, int y, int wd, int ht, cellbuffer& buf);
+const char* GSF_putcellbuf(const int* cells, int numints, int x0, int y0,
+                           int axx, int axy, int ayx, int ayy, const char* mode,
+                           const char* badstate);
 int GSF_hash(int x, int y, int wd, int ht);
+const char* GSF_findperiod(const bigint& gens, bool test, bool& found,
+                           bigint& period, bigint& dx, bigint& dy);
 bool GSF_setoption(const char* optname, int newval, int* oldval);
 bool GSF_getoption(const char* optname, int* optval);
 bool GSF_setcolor(const char* colname, wxColor& newcol, wxColor& oldcol);
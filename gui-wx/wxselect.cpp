@@ -22,6 +22,8 @@
 #include "wxlayer.h"       // for currlayer, MarkLayerDirty, etc
 #include "wxselect.h"
 
+#include <vector>         // for std::vector
+
 // This module implements operations on selections.
 
 // -----------------------------------------------------------------------------
@@ -645,6 +647,7 @@ void Selection::AdvanceOutside()
         if (abort && savecells) {
             // revert back to pattern saved in oldalgo
             delete newalgo;
+            currlayer->undoredo->SavePinnedPatterns();
             delete currlayer->algo;
             currlayer->algo = oldalgo;
             mainptr->SetGenIncrement();
@@ -654,6 +657,7 @@ void Selection::AdvanceOutside()
     }
 
     // switch to new universe (best to do this even if aborted)
+    currlayer->undoredo->SavePinnedPatterns();
     delete currlayer->algo;
     currlayer->algo = newalgo;
     mainptr->SetGenIncrement();
@@ -687,6 +691,7 @@ void Selection::AdvanceOutside()
         } else {
             // revert back to pattern saved in oldalgo
             currlayer->undoredo->ForgetCellChanges();
+            currlayer->undoredo->SavePinnedPatterns();
             delete currlayer->algo;
             currlayer->algo = oldalgo;
             mainptr->SetGenIncrement();
@@ -1297,6 +1302,7 @@ void Selection::ClearOutside()
     if ( viewptr->CopyRect(top.toint(), left.toint(), bottom.toint(), right.toint(),
                            currlayer->algo, newalgo, false, _("Saving selection")) ) {
         // delete old universe and point currlayer->algo at new universe
+        currlayer->undoredo->SavePinnedPatterns();
         delete currlayer->algo;
         currlayer->algo = newalgo;
         mainptr->SetGenIncrement();
@@ -1329,7 +1335,6 @@ void Selection::AddEOL(char* &chptr)
 
 // -----------------------------------------------------------------------------
 
-const int WRLE_NONE = -3;
 const int WRLE_EOP = -2;
 const int WRLE_NEWLINE = -1;
 
@@ -1384,6 +1389,90 @@ void Selection::AddRun(int state,                // in: state of cell to write
 
 // -----------------------------------------------------------------------------
 
+// CopyToClipboard gets the live cells in the selection from the algorithm
+// as runs; the dead cells and row ends between them follow from where the
+// runs are, and the cells to cut are remembered until the walk is done
+
+class Selection::ClipboardRuns : public liferunsink
+{
+public:
+    ClipboardRuns(Selection* selarg, int multistatearg, bool cutarg,
+                  unsigned int wdarg, unsigned int htarg)
+        : sel(selarg), multistate(multistatearg), cut(cutarg), wd(wdarg),
+          maxcount((double)wdarg * (double)htarg), linelen(0), livecount(0),
+          curx(0), cury(0), cntr(0), abort(false) {}
+
+    virtual int run(G_INT64 x, G_INT64 y, G_INT64 len, int state);
+
+    Selection* sel;
+    int multistate;
+    bool cut;
+    double wd, maxcount;
+    char* textptr;
+    char* etextptr;
+    char* chptr;
+    int cursize;
+    unsigned int linelen;
+    unsigned int livecount;
+    G_INT64 curx, cury;
+    int cntr;
+    bool abort;
+    std::vector<G_INT64> cutruns;   // x, y, length and state of each run
+};
+
+// -----------------------------------------------------------------------------
+
+int Selection::ClipboardRuns::run(G_INT64 x, G_INT64 y, G_INT64 len, int state)
+{
+    unsigned int n;
+    if (chptr + 60 >= etextptr) {
+        // nearly out of space; try to increase allocation
+        char* ntxtptr = (char*) realloc(textptr, 2*cursize);
+        if (ntxtptr == 0) {
+            statusptr->ErrorMessage(_("No more memory for clipboard data!"));
+            // stop here rather than fail so that partially cut/copied
+            // portion gets saved to clipboard
+            abort = true;
+            return 1;
+        }
+        chptr = ntxtptr + (chptr - textptr);
+        cursize *= 2;
+        etextptr = ntxtptr + cursize;
+        textptr = ntxtptr;
+    }
+    if (y > cury) {
+        // output current run of $ chars
+        n = (unsigned int)(y - cury);
+        sel->AddRun(WRLE_NEWLINE, multistate, n, linelen, chptr);
+        cury = y;
+        curx = 0;
+    }
+    if (x > curx) {
+        // output current run of dead cells
+        n = (unsigned int)(x - curx);
+        sel->AddRun(0, multistate, n, linelen, chptr);
+    }
+    n = (unsigned int)len;
+    sel->AddRun(state, multistate, n, linelen, chptr);
+    curx = x + len;
+    livecount += (unsigned int)len;
+    if (cut) {
+        cutruns.push_back(x);
+        cutruns.push_back(y);
+        cutruns.push_back(len);
+        cutruns.push_back(state);
+    }
+    cntr++;
+    if ((cntr % 4096) == 0) {
+        double prog = (y * wd + x) / maxcount;
+        abort = AbortProgress(prog, wxEmptyString);
+        if (abort) return 1;
+    }
+    return 0;
+}
+
+// -----------------------------------------------------------------------------
+
 void Selection::CopyToClipboard(bool cut)
 {
     // can only use getcell/setcell in limited domain
@@ -1399,138 +1488,58 @@ void Selection::CopyToClipboard(bool cut)
     unsigned int wd = iright - ileft + 1;
     unsigned int ht = ibottom - itop + 1;
 
-    // convert cells in selection to RLE data in textptr
-    char* textptr;
-    char* etextptr;
-    int cursize = 4096;
+    lifealgo* curralgo = currlayer->algo;
+    int multistate = curralgo->NumCellStates() > 2;
+    ClipboardRuns rle(this, multistate, cut, wd, ht);
 
-    textptr = (char*)malloc(cursize);
-    if (textptr == NULL) {
+    // convert cells in selection to RLE data in rle.textptr
+    rle.cursize = 4096;
+    rle.textptr = (char*)malloc(rle.cursize);
+    if (rle.textptr == NULL) {
         statusptr->ErrorMessage(_("Not enough memory for clipboard data!"));
         return;
     }
-    etextptr = textptr + cursize;
+    rle.etextptr = rle.textptr + rle.cursize;
 
     // add RLE header line
-    sprintf(textptr, "x = %u, y = %u, rule = %s", wd, ht, currlayer->algo->getrule());
-    char* chptr = textptr;
-    chptr += strlen(textptr);
-    AddEOL(chptr);
+    sprintf(rle.textptr, "x = %u, y = %u, rule = %s", wd, ht, curralgo->getrule());
+    rle.chptr = rle.textptr + strlen(rle.textptr);
+    AddEOL(rle.chptr);
     // save start of data in case livecount is zero
-    int datastart = chptr - textptr;
-
-    // add RLE pattern data
-    unsigned int livecount = 0;
-    unsigned int linelen = 0;
-    unsigned int brun = 0;
-    unsigned int orun = 0;
-    unsigned int dollrun = 0;
-    int laststate;
-    int cx, cy;
-    int v = 0;
+    int datastart = int(rle.chptr - rle.textptr);
 
     // save cell changes if undo/redo is enabled and script isn't constructing a pattern
     bool savecells = allowundo && !currlayer->stayclean;
     if (savecells && inscript) SavePendingChanges();
 
-    double maxcount = (double)wd * (double)ht;
-    int cntr = 0;
-    bool abort = false;
     if (cut)
         BeginProgress(_("Cutting selection"));
     else
         BeginProgress(_("Copying selection"));
 
-    lifealgo* curralgo = currlayer->algo;
-    int multistate = curralgo->NumCellStates() > 2;
-    for ( cy=itop; cy<=ibottom; cy++ ) {
-        laststate = WRLE_NONE;
-        for ( cx=ileft; cx<=iright; cx++ ) {
-            int skip = curralgo->nextcell(cx, cy, v);
-            if (skip + cx > iright)
-                skip = -1;           // pretend we found no more live cells
-            if (skip > 0) {
-                // have exactly "skip" empty cells here
-                if (laststate == 0) {
-                    brun += skip;
-                } else {
-                    if (orun > 0) {
-                        // output current run of live cells
-                        AddRun(laststate, multistate, orun, linelen, chptr);
-                    }
-                    laststate = 0;
-                    brun = skip;
-                }
-            }
-            if (skip >= 0) {
-                // found next live cell
-                cx += skip;
-                livecount++;
-                if (cut) {
-                    curralgo->setcell(cx, cy, 0);
-                    if (savecells) currlayer->undoredo->SaveCellChange(cx, cy, v, 0);
-                }
-                if (laststate == v) {
-                    orun++;
-                } else {
-                    if (dollrun > 0)
-                        // output current run of $ chars
-                        AddRun(WRLE_NEWLINE, multistate, dollrun, linelen, chptr);
-                    if (brun > 0)
-                        // output current run of dead cells
-                        AddRun(0, multistate, brun, linelen, chptr);
-                    if (orun > 0)
-                        // output current run of other live cells
-                        AddRun(laststate, multistate, orun, linelen, chptr);
-                    laststate = v;
-                    orun = 1;
-                }
-            } else {
-                cx = iright + 1;     // done this row
-            }
-            cntr++;
-            if ((cntr % 4096) == 0) {
-                double prog = ((cy - itop) * (double)(iright - ileft + 1) +
-                               (cx - ileft)) / maxcount;
-                abort = AbortProgress(prog, wxEmptyString);
-                if (abort) break;
-            }
-            if (chptr + 60 >= etextptr) {
-                // nearly out of space; try to increase allocation
-                char* ntxtptr = (char*) realloc(textptr, 2*cursize);
-                if (ntxtptr == 0) {
-                    statusptr->ErrorMessage(_("No more memory for clipboard data!"));
-                    // don't return here -- best to set abort flag and break so that
-                    // partially cut/copied portion gets saved to clipboard
-                    abort = true;
-                    break;
-                }
-                chptr = ntxtptr + (chptr - textptr);
-                cursize *= 2;
-                etextptr = ntxtptr + cursize;
-                textptr = ntxtptr;
-            }
+    // add RLE pattern data
+    curralgo->getruns(seltop, selleft, selbottom, selright, rle);
+
+    // kill the cells we copied (they can't be changed during the walk)
+    for (size_t i = 0; i < rle.cutruns.size(); i += 4) {
+        int cy = itop + (int)rle.cutruns[i+1];
+        int state = (int)rle.cutruns[i+3];
+        for (int cx = ileft + (int)rle.cutruns[i]; cx < ileft + rle.cutruns[i] + rle.cutruns[i+2]; cx++) {
+            curralgo->setcell(cx, cy, 0);
+            if (savecells) currlayer->undoredo->SaveCellChange(cx, cy, state, 0);
         }
-        if (abort) break;
-        // end of current row
-        if (laststate == 0)
-            // forget dead cells at end of row
-            brun = 0;
-        else if (laststate >= 0)
-            // output current run of live cells
-            AddRun(laststate, multistate, orun, linelen, chptr);
-        dollrun++;
     }
 
-    if (livecount == 0) {
+    char* chptr = rle.chptr;
+    if (rle.livecount == 0) {
         // no live cells in selection so simplify RLE data to "!"
-        chptr = textptr + datastart;
+        chptr = rle.textptr + datastart;
         *chptr = '!';
         chptr++;
     } else {
         // terminate RLE data
-        dollrun = 1;
-        AddRun(WRLE_EOP, multistate, dollrun, linelen, chptr);
+        unsigned int dollrun = 1;
+        AddRun(WRLE_EOP, multistate, dollrun, rle.linelen, chptr);
         if (cut) currlayer->algo->endofpattern();
     }
     AddEOL(chptr);
@@ -1538,16 +1547,16 @@ void Selection::CopyToClipboard(bool cut)
 
     EndProgress();
 
-    if (cut && livecount > 0) {
+    if (cut && rle.livecount > 0) {
         if (savecells) currlayer->undoredo->RememberCellChanges(_("Cut"), currlayer->dirty);
         // update currlayer->dirty AFTER RememberCellChanges
         MarkLayerDirty();
         mainptr->UpdatePatternAndStatus();
     }
 
-    wxString text = wxString(textptr,wxConvLocal);
+    wxString text = wxString(rle.textptr,wxConvLocal);
     mainptr->CopyTextToClipboard(text);
-    free(textptr);
+    free(rle.textptr);
 }
 
 // -----------------------------------------------------------------------------
@@ -1814,6 +1823,7 @@ bool Selection::Flip(bool topbottom, bool inundoredo)
 
         if ( FlipRect(topbottom, currlayer->algo, newalgo, false, itop, ileft, ibottom, iright) ) {
             // switch to newalgo
+            currlayer->undoredo->SavePinnedPatterns();
             delete currlayer->algo;
             currlayer->algo = newalgo;
             mainptr->SetGenIncrement();
@@ -2007,6 +2017,7 @@ bool Selection::RotatePattern(bool clockwise,
         selright  = newright;
 
         // switch to new universe and display results
+        currlayer->undoredo->SavePinnedPatterns();
         delete currlayer->algo;
         currlayer->algo = newalgo;
         mainptr->SetGenIncrement();
@@ -120,6 +120,9 @@ private:
     
     void AddEOL(char* &chptr);
     // these routines are used by CopyToClipboard to create RLE data
+
+    class ClipboardRuns;
+    // receives the runs of live cells for CopyToClipboard
     
     bool SaveDifferences(lifealgo* oldalgo, lifealgo* newalgo,
                          int itop, int ileft, int ibottom, int iright);
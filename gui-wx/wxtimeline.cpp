@@ -14,7 +14,7 @@
 #include "bigint.h"
 #include "lifealgo.h"
 
-#include "wxgolly.h"       // for viewptr, statusptr, mainptr
+#include "wxgolly.h"       // for wxGetApp, viewptr, statusptr, mainptr
 #include "wxmain.h"        // for mainptr->...
 #include "wxutils.h"       // for Warning, etc
 #include "wxprefs.h"       // for showtimeline, etc
@@ -63,7 +63,8 @@ public:
     void UpdateButtons();
     void UpdateSlider();
     void UpdateScrollBar();
-    void DisplayCurrentFrame();
+    void DisplayCurrentFrame(bool exact = true);
+    int FramePageSize();
     void StartAutoTimer();
     void StopAutoTimer();
 
@@ -343,41 +344,23 @@ void TimelineBar::DrawTimelineBar(wxDC& dc, int wd, int ht)
     dc.DrawLine(0, 0, r.width, 0);
     dc.SetPen(wxNullPen);
     
-    if (currlayer->algo->hyperCapable()) {
-        bool canplay = TimelineExists() && !currlayer->algo->isrecording();
-        tlbutt[RECORD_BUTT]->Show(true);
-        tlbutt[BACKWARDS_BUTT]->Show(canplay);
-        tlbutt[FORWARDS_BUTT]->Show(canplay);
-        tlbutt[DELETE_BUTT]->Show(canplay);
-        slider->Show(canplay);
-        framebar->Show(canplay);
-        
-        if (currlayer->algo->isrecording()) {
-            // show number of frames recorded so far
-            SetTimelineFont(dc);
-            dc.SetPen(*wxBLACK_PEN);
-            int x = smallgap + BUTTON_WD + 10;
-            int y = TBARHT - 8;
-            wxString str;
-            str.Printf(_("Frames recorded: %d"), currlayer->algo->getframecount());
-            DisplayText(dc, str, x, y - (SCROLLHT - digitht)/2);
-            dc.SetPen(wxNullPen);
-        }
-        
-    } else {
-        tlbutt[RECORD_BUTT]->Show(false);
-        tlbutt[BACKWARDS_BUTT]->Show(false);
-        tlbutt[FORWARDS_BUTT]->Show(false);
-        tlbutt[DELETE_BUTT]->Show(false);
-        slider->Show(false);
-        framebar->Show(false);
-        
+    bool canplay = TimelineExists() && !currlayer->algo->isrecording();
+    tlbutt[RECORD_BUTT]->Show(true);
+    tlbutt[BACKWARDS_BUTT]->Show(canplay);
+    tlbutt[FORWARDS_BUTT]->Show(canplay);
+    tlbutt[DELETE_BUTT]->Show(canplay);
+    slider->Show(canplay);
+    framebar->Show(canplay);
+    
+    if (currlayer->algo->isrecording()) {
+        // show number of frames recorded so far
         SetTimelineFont(dc);
         dc.SetPen(*wxBLACK_PEN);
-        int x = 6;
+        int x = smallgap + BUTTON_WD + 10;
         int y = TBARHT - 8;
-        DisplayText(dc, _("The current algorithm does not support timelines."),
-                    x, y - (SCROLLHT - digitht)/2);
+        wxString str;
+        str.Printf(_("Frames recorded: %d"), currlayer->algo->getframecount());
+        DisplayText(dc, str, x, y - (SCROLLHT - digitht)/2);
         dc.SetPen(wxNullPen);
     }
 }
@@ -497,9 +480,32 @@ void TimelineBar::OnSlider(wxScrollEvent& event)
 
 // -----------------------------------------------------------------------------
 
-void TimelineBar::DisplayCurrentFrame()
+void TimelineBar::DisplayCurrentFrame(bool exact)
 {
-    currlayer->algo->gotoframe(currlayer->currframe);
+    // an evicted frame is recomputed by stepping from the nearest kept frame;
+    // events handled while that happens can change currframe, in which case
+    // we show the new frame once the current one is done
+    static bool displaying = false;
+    static bool again = false;
+    static bool wantexact = true;
+    wantexact = exact;
+    if (displaying) {
+        again = true;
+        return;
+    }
+    displaying = true;
+    do {
+        again = false;
+        int frame = currlayer->currframe;
+        int kept = currlayer->algo->nearestkeptframe(frame);
+        if (!wantexact) {
+            frame = kept;
+        } else if (kept != frame) {
+            wxGetApp().PollerReset();
+        }
+        currlayer->algo->gotoframe(frame);
+    } while (again);
+    displaying = false;
     
     // FitInView(0) would be less jerky but has the disadvantage that
     // scale won't change if a pattern shrinks when going backwards
@@ -533,12 +539,12 @@ void TimelineBar::OnScroll(wxScrollEvent& event)
         DisplayCurrentFrame();
         
     } else if (type == wxEVT_SCROLL_PAGEUP) {
-        currlayer->currframe -= PAGESIZE;
+        currlayer->currframe -= FramePageSize();
         if (currlayer->currframe < 0) currlayer->currframe = 0;
         DisplayCurrentFrame();
         
     } else if (type == wxEVT_SCROLL_PAGEDOWN) {
-        currlayer->currframe += PAGESIZE;
+        currlayer->currframe += FramePageSize();
         if (currlayer->currframe >= currlayer->algo->getframecount())
             currlayer->currframe = currlayer->algo->getframecount() - 1;
         DisplayCurrentFrame();
@@ -549,9 +555,11 @@ void TimelineBar::OnScroll(wxScrollEvent& event)
             currlayer->currframe = 0;
         if (currlayer->currframe >= currlayer->algo->getframecount())
             currlayer->currframe = currlayer->algo->getframecount() - 1;
-        DisplayCurrentFrame();
+        // while dragging, show the nearest frame that needn't be recomputed
+        DisplayCurrentFrame(false);
         
     } else if (type == wxEVT_SCROLL_THUMBRELEASE) {
+        DisplayCurrentFrame();
         UpdateScrollBar();
     }
     
@@ -726,10 +734,19 @@ void TimelineBar::UpdateSlider()
 
 // -----------------------------------------------------------------------------
 
+int TimelineBar::FramePageSize()
+{
+    // page through long timelines in about 100 steps
+    int pagesize = currlayer->algo->getframecount() / 100;
+    return pagesize > PAGESIZE ? pagesize : PAGESIZE;
+}
+
+// -----------------------------------------------------------------------------
+
 void TimelineBar::UpdateScrollBar()
 {
     framebar->SetScrollbar(currlayer->currframe, 1,
-                           currlayer->algo->getframecount(), PAGESIZE, true);
+                           currlayer->algo->getframecount(), FramePageSize(), true);
 }
 
 // -----------------------------------------------------------------------------
@@ -823,7 +840,7 @@ void UpdateTimelineBar()
         // may need to change bitmaps in some buttons
         tbarptr->UpdateButtons();
         
-        tbarptr->EnableButton(RECORD_BUTT, active && currlayer->algo->hyperCapable());
+        tbarptr->EnableButton(RECORD_BUTT, active);
         
         // note that slider, scroll bar and some buttons are only shown if there is
         // a timeline and we're not recording (see DrawTimelineBar)
@@ -885,7 +902,7 @@ void ToggleTimelineBar()
 
 void StartStopRecording()
 {
-    if (!inscript && currlayer->algo->hyperCapable()) {
+    if (!inscript) {
         if (currlayer->algo->isrecording()) {
             mainptr->Stop();
             // StopGenerating() has called currlayer->algo->stoprecording()
@@ -900,10 +917,10 @@ void StartStopRecording()
             
             if (!showtimeline) ToggleTimelineBar();
             
-            if (currlayer->algo->getframecount() == MAX_FRAME_COUNT) {
+            if (currlayer->algo->getframecount() >= currlayer->algo->getmaxframecount()) {
                 wxString msg;
                 msg.Printf(_("The timeline can't be extended any further (max frames = %d)."),
-                           MAX_FRAME_COUNT);
+                           currlayer->algo->getmaxframecount());
                 statusptr->ErrorMessage(msg);
                 return;
             }
@@ -918,9 +935,13 @@ void StartStopRecording()
                 
                 mainptr->StartGenerating();
                 
-            } else {
+            } else if (currlayer->algo->hyperCapable()) {
                 // this should never happen
                 Warning(_("Bug: could not start recording!"));
+            } else {
+                // the other algorithms record the cells, which must be within
+                // the editing limits
+                statusptr->ErrorMessage(_("Pattern is too big to record."));
             }
         }
     }
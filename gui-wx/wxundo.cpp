@@ -213,7 +213,10 @@ public:
     // rotate/flip operation) then cancel the undo/redo
     
     void ChangeCells(bool undo);
-    // change cell states using cellinfo
+    // change cell states using cells
+    
+    void SavePinnedStates();
+    // save oldstate/newstate to oldfile/newfile and unpin them
     
     change_type changeid;                   // specifies the type of change
     wxString suffix;                        // action string for Undo/Redo item
@@ -221,8 +224,7 @@ public:
     bool newdirty;                          // layer's dirty state after change
     
     // cellstates info
-    cell_change* cellinfo;                  // dynamic array of cell changes
-    unsigned int cellcount;                 // number of cell changes in array
+    cellchanges cells;                      // compressed cell changes
     
     // rotatecw/rotateacw/selchange info
     Selection oldsel, newsel;               // old and new selections
@@ -230,6 +232,8 @@ public:
     // genchange info
     bool scriptgen;                         // gen change was done by script?
     wxString oldfile, newfile;              // old and new pattern files
+    void* oldstate, *newstate;              // or old and new pinned patterns
+    lifealgo* pinalgo;                      // universe holding pinned patterns
     bigint oldgen, newgen;                  // old and new generation counts
     bigint oldx, oldy, newx, newy;          // old and new positions
     int oldmag, newmag;                     // old and new scales
@@ -270,8 +274,9 @@ ChangeNode::ChangeNode(change_type id)
     changeid = id;
     startinfo = NULL;
     whichlayer = NULL;      // simplifies UndoRedo::DeletingClone
-    cellinfo = NULL;
-    cellcount = 0;
+    oldstate = NULL;
+    newstate = NULL;
+    pinalgo = NULL;
     oldfile = wxEmptyString;
     newfile = wxEmptyString;
     oldtempstart = wxEmptyString;
@@ -287,7 +292,11 @@ bool delete_all_temps = false;   // ok to delete all temporary files?
 ChangeNode::~ChangeNode()
 {
     if (startinfo) delete startinfo;
-    if (cellinfo) free(cellinfo);
+    
+    // the universe holding any pinned patterns is deleted after the undo
+    // history, or SavePinnedPatterns has been called
+    if (oldstate) pinalgo->unpinstate(oldstate);
+    if (newstate) pinalgo->unpinstate(newstate);
     
     // it's always ok to delete oldfile and newfile if they exist
     
@@ -334,37 +343,67 @@ ChangeNode::~ChangeNode()
 
 void ChangeNode::ChangeCells(bool undo)
 {
-    // avoid possible pattern update during a setcell call (can happen if cellcount is large)
+    // avoid possible pattern update during a setcell call (can happen if there are many changes)
     viewptr->nopattupdate = true;
 
-    // change state of cell(s) stored in cellinfo array
-    if (undo) {
-        // we must undo the cell changes in reverse order in case
-        // a script has changed the same cell more than once
-        unsigned int i = cellcount;
-        while (i > 0) {
-            i--;
-            currlayer->algo->setcell(cellinfo[i].x, cellinfo[i].y, cellinfo[i].oldstate);
-        }
-    } else {
-        unsigned int i = 0;
-        while (i < cellcount) {
-            currlayer->algo->setcell(cellinfo[i].x, cellinfo[i].y, cellinfo[i].newstate);
-            i++;
-        }
-    }
-    if (cellcount > 0) currlayer->algo->endofpattern();
+    // change state of cell(s) stored in cells (apply undoes the changes
+    // in reverse order in case a script has changed the same cell more than once)
+    cells.apply(*currlayer->algo, undo);
+    if (cells.count() > 0) currlayer->algo->endofpattern();
     
     viewptr->nopattupdate = false;
 }
 
 // -----------------------------------------------------------------------------
 
+static void WritePinnedPattern(void* state, bigint& gen, wxString& tempfile)
+{
+    // temporarily make the given pinned pattern the current one and save it
+    // in a unique temporary file, as SaveCurrentPattern would have done
+    lifealgo* algo = currlayer->algo;
+    bigint savegen = algo->getGeneration();
+    void* savestate = algo->pinstate();
+    algo->setcurrentstate(state);
+    algo->setGeneration(gen);
+    
+    tempfile = wxFileName::CreateTempFileName(tempdir + genchange_prefix);
+    const char* err = mainptr->WritePattern(tempfile, MC_format, no_compression, 0, 0, 0, 0);
+    
+    algo->setcurrentstate(savestate);
+    algo->setGeneration(savegen);
+    algo->unpinstate(savestate);
+    if (err) Warning(wxString(err,wxConvLocal));
+}
+
+// -----------------------------------------------------------------------------
+
+void ChangeNode::SavePinnedStates()
+{
+    if (oldstate == NULL && newstate == NULL) return;
+    
+    if (pinalgo != currlayer->algo) {
+        Warning(_("Bug detected in SavePinnedStates!"));
+        return;
+    }
+    if (oldstate) {
+        WritePinnedPattern(oldstate, oldgen, oldfile);
+        pinalgo->unpinstate(oldstate);
+        oldstate = NULL;
+    }
+    if (newstate) {
+        WritePinnedPattern(newstate, newgen, newfile);
+        pinalgo->unpinstate(newstate);
+        newstate = NULL;
+    }
+}
+
+// -----------------------------------------------------------------------------
+
 bool ChangeNode::DoChange(bool undo)
 {
     switch (changeid) {
         case cellstates:
-            if (cellcount > 0) {
+            if (cells.count() > 0) {
                 ChangeCells(undo);
                 mainptr->UpdatePatternAndStatus();
             }
@@ -386,7 +425,7 @@ bool ChangeNode::DoChange(bool undo)
             
         case rotatecw:
         case rotateacw:
-            if (cellcount > 0) {
+            if (cells.count() > 0) {
                 ChangeCells(undo);
             }
             // rotate selection edges
@@ -418,11 +457,13 @@ bool ChangeNode::DoChange(bool undo)
             if (undo) {
                 currlayer->tempstart = oldtempstart;    // in case script called reset()
                 currlayer->currsel = oldsel;
-                mainptr->RestorePattern(oldgen, oldfile, oldx, oldy, oldmag, oldbase, oldexpo);
+                mainptr->RestorePattern(oldgen, oldfile, oldx, oldy, oldmag, oldbase, oldexpo,
+                                        oldstate);
             } else {
                 currlayer->tempstart = newtempstart;    // in case script called reset()
                 currlayer->currsel = newsel;
-                mainptr->RestorePattern(newgen, newfile, newx, newy, newmag, newbase, newexpo);
+                mainptr->RestorePattern(newgen, newfile, newx, newy, newmag, newbase, newexpo,
+                                        newstate);
             }
             break;
             
@@ -485,7 +526,7 @@ bool ChangeNode::DoChange(bool undo)
             }
             // show new rule in window title (file name doesn't change)
             mainptr->SetWindowTitle(wxEmptyString);
-            if (cellcount > 0) {
+            if (cells.count() > 0) {
                 ChangeCells(undo);
             }
             // switch to default colors for new rule
@@ -504,7 +545,7 @@ bool ChangeNode::DoChange(bool undo)
             }
             // show new rule in window title (file name doesn't change)
             mainptr->SetWindowTitle(wxEmptyString);
-            if (cellcount > 0) {
+            if (cells.count() > 0) {
                 ChangeCells(undo);
             }
             // ChangeAlgorithm has called UpdateLayerColors()
@@ -524,14 +565,12 @@ bool ChangeNode::DoChange(bool undo)
 
 UndoRedo::UndoRedo()
 {
-    numchanges = 0;               // for 1st SaveCellChange
-    maxchanges = 0;               // ditto
-    badalloc = false;             // true if malloc/realloc fails
-    cellarray = NULL;             // play safe
     savecellchanges = false;      // no script cell changes are pending
     savegenchanges = false;       // no script gen changes are pending
     doingscriptchanges = false;   // not undoing/redoing script changes
     prevfile = wxEmptyString;     // play safe for ClearUndoRedo
+    prevstate = NULL;             // ditto
+    pinalgo = NULL;               // ditto
     startcount = 0;               // unfinished RememberGenStart calls
     
     // need to remember if script has created a new layer (not a clone)
@@ -549,65 +588,22 @@ UndoRedo::~UndoRedo()
 
 void UndoRedo::SaveCellChange(int x, int y, int oldstate, int newstate)
 {
-    if (numchanges == maxchanges) {
-        if (numchanges == 0) {
-            // initially allocate room for 1 cell change
-            maxchanges = 1;
-            cellarray = (cell_change*) malloc(maxchanges * sizeof(cell_change));
-            if (cellarray == NULL) {
-                badalloc = true;
-                return;
-            }
-            // ~ChangeNode or ForgetCellChanges will free cellarray
-        } else {
-            // double size of cellarray
-            cell_change* newptr = (cell_change*) realloc(cellarray, maxchanges * 2 * sizeof(cell_change));
-            if (newptr == NULL) {
-                badalloc = true;
-                return;
-            }
-            cellarray = newptr;
-            maxchanges *= 2;
-        }
-    }
-    
-    cellarray[numchanges].x = x;
-    cellarray[numchanges].y = y;
-    cellarray[numchanges].oldstate = oldstate;
-    cellarray[numchanges].newstate = newstate;
-    
-    numchanges++;
+    // consecutive changes along a row are merged into runs
+    cellbatch.add(x, y, oldstate, newstate);
 }
 
 // -----------------------------------------------------------------------------
 
 void UndoRedo::ForgetCellChanges()
 {
-    if (numchanges > 0) {
-        if (cellarray) {
-            free(cellarray);
-        } else {
-            Warning(_("Bug detected in ForgetCellChanges!"));
-        }
-        numchanges = 0;      // reset for next SaveCellChange
-        maxchanges = 0;      // ditto
-        badalloc = false;
-    }
+    cellbatch.clear();
 }
 
 // -----------------------------------------------------------------------------
 
 bool UndoRedo::RememberCellChanges(const wxString& action, bool olddirty)
 {
-    if (numchanges > 0) {
-        if (numchanges < maxchanges) {
-            // reduce size of cellarray
-            cell_change* newptr = (cell_change*) realloc(cellarray, numchanges * sizeof(cell_change));
-            if (newptr != NULL) cellarray = newptr;
-            // in the unlikely event that newptr is NULL, cellarray should
-            // still point to valid data
-        }
-        
+    if (cellbatch.count() > 0) {
         // clear the redo history
         WX_CLEAR_LIST(wxList, redolist);
         UpdateRedoItem(wxEmptyString);
@@ -617,8 +613,8 @@ bool UndoRedo::RememberCellChanges(const wxString& action, bool olddirty)
         if (change == NULL) Fatal(_("Failed to create cellstates node!"));
         
         change->suffix = action;
-        change->cellinfo = cellarray;
-        change->cellcount = numchanges;
+        change->cells.swap(cellbatch);
+        change->cells.trim();
         change->olddirty = olddirty;
         change->newdirty = true;
         
@@ -627,13 +623,9 @@ bool UndoRedo::RememberCellChanges(const wxString& action, bool olddirty)
         // update Undo item in Edit menu
         UpdateUndoItem(change->suffix);
         
-        numchanges = 0;      // reset for next SaveCellChange
-        maxchanges = 0;      // ditto
+        cellbatch.clear();   // reset for next SaveCellChange
         
-        if (badalloc) {
-            Warning(lack_of_memory);
-            badalloc = false;
-        }
+        if (change->cells.failed()) Warning(lack_of_memory);
         return true;   // at least one cell changed state
     }
     return false;     // no cells changed state (SaveCellChange wasn't called)
@@ -702,23 +694,12 @@ void UndoRedo::RememberRotation(bool clockwise, Selection& oldsel, Selection& ne
     change->olddirty = olddirty;
     change->newdirty = true;
     
-    // if numchanges == 0 we still need to rotate selection edges
-    if (numchanges > 0) {
-        if (numchanges < maxchanges) {
-            // reduce size of cellarray
-            cell_change* newptr = (cell_change*) realloc(cellarray, numchanges * sizeof(cell_change));
-            if (newptr != NULL) cellarray = newptr;
-        }
-        
-        change->cellinfo = cellarray;
-        change->cellcount = numchanges;
-        
-        numchanges = 0;      // reset for next SaveCellChange
-        maxchanges = 0;      // ditto
-        if (badalloc) {
-            Warning(lack_of_memory);
-            badalloc = false;
-        }
+    // if there are no cell changes we still need to rotate selection edges
+    if (cellbatch.count() > 0) {
+        change->cells.swap(cellbatch);
+        change->cells.trim();
+        cellbatch.clear();   // reset for next SaveCellChange
+        if (change->cells.failed()) Warning(lack_of_memory);
     }
     
     undolist.Insert(change);
@@ -824,6 +805,11 @@ void UndoRedo::RememberGenStart()
     if (prevgen == currlayer->startgen) {
         // we can just reset to starting pattern
         prevfile = wxEmptyString;
+    } else if ((prevstate = currlayer->algo->pinstate()) != NULL) {
+        // the algorithm can keep the current pattern in memory, and it will
+        // share most of its structure with the patterns generated from it
+        prevfile = wxEmptyString;
+        pinalgo = currlayer->algo;
     } else {
         // save current pattern in a unique temporary file
         prevfile = wxFileName::CreateTempFileName(tempdir + genchange_prefix);
@@ -872,6 +858,8 @@ void UndoRedo::RememberGenFinish()
             wxRemoveFile(prevfile);
         }
         prevfile = wxEmptyString;
+        if (prevstate) pinalgo->unpinstate(prevstate);
+        prevstate = NULL;
         return;
     }
 
@@ -879,6 +867,7 @@ void UndoRedo::RememberGenFinish()
     wxString oldtempstart = currlayer->tempstart;
     
     wxString fpath;
+    void* fstate = NULL;
     if (currlayer->algo->getGeneration() == currlayer->startgen) {
         // script called reset() so just use starting pattern
         fpath = wxEmptyString;
@@ -887,6 +876,10 @@ void UndoRedo::RememberGenFinish()
         // SaveStartingPattern, so change currlayer->tempstart to a new temporary file
         currlayer->tempstart = wxFileName::CreateTempFileName(tempdir + wxT("gr_"));
 
+    } else if ((fstate = currlayer->algo->pinstate()) != NULL) {
+        // keep finishing pattern in memory (see RememberGenStart)
+        fpath = wxEmptyString;
+        pinalgo = currlayer->algo;
     } else {
         // save finishing pattern in a unique temporary file
         fpath = wxFileName::CreateTempFileName(tempdir + genchange_prefix);
@@ -907,6 +900,9 @@ void UndoRedo::RememberGenFinish()
     change->newgen = currlayer->algo->getGeneration();
     change->oldfile = prevfile;
     change->newfile = fpath;
+    change->oldstate = prevstate;
+    change->newstate = fstate;
+    if (prevstate || fstate) change->pinalgo = pinalgo;
     change->oldx = prevx;
     change->oldy = prevy;
     viewptr->GetPos(change->newx, change->newy);
@@ -933,11 +929,61 @@ void UndoRedo::RememberGenFinish()
     
     // prevfile has been saved in change->oldfile (~ChangeNode will delete it)
     prevfile = wxEmptyString;
+    prevstate = NULL;
     
     undolist.Insert(change);
     
     // update Undo item in Edit menu
     UpdateUndoItem(change->suffix);
+    
+    if (change->pinalgo) SpillOldPatterns();
+}
+
+// -----------------------------------------------------------------------------
+
+void UndoRedo::SpillOldPatterns()
+{
+    // pinned patterns share most of their nodes with the current pattern,
+    // but if the last garbage collection had to keep more than half of the
+    // universe's memory then save all but the newest change to files
+    if (pinalgo == NULL || pinalgo->getkeptfraction() <= 0.5) return;
+    
+    wxList::compatibility_iterator node = undolist.GetFirst();
+    if (node) node = node->GetNext();
+    while (node) {
+        ChangeNode* change = (ChangeNode*) node->GetData();
+        change->SavePinnedStates();
+        node = node->GetNext();
+    }
+}
+
+// -----------------------------------------------------------------------------
+
+void UndoRedo::SavePinnedPatterns()
+{
+    if (pinalgo == NULL) return;
+    
+    wxList::compatibility_iterator node = undolist.GetFirst();
+    while (node) {
+        ChangeNode* change = (ChangeNode*) node->GetData();
+        change->SavePinnedStates();
+        node = node->GetNext();
+    }
+    
+    node = redolist.GetFirst();
+    while (node) {
+        ChangeNode* change = (ChangeNode*) node->GetData();
+        change->SavePinnedStates();
+        node = node->GetNext();
+    }
+    
+    if (prevstate) {
+        WritePinnedPattern(prevstate, prevgen, prevfile);
+        pinalgo->unpinstate(prevstate);
+        prevstate = NULL;
+    }
+    
+    pinalgo = NULL;
 }
 
 // -----------------------------------------------------------------------------
@@ -1161,22 +1207,11 @@ void UndoRedo::RememberRuleChange(const wxString& oldrule)
     change->newsel = currlayer->currsel;
     
     // SaveCellChange may have been called
-    if (numchanges > 0) {
-        if (numchanges < maxchanges) {
-            // reduce size of cellarray
-            cell_change* newptr = (cell_change*) realloc(cellarray, numchanges * sizeof(cell_change));
-            if (newptr != NULL) cellarray = newptr;
-        }
-        
-        change->cellinfo = cellarray;
-        change->cellcount = numchanges;
-        
-        numchanges = 0;      // reset for next SaveCellChange
-        maxchanges = 0;      // ditto
-        if (badalloc) {
-            Warning(lack_of_memory);
-            badalloc = false;
-        }
+    if (cellbatch.count() > 0) {
+        change->cells.swap(cellbatch);
+        change->cells.trim();
+        cellbatch.clear();   // reset for next SaveCellChange
+        if (change->cells.failed()) Warning(lack_of_memory);
     }
     
     undolist.Insert(change);
@@ -1208,22 +1243,11 @@ void UndoRedo::RememberAlgoChange(algo_type oldalgo, const wxString& oldrule)
     change->newsel = currlayer->currsel;
     
     // SaveCellChange may have been called
-    if (numchanges > 0) {
-        if (numchanges < maxchanges) {
-            // reduce size of cellarray
-            cell_change* newptr = (cell_change*) realloc(cellarray, numchanges * sizeof(cell_change));
-            if (newptr != NULL) cellarray = newptr;
-        }
-        
-        change->cellinfo = cellarray;
-        change->cellcount = numchanges;
-        
-        numchanges = 0;      // reset for next SaveCellChange
-        maxchanges = 0;      // ditto
-        if (badalloc) {
-            Warning(lack_of_memory);
-            badalloc = false;
-        }
+    if (cellbatch.count() > 0) {
+        change->cells.swap(cellbatch);
+        change->cells.trim();
+        cellbatch.clear();   // reset for next SaveCellChange
+        if (change->cells.failed()) Warning(lack_of_memory);
     }
     
     undolist.Insert(change);
@@ -1547,7 +1571,7 @@ void UndoRedo::UpdateRedoItem(const wxString& action)
 
 void UndoRedo::ClearUndoRedo()
 {
-    // free cellarray in case there were SaveCellChange calls not followed
+    // free cellbatch in case there were SaveCellChange calls not followed
     // by ForgetCellChanges or RememberCellChanges
     ForgetCellChanges();
     
@@ -1557,6 +1581,8 @@ void UndoRedo::ClearUndoRedo()
             wxRemoveFile(prevfile);
         }
         prevfile = wxEmptyString;
+        if (prevstate) pinalgo->unpinstate(prevstate);
+        prevstate = NULL;
         startcount = 0;
     }
     
@@ -1566,6 +1592,7 @@ void UndoRedo::ClearUndoRedo()
     // clear the undo/redo lists (and delete each node's data)
     WX_CLEAR_LIST(wxList, undolist);
     WX_CLEAR_LIST(wxList, redolist);
+    pinalgo = NULL;
     
     delete_all_temps = false;
     
@@ -1671,9 +1698,7 @@ void UndoRedo::DuplicateHistory(Layer* oldlayer, Layer* newlayer)
     savecellchanges = history->savecellchanges;
     savegenchanges = history->savegenchanges;
     doingscriptchanges = history->doingscriptchanges;
-    numchanges = history->numchanges;
-    maxchanges = history->maxchanges;
-    badalloc = history->badalloc;
+    cellbatch = history->cellbatch;
     prevfile = history->prevfile;
     prevgen = history->prevgen;
     prevx = history->prevx;
@@ -1693,17 +1718,14 @@ void UndoRedo::DuplicateHistory(Layer* oldlayer, Layer* newlayer)
         }
     }
     
-    // do a deep copy of dynamically allocated data
-    cellarray = NULL;
-    if (numchanges > 0 && history->cellarray) {
-        cellarray = (cell_change*) malloc(maxchanges * sizeof(cell_change));
-        if (cellarray == NULL) {
-            Warning(_("Could not allocate cellarray!"));
-            return;
-        }
-        // copy history->cellarray data to this cellarray
-        memcpy(cellarray, history->cellarray, numchanges * sizeof(cell_change));
-    } 
+    // patterns pinned in the old layer's universe are saved in files
+    // (the new layer has its own universe)
+    if (history->prevstate) WritePinnedPattern(history->prevstate, prevgen, prevfile);
+    
+    if (cellbatch.failed() && !history->cellbatch.failed()) {
+        Warning(_("Could not copy cell changes!"));
+        return;
+    }
     
     wxList::compatibility_iterator node;
     
@@ -1719,19 +1741,15 @@ void UndoRedo::DuplicateHistory(Layer* oldlayer, Layer* newlayer)
             return;
         }
         
-        // shallow copy the change node
+        // shallow copy the change node (this also copies the cell changes)
         *newchange = *change;
-        
-        // deep copy any dynamically allocated data
-        if (change->cellinfo) {
-            int bytes = change->cellcount * sizeof(cell_change);
-            newchange->cellinfo = (cell_change*) malloc(bytes);
-            if (newchange->cellinfo == NULL) {
-                Warning(_("Could not copy undolist!"));
-                WX_CLEAR_LIST(wxList, undolist);
-                return;
-            }
-            memcpy(newchange->cellinfo, change->cellinfo, bytes);
+        newchange->oldstate = NULL;
+        newchange->newstate = NULL;
+        newchange->pinalgo = NULL;
+        if (change->cells.failed() != newchange->cells.failed()) {
+            Warning(_("Could not copy undolist!"));
+            WX_CLEAR_LIST(wxList, undolist);
+            return;
         }
         
         if (change->startinfo) {
@@ -1754,6 +1772,10 @@ void UndoRedo::DuplicateHistory(Layer* oldlayer, Layer* newlayer)
             return;
         }
         
+        // save any patterns pinned in the old layer's universe
+        if (change->oldstate) WritePinnedPattern(change->oldstate, newchange->oldgen, newchange->oldfile);
+        if (change->newstate) WritePinnedPattern(change->newstate, newchange->newgen, newchange->newfile);
+        
         undolist.Append(newchange);
         node = node->GetNext();
     }
@@ -1770,19 +1792,15 @@ void UndoRedo::DuplicateHistory(Layer* oldlayer, Layer* newlayer)
             return;
         }
         
-        // shallow copy the change node
+        // shallow copy the change node (this also copies the cell changes)
         *newchange = *change;
-        
-        // deep copy any dynamically allocated data
-        if (change->cellinfo) {
-            int bytes = change->cellcount * sizeof(cell_change);
-            newchange->cellinfo = (cell_change*) malloc(bytes);
-            if (newchange->cellinfo == NULL) {
-                Warning(_("Could not copy redolist!"));
-                WX_CLEAR_LIST(wxList, redolist);
-                return;
-            }
-            memcpy(newchange->cellinfo, change->cellinfo, bytes);
+        newchange->oldstate = NULL;
+        newchange->newstate = NULL;
+        newchange->pinalgo = NULL;
+        if (change->cells.failed() != newchange->cells.failed()) {
+            Warning(_("Could not copy redolist!"));
+            WX_CLEAR_LIST(wxList, redolist);
+            return;
         }
         
         if (change->startinfo) {
@@ -1805,6 +1823,10 @@ void UndoRedo::DuplicateHistory(Layer* oldlayer, Layer* newlayer)
             return;
         }
         
+        // save any patterns pinned in the old layer's universe
+        if (change->oldstate) WritePinnedPattern(change->oldstate, newchange->oldgen, newchange->oldfile);
+        if (change->newstate) WritePinnedPattern(change->newstate, newchange->newgen, newchange->newfile);
+        
         redolist.Append(newchange);
         node = node->GetNext();
     }
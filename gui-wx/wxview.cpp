@@ -585,7 +585,7 @@ void PatternView::PasteTemporaryToCurrent(bool toselection,
     
     BeginProgress(_("Pasting pattern"));
     
-    // we can speed up pasting sparse patterns by using nextcell in these cases:
+    // we can speed up pasting sparse patterns by only visiting live cells in these cases:
     // - if using Or mode
     // - if current universe is empty
     // - if paste rect is outside current pattern edges
@@ -602,44 +602,41 @@ void PatternView::PasteTemporaryToCurrent(bool toselection,
         // current universe is empty or paste rect is outside current pattern edges
         // so don't change any cells
     } else if ( usenextcell ) {
-        int newstate = 0;
-        cy = pastey;
-        for ( ty=itop; ty<=ibottom; ty++ ) {
-            cx = pastex;
-            for ( tx=ileft; tx<=iright; tx++ ) {
-                int skip = pastealgo->nextcell(tx, ty, newstate);
-                if (skip + tx > iright)
-                    skip = -1;           // pretend we found no more live cells
-                if (skip >= 0) {
-                    // found next live cell so paste it into current universe
-                    tx += skip;
-                    cx += skip;
-                    if (cx >= gleft && cx <= gright && cy >= gtop && cy <= gbottom) {
-                        int currstate = curralgo->getcell(cx, cy);
-                        if (currstate != newstate) {
-                            if (newstate > maxstate) {
-                                newstate = maxstate;
-                                reduced = true;
-                            }
-                            curralgo->setcell(cx, cy, newstate);
-                            pattchanged = true;
-                            if (savecells) currlayer->undoredo->SaveCellChange(cx, cy, currstate, newstate);
-                        }
+        // get the live cells in one pass and set them in one batch so the
+        // hashing algos can build their tree bottom-up
+        cellbuffer livecells, changes;
+        pastealgo->getcells(livecells, ileft, itop, iright - ileft + 1, ibottom - itop + 1);
+        changes.clear(1);
+        // if not in Or mode then the current universe has no cells in the paste rect
+        bool getcurr = pmode == Or && !curralgo->isEmpty();
+        int step = livecells.multistate ? 3 : 2;
+        size_t numcells = livecells.count();
+        const int* cells = livecells.data();
+        for ( size_t i = 0; i < numcells; i++, cells += step ) {
+            int newstate = livecells.multistate ? cells[2] : 1;
+            cx = pastex + cells[0] - ileft;
+            cy = pastey + cells[1] - itop;
+            if (cx >= gleft && cx <= gright && cy >= gtop && cy <= gbottom) {
+                int currstate = getcurr ? curralgo->getcell(cx, cy) : 0;
+                if (currstate != newstate) {
+                    if (newstate > maxstate) {
+                        newstate = maxstate;
+                        reduced = true;
                     }
-                    cx++;
-                } else {
-                    tx = iright + 1;     // done this row
-                }
-                cntr++;
-                if ((cntr % 4096) == 0) {
-                    double prog = ((ty - itop) * (double)(iright - ileft + 1) +
-                                   (tx - ileft)) / maxcount;
-                    abort = AbortProgress(prog, wxEmptyString);
-                    if (abort) break;
+                    changes.add(cx, cy, newstate);
+                    if (savecells) currlayer->undoredo->SaveCellChange(cx, cy, currstate, newstate);
                 }
             }
-            if (abort) break;
-            cy++;
+            cntr++;
+            if ((cntr % 4096) == 0) {
+                abort = AbortProgress((double)i / numcells, wxEmptyString);
+                if (abort) break;
+            }
+        }
+        if (changes.size() > 0) {
+            // keep the cells changed before any abort, as the undo history has them
+            curralgo->setcells(changes.data(), changes.size(), 1, 0, 0);
+            pattchanged = true;
         }
     } else {
         // have to use slower getcell/setcell calls